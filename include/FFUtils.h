@@ -39,6 +39,7 @@ extern "C"
 }
 
 #include "MediaCore.h"
+#include "ImMatPool.h"
 
 #if LIBAVFORMAT_VERSION_MAJOR >= 59
 typedef const AVCodec*      AVCodecPtr;
@@ -69,7 +70,7 @@ MEDIACORE_API SelfFreeAVPacketPtr WrapSelfFreeAVPacketPtr(AVPacket* avpkt);
 MEDIACORE_API AVPixelFormat GetAVPixelFormatByName(const std::string& name);
 MEDIACORE_API ImColorFormat ConvertPixelFormatToColorFormat(AVPixelFormat pixfmt);
 MEDIACORE_API ImDataType GetDataTypeFromSampleFormat(AVSampleFormat smpfmt);
-MEDIACORE_API bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& vmat, double timestamp);
+MEDIACORE_API bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& vmat, double timestamp, MediaCore::ImMatPool* pool = nullptr);
 MEDIACORE_API bool ConvertAVFrameToImMat(const AVFrame* avfrm, std::vector<ImGui::ImMat>& vmat, double timestamp);
 MEDIACORE_API bool ConvertImMatToAVFrame(const ImGui::ImMat& vmat, AVFrame* avfrm, int64_t pts);
 
@@ -85,8 +86,12 @@ public:
 
     bool SetOutSize(uint32_t width, uint32_t height);
     bool SetOutColorFormat(ImColorFormat clrfmt);
+    // With float32, the cpu output is RGBA float32 normalized to [0, 1] for all the source formats.
     bool SetOutDataType(ImDataType dtype);
     bool SetResizeInterpolateMode(ImInterpolateMode interp);
+    // Split the conversion of an image into slices which are processed concurrently by 'count' threads.
+    // 0 means using all the threads of the default 'ThreadPoolExecutor', 1 (default) disables the slice threading.
+    bool SetThreadCount(uint32_t count);
     bool ConvertImage(const AVFrame* avfrm, ImGui::ImMat& outMat, double timestamp);
 
     uint32_t GetOutWidth() const { return m_outWidth; }
@@ -94,8 +99,12 @@ public:
     ImColorFormat GetOutColorFormat() const { return m_outClrFmt; }
     ImDataType GetOutDataType() const { return m_outDataType; }
     ImInterpolateMode GetResizeInterpolateMode() const { return m_resizeInterp; }
+    uint32_t GetThreadCount() const { return m_threadCount; }
 
     void SetUseVulkanConverter(bool use) { m_useVulkanComponents = use; }
+    bool IsUseVulkanConverter() const { return m_useVulkanComponents; }
+    // The cpu output images are drawn from this pool, nullptr disables pooling.
+    void SetMatPool(MediaCore::ImMatPool::Holder hPool) { m_hMatPool = hPool; }
 
     std::string GetError() const { return m_errMsg; }
 
@@ -117,6 +126,10 @@ private:
     AVPixelFormat m_swsOutFormat{AV_PIX_FMT_RGBA};
     AVColorSpace m_swsClrspc{AVCOL_SPC_RGB};
     bool m_passThrough{false};
+    uint32_t m_threadCount{1};
+    MediaCore::ImMatPool::Holder m_hMatPool;
+    // the frames of the 2x2 box downscaling levels, reused from one conversion to the next
+    std::vector<SelfFreeAVFramePtr> m_halvedFrms;
     std::string m_errMsg;
 };
 
@@ -135,6 +148,8 @@ public:
     bool SetOutColorSpace(AVColorSpace clrspc);
     bool SetOutColorRange(AVColorRange clrrng);
     bool SetResizeInterpolateMode(ImInterpolateMode interp);
+    // Same as 'AVFrameToImMatConverter::SetThreadCount()'.
+    bool SetThreadCount(uint32_t count);
     bool ConvertImage(const ImGui::ImMat& inMat, AVFrame* avfrm, int64_t pts);
 
     uint32_t GetOutWidth() const { return m_outWidth; }
@@ -143,6 +158,7 @@ public:
     AVColorSpace GetOutColorSpace() const { return m_outClrspc; }
     AVColorRange GetOutColorRange() const { return m_outClrrng; }
     ImInterpolateMode GetResizeInterpolateMode() const { return m_resizeInterp; }
+    uint32_t GetThreadCount() const { return m_threadCount; }
 
     void SetUseVulkanConverter(bool use) { m_useVulkanComponents = use; }
 
@@ -170,6 +186,7 @@ private:
     int m_swsInWidth{0}, m_swsInHeight{0};
     AVPixelFormat m_swsInFormat{AV_PIX_FMT_NONE};
     bool m_passThrough{false};
+    uint32_t m_threadCount{1};
     std::string m_errMsg;
 };
 
@@ -222,6 +239,11 @@ public:
 
     bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& amat, double timestamp);
     bool ConvertImMatToAVFrame(const ImGui::ImMat& amat, AVFrame* avfrm, int64_t pts);
+
+    void SetMatPool(MediaCore::ImMatPool::Holder hPool) { m_hMatPool = hPool; }
+
+private:
+    MediaCore::ImMatPool::Holder m_hMatPool{MediaCore::ImMatPool::GetSharedInstance("AudioFrame")};
 };
 
 namespace FFUtils
@@ -235,6 +257,11 @@ namespace FFUtils
         bool preferHwOutputPixfmt{true};
         AVPixelFormat useHwOutputPixfmt{AV_PIX_FMT_NONE};
         AVPixelFormat forceOutputPixfmt{AV_PIX_FMT_NONE};
+        // The smallest picture size the caller needs. If the software decoder supports reduced resolution decoding (lowres,
+        // e.g. the scaled IDCT of MJPEG), it outputs pictures downscaled by the largest power of 2 that keeps them not smaller
+        // than this size. 0 disables it.
+        uint32_t minPictureWidth{0};
+        uint32_t minPictureHeight{0};
     };
     struct OpenVideoDecoderResult
     {
@@ -244,6 +271,8 @@ namespace FFUtils
         std::string errMsg;
     };
     bool OpenVideoDecoder(const AVFormatContext* pAvfmtCtx, int videoStreamIndex, OpenVideoDecoderOptions* options, OpenVideoDecoderResult* result, bool needValidation = true);
+    // The 'lowres' level for decoding pictures of 'srcWidth'x'srcHeight' with 'codec', so they are not smaller than 'minWidth'x'minHeight'.
+    int GetVideoDecoderLowres(AVCodecPtr codec, int srcWidth, int srcHeight, uint32_t minWidth, uint32_t minHeight);
 
     // A function to copy pcm data from one buffer to another, with the considering of sample format and buffer state
     uint32_t CopyPcmDataEx(uint8_t channels, uint8_t bytesPerSample, uint32_t copySamples,
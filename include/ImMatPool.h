@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "immat.h"
+#include "MediaCore.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Recycling pool of fixed-size ImMat buffers. Buffers are grouped into size classes by their shape
+ * (width, height, channels, data type). 'Acquire()' hands out a buffer of the pool that is not
+ * referenced by anyone else any more, so a buffer returns to the pool as soon as the last ImMat
+ * referring to it is released. New buffers are only kept by the pool while the total size is
+ * under the high-water mark, beyond that 'Acquire()' falls back to a plain allocation.
+ * A pool is a low priority consumer of the default MemoryGovernor. A new buffer is only kept if the
+ * governor grants it, and the idle buffers are released when the governor asks the pool to shrink.
+ * On linux the large buffers are advised to be backed by transparent huge pages.
+ * The content of an acquired buffer is undefined, the caller must overwrite it.
+ */
+struct ImMatPool
+{
+    using Holder = std::shared_ptr<ImMatPool>;
+    static MEDIACORE_API Holder CreateInstance(const std::string& name, uint64_t highWaterBytes);
+    // Get the process-wide pool of the name, it's created with the default high-water mark of 64MB on first use.
+    static MEDIACORE_API Holder GetSharedInstance(const std::string& name);
+
+    struct Stats
+    {
+        uint64_t highWaterBytes{0};
+        uint64_t pooledBytes{0};
+        uint32_t bufferCount{0};
+        uint32_t inUseCount{0};
+        uint64_t acquireCount{0};
+        uint64_t reuseCount{0};
+        uint64_t allocCount{0};
+        // allocations not kept by the pool because of the high-water mark
+        uint64_t overflowCount{0};
+    };
+
+    virtual bool Acquire(ImGui::ImMat& m, int w, int h, int c, ImDataType dtype) = 0;
+    // Release the buffers that are not in use.
+    virtual void Trim() = 0;
+
+    virtual void SetHighWaterMark(uint64_t bytes) = 0;
+    virtual std::string GetName() const = 0;
+    virtual Stats GetStats() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
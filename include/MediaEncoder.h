@@ -22,6 +22,7 @@
 #include <memory>
 #include "immat.h"
 #include "MediaInfo.h"
+#include "MediaReader.h"
 #include "Logger.h"
 #include "MediaCore.h"
 
@@ -103,13 +104,64 @@ struct MediaEncoder
     virtual bool Start() = 0;
     virtual bool FinishEncoding() = 0;
     virtual bool EncodeVideoFrame(ImGui::ImMat& vmat, bool wait = true) = 0;
+    // Encode a decoded frame without the round trip through ImMat, for the exports that only cut and concatenate the sources.
+    // The frame is taken as it is if it matches the encoder input. A hardware frame is kept on the device only if the encoder is
+    // configured with the same hardware image format, otherwise it's downloaded. A frame of other size or image format is
+    // converted with swscale. If the frame is not available as AVFrame, its ImMat is encoded instead. Only a few hardware frames
+    // wait in the input queue, the ones beyond are downloaded, or block the call if the encoder takes the hardware frames.
+    // A null 'hVfrm' marks the end of the video input, like an empty ImMat does.
+    virtual bool EncodeVideoFrame(MediaReader::VideoFrame::Holder hVfrm, bool wait = true) = 0;
     virtual bool EncodeAudioSamples(uint8_t* buf, uint32_t size, bool wait = true) = 0;
     virtual bool EncodeAudioSamples(ImGui::ImMat& amat, bool wait = true) = 0;
 
+    // Smart rendering. The ranges of a source which need no processing are copied into the output packet by packet,
+    // only the frames around the cut points are re-encoded with 'EncodeVideoFrame()'. 'EnableVideoStreamCopy()' must be
+    // called after 'ConfigureVideoStream()' and before 'Start()'. The source must have the codec and the size of the
+    // configured video stream, and the encoder must support being flushed. For the containers storing the codec
+    // parameters in the stream header (mp4, mkv...), the stream header is taken from the source. If the encoder produces
+    // other parameter sets, a H.264 or HEVC encoder is reopened to send them in-band with each key frame, for the other
+    // codecs only the copied ranges can be written then.
+    virtual bool EnableVideoStreamCopy(MediaParser::Holder hSrcParser) = 0;
+    // Copy the packets of the source in [srcStartPos, srcEndPos) to 'dstPos' of the output, all in milliseconds.
+    // The copy starts from the first key frame at or after 'srcStartPos' and stops at the first key frame at or after
+    // 'srcEndPos', see 'PlanVideoStreamCopy()'. The frames sent to 'EncodeVideoFrame()' before are all encoded ahead of
+    // the copied packets. This call blocks until all the packets are queued.
+    virtual bool CopyVideoPackets(int64_t srcStartPos, int64_t srcEndPos, int64_t dstPos) = 0;
+
+    // The part of a source range which can be copied, positions are in milliseconds. It's empty if 'endPos' <= 'startPos'.
+    struct StreamCopyRange
+    {
+        int64_t startPos{0};
+        int64_t endPos{0};
+    };
+    // Find the GOP-aligned part of the source range [startPos, endPos) that can be copied by 'CopyVideoPackets()'.
+    // The frames in [startPos, range.startPos) and [range.endPos, endPos) have to be re-encoded.
+    static MEDIACORE_API StreamCopyRange PlanVideoStreamCopy(const MediaParser::VideoFrameIndex& frameIndex, int64_t startPos, int64_t endPos);
+
+    // Joins the timestamps of the video packet runs from different origins, the copied and the re-encoded ranges or the
+    // encoded segments, all in the output time base. Each run starts with a key frame. If a run would overlap the one
+    // before, because of the reordering delays, all of its packets are delayed by the same offset, so the dts keeps
+    // increasing and never exceeds the pts. A missing timestamp is INT64_MIN (AV_NOPTS_VALUE).
+    struct VideoTimestampStitcher
+    {
+        MEDIACORE_API void StartRun();
+        MEDIACORE_API void Stitch(int64_t& pts, int64_t& dts);
+
+        bool runStarted{false};
+        int64_t runOffset{0};
+        int64_t lastDts{INT64_MIN};
+        int64_t maxPts{INT64_MIN};
+    };
+
     virtual bool IsOpened() const = 0;
     virtual bool HasVideo() const = 0;
     virtual bool HasAudio() const = 0;
     virtual Ratio GetVideoFrameRate() const = 0;
+    // Return true if the video input queue is full, 'EncodeVideoFrame()' with 'wait' = false fails then.
+    virtual bool IsVideoInputFull() const = 0;
+    // Return true if all the input is encoded and written after the end of the input is marked, 'FinishEncoding()'
+    // only writes the trailer then. It lets the caller that must not block finish the encoding in steps.
+    virtual bool IsEncodingDone() const = 0;
 
     virtual bool IsHwAccelEnabled() const = 0;
     virtual void EnableHwAccel(bool enable) = 0;
@@ -42,6 +42,7 @@ struct MediaParser
     {
         MEDIA_INFO = 0,
         VIDEO_SEEK_POINTS,
+        VIDEO_FRAME_INDEX,
     };
     virtual bool EnableParseInfo(InfoType infoType) = 0;
     virtual bool CheckInfoReady(InfoType infoType) = 0;
@@ -61,6 +62,36 @@ struct MediaParser
     using SeekPointsHolder = std::shared_ptr<std::vector<int64_t>>;
     virtual SeekPointsHolder GetVideoSeekPoints(bool wait = true) = 0;
 
+    // Index of all the packets of the best video stream, in decoding order. It's only built when
+    // VIDEO_FRAME_INDEX is enabled, by demuxing the whole media once after the pending seek points
+    // parsing. If a cache directory is set, the index is saved there as '<hash of url>.mcidx', and
+    // later parsing of the same media, including the seek points parsing, loads it instead of scanning again.
+    struct VideoFrameIndex
+    {
+        using Holder = std::shared_ptr<VideoFrameIndex>;
+        struct Frame
+        {
+            int64_t pts;
+            int64_t dts;
+            // byte offset in the media file, -1 if it's unknown
+            int64_t pos;
+        };
+
+        Ratio timeBase;
+        // start time of the stream in 'timeBase', the origin of the millisecond positions used by the readers
+        int64_t startTime{0};
+        std::vector<Frame> frames;
+        // indices of the key frames in 'frames'
+        std::vector<uint32_t> keyFrames;
+        // frame count of the GOP started by each of the key frames
+        std::vector<uint32_t> gopSizes;
+    };
+    virtual VideoFrameIndex::Holder GetVideoFrameIndex(bool wait = true) = 0;
+    // Directory to save and load the video frame index files. Empty (the default) keeps the index in memory only.
+    // It takes effect if it is called before VIDEO_FRAME_INDEX or VIDEO_SEEK_POINTS is enabled.
+    virtual void SetFrameIndexCacheDirectory(const std::string& dirPath) = 0;
+    virtual std::string GetFrameIndexCacheDirectory() const = 0;
+
     virtual std::string GetError() const = 0;
 };
 }
@@ -25,6 +25,8 @@
 #include "MediaParser.h"
 #include "Logger.h"
 
+struct AVFrame;
+
 namespace MediaCore
 {
 struct MediaReader
@@ -41,6 +43,9 @@ struct MediaReader
         using Holder = std::shared_ptr<VideoFrame>;
         static Holder CreateMatInstance(ImGui::ImMat& m);
         virtual bool GetMat(ImGui::ImMat& m) = 0;
+        // Get the decoded frame as it is, without the conversion into ImMat. It can be a hardware frame, and must not be modified.
+        // A null pointer is returned if the frame is not available, e.g. it has been converted into ImMat already.
+        virtual std::shared_ptr<AVFrame> GetAVFrame() = 0;
         virtual int64_t Pos() const = 0;
         virtual int64_t Pts() const = 0;
         virtual int64_t Dur() const = 0;
@@ -62,6 +67,13 @@ struct MediaReader
     virtual void Close() = 0;
     virtual bool SeekTo(int64_t pos) = 0;
     virtual void SetDirection(bool forward) = 0;
+    // In scrub mode, a video frame read after a seek returns the nearest decoded frame at once instead of waiting for the exact one,
+    // and the decoder stops as soon as a frame at or before the read position is available, which is the key frame of the seek.
+    // Disabling it resumes the decoding up to the exact frame.
+    virtual void EnableScrubMode(bool enable) = 0;
+    // Restore the state a new user of the reader starts with: forward direction, scrub mode disabled, normal memory priority,
+    // and no image remembered from the previous read. 'MediaReaderPool' calls it when a reader goes back to the pool.
+    virtual void ResetReadState() = 0;
     virtual void Suspend() = 0;
     virtual void Wakeup() = 0;
 
@@ -75,15 +87,30 @@ struct MediaReader
     virtual MediaParser::Holder GetMediaParser() const = 0;
     virtual bool IsVideoReader() const = 0;
     virtual bool IsDirectionForward() const = 0;
+    virtual bool IsScrubModeEnabled() const = 0;
     virtual bool IsSuspended() const = 0;
     virtual bool IsPlanar() const = 0;
     virtual int64_t GetReadPos() const = 0;
 
     virtual bool SetCacheDuration(double forwardDur, double backwardDur) = 0;
     virtual bool SetCacheFrames(bool readForward, uint32_t forwardFrames, uint32_t backwardFrames) = 0;
+    // When reading backward, at most 'frames' decoded frames of a GOP are kept ahead of the read position, the rest of the GOP
+    // is decoded again later. A larger buffer takes more memory and less decoding, 0 keeps the whole GOPs.
+    virtual void SetReverseBufferFrames(uint32_t frames) = 0;
     virtual std::pair<double, double> GetCacheDuration() const = 0;
+    // Priority of the cached frames against the other caches under the global memory budget, see 'MemoryGovernor::Priority'.
+    virtual void SetMemoryPriority(int32_t priority) = 0;
+    // The priority set with 'SetMemoryPriority()'. The memory governor treats a suspended reader as 'PRIORITY_IDLE' anyway.
+    virtual int32_t GetMemoryPrioritySetting() const = 0;
     virtual bool IsHwAccelEnabled() const = 0;
     virtual void EnableHwAccel(bool enable) = 0;
+    // Set the thread count used to convert a decoded video frame into ImMat, see 'AVFrameToImMatConverter::SetThreadCount()'.
+    // It takes effect if it is called before the reader is started.
+    virtual void SetVideoConvertThreadCount(uint32_t count) = 0;
+    // Keep the decoded hardware frames on the device instead of downloading them in advance, so that they can be passed to
+    // a hardware encoder without copy through 'VideoFrame::GetAVFrame()'. It takes effect if it is called before the reader is started.
+    // Only a few frames are kept on the device, the ones beyond are still downloaded, so the surface pool of the decoder is not exhausted.
+    virtual void SetKeepHwFrames(bool keep) = 0;
 
     virtual MediaInfo::Holder GetMediaInfo() const = 0;
     virtual const VideoStream* GetVideoStream() const = 0;
@@ -0,0 +1,73 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "immat.h"
+#include "MediaCore.h"
+#include "MediaReader.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Pool of the media readers used by the clips. The readers are keyed by the media parser, the stream type
+ * and the output configuration. A reader released to the pool is kept open, with its decoder, threads and
+ * cache, so the clip created next for the same source (moving, splitting, undoing or cloning a clip)
+ * checks it out warm instead of opening the media again. Beyond the idle limit, the readers idle for the
+ * longest time are closed.
+ * A reader checked out of the pool is opened and configured, it may be started already. Its read state is
+ * reset, see 'MediaReader::ResetReadState()'. The caller still sets the direction, seeks and starts it as
+ * it does with a new reader. The reader goes back to the pool
+ * when the last reference to the returned holder is dropped, the caller must not close it.
+ */
+struct MediaReaderPool
+{
+    using Holder = std::shared_ptr<MediaReaderPool>;
+    static MEDIACORE_API Holder CreateInstance(uint32_t maxIdleCount);
+    // The process-wide pool used by VideoClip and AudioClip.
+    static MEDIACORE_API Holder GetDefaultInstance();
+
+    struct Stats
+    {
+        uint32_t idleCount{0};
+        uint32_t inUseCount{0};
+        uint64_t acquireCount{0};
+        uint64_t reuseCount{0};
+        uint64_t evictCount{0};
+    };
+
+    virtual MediaReader::Holder AcquireVideoReader(MediaParser::Holder hParser, uint32_t outWidth, uint32_t outHeight,
+            ImColorFormat outClrfmt, ImDataType outDtype, ImInterpolateMode interpMode, bool enableHwAccel, const std::string& loggerName = "") = 0;
+    // The reader of a still image source. It decodes the image once and releases the decoding resources after that,
+    // instead of keeping the demuxing and decoding tasks of a video reader running.
+    virtual MediaReader::Holder AcquireImageReader(MediaParser::Holder hParser, uint32_t outWidth, uint32_t outHeight,
+            ImColorFormat outClrfmt, ImDataType outDtype, ImInterpolateMode interpMode, const std::string& loggerName = "") = 0;
+    virtual MediaReader::Holder AcquireAudioReader(MediaParser::Holder hParser, uint32_t outChannels, uint32_t outSampleRate,
+            const std::string& outPcmFormat, const std::string& loggerName = "") = 0;
+    // Close all the idle readers.
+    virtual void Trim() = 0;
+
+    virtual void SetMaxIdleCount(uint32_t count) = 0;
+    virtual Stats GetStats() const = 0;
+    virtual std::string GetError() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MediaCore.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Process-wide memory budget shared by the caches. A cache registers itself as a consumer, and asks
+ * with 'RequestMemory()' before it grows. If the total usage of all the consumers would exceed the
+ * budget, the consumers of lower priority than the requester are asked to shrink, the lowest priority
+ * and the largest usage first. If that is not enough, the request is refused and the requester must
+ * not grow, that is the backpressure on the producers.
+ * A consumer reports every change of its usage with 'ReportUsageChange()', and the governor keeps the
+ * total in an atomic counter, so a request within the budget takes no lock and calls no consumer.
+ * 'GetMemoryUsage()' must return the sum of the changes the consumer has reported.
+ * The governor calls the consumers' methods with its own lock held, so a consumer must not hold its own
+ * lock when calling the governor, except 'ReportUsageChange()' which is lock free and can be called from
+ * anywhere, including 'Shrink()'. No other method of the governor can be called from 'Shrink()'.
+ */
+struct MemoryGovernor
+{
+    using Holder = std::shared_ptr<MemoryGovernor>;
+    static MEDIACORE_API Holder CreateInstance(uint64_t budget);
+    // The process-wide governor the readers and the caches register with, its default budget is 4GB.
+    static MEDIACORE_API Holder GetDefaultInstance();
+
+    enum Priority
+    {
+        // suspended readers, invisible views
+        PRIORITY_IDLE = 0,
+        // opportunistic caches, readers far from the play head
+        PRIORITY_LOW,
+        // readers about to be read
+        PRIORITY_NORMAL,
+        // readers at the play head, visible views
+        PRIORITY_HIGH,
+    };
+
+    struct Consumer
+    {
+        virtual std::string GetMemoryConsumerName() const = 0;
+        virtual uint64_t GetMemoryUsage() const = 0;
+        virtual int32_t GetMemoryPriority() const = 0;
+        // Release at least 'bytes' bytes if possible, return the bytes actually released.
+        virtual uint64_t Shrink(uint64_t bytes) = 0;
+    };
+
+    struct ConsumerUsage
+    {
+        std::string name;
+        int32_t priority;
+        uint64_t bytes;
+    };
+
+    // The current usage of the consumer is added to the total.
+    virtual void Register(Consumer* consumer) = 0;
+    // The current usage of the consumer is subtracted from the total. After this call returns,
+    // the governor does not call the consumer any more.
+    virtual void Unregister(Consumer* consumer) = 0;
+    // Return true if 'consumer' can grow by 'bytes' bytes.
+    virtual bool RequestMemory(Consumer* consumer, uint64_t bytes) = 0;
+    virtual void ReportUsageChange(int64_t deltaBytes) = 0;
+
+    // A budget of 0 means no limit.
+    virtual void SetBudget(uint64_t bytes) = 0;
+    virtual uint64_t GetBudget() const = 0;
+    virtual uint64_t GetTotalUsage() const = 0;
+    virtual std::vector<ConsumerUsage> GetUsage() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
@@ -45,6 +45,8 @@ struct MultiTrackAudioReader
     virtual bool SeekTo(int64_t pos, bool probeMode = false) = 0;
     virtual bool SetTrackMuted(int64_t id, bool muted) = 0;
     virtual bool IsTrackMuted(int64_t id) = 0;
+    // Flush the denormal values to zero while mixing and applying the mixer effects, it's enabled by default.
+    virtual void SetFlushDenormals(bool enable) = 0;
     virtual bool ReadAudioSamplesEx(std::vector<CorrelativeFrame>& amats, bool& eof) = 0;
     virtual bool ReadAudioSamples(ImGui::ImMat& amat, bool& eof) = 0;
     virtual void UpdateDuration() = 0;
@@ -52,6 +52,10 @@ struct MultiTrackVideoReader
     virtual bool SeekTo(int64_t pos) = 0;
     virtual bool ConsecutiveSeek(int64_t pos) = 0;
     virtual bool StopConsecutiveSeek() = 0;
+    // Scrub mode of 'ConsecutiveSeek()'. The frames shown while seeking are made of the nearest decoded source frames, mostly the
+    // key frames, which come without decoding up to the exact position. Once the seek position has not changed for 'refineDelay'
+    // milliseconds, the exact frame is read to replace it.
+    virtual void EnableScrubMode(bool enable, uint32_t refineDelay = 150) = 0;
     virtual bool SetTrackVisible(int64_t id, bool visible) = 0;
     virtual bool IsTrackVisible(int64_t id) = 0;
     virtual bool ReadVideoFrameEx(int64_t pos, std::vector<CorrelativeFrame>& frames, bool nonblocking = false, bool precise = true) = 0;
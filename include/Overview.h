@@ -18,6 +18,7 @@
 #pragma once
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 #include "immat.h"
 #include "MediaParser.h"
@@ -31,6 +32,16 @@ struct Overview
     using Holder = std::shared_ptr<Overview>;
     static MEDIACORE_API Holder CreateInstance();
     static MEDIACORE_API Logger::ALogger* GetLogger();
+    // Set the directory of the persistent cache of the snapshots and the waveforms, it must exist already. The cache entries
+    // are keyed by the identity of the media file (path, size and modification time) and the overview settings, so opening
+    // a media file that has not changed since its overview was generated loads the overview instead of decoding it again.
+    // An empty path, which is the default, disables the cache.
+    static MEDIACORE_API void SetCacheDirectory(const std::string& dirPath);
+    static MEDIACORE_API std::string GetCacheDirectory();
+    // Upper limit of the total size of the cache files, 256MB by default. When a new entry is saved, the least recently
+    // used entries are removed until the cache fits in the limit. 0 means no limit.
+    static MEDIACORE_API void SetCacheSizeLimit(uint64_t bytes);
+    static MEDIACORE_API uint64_t GetCacheSizeLimit();
 
     virtual bool Open(const std::string& url, uint32_t snapshotCount = 20) = 0;
     virtual bool Open(MediaParser::Holder hParser, uint32_t snapshotCount = 20) = 0;
@@ -47,13 +58,39 @@ struct Overview
         std::vector<std::vector<float>> pcm;
         int64_t validSampleCount{0};
         bool parseDone{false};
+
+        // One level of the waveform pyramid. Each entry aggregates 'aggregateSamples' pcm samples of one channel,
+        // the arrays are indexed by [channel][entry], and 'validCount' entries are generated for every channel.
+        struct Level
+        {
+            uint32_t aggregateSamples;
+            std::vector<std::vector<float>> minv, maxv, rms;
+            int64_t validCount{0};
+        };
+        // Built in the same decoding pass as 'pcm', for all the audio channels, while 'pcm' holds the stereo downmix.
+        // Level 0 aggregates 256 samples, and each following level aggregates twice as many samples as the previous one.
+        // The persistent cache only keeps the levels from 4096 samples on, a pyramid loaded from it starts there.
+        // The arrays grow while the waveform is being generated, read them with 'GetWaveformPeaks()' until 'parseDone' is set.
+        std::vector<Level> pyramid;
+        uint32_t sampleRate{0};
     };
     virtual Waveform::Holder GetWaveform() const = 0;
+
+    struct WaveformPeaks
+    {
+        std::vector<float> minv, maxv, rms;
+    };
+    // Fill 'peaks' with 'pixels' columns covering 'duration' seconds of the channel 'channel' from 'startPos' seconds on.
+    // The columns are reduced from the nearest pyramid level not coarser than one column, so any zoom level costs
+    // O('pixels') and does not decode the audio again. The columns not generated yet are left zero.
+    virtual bool GetWaveformPeaks(uint32_t channel, double startPos, double duration, uint32_t pixels, WaveformPeaks& peaks) = 0;
     virtual bool SetSingleFramePixels(uint32_t pixels) = 0;
     virtual bool SetFixedAggregateSamples(double aggregateSamples) = 0;
 
     virtual bool IsOpened() const = 0;
     virtual bool IsDone() const = 0;
+    // Return true if the snapshots and the waveform are loaded from the persistent cache.
+    virtual bool IsLoadedFromCache() const = 0;
     virtual bool HasVideo() const = 0;
     virtual bool HasAudio() const = 0;
     virtual uint32_t GetSnapshotCount() const = 0;
@@ -76,6 +113,11 @@ struct Overview
 
     virtual bool IsHwAccelEnabled() const = 0;
     virtual void EnableHwAccel(bool enable) = 0;
+    // In key-frame-only mode, each snapshot shows the key frame nearest to its position, and the decoder skips all
+    // the non-key frames, so a snapshot costs about one frame decoding. The nearest key frame is picked from the
+    // video seek points of the parser if they are available, otherwise the preceding key frame is used.
+    virtual void EnableKeyFrameOnly(bool enable) = 0;
+    virtual bool IsKeyFrameOnly() const = 0;
     virtual std::string GetError() const = 0;
 };
 }
@@ -0,0 +1,72 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "MediaCore.h"
+#include "MediaParser.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Manager of the proxy media. A proxy is a low resolution, all-intra (MJPEG) transcode of the video stream of a
+ * source, it's generated in the background on the default 'ThreadPoolExecutor', one source at a time, and kept in
+ * the proxy directory. The proxy file is named by the hash of the source path, size and modification time, so it's
+ * found again by the next session, and a modified source gets a new proxy.
+ * The video clips created with a 'SharedSettings' that has proxy media enabled read the proxy of their source instead
+ * of the source itself, if the proxy is ready when the clip is created or cloned. The clips already created keep
+ * reading what they read. The export should read the original media, with proxy media disabled in its settings.
+ */
+struct ProxyManager
+{
+    using Holder = std::shared_ptr<ProxyManager>;
+    static MEDIACORE_API Holder CreateInstance(const std::string& proxyDir = "");
+    // The process-wide manager used by VideoClip. Its proxy directory is empty, that is no proxy, until it's set.
+    static MEDIACORE_API Holder GetDefaultInstance();
+
+    enum ProxyState
+    {
+        PROXY_NONE = 0,
+        PROXY_QUEUED,
+        PROXY_GENERATING,
+        PROXY_READY,
+        PROXY_FAILED,
+    };
+
+    // Queue the generation of the proxy of 'hParser'. It returns true if the proxy is ready or queued already.
+    virtual bool RequestProxy(MediaParser::Holder hParser) = 0;
+    // Cancel the generation of the proxy, or forget about the failure of it. A ready proxy is kept.
+    virtual void CancelProxy(MediaParser::Holder hParser) = 0;
+    virtual ProxyState GetProxyState(MediaParser::Holder hParser) = 0;
+    // Progress of the generation in [0, 1].
+    virtual float GetProxyProgress(MediaParser::Holder hParser) = 0;
+    // The opened parser of the proxy, or null if the proxy is not ready.
+    virtual MediaParser::Holder GetProxyParser(MediaParser::Holder hParser) = 0;
+
+    virtual void SetProxyDirectory(const std::string& dirPath) = 0;
+    virtual std::string GetProxyDirectory() const = 0;
+    // Height of the proxies generated after this call, the width keeps the aspect ratio of the source. Default is 540.
+    virtual void SetProxyHeight(uint32_t height) = 0;
+    virtual uint32_t GetProxyHeight() const = 0;
+
+    virtual std::string GetError() const = 0;
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
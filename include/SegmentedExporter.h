@@ -0,0 +1,65 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MediaCore.h"
+#include "MultiTrackVideoReader.h"
+#include "MediaEncoder.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Export the video of a timeline with several encoders running in parallel. The export range is split
+ * into segments of whole GOPs, each segment is rendered by a clone of the MultiTrackVideoReader and
+ * encoded by its own MediaEncoder into a temporary file next to the output. When all the segments are
+ * done, their packets are concatenated into the output container without re-encoding, then the temporary
+ * files are removed. Since every segment starts with a key frame, the encoder configuration must produce
+ * the same codec parameters for all the segments, which is the case for the encoders with fixed settings.
+ * Only the video is exported, the output has no audio stream.
+ */
+struct SegmentedExporter
+{
+    using Holder = std::shared_ptr<SegmentedExporter>;
+    static MEDIACORE_API Holder CreateInstance();
+    static MEDIACORE_API Logger::ALogger* GetLogger();
+
+    // The output size and frame rate are the ones of the reader's shared settings. If the options contain the
+    // GOP size ('g'), the segment boundaries are aligned to it.
+    virtual bool Configure(MultiTrackVideoReader::Holder hMtvReader, const std::string& codecName, const std::string& imageFormat,
+            uint64_t bitRate, const std::vector<MediaEncoder::Option>& extraOpts = {}) = 0;
+    // 'count' is the number of segments the export range is split into, 0 means the number of cpu cores. At most as many
+    // segments as the cpu cores are encoded at the same time, the others wait for a free worker.
+    virtual void SetSegmentCount(uint32_t count) = 0;
+    // Segments are not made shorter than this, in milliseconds.
+    virtual void SetMinSegmentDuration(int64_t duration) = 0;
+    // Export the range [startPos, endPos) of the timeline, -1 for 'endPos' means the timeline duration.
+    // This call blocks until the output is written or the export fails.
+    virtual bool Export(const std::string& url, int64_t startPos = 0, int64_t endPos = -1) = 0;
+    // Stop an ongoing 'Export()' from another thread, it returns false then.
+    virtual void Cancel() = 0;
+    // Progress of the ongoing export, from 0 to 1.
+    virtual float GetProgress() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+    virtual std::string GetError() const = 0;
+};
+}
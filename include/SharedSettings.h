@@ -5,6 +5,7 @@
 #include "immat.h"
 #include <memory>
 #include <cstdint>
+#include <string>
 
 namespace MediaCore
 {
@@ -13,18 +14,26 @@ struct SharedSettings
 {
     using Holder = std::shared_ptr<SharedSettings>;
     static MEDIACORE_API Holder CreateInstance();
+    virtual Holder Clone() const = 0;
 
     virtual uint32_t VideoOutWidth() const = 0;
     virtual uint32_t VideoOutHeight() const = 0;
     virtual Ratio VideoOutFrameRate() const = 0;
     virtual ImColorFormat VideoOutColorFormat() const = 0;
     virtual ImDataType VideoOutDataType() const = 0;
+    // If enabled, the video clips created with these settings read the proxy of their source when it's ready, see 'ProxyManager'.
+    virtual bool IsProxyMediaEnabled() const = 0;
+    // If not empty, the video clips created with these settings build the frame index of their source and save it in this
+    // directory, so their readers seek to the byte offset of the key frames. See 'MediaParser::VIDEO_FRAME_INDEX'.
+    virtual std::string VideoFrameIndexCacheDirectory() const = 0;
 
     virtual void SetVideoOutWidth(uint32_t width) = 0;
     virtual void SetVideoOutHeight(uint32_t height) = 0;
     virtual void SetVideoOutFrameRate(const Ratio& framerate) = 0;
     virtual void SetVideoOutColorFormat(ImColorFormat colorformat) = 0;
     virtual void SetVideoOutDataType(ImDataType datatype) = 0;
+    virtual void EnableProxyMedia(bool enable) = 0;
+    virtual void SetVideoFrameIndexCacheDirectory(const std::string& dirPath) = 0;
 };
 
 }
\ No newline at end of file
@@ -105,6 +105,10 @@ namespace Snapshot
 
         virtual bool IsHwAccelEnabled() const = 0;
         virtual void EnableHwAccel(bool enable) = 0;
+        // In key-frame-only mode, only the key frame of each GOP is decoded, with the non-key frames skipped by the decoder,
+        // and it's used for all the snapshots within that GOP. A snapshot then costs at most one frame decoding.
+        virtual void EnableKeyFrameOnly(bool enable) = 0;
+        virtual bool IsKeyFrameOnly() const = 0;
         virtual void SetLogLevel(Logger::Level l) = 0;
         virtual std::string GetError() const = 0;
     };
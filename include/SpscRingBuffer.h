@@ -0,0 +1,252 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include "SysUtils.h"
+
+namespace SysUtils
+{
+/*
+ * Bounded lock-free queue for handing data from ONE producer stage to ONE consumer stage.
+ * All the slots are allocated by 'Reset()', push and pop never allocate and never lock.
+ * When the queue is full 'CanPush()' and 'TryPush()' fail, and the producer is expected to retry
+ * after the consumer has popped something (backpressure). If a wakeup event is attached, it is
+ * notified only when a push finds the queue empty or a pop finds it full, those are the only
+ * changes a stage idling on that event can be waiting for. A producer limiting the queue below
+ * its capacity sets that limit with 'SetHighWaterMark()', so the pops below it notify too.
+ * 'Reset()', 'Clear()' and the destructor must only be called while neither side is running.
+ */
+template<typename T>
+class SpscRingBuffer
+{
+public:
+    struct Stats
+    {
+        uint32_t capacity{0};
+        uint32_t depth{0};
+        uint32_t maxDepth{0};
+        uint64_t pushCount{0};
+        uint64_t popCount{0};
+        // how many times 'CanPush()' or 'TryPush()' failed because the queue was full
+        uint64_t fullCount{0};
+        // accumulated time from a failed 'CanPush()' or 'TryPush()' until the following successful push
+        uint64_t producerStallUs{0};
+        // accumulated time from a failed pop on an empty queue until the following successful one
+        uint64_t consumerStallUs{0};
+    };
+
+    explicit SpscRingBuffer(uint32_t capacity = 0, WaitableEvent* wakeupEvt = nullptr)
+        : m_wakeupEvt(wakeupEvt)
+    {
+        Reset(capacity);
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Reallocate the slots. The capacity is rounded up to a power of 2.
+    void Reset(uint32_t capacity)
+    {
+        uint32_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        m_buf.clear();
+        m_buf.resize(capacity > 0 ? size : 0);
+        m_mask = size-1;
+        m_head = 0;
+        m_tail = 0;
+        m_highWaterMark = (uint32_t)m_buf.size();
+        ResetStats();
+    }
+
+    void Clear()
+    {
+        for (auto& elem : m_buf)
+            elem = T();
+        m_head = 0;
+        m_tail = 0;
+    }
+
+    void SetWakeupEvent(WaitableEvent* wakeupEvt) { m_wakeupEvt = wakeupEvt; }
+    // A pop notifies the wakeup event if the depth before it is not less than 'depth'. It is the capacity after 'Reset()'.
+    void SetHighWaterMark(uint32_t depth) { m_highWaterMark.store(depth, std::memory_order_relaxed); }
+
+    // producer side. 'CanPush()' is for the producer which has to prepare the element before pushing it,
+    // a 'false' result is counted as a stall just like a failed 'TryPush()'.
+    bool CanPush()
+    {
+        const uint32_t depth = m_tail.load(std::memory_order_relaxed)-m_head.load(std::memory_order_acquire);
+        if (depth < (uint32_t)m_buf.size())
+            return true;
+        MarkProducerStall();
+        return false;
+    }
+
+    bool TryPush(const T& elem)
+    {
+        T copy(elem);
+        return TryPush(std::move(copy));
+    }
+
+    bool TryPush(T&& elem)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        const uint32_t depth = tail-m_head.load(std::memory_order_acquire);
+        if (depth >= (uint32_t)m_buf.size())
+        {
+            MarkProducerStall();
+            return false;
+        }
+        m_buf[tail&m_mask] = std::move(elem);
+        m_tail.store(tail+1, std::memory_order_release);
+        // pairs with the fence in 'TryPop()': either the consumer sees the new tail, or this check sees it drained the queue
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool wasEmpty = m_head.load(std::memory_order_relaxed) == tail;
+        m_pushCount.fetch_add(1, std::memory_order_relaxed);
+        if (depth+1 > m_maxDepth.load(std::memory_order_relaxed))
+            m_maxDepth.store(depth+1, std::memory_order_relaxed);
+        if (m_pushStallTp.time_since_epoch().count() != 0)
+        {
+            m_producerStallUs.fetch_add(ElapsedUs(m_pushStallTp), std::memory_order_relaxed);
+            m_pushStallTp = TimePoint();
+        }
+        if (wasEmpty && m_wakeupEvt)
+            m_wakeupEvt->Notify();
+        return true;
+    }
+
+    // consumer side, returns nullptr if the queue is empty. The element stays in the queue until 'Pop()'.
+    T* Front()
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            MarkConsumerStall();
+            return nullptr;
+        }
+        return &m_buf[head&m_mask];
+    }
+
+    bool Pop()
+    {
+        T elem;
+        return TryPop(elem);
+    }
+
+    bool TryPop(T& elem)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            MarkConsumerStall();
+            return false;
+        }
+        elem = std::move(m_buf[head&m_mask]);
+        // release the references held by the slot right now, not when it is overwritten
+        m_buf[head&m_mask] = T();
+        m_head.store(head+1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const bool wasFull = m_tail.load(std::memory_order_relaxed)-head >= m_highWaterMark.load(std::memory_order_relaxed);
+        m_popCount.fetch_add(1, std::memory_order_relaxed);
+        if (m_popStallTp.time_since_epoch().count() != 0)
+        {
+            m_consumerStallUs.fetch_add(ElapsedUs(m_popStallTp), std::memory_order_relaxed);
+            m_popStallTp = TimePoint();
+        }
+        if (wasFull && m_wakeupEvt)
+            m_wakeupEvt->Notify();
+        return true;
+    }
+
+    // can be called from either side, the result is a snapshot
+    uint32_t Size() const { return m_tail.load(std::memory_order_acquire)-m_head.load(std::memory_order_acquire); }
+    bool Empty() const { return Size() == 0; }
+    bool Full() const { return Size() >= (uint32_t)m_buf.size(); }
+    uint32_t Capacity() const { return (uint32_t)m_buf.size(); }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.capacity = Capacity();
+        stats.depth = Size();
+        stats.maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+        stats.pushCount = m_pushCount.load(std::memory_order_relaxed);
+        stats.popCount = m_popCount.load(std::memory_order_relaxed);
+        stats.fullCount = m_fullCount.load(std::memory_order_relaxed);
+        stats.producerStallUs = m_producerStallUs.load(std::memory_order_relaxed);
+        stats.consumerStallUs = m_consumerStallUs.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void ResetStats()
+    {
+        m_maxDepth = 0;
+        m_pushCount = 0;
+        m_popCount = 0;
+        m_fullCount = 0;
+        m_producerStallUs = 0;
+        m_consumerStallUs = 0;
+        m_pushStallTp = TimePoint();
+        m_popStallTp = TimePoint();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    static uint64_t ElapsedUs(const TimePoint& since)
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()-since).count();
+    }
+
+    void MarkProducerStall()
+    {
+        m_fullCount.fetch_add(1, std::memory_order_relaxed);
+        if (m_pushStallTp.time_since_epoch().count() == 0)
+            m_pushStallTp = Clock::now();
+    }
+
+    void MarkConsumerStall()
+    {
+        // only count the stall after the queue has been used, an idle queue before the first push is not a stall
+        if (m_popStallTp.time_since_epoch().count() == 0 && m_pushCount.load(std::memory_order_relaxed) > 0)
+            m_popStallTp = Clock::now();
+    }
+
+private:
+    std::vector<T> m_buf;
+    uint32_t m_mask{0};
+    WaitableEvent* m_wakeupEvt;
+    std::atomic<uint32_t> m_highWaterMark{0};
+    // 'm_head' is only written by the consumer and 'm_tail' only by the producer, keep them on separate cache lines
+    alignas(64) std::atomic<uint32_t> m_head{0};
+    TimePoint m_popStallTp;
+    std::atomic<uint64_t> m_popCount{0};
+    std::atomic<uint64_t> m_consumerStallUs{0};
+    alignas(64) std::atomic<uint32_t> m_tail{0};
+    TimePoint m_pushStallTp;
+    std::atomic<uint32_t> m_maxDepth{0};
+    std::atomic<uint64_t> m_pushCount{0};
+    std::atomic<uint64_t> m_fullCount{0};
+    std::atomic<uint64_t> m_producerStallUs{0};
+};
+}
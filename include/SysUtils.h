@@ -21,6 +21,11 @@
 #include <memory>
 #include <cstdint>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <list>
 #include "MediaCore.h"
 
 namespace SysUtils
@@ -31,6 +36,73 @@ MEDIACORE_API std::string ExtractFileExtName(const std::string& path);
 MEDIACORE_API std::string ExtractFileName(const std::string& path);
 MEDIACORE_API std::string ExtractDirectoryPath(const std::string& path);
 MEDIACORE_API bool IsDirectory(const std::string& path);
+// Get the size and the last modification time of a file. The time value is only meant to be
+// compared with another value returned by this function, on the same platform.
+MEDIACORE_API bool GetFileStatus(const std::string& path, uint64_t& fileSize, int64_t& modifyTime);
+// Set the last modification time of a file to now, the cache directories use it to record the last use of a file.
+MEDIACORE_API bool TouchFile(const std::string& path);
+// 64-bit FNV-1a hash, used to derive the file names of the cache files
+MEDIACORE_API uint64_t Fnv1aHash(const std::string& str);
+// A temporary file path next to 'path', unique among the processes and the threads writing the same 'path'.
+MEDIACORE_API std::string MakeUniqueTempPath(const std::string& path);
+
+/*
+ * Wait/notify primitive shared by the producer/consumer stages of a pipeline.
+ * A waiting stage takes 'Sequence()' BEFORE it examines the shared state, and if there is
+ * nothing to do, it calls 'Wait()' with that sequence number. Any 'Notify()' issued after
+ * the sequence was taken makes 'Wait()' return immediately, so no wakeup is lost between
+ * the check and the wait. 'Notify()' is a single atomic increment when there is no waiter.
+ */
+class MEDIACORE_API WaitableEvent
+{
+public:
+    WaitableEvent() = default;
+    WaitableEvent(const WaitableEvent&) = delete;
+    WaitableEvent& operator=(const WaitableEvent&) = delete;
+
+    uint64_t Sequence() const { return m_seq.load(); }
+    void Notify();
+    // Returns true if notified after 'seq', false on timeout.
+    bool Wait(uint64_t seq, uint32_t timeoutMillisec) const;
+
+    // Blocks until 'pred()' returns true. 'pred' is re-evaluated on every notification,
+    // and also every 'recheckMillisec' in case the state is changed without a notification.
+    template<typename Pred>
+    void WaitUntil(Pred pred, uint32_t recheckMillisec = 100) const
+    {
+        while (true)
+        {
+            const auto seq = Sequence();
+            if (pred())
+                break;
+            Wait(seq, recheckMillisec);
+        }
+    }
+
+    // Listeners are invoked from inside 'Notify()', so they must be short and must not block.
+    // They are used to resume the tasks that are parked on this event (see ThreadPoolExecutor).
+    uint32_t AddListener(std::function<void()> listener);
+    void RemoveListener(uint32_t listenerId);
+
+private:
+    mutable std::mutex m_mtx;
+    mutable std::condition_variable m_cv;
+    std::atomic<uint64_t> m_seq{0};
+    mutable std::atomic<int32_t> m_waiterCnt{0};
+    std::mutex m_listenerLock;
+    std::list<std::pair<uint32_t, std::function<void()>>> m_listeners;
+    std::atomic<int32_t> m_listenerCnt{0};
+    uint32_t m_nextListenerId{1};
+};
+
+// Notifies the event when going out of scope. Declared before a lock guard, it notifies after the lock is released, e.g. to
+// resume a task which failed to take that lock and parked itself on the event.
+struct ScopedNotifier
+{
+    ScopedNotifier(WaitableEvent& evt) : m_evt(evt) {}
+    ~ScopedNotifier() { m_evt.Notify(); }
+    WaitableEvent& m_evt;
+};
 
 struct FileIterator
 {
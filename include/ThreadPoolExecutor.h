@@ -0,0 +1,75 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <functional>
+#include "MediaCore.h"
+#include "SysUtils.h"
+#include "Logger.h"
+
+namespace SysUtils
+{
+/*
+ * A work-stealing executor that runs the pipeline stages of all the media readers on a
+ * bounded set of worker threads. A stage is submitted as a resumable task: its step function
+ * is called repeatedly, each call does one iteration of what used to be the body of a thread
+ * loop and tells the executor how to continue.
+ *   STEP_BUSY: progress was made, the task is rescheduled immediately;
+ *   STEP_IDLE: nothing to do, the task is parked until 'wakeupEvt' is notified, or until
+ *              'idleWaitTimeout' milliseconds have elapsed;
+ *   STEP_DONE: the task is finished and will not be called again.
+ * A step function must not block for a long time, since it occupies a worker thread.
+ */
+struct ThreadPoolExecutor
+{
+    using Holder = std::shared_ptr<ThreadPoolExecutor>;
+    static MEDIACORE_API Holder CreateInstance(uint32_t threadCount = 0, const std::string& name = "");
+    static MEDIACORE_API Holder GetDefaultInstance();
+    // Set the worker thread count of the default instance. It only takes effect if it is called
+    // before the first 'GetDefaultInstance()'. 0 means using the count of the hardware threads.
+    static MEDIACORE_API bool SetDefaultThreadCount(uint32_t threadCount);
+
+    enum StepResult
+    {
+        STEP_BUSY = 0,
+        STEP_IDLE,
+        STEP_DONE,
+    };
+    using StepFunction = std::function<StepResult()>;
+
+    struct Task
+    {
+        using Holder = std::shared_ptr<Task>;
+        virtual std::string GetName() const = 0;
+        virtual bool IsDone() const = 0;
+        // Wait for the task to finish. If it's called from a worker thread of the same executor, this worker
+        // runs the joined task itself while it's queued, but never picks up other tasks, so a step function
+        // can fork jobs and join them without nesting unrelated tasks on its stack.
+        virtual void Join() = 0;
+    };
+
+    virtual Task::Holder Submit(const std::string& name, StepFunction stepFunc, WaitableEvent* wakeupEvt = nullptr, uint32_t idleWaitTimeout = 100) = 0;
+    virtual uint32_t GetThreadCount() const = 0;
+    virtual uint32_t GetTaskCount() const = 0;
+    virtual bool IsWorkerThread() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
@@ -77,6 +77,14 @@ struct VideoClip
     virtual void ProcessSourceFrame(int64_t pos, std::vector<CorrelativeFrame>& frames, ImGui::ImMat& out, MediaReader::VideoFrame::Holder hInVf) = 0;
     virtual void SeekTo(int64_t pos) = 0;
     virtual void NotifyReadPos(int64_t pos) = 0;
+    // Open, seek and warm up the reader at clip position 'pos' before the reading reaches this clip.
+    // It's called from the dedicated prefetching thread of the track and blocks while the reader is opened,
+    // without holding the locks taken on the read thread of the track.
+    virtual void Prefetch(int64_t pos) = 0;
+    // Keep the reader awake while the track position is within 'window' milliseconds before this clip, in the reading direction.
+    virtual void SetPrefetchWindow(int64_t window) = 0;
+    // Read the nearest decoded frame instead of the exact one after a seek, see 'MediaReader::EnableScrubMode()'.
+    virtual void EnableScrubMode(bool enable) = 0;
     virtual void SetDirection(bool forward) = 0;
     virtual void SetFilter(VideoFilter::Holder filter) = 0;
     virtual VideoFilter::Holder GetFilter() const = 0;
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include "immat.h"
+#include "MediaCore.h"
+#include "Logger.h"
+
+namespace MediaCore
+{
+/*
+ * Process-wide cache of the decoded and converted video frames. The readers of the same source
+ * (MediaReader, Snapshot::Generator, Overview) look up a frame here before converting a decoded
+ * frame, and put the converted one back, so the same frame is not converted again by another
+ * reader with the same output format. The media readers (the generic one and VideoReader) only
+ * put the frames around their seek targets, the snapshots and the overview key frames are all put. The frames are evicted in LRU order once
+ * the total size exceeds the memory budget. A budget of 0 disables the cache.
+ */
+struct VideoFrameCache
+{
+    using Holder = std::shared_ptr<VideoFrameCache>;
+    static MEDIACORE_API Holder CreateInstance(uint64_t memoryBudget);
+    static MEDIACORE_API Holder GetDefaultInstance();
+
+    struct Key
+    {
+        std::string url;
+        int streamIndex{-1};
+        uint32_t width{0};
+        uint32_t height{0};
+        ImColorFormat clrfmt{IM_CF_RGBA};
+        ImDataType dtype{IM_DT_INT8};
+        ImInterpolateMode interp{IM_INTERPOLATE_BICUBIC};
+        // the frames converted by the vulkan components may reside in gpu memory
+        bool useVulkan{false};
+
+        bool operator<(const Key& other) const
+        {
+            return std::tie(url, streamIndex, width, height, clrfmt, dtype, interp, useVulkan) <
+                std::tie(other.url, other.streamIndex, other.width, other.height, other.clrfmt, other.dtype, other.interp, other.useVulkan);
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t memoryBudget{0};
+        uint64_t memoryUsage{0};
+        uint32_t frameCount{0};
+        uint64_t hitCount{0};
+        uint64_t missCount{0};
+        uint64_t evictCount{0};
+    };
+
+    // Get the frame with the largest pts in range [pts-ptsTolerance, pts].
+    virtual bool Get(const Key& key, int64_t pts, ImGui::ImMat& m, int64_t ptsTolerance = 0) = 0;
+    virtual void Put(const Key& key, int64_t pts, const ImGui::ImMat& m) = 0;
+    // Remove all the frames of the source 'url'.
+    virtual void Remove(const std::string& url) = 0;
+    virtual void Clear() = 0;
+
+    virtual void SetMemoryBudget(uint64_t bytes) = 0;
+    virtual uint64_t GetMemoryBudget() const = 0;
+    virtual Stats GetStats() const = 0;
+
+    virtual void SetLogLevel(Logger::Level l) = 0;
+};
+}
@@ -62,6 +62,11 @@ struct VideoTrack
     virtual int64_t Duration() const = 0;
     virtual void SetDirection(bool forward) = 0;
     virtual bool Direction() const = 0;
+    // When the read position comes within 'window' milliseconds of the next clip in the reading direction,
+    // the reader of that clip is opened, seeked and warmed up in the background. 0 disables the prefetching.
+    virtual void SetPrefetchWindow(int64_t window) = 0;
+    // Let the clips read the nearest decoded frames after seeking, for the scrubbing of 'MultiTrackVideoReader::ConsecutiveSeek()'.
+    virtual void EnableScrubMode(bool enable) = 0;
     virtual void SetVisible(bool visible) = 0;
     virtual bool IsVisible() const = 0;
     virtual ReadFrameTask::Holder CreateReadFrameTask(int64_t frameIndex, bool canDrop, bool needSeek, ReadFrameTask::Callback* pCb = nullptr) = 0;
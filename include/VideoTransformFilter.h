@@ -52,12 +52,17 @@ namespace MediaCore
         virtual bool SetScaleH(double scale) = 0;
         virtual bool SetScaleV(double scale) = 0;
         virtual bool SetKeyPoint(ImGui::KeyPointEditor &keypoint) = 0;
+        // Size of the media the input images are decoded from, 0 means the size of the input image. When the input is
+        // a downscaled proxy of the source, the crop margins and the unscaled layout are still in the pixels of the source.
+        virtual bool SetSourceSize(uint32_t width, uint32_t height) = 0;
         virtual ImGui::ImMat FilterImage(const ImGui::ImMat& vmat, int64_t pos) = 0;
 
         virtual const std::string GetFilterName() const = 0;
         virtual std::string GetOutputFormat() const = 0;
         virtual uint32_t GetInWidth() const = 0;
         virtual uint32_t GetInHeight() const = 0;
+        virtual uint32_t GetSourceWidth() const = 0;
+        virtual uint32_t GetSourceHeight() const = 0;
         virtual uint32_t GetOutWidth() const = 0;
         virtual uint32_t GetOutHeight() const = 0;
         virtual ScaleType GetScaleType() const = 0;
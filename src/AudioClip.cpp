@@ -19,6 +19,7 @@
 #include <functional>
 #include <cmath>
 #include "AudioClip.h"
+#include "MediaReaderPool.h"
 #include "MatUtils.h"
 #include "Logger.h"
 #include "SysUtils.h"
@@ -62,11 +63,10 @@ public:
             oss << "AUD@" << fileName << "";
             loggerName = oss.str();
         }
-        m_hReader = MediaReader::CreateInstance(loggerName);
-        if (!m_hReader->Open(hParser))
-            throw runtime_error(m_hReader->GetError());
-        if (!m_hReader->ConfigAudioReader(outChannels, outSampleRate, outSampleFormat))
-            throw runtime_error(m_hReader->GetError());
+        auto hReaderPool = MediaReaderPool::GetDefaultInstance();
+        m_hReader = hReaderPool->AcquireAudioReader(hParser, outChannels, outSampleRate, outSampleFormat, loggerName);
+        if (!m_hReader)
+            throw runtime_error(hReaderPool->GetError());
         m_srcDuration = (int64_t)(m_hReader->GetAudioStream()->duration*1000);
         if (startOffset < 0)
             throw invalid_argument("Argument 'startOffset' can NOT be NEGATIVE!");
@@ -78,6 +78,9 @@ public:
         m_endOffset = endOffset;
         m_padding = (end-start)+startOffset+endOffset-m_srcDuration;
         m_totalSamples = Duration()*outSampleRate/1000;
+        // a reader reused from the pool is left where the previous clip stopped reading
+        if (m_hReader->IsStarted() && !m_hReader->SeekTo(startOffset))
+            throw runtime_error(m_hReader->GetError());
         if (!m_hReader->Start())
             throw runtime_error(m_hReader->GetError());
     }
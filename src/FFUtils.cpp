@@ -21,8 +21,11 @@
 #include <memory>
 #include <functional>
 #include <algorithm>
+#include <atomic>
 #include "Logger.h"
 #include "FFUtils.h"
+#include "MatUtils.h"
+#include "ThreadPoolExecutor.h"
 extern "C"
 {
     #include "libavutil/pixdesc.h"
@@ -501,7 +504,7 @@ bool MakeAVFrameCopy(AVFrame* dst, const AVFrame* src)
     return true;
 }
 
-bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& vmat, double timestamp)
+bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& vmat, double timestamp, MediaCore::ImMatPool* pool)
 {
     SelfFreeAVFramePtr swfrm;
     if (IsHwFrame(avfrm))
@@ -555,7 +558,8 @@ bool ConvertAVFrameToImMat(const AVFrame* avfrm, ImGui::ImMat& vmat, double time
         else
             channel = 2;
     }
-    mat_V.create_type(width, height, channel, dataType);
+    if (!pool || !pool->Acquire(mat_V, width, height, channel, dataType))
+        mat_V.create_type(width, height, channel, dataType);
     uint8_t* prevDataPtr = nullptr;
     for (int i = 0; i < desc->nb_components; i++)
     {
@@ -761,6 +765,185 @@ bool ConvertImMatToAVFrame(const ImGui::ImMat& vmat, AVFrame* avfrm, int64_t pts
     return true;
 }
 
+static uint32_t ResolveThreadCount(uint32_t threadCount)
+{
+    if (threadCount > 0)
+        return threadCount;
+    return max(SysUtils::ThreadPoolExecutor::GetDefaultInstance()->GetThreadCount(), 1U);
+}
+
+// With more than one thread, the SwsContext runs its own slice threads (libswscale 6 and later),
+// which are only used when the image is scaled with 'sws_scale_frame()'.
+static SwsContext* CreateSwsContext(int srcW, int srcH, AVPixelFormat srcFormat, int dstW, int dstH, AVPixelFormat dstFormat, int flags, uint32_t threadCount)
+{
+#if LIBSWSCALE_VERSION_MAJOR >= 6
+    if (threadCount > 1)
+    {
+        SwsContext* swsCtx = sws_alloc_context();
+        if (!swsCtx)
+            return nullptr;
+        av_opt_set_int(swsCtx, "srcw", srcW, 0);
+        av_opt_set_int(swsCtx, "srch", srcH, 0);
+        av_opt_set_int(swsCtx, "src_format", (int)srcFormat, 0);
+        av_opt_set_int(swsCtx, "dstw", dstW, 0);
+        av_opt_set_int(swsCtx, "dsth", dstH, 0);
+        av_opt_set_int(swsCtx, "dst_format", (int)dstFormat, 0);
+        av_opt_set_int(swsCtx, "sws_flags", flags, 0);
+        av_opt_set_int(swsCtx, "threads", threadCount, 0);
+        if (sws_init_context(swsCtx, nullptr, nullptr) < 0)
+        {
+            sws_freeContext(swsCtx);
+            return nullptr;
+        }
+        return swsCtx;
+    }
+#endif
+    return sws_getContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat, flags, nullptr, nullptr, nullptr);
+}
+
+static int SwsScaleFrame(SwsContext* swsCtx, AVFrame* dstfrm, const AVFrame* srcfrm, uint32_t threadCount)
+{
+#if LIBSWSCALE_VERSION_MAJOR >= 6
+    if (threadCount > 1)
+        return sws_scale_frame(swsCtx, dstfrm, srcfrm);
+#endif
+    return sws_scale(swsCtx, srcfrm->data, srcfrm->linesize, 0, srcfrm->height, dstfrm->data, dstfrm->linesize);
+}
+
+// Describe 'avfrm' as a 'MatUtils::YuvImage' if it's one of the 4:2:0 formats (YUV420P, NV12, P010, ...)
+// which can be converted to RGBA float32 by the MatUtils kernels directly.
+static bool GetYuv420Image(const AVFrame* avfrm, MatUtils::YuvImage& yuvImg)
+{
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)avfrm->format);
+    if (!desc || desc->nb_components != 3 || desc->log2_chroma_w != 1 || desc->log2_chroma_h != 1)
+        return false;
+    if ((desc->flags&(AV_PIX_FMT_FLAG_RGB|AV_PIX_FMT_FLAG_BE|AV_PIX_FMT_FLAG_PAL|AV_PIX_FMT_FLAG_HWACCEL)) != 0)
+        return false;
+    const int bitDepth = desc->comp[0].depth;
+    const int elemSize = bitDepth > 8 ? 2 : 1;
+    for (int i = 1; i < 3; i++)
+    {
+        if (desc->comp[i].depth != bitDepth || desc->comp[i].shift != desc->comp[0].shift)
+            return false;
+    }
+    if (desc->comp[0].plane != 0 || desc->comp[0].step != elemSize || desc->comp[0].offset != 0 || desc->comp[1].plane != 1 || desc->comp[1].offset != 0)
+        return false;
+    bool interleavedChroma;
+    if (desc->comp[2].plane == 2 && desc->comp[2].offset == 0 && desc->comp[1].step == elemSize && desc->comp[2].step == elemSize)
+        interleavedChroma = false;
+    else if (desc->comp[2].plane == 1 && desc->comp[2].offset == elemSize && desc->comp[1].step == 2*elemSize && desc->comp[2].step == 2*elemSize)
+        interleavedChroma = true;
+    else
+        return false;
+
+    for (int i = 0; i < 3; i++)
+    {
+        yuvImg.data[i] = avfrm->data[i];
+        yuvImg.lineSize[i] = avfrm->linesize[i];
+    }
+    yuvImg.width = avfrm->width;
+    yuvImg.height = avfrm->height;
+    yuvImg.bitDepth = bitDepth;
+    yuvImg.sampleShift = desc->comp[0].shift;
+    yuvImg.interleavedChroma = interleavedChroma;
+    // same coefficients as the ones 'sws_getCoefficients()' picks for the swscale path
+    yuvImg.colorSpace = avfrm->colorspace == AVCOL_SPC_BT709 ? IM_CS_BT709 :
+                        avfrm->colorspace == AVCOL_SPC_BT2020_NCL || avfrm->colorspace == AVCOL_SPC_BT2020_CL ? IM_CS_BT2020 : IM_CS_BT601;
+    yuvImg.colorRange = avfrm->color_range == AVCOL_RANGE_JPEG || avfrm->format == (int)AV_PIX_FMT_YUVJ420P ? IM_CR_FULL_RANGE : IM_CR_NARROW_RANGE;
+    return true;
+}
+
+static bool ConvertYuv420ImageToRgbaFloat(ImGui::ImMat& dstMat, const MatUtils::YuvImage& yuvImg, uint32_t threadCount)
+{
+    const int32_t minSliceHeight = 64;
+    uint32_t sliceCount = min(threadCount, (uint32_t)(yuvImg.height/minSliceHeight));
+    if (sliceCount <= 1)
+        return MatUtils::ConvertYuv420ToRgbaFloat(dstMat, yuvImg);
+
+    const int32_t sliceHeight = (yuvImg.height+sliceCount-1)/sliceCount;
+    auto hExecutor = SysUtils::ThreadPoolExecutor::GetDefaultInstance();
+    vector<SysUtils::ThreadPoolExecutor::Task::Holder> sliceJobs;
+    atomic_bool success{true};
+    for (uint32_t i = 1; i < sliceCount; i++)
+    {
+        const int32_t rowBegin = i*sliceHeight;
+        const int32_t rowEnd = min(rowBegin+sliceHeight, yuvImg.height);
+        sliceJobs.push_back(hExecutor->Submit("FrmCvtSlice", [&dstMat, &yuvImg, &success, rowBegin, rowEnd] () {
+            if (!MatUtils::ConvertYuv420ToRgbaFloat(dstMat, yuvImg, rowBegin, rowEnd))
+                success = false;
+            return SysUtils::ThreadPoolExecutor::STEP_DONE;
+        }));
+    }
+    if (!MatUtils::ConvertYuv420ToRgbaFloat(dstMat, yuvImg, 0, sliceHeight))
+        success = false;
+    for (auto& job : sliceJobs)
+        job->Join();
+    return success;
+}
+
+// Normalize the 8-bit RGBA image 'srcMat' to the float32 one 'dstMat' of the same size.
+static void ConvertRgbaInt8ToFloat(ImGui::ImMat& dstMat, const ImGui::ImMat& srcMat)
+{
+    const size_t valueCount = (size_t)srcMat.w*srcMat.h*4;
+    const uint8_t* src = (const uint8_t*)srcMat.data;
+    float* dst = (float*)dstMat.data;
+    for (size_t i = 0; i < valueCount; i++)
+        dst[i] = (float)src[i]*(1.f/255.f);
+    dstMat.color_format = srcMat.color_format;
+    dstMat.color_space = srcMat.color_space;
+    dstMat.color_range = srcMat.color_range;
+    dstMat.flags = srcMat.flags;
+}
+
+// Halve the 8-bit 4:2:0 frame 'srcfrm' into 'dstfrm' by averaging each 2x2 block of pixels. The size of 'dstfrm' is rounded down to
+// an even number of pixels, so the chroma planes are halved by whole blocks too. The buffers of 'dstfrm' are reused if they are
+// of the same size and format, and not referenced elsewhere.
+static bool HalveYuv420Frame(AVFrame* dstfrm, const AVFrame* srcfrm)
+{
+    MatUtils::YuvImage yuvImg;
+    if (!GetYuv420Image(srcfrm, yuvImg) || yuvImg.bitDepth != 8)
+        return false;
+    const int dstWidth = srcfrm->width/4*2;
+    const int dstHeight = srcfrm->height/4*2;
+    if (dstWidth <= 0 || dstHeight <= 0)
+        return false;
+    if (!dstfrm->buf[0] || dstfrm->width != dstWidth || dstfrm->height != dstHeight || dstfrm->format != srcfrm->format
+        || !av_frame_is_writable(dstfrm))
+    {
+        av_frame_unref(dstfrm);
+        dstfrm->width = dstWidth;
+        dstfrm->height = dstHeight;
+        dstfrm->format = srcfrm->format;
+        if (av_frame_get_buffer(dstfrm, 0) < 0)
+            return false;
+    }
+    MatUtils::DownscalePlaneBox2x(dstfrm->data[0], dstfrm->linesize[0], srcfrm->data[0], srcfrm->linesize[0], dstfrm->width, dstfrm->height);
+    const int chromaWidth = dstfrm->width/2;
+    const int chromaHeight = dstfrm->height/2;
+    if (yuvImg.interleavedChroma)
+    {
+        MatUtils::DownscalePlaneBox2x(dstfrm->data[1], dstfrm->linesize[1], srcfrm->data[1], srcfrm->linesize[1], chromaWidth, chromaHeight, 2);
+    }
+    else
+    {
+        MatUtils::DownscalePlaneBox2x(dstfrm->data[1], dstfrm->linesize[1], srcfrm->data[1], srcfrm->linesize[1], chromaWidth, chromaHeight);
+        MatUtils::DownscalePlaneBox2x(dstfrm->data[2], dstfrm->linesize[2], srcfrm->data[2], srcfrm->linesize[2], chromaWidth, chromaHeight);
+    }
+    // only the properties read by the conversion, 'av_frame_copy_props()' would pile up the side data on a reused frame
+    dstfrm->pts = srcfrm->pts;
+    dstfrm->pict_type = srcfrm->pict_type;
+    dstfrm->key_frame = srcfrm->key_frame;
+    dstfrm->interlaced_frame = srcfrm->interlaced_frame;
+    dstfrm->top_field_first = srcfrm->top_field_first;
+    dstfrm->sample_aspect_ratio = srcfrm->sample_aspect_ratio;
+    dstfrm->colorspace = srcfrm->colorspace;
+    dstfrm->color_range = srcfrm->color_range;
+    dstfrm->color_primaries = srcfrm->color_primaries;
+    dstfrm->color_trc = srcfrm->color_trc;
+    dstfrm->chroma_location = srcfrm->chroma_location;
+    return true;
+}
+
 AVFrameToImMatConverter::AVFrameToImMatConverter()
 {
 #if IMGUI_VULKAN_SHADER
@@ -773,6 +956,7 @@ AVFrameToImMatConverter::AVFrameToImMatConverter()
 #else
     m_useVulkanComponents = false;
 #endif
+    m_hMatPool = MediaCore::ImMatPool::GetSharedInstance("VideoFrame");
 }
 
 AVFrameToImMatConverter::~AVFrameToImMatConverter()
@@ -881,6 +1065,22 @@ bool AVFrameToImMatConverter::SetResizeInterpolateMode(ImInterpolateMode interp)
     return true;
 }
 
+bool AVFrameToImMatConverter::SetThreadCount(uint32_t count)
+{
+    if (m_threadCount == count)
+        return true;
+
+    m_threadCount = count;
+
+    if (m_swsCtx)
+    {
+        sws_freeContext(m_swsCtx);
+        m_swsCtx = nullptr;
+        m_passThrough = false;
+    }
+    return true;
+}
+
 bool AVFrameToImMatConverter::ConvertImage(const AVFrame* avfrm, ImGui::ImMat& outMat, double timestamp)
 {
     if (m_useVulkanComponents)
@@ -1013,6 +1213,51 @@ bool AVFrameToImMatConverter::ConvertImage(const AVFrame* avfrm, ImGui::ImMat& o
 
         int outWidth = m_outWidth == 0 ? avfrm->width : m_outWidth;
         int outHeight = m_outHeight == 0 ? avfrm->height : m_outHeight;
+        const uint32_t threadCount = ResolveThreadCount(m_threadCount);
+
+        // When the output is half the size of the frame or smaller, box-downscale 8-bit 4:2:0 frames by 2x2 blocks first,
+        // so swscale only filters the remaining scale from a much smaller image. The decoders without lowres support end up here.
+        // Each halving level keeps its frame, whose size is the same for all the frames of a stream.
+        if (m_resizeInterp != IM_INTERPOLATE_NEAREST)
+        {
+            size_t level = 0;
+            while (avfrm->width/4*2 >= outWidth && avfrm->height/4*2 >= outHeight)
+            {
+                if (level >= m_halvedFrms.size())
+                    m_halvedFrms.push_back(AllocSelfFreeAVFramePtr());
+                auto& halvedfrm = m_halvedFrms[level];
+                if (!halvedfrm || !HalveYuv420Frame(halvedfrm.get(), avfrm))
+                    break;
+                avfrm = halvedfrm.get();
+                level++;
+            }
+        }
+
+        // YUV 4:2:0 -> RGBA float32 without resizing, convert with the MatUtils kernels instead of swscale
+        MatUtils::YuvImage yuvImg;
+        if (m_outDataType == IM_DT_FLOAT32 && m_outClrFmt == IM_CF_RGBA && avfrm->width == outWidth && avfrm->height == outHeight && GetYuv420Image(avfrm, yuvImg))
+        {
+            ImGui::ImMat rgbaMat;
+            if (!m_hMatPool || !m_hMatPool->Acquire(rgbaMat, outWidth, outHeight, 4, IM_DT_FLOAT32))
+                rgbaMat.create_type(outWidth, outHeight, 4, IM_DT_FLOAT32);
+            if (!ConvertYuv420ImageToRgbaFloat(rgbaMat, yuvImg, threadCount))
+            {
+                m_errMsg = "FAILED to invoke 'MatUtils::ConvertYuv420ToRgbaFloat()'!";
+                return false;
+            }
+            rgbaMat.color_format = IM_CF_RGBA;
+            rgbaMat.color_space = yuvImg.colorSpace;
+            rgbaMat.color_range = yuvImg.colorRange;
+            rgbaMat.flags = IM_MAT_FLAGS_VIDEO_FRAME;
+            if (avfrm->pict_type == AV_PICTURE_TYPE_I) rgbaMat.flags |= IM_MAT_FLAGS_VIDEO_FRAME_I;
+            if (avfrm->pict_type == AV_PICTURE_TYPE_P) rgbaMat.flags |= IM_MAT_FLAGS_VIDEO_FRAME_P;
+            if (avfrm->pict_type == AV_PICTURE_TYPE_B) rgbaMat.flags |= IM_MAT_FLAGS_VIDEO_FRAME_B;
+            if (avfrm->interlaced_frame) rgbaMat.flags |= IM_MAT_FLAGS_VIDEO_INTERLACED;
+            rgbaMat.time_stamp = timestamp;
+            outMat = rgbaMat;
+            return true;
+        }
+
         if (!(m_swsCtx || m_passThrough) ||
             m_swsInWidth != avfrm->width || m_swsInHeight != avfrm->height ||
             (int)m_swsInFormat != avfrm->format || m_swsClrspc != avfrm->colorspace)
@@ -1024,7 +1269,7 @@ bool AVFrameToImMatConverter::ConvertImage(const AVFrame* avfrm, ImGui::ImMat& o
             }
             if (avfrm->width != outWidth || avfrm->height != outHeight || avfrm->format != (int)m_swsOutFormat)
             {
-                m_swsCtx = sws_getContext(avfrm->width, avfrm->height, (AVPixelFormat)avfrm->format, outWidth, outHeight, m_swsOutFormat, m_swsFlags, nullptr, nullptr, nullptr);
+                m_swsCtx = CreateSwsContext(avfrm->width, avfrm->height, (AVPixelFormat)avfrm->format, outWidth, outHeight, m_swsOutFormat, m_swsFlags, threadCount);
                 if (!m_swsCtx)
                 {
                     ostringstream oss;
@@ -1070,17 +1315,26 @@ bool AVFrameToImMatConverter::ConvertImage(const AVFrame* avfrm, ImGui::ImMat& o
                 m_errMsg = string("FAILED to invoke 'av_frame_get_buffer()' for 'swsfrm'! fferr = ")+to_string(fferr)+".";
                 return false;
             }
-            fferr = sws_scale(m_swsCtx, avfrm->data, avfrm->linesize, 0, avfrm->height, swsfrm->data, swsfrm->linesize);
+            fferr = SwsScaleFrame(m_swsCtx, pfrm, avfrm, threadCount);
             av_frame_copy_props(swsfrm.get(), avfrm);
             avfrm = swsfrm.get();
         }
 
         // AVFrame -> ImMat
-        if (!ConvertAVFrameToImMat(avfrm, outMat, timestamp))
+        if (!ConvertAVFrameToImMat(avfrm, outMat, timestamp, m_hMatPool.get()))
         {
             m_errMsg = "Failed to invoke 'ConvertAVFrameToImMat()'!";
             return false;
         }
+        // the float32 output does not depend on whether the source took the YUV 4:2:0 path above
+        if (m_outDataType == IM_DT_FLOAT32 && outMat.type == IM_DT_INT8 && outMat.c == 4)
+        {
+            ImGui::ImMat fltMat;
+            if (!m_hMatPool || !m_hMatPool->Acquire(fltMat, outMat.w, outMat.h, 4, IM_DT_FLOAT32))
+                fltMat.create_type(outMat.w, outMat.h, 4, IM_DT_FLOAT32);
+            ConvertRgbaInt8ToFloat(fltMat, outMat);
+            outMat = fltMat;
+        }
 
         outMat.time_stamp = timestamp;
         return true;
@@ -1259,6 +1513,22 @@ bool ImMatToAVFrameConverter::SetResizeInterpolateMode(ImInterpolateMode interp)
     return true;
 }
 
+bool ImMatToAVFrameConverter::SetThreadCount(uint32_t count)
+{
+    if (m_threadCount == count)
+        return true;
+
+    m_threadCount = count;
+
+    if (m_swsCtx)
+    {
+        sws_freeContext(m_swsCtx);
+        m_swsCtx = nullptr;
+        m_passThrough = false;
+    }
+    return true;
+}
+
 bool ImMatToAVFrameConverter::ConvertImage(const ImGui::ImMat& vmat, AVFrame* avfrm, int64_t pts)
 {
     ImGui::ImMat inMat = vmat;
@@ -1353,6 +1623,7 @@ bool ImMatToAVFrameConverter::ConvertImage(const ImGui::ImMat& vmat, AVFrame* av
         return false;
     }
 
+    const uint32_t threadCount = ResolveThreadCount(m_threadCount);
     if (!m_swsCtx || m_swsInWidth != inMat.w || m_swsInHeight != inMat.h || m_swsInFormat != cvtPixfmt)
     {
         if (m_swsCtx)
@@ -1360,7 +1631,7 @@ bool ImMatToAVFrameConverter::ConvertImage(const ImGui::ImMat& vmat, AVFrame* av
             sws_freeContext(m_swsCtx);
             m_swsCtx = nullptr;
         }
-        m_swsCtx = sws_getContext(inMat.w, inMat.h, cvtPixfmt, outWidth, outHeight, m_outPixfmt, m_swsFlags, nullptr, nullptr, nullptr);
+        m_swsCtx = CreateSwsContext(inMat.w, inMat.h, cvtPixfmt, outWidth, outHeight, m_outPixfmt, m_swsFlags, threadCount);
         if (!m_swsCtx)
         {
             ostringstream oss;
@@ -1393,7 +1664,7 @@ bool ImMatToAVFrameConverter::ConvertImage(const ImGui::ImMat& vmat, AVFrame* av
         m_errMsg = oss.str();
         return false;
     }
-    fferr = sws_scale(m_swsCtx, cvtfrm->data, cvtfrm->linesize, 0, outHeight, avfrm->data, avfrm->linesize);
+    fferr = SwsScaleFrame(m_swsCtx, avfrm, cvtfrm.get(), threadCount);
     av_frame_copy_props(avfrm, cvtfrm.get());
 
     return true;
@@ -1509,6 +1780,7 @@ SelfFreeAVFramePtr ImMatWrapper_AVFrame::GetWrapper(int64_t pts)
 FFOverlayBlender::FFOverlayBlender()
 {
     m_cvtMat2Avfrm.SetOutPixelFormat(AV_PIX_FMT_RGBA);
+    m_cvtAvfrm2Mat.SetMatPool(MediaCore::ImMatPool::GetSharedInstance("Blend"));
 }
 
 FFOverlayBlender::~FFOverlayBlender()
@@ -1813,7 +2085,8 @@ bool AudioImMatAVFrameConverter::ConvertAVFrameToImMat(const AVFrame* avfrm, ImG
 #else
     const int channels = avfrm->ch_layout.nb_channels;
 #endif
-    amat.create_type(avfrm->nb_samples, (int)1, channels, dtype);
+    if (!m_hMatPool || !m_hMatPool->Acquire(amat, avfrm->nb_samples, (int)1, channels, dtype))
+        amat.create_type(avfrm->nb_samples, (int)1, channels, dtype);
     amat.elempack = isPlanar ? 1 : channels;
     int bytesPerSample = av_get_bytes_per_sample((AVSampleFormat)avfrm->format);
     int bytesPerLine = avfrm->nb_samples*bytesPerSample*(isPlanar?1:channels);
@@ -2009,6 +2282,7 @@ static bool _OpenSwVideoDecoder(AVCodecPtr codec, const AVCodecParameters *codec
     // TODO: decoder multi-thread opts are hardcoded here, should be controlled by FFUtils::OpenVideoDecoderOptions in the future
     swDecCtx->thread_count = 8;
     // swDecCtx->thread_type = FF_THREAD_FRAME;
+    swDecCtx->lowres = FFUtils::GetVideoDecoderLowres(codec, codecpar->width, codecpar->height, options->minPictureWidth, options->minPictureHeight);
 
     fferr = avcodec_open2(swDecCtx, codec, nullptr);
     if (fferr < 0)
@@ -2124,6 +2398,18 @@ static bool _CheckVideoDecoderValidity(const AVFormatContext* pAvfmtCtx, int vid
 
 namespace FFUtils
 {
+    int GetVideoDecoderLowres(AVCodecPtr codec, int srcWidth, int srcHeight, uint32_t minWidth, uint32_t minHeight)
+    {
+        if (!codec || minWidth == 0 || minHeight == 0)
+            return 0;
+        int lowres = 0;
+        // the decoder rounds the reduced size up, same as 'AV_CEIL_RSHIFT()'
+        while (lowres < codec->max_lowres &&
+            (uint32_t)AV_CEIL_RSHIFT(srcWidth, lowres+1) >= minWidth && (uint32_t)AV_CEIL_RSHIFT(srcHeight, lowres+1) >= minHeight)
+            lowres++;
+        return lowres;
+    }
+
     bool OpenVideoDecoder(const AVFormatContext* pAvfmtCtx, int videoStreamIndex, OpenVideoDecoderOptions* options, OpenVideoDecoderResult* result, bool needValidation)
     {
         // check arguments are valid
@@ -0,0 +1,278 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <tuple>
+#include "ImMatPool.h"
+#include "MemoryGovernor.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace Logger;
+
+namespace MediaCore
+{
+// the high-water mark of the shared pools, a few frames of each size class in use
+static const uint64_t IMMAT_POOL_DEFAULT_HIGH_WATER_BYTES = 64ULL*1024*1024;
+
+class ImMatPool_Impl : public ImMatPool, public MemoryGovernor::Consumer
+{
+public:
+    ImMatPool_Impl(const string& name, uint64_t highWaterBytes)
+        : m_name(name), m_highWaterBytes(highWaterBytes)
+    {
+        m_logger = GetLogger("MatPool");
+        m_hMemGov = MemoryGovernor::GetDefaultInstance();
+        m_hMemGov->Register(this);
+    }
+
+    ~ImMatPool_Impl()
+    {
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_sizeClasses.clear();
+            m_pooledBytes = 0;
+            ReportMemoryUsage();
+        }
+        m_hMemGov->Unregister(this);
+    }
+
+    bool Acquire(ImGui::ImMat& m, int w, int h, int c, ImDataType dtype) override
+    {
+        const SizeClass sizeCls(w, h, c, dtype);
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_acquireCount++;
+            auto& bufList = m_sizeClasses[sizeCls];
+            for (auto& buf : bufList)
+            {
+                if (!IsInUse(buf))
+                {
+                    m = buf;
+                    m_reuseCount++;
+                    return true;
+                }
+            }
+        }
+
+        ImGui::ImMat buf;
+        buf.create_type(w, h, c, dtype);
+        if (!buf.data)
+            return false;
+        const uint64_t bytes = (uint64_t)buf.total()*buf.elemsize;
+        // the governor may ask the other consumers to shrink, so it's called without 'm_lock'
+        const bool granted = m_hMemGov->RequestMemory(this, bytes);
+        lock_guard<mutex> lk(m_lock);
+        if (!granted || m_pooledBytes+bytes > m_highWaterBytes)
+        {
+            m_overflowCount++;
+            m = buf;
+            return true;
+        }
+        AdviseHugePages(buf.data, bytes);
+        m_sizeClasses[sizeCls].push_back(buf);
+        m_pooledBytes += bytes;
+        ReportMemoryUsage();
+        m_allocCount++;
+        m = buf;
+        return true;
+    }
+
+    void Trim() override
+    {
+        lock_guard<mutex> lk(m_lock);
+        ReleaseIdleBuffers(UINT64_MAX);
+        ReportMemoryUsage();
+    }
+
+    void SetHighWaterMark(uint64_t bytes) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_highWaterBytes = bytes;
+        if (m_pooledBytes > m_highWaterBytes)
+        {
+            ReleaseIdleBuffers(UINT64_MAX);
+            ReportMemoryUsage();
+        }
+    }
+
+    string GetName() const override
+    {
+        return m_name;
+    }
+
+    Stats GetStats() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        Stats stats;
+        stats.highWaterBytes = m_highWaterBytes;
+        stats.pooledBytes = m_pooledBytes;
+        for (auto& elem : m_sizeClasses)
+        {
+            for (auto& buf : elem.second)
+            {
+                stats.bufferCount++;
+                if (IsInUse(buf))
+                    stats.inUseCount++;
+            }
+        }
+        stats.acquireCount = m_acquireCount;
+        stats.reuseCount = m_reuseCount;
+        stats.allocCount = m_allocCount;
+        stats.overflowCount = m_overflowCount;
+        return stats;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+    string GetMemoryConsumerName() const override
+    {
+        return "ImMatPool-"+m_name;
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_reportedUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return MemoryGovernor::PRIORITY_LOW;
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        const uint64_t releasedBytes = ReleaseIdleBuffers(bytes);
+        ReportMemoryUsage();
+        return releasedBytes;
+    }
+
+private:
+    using SizeClass = tuple<int, int, int, ImDataType>;
+
+    static bool IsInUse(const ImGui::ImMat& buf)
+    {
+        // the pool itself holds one reference
+        if (!buf.refcount || *buf.refcount > 1)
+            return true;
+        atomic_thread_fence(memory_order_acquire);
+        return false;
+    }
+
+    static void AdviseHugePages(void* data, uint64_t bytes)
+    {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        const uint64_t hugePageSize = 2*1024*1024;
+        if (bytes < hugePageSize)
+            return;
+        const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+        const uintptr_t begin = ((uintptr_t)data+pageSize-1)&~(pageSize-1);
+        const uintptr_t end = ((uintptr_t)data+bytes)&~(pageSize-1);
+        if (end > begin)
+            madvise((void*)begin, end-begin, MADV_HUGEPAGE);
+#endif
+    }
+
+    // 'm_lock' must be held when calling this method
+    void ReportMemoryUsage()
+    {
+        const uint64_t prevUsage = m_reportedUsage.exchange(m_pooledBytes);
+        if (m_pooledBytes != prevUsage)
+            m_hMemGov->ReportUsageChange((int64_t)m_pooledBytes-(int64_t)prevUsage);
+    }
+
+    // 'm_lock' must be held when calling this method
+    uint64_t ReleaseIdleBuffers(uint64_t bytes)
+    {
+        uint32_t releaseCnt = 0;
+        uint64_t releasedBytes = 0;
+        auto clsIter = m_sizeClasses.begin();
+        while (clsIter != m_sizeClasses.end() && releasedBytes < bytes)
+        {
+            auto& bufList = clsIter->second;
+            auto bufIter = bufList.begin();
+            while (bufIter != bufList.end() && releasedBytes < bytes)
+            {
+                if (!IsInUse(*bufIter))
+                {
+                    const uint64_t bufBytes = (uint64_t)bufIter->total()*bufIter->elemsize;
+                    m_pooledBytes -= bufBytes;
+                    releasedBytes += bufBytes;
+                    bufIter = bufList.erase(bufIter);
+                    releaseCnt++;
+                }
+                else
+                    bufIter++;
+            }
+            if (bufList.empty())
+                clsIter = m_sizeClasses.erase(clsIter);
+            else
+                clsIter++;
+        }
+        m_logger->Log(DEBUG) << "Pool '" << m_name << "' released " << releaseCnt << " idle buffers, " << m_pooledBytes << " bytes remain pooled." << endl;
+        return releasedBytes;
+    }
+
+private:
+    ALogger* m_logger;
+    string m_name;
+    mutable mutex m_lock;
+    map<SizeClass, list<ImGui::ImMat>> m_sizeClasses;
+    uint64_t m_highWaterBytes;
+    uint64_t m_pooledBytes{0};
+    MemoryGovernor::Holder m_hMemGov;
+    atomic<uint64_t> m_reportedUsage{0};
+    uint64_t m_acquireCount{0};
+    uint64_t m_reuseCount{0};
+    uint64_t m_allocCount{0};
+    uint64_t m_overflowCount{0};
+};
+
+static const auto IMMAT_POOL_HOLDER_DELETER = [] (ImMatPool* p) {
+    ImMatPool_Impl* ptr = dynamic_cast<ImMatPool_Impl*>(p);
+    delete ptr;
+};
+
+ImMatPool::Holder ImMatPool::CreateInstance(const string& name, uint64_t highWaterBytes)
+{
+    return ImMatPool::Holder(new ImMatPool_Impl(name, highWaterBytes), IMMAT_POOL_HOLDER_DELETER);
+}
+
+static map<string, ImMatPool::Holder> g_sharedMatPools;
+static mutex g_sharedMatPoolsLock;
+
+ImMatPool::Holder ImMatPool::GetSharedInstance(const string& name)
+{
+    lock_guard<mutex> lk(g_sharedMatPoolsLock);
+    auto iter = g_sharedMatPools.find(name);
+    if (iter != g_sharedMatPools.end())
+        return iter->second;
+    auto hPool = CreateInstance(name, IMMAT_POOL_DEFAULT_HIGH_WATER_BYTES);
+    g_sharedMatPools[name] = hPool;
+    return hPool;
+}
+}
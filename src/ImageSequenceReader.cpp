@@ -23,6 +23,7 @@
 #include "MediaReader.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "MemoryGovernor.h"
 #include "DebugHelper.h"
 extern "C"
 {
@@ -35,6 +36,10 @@ using namespace Logger;
 
 namespace MediaCore
 {
+// with 'SetKeepHwFrames()', the hardware frames of the queue beyond this count are still downloaded, so the frames kept on
+// the device and the ones passed on to an encoder do not exhaust the surface pool of the decoder
+static const int32_t MAX_KEPT_HW_FRAMES = 4;
+
 class ImageSequenceReader_Impl : public MediaReader
 {
 public:
@@ -248,6 +253,7 @@ public:
             return;
         }
         m_readForward = forward;
+        m_wakeupEvt.Notify();
     }
 
     void Suspend() override {}
@@ -276,8 +282,8 @@ public:
             eof = false;
             return nullptr;
         }
-        while (!m_quitThread && !m_prepared && wait)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        if (wait)
+            m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
         if (m_close || !m_prepared)
         {
             m_errMsg = "This 'VideoReader' instance is NOT READY to read!";
@@ -303,6 +309,7 @@ public:
         VideoFrame::Holder hVfrm;
         while (!m_quitThread)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             if (!zeroCache)
             {
                 lock_guard<mutex> _lk(m_vfrmQLock);
@@ -340,7 +347,7 @@ public:
             if (hVfrm || !wait)
                 break;
 
-            this_thread::sleep_for(chrono::milliseconds(2));
+            m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
             auto wait2 = GetTimePoint();
             if (CountElapsedMillisec(wait1, wait2) > 3000)
             {
@@ -430,6 +437,33 @@ public:
         throw runtime_error("This interface is NOT SUPPORTED by ImageSequenceReader!");
     }
 
+    void SetReverseBufferFrames(uint32_t frames) override
+    {}
+
+    void EnableScrubMode(bool enable) override
+    {}
+
+    bool IsScrubModeEnabled() const override
+    {
+        return false;
+    }
+
+    void SetMemoryPriority(int32_t priority) override
+    {}
+
+    int32_t GetMemoryPrioritySetting() const override
+    {
+        return MemoryGovernor::PRIORITY_NORMAL;
+    }
+
+    void ResetReadState() override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_opened)
+            SetDirection(true);
+        m_prevReadResult = {0, nullptr};
+    }
+
     bool IsHwAccelEnabled() const override
     {
         return m_vidPreferUseHw;
@@ -440,6 +474,16 @@ public:
         m_vidPreferUseHw = enable;
     }
 
+    void SetVideoConvertThreadCount(uint32_t count) override
+    {
+        m_cvtThreadCount = count;
+    }
+
+    void SetKeepHwFrames(bool keep) override
+    {
+        m_keepHwFrames = keep;
+    }
+
     MediaInfo::Holder GetMediaInfo() const override
     {
         return m_hMediaInfo;
@@ -524,6 +568,7 @@ private:
         ~DecodeImageContext()
         {
             quit = true;
+            owner->m_wakeupEvt.Notify();
             if (m_decThread.joinable())
                 m_decThread.join();
             ReleaseDecoderContext();
@@ -552,6 +597,7 @@ private:
                 lock_guard<mutex> lk(m_vfLock);
                 m_pVfrm = pVfrm;
             }
+            owner->m_wakeupEvt.Notify();
             return true;
         }
 
@@ -731,6 +777,7 @@ private:
         {
             while (!quit)
             {
+                const uint64_t wakeupSeq = owner->m_wakeupEvt.Sequence();
                 bool idleLoop = true;
 
                 if (!imagePath.empty())
@@ -749,10 +796,11 @@ private:
                     ReleaseFormatContext();
                     imagePath.clear();
                     isBusy = false;
+                    owner->m_wakeupEvt.Notify();
                 }
 
                 if (idleLoop)
-                    this_thread::sleep_for(chrono::milliseconds(5));
+                    owner->m_wakeupEvt.Wait(wakeupSeq, owner->m_idleWaitTimeout);
             }
         }
     };
@@ -782,10 +830,7 @@ private:
             }
             if (!frmPtr)
             {
-                while (!frmPtr && !decodeFailed)
-                {
-                    this_thread::sleep_for(chrono::milliseconds(2));
-                }
+                owner->m_wakeupEvt.WaitUntil([this] { return frmPtr || decodeFailed; });
                 if (!frmPtr)
                     return false;
             }
@@ -793,10 +838,11 @@ private:
             // acquire the lock of 'frmPtr'
             while (!owner->m_quitThread)
             {
+                const uint64_t wakeupSeq = owner->m_wakeupEvt.Sequence();
                 bool testVal = false;
                 if (frmPtrInUse.compare_exchange_strong(testVal, true))
                     break;
-                this_thread::sleep_for(chrono::milliseconds(5));
+                owner->m_wakeupEvt.Wait(wakeupSeq, owner->m_idleWaitTimeout);
             }
             if (owner->m_quitThread)
                 return false;
@@ -811,6 +857,7 @@ private:
             frmPtr = nullptr;
             isHwfrm = false;
             frmPtrInUse = false;
+            owner->m_wakeupEvt.Notify();
 
             if (vmat.empty())
                 return false;
@@ -818,6 +865,28 @@ private:
             return true;
         }
 
+        shared_ptr<AVFrame> GetAVFrame() override
+        {
+            if (!frmPtr && vmat.empty())
+                owner->m_wakeupEvt.WaitUntil([this] { return frmPtr || decodeFailed || !vmat.empty(); });
+
+            // acquire the lock of 'frmPtr'
+            while (!owner->m_quitThread)
+            {
+                const uint64_t wakeupSeq = owner->m_wakeupEvt.Sequence();
+                bool testVal = false;
+                if (frmPtrInUse.compare_exchange_strong(testVal, true))
+                    break;
+                owner->m_wakeupEvt.Wait(wakeupSeq, owner->m_idleWaitTimeout);
+            }
+            if (owner->m_quitThread)
+                return nullptr;
+            SelfFreeAVFramePtr avfrm = frmPtr;
+            frmPtrInUse = false;
+            owner->m_wakeupEvt.Notify();
+            return avfrm;
+        }
+
         int64_t Pos() const override { return pos; }
         int64_t Pts() const override { return pts; }
         int64_t Dur() const override { return dur; }
@@ -865,6 +934,7 @@ private:
             m_cacheRange.first--;
             m_cacheRange.second++;
         }
+        m_wakeupEvt.Notify();
     }
 
     int64_t CvtMtsToPts(int64_t mts)
@@ -895,6 +965,7 @@ private:
     void WaitAllThreadsQuit(bool callFromReleaseProc = false)
     {
         m_quitThread = true;
+        m_wakeupEvt.Notify();
         if (m_readImageThread.joinable())
         {
             m_readImageThread.join();
@@ -916,9 +987,10 @@ private:
     {
         bool locked = false;
         do {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             locked = m_apiLock.try_lock();
             if (!locked)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_wakeupEvt.Wait(wakeupSeq, 5);
         } while (!locked && !m_quitThread);
         if (m_quitThread)
         {
@@ -966,9 +1038,15 @@ private:
                 m_errMsg = m_pFrmCvt->GetError();
                 return false;
             }
+            if (!m_pFrmCvt->SetThreadCount(m_cvtThreadCount))
+            {
+                m_errMsg = m_pFrmCvt->GetError();
+                return false;
+            }
         }
 
         m_prepared = true;
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -985,6 +1063,7 @@ private:
 
         while (!m_quitThread)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
 
             pair<int64_t, int64_t> cacheRange;
@@ -1058,7 +1137,9 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
+            else
+                m_wakeupEvt.Notify();
         }
         m_rdimgThdRunning = false;
         m_logger->Log(DEBUG) << "Leave ReadImageThreadProc()." << endl;
@@ -1067,11 +1148,11 @@ private:
     void ConvertMatThreadProc()
     {
         m_logger->Log(DEBUG) << "Enter ConvertMatThreadProc()..." << endl;
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
 
         while (!m_quitThread)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
 
             // remove unused frames and find the next frame needed to do the conversion
@@ -1079,6 +1160,7 @@ private:
             {
                 lock_guard<mutex> _lk(m_vfrmQLock);
                 auto iter = m_vfrmQ.begin();
+                int32_t keptHwfrmCnt = 0;
                 while (iter != m_vfrmQ.end())
                 {
                     VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(iter->get());
@@ -1103,7 +1185,7 @@ private:
                         iter = m_vfrmQ.erase(iter);
                         continue;
                     }
-                    if (!hVfrm && (pVf->isHwfrm || (pVf->bAutoCvtToMat && pVf->frmPtr)))
+                    if (!hVfrm && ((pVf->isHwfrm && (!m_keepHwFrames || ++keptHwfrmCnt > MAX_KEPT_HW_FRAMES)) || (pVf->bAutoCvtToMat && pVf->frmPtr)))
                         hVfrm = *iter;
                     iter++;
                 }
@@ -1116,10 +1198,11 @@ private:
                 // acquire the lock of 'frmPtr'
                 while (!m_quitThread)
                 {
+                    const uint64_t wakeupSeq2 = m_wakeupEvt.Sequence();
                     bool testVal = false;
                     if (pVf->frmPtrInUse.compare_exchange_strong(testVal, true))
                         break;
-                    this_thread::sleep_for(chrono::milliseconds(5));
+                    m_wakeupEvt.Wait(wakeupSeq2, m_idleWaitTimeout);
                 }
 
                 if (pVf->isHwfrm)
@@ -1164,7 +1247,9 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
+            else
+                m_wakeupEvt.Notify();
         }
         m_cnvThdRunning = false;
         m_logger->Log(DEBUG) << "Leave ConvertMatThreadProc()." << endl;
@@ -1183,6 +1268,8 @@ private:
     bool m_readForward{true};
 
     bool m_quitThread{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
     thread m_readImageThread;
     bool m_rdimgThdRunning{false};
     thread m_cnvMatThread;
@@ -1208,6 +1295,8 @@ private:
     list<DecodeImageContext::Holder> m_decCtxs;
     uint8_t m_decWorkerCount{4};
     bool m_vidPreferUseHw{true};
+    uint32_t m_cvtThreadCount{1};
+    bool m_keepHwFrames{false};
     FFUtils::OpenVideoDecoderOptions m_viddecOpenOpts;
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
 
@@ -1,5 +1,6 @@
 #include <cassert>
 #include <cstring>
+#include <atomic>
 #include "MatUtils.h"
 #include "Logger.h"
 
@@ -88,4 +89,16 @@ void CopyAudioMatSamples(ImGui::ImMat& dstMat, const ImGui::ImMat& srcMat, uint3
         memcpy(dstPtr, srcPtr, copySize);
     }
 }
-}
\ No newline at end of file
+
+static atomic<bool> s_simdEnabled{true};
+
+void SetSimdEnabled(bool enable)
+{
+    s_simdEnabled = enable;
+}
+
+bool IsSimdEnabled()
+{
+    return s_simdEnabled;
+}
+}
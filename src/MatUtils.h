@@ -1,9 +1,90 @@
 #pragma once
 #include <cstdint>
+#include <vector>
 #include "MediaCore.h"
 #include "immat.h"
 
 namespace MatUtils
 {
     MEDIACORE_API void CopyAudioMatSamples(ImGui::ImMat& dstMat, const ImGui::ImMat& srcMat, uint32_t dstOffSmpCnt, uint32_t srcOffSmpCnt, uint32_t copySmpCnt = 0);
+
+    // Sum the float sample buffers 'srcs', each one scaled by its gain in 'gains', into 'dst'. All the buffers hold 'sampleCount' values.
+    // 'dst' is overwritten, it's filled with zeros if 'srcCount' is 0.
+    MEDIACORE_API void MixAudioSamples(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount);
+
+    // Accumulate the minimum, the maximum and the sum of squares of the 'sampleCount' float samples of 'src' into
+    // 'minValue', 'maxValue' and 'sumSquares'. The output arguments are not reset, so consecutive runs can be chained.
+    MEDIACORE_API void AccumulateAudioStats(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares);
+
+    // Enable the flush-to-zero and denormals-are-zero modes of the calling thread while this object lives, so the audio processing
+    // does not slow down on the denormal values of decaying signals. The previous modes are restored on destruction.
+    class MEDIACORE_API ScopedFlushDenormals
+    {
+    public:
+        ScopedFlushDenormals(bool enable = true);
+        ~ScopedFlushDenormals();
+        ScopedFlushDenormals(const ScopedFlushDenormals&) = delete;
+        ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+    private:
+        bool m_enabled;
+        uint64_t m_prevState{0};
+    };
+
+    // Blend 'ovlyMat' over 'baseMat' at offset (x, y) into 'dstMat', with the straight alpha 'over' operator.
+    // 'dstMat' can share the buffer with 'baseMat' for in-place blending, otherwise it must be created with the same shape.
+    // Only cpu images of 4 channels with alpha as the last one, and of data type int8, int16 or float32 are supported.
+    MEDIACORE_API bool AlphaBlend(ImGui::ImMat& dstMat, const ImGui::ImMat& baseMat, const ImGui::ImMat& ovlyMat, int32_t x, int32_t y);
+
+    struct BlendLayer
+    {
+        ImGui::ImMat mat;
+        int32_t x{0}, y{0};
+        float opacity{1.f};
+    };
+    // Composite 'layers', ordered from bottom to top, into 'dstMat' in one pass over tiles of 'tileSize'x'tileSize'.
+    // The area not covered by any layer is transparent black. In a tile fully covered by the opaque pixels of a layer,
+    // the layers below that one are skipped. The image requirements are the same as 'AlphaBlend()'.
+    // Only the rows in [rowBegin, rowEnd) are written, so disjoint row bands can be composited concurrently,
+    // a negative 'rowEnd' means the image height.
+    MEDIACORE_API bool CompositeLayers(ImGui::ImMat& dstMat, const std::vector<BlendLayer>& layers, uint32_t tileSize = 64, int32_t rowBegin = 0, int32_t rowEnd = -1);
+
+    // Fill 'dstMat' by sampling 'srcMat' once per output pixel through the affine mapping 'matrix', which maps the output position
+    // (x, y) to the source position (matrix[0]*x+matrix[1]*y+matrix[2], matrix[3]*x+matrix[4]*y+matrix[5]). The positions are in
+    // pixel units with the center of pixel (i, j) at (i+0.5, j+0.5). Only the source area in the clip rectangle is sampled, the
+    // rest reads as transparent black. 'dstMat' must be created beforehand, the image requirements are the same as 'AlphaBlend()'.
+    // When the mapping shrinks the source to less than the half, bilinear and bicubic average the footprint of each output pixel
+    // instead, so the skipped source pixels do not alias.
+    MEDIACORE_API bool WarpAffine(ImGui::ImMat& dstMat, const ImGui::ImMat& srcMat, const float matrix[6],
+            int32_t clipX, int32_t clipY, int32_t clipW, int32_t clipH, ImInterpolateMode interp = IM_INTERPOLATE_BICUBIC);
+
+    // A 4:2:0 YUV image in memory, e.g. the planes of a decoded AVFrame. The chroma samples are either in the planes 1 and 2 (YUV420P),
+    // or interleaved as U,V pairs in plane 1 with 'interleavedChroma' (NV12, P010), then 'data[2]' is not used. Samples of more than
+    // 8 bits are little-endian 16-bit words, with the value shifted up by 'sampleShift' bits (6 for P010). 'lineSize' is in bytes.
+    struct YuvImage
+    {
+        const uint8_t* data[3]{nullptr, nullptr, nullptr};
+        int32_t lineSize[3]{0, 0, 0};
+        int32_t width{0}, height{0};
+        int32_t bitDepth{8};
+        int32_t sampleShift{0};
+        bool interleavedChroma{false};
+        ImColorSpace colorSpace{IM_CS_BT709};
+        ImColorRange colorRange{IM_CR_NARROW_RANGE};
+    };
+    // Convert 'srcImg' to RGBA float32 with the values normalized to [0, 1] and alpha set to 1. The chroma is upsampled by replication.
+    // 'dstMat' must be a cpu image created with the size of 'srcImg' and 4 channels of float32. Only the rows in [rowBegin, rowEnd) are
+    // written, so disjoint row bands can be converted concurrently, a negative 'rowEnd' means the image height.
+    MEDIACORE_API bool ConvertYuv420ToRgbaFloat(ImGui::ImMat& dstMat, const YuvImage& srcImg, int32_t rowBegin = 0, int32_t rowEnd = -1);
+
+    // Halve the 8-bit image plane 'src' by averaging each 2x2 block of samples into one sample of 'dst'. A sample is made of
+    // 'sampleSize' interleaved bytes, e.g. 2 for the U,V pairs of NV12, and each byte is averaged separately. 'dstWidth' and
+    // 'dstHeight' are in samples, 'src' must hold at least 2*dstWidth x 2*dstHeight samples. 'lineSize' is in bytes.
+    MEDIACORE_API void DownscalePlaneBox2x(uint8_t* dst, int32_t dstLineSize, const uint8_t* src, int32_t srcLineSize,
+            int32_t dstWidth, int32_t dstHeight, int32_t sampleSize = 1);
+
+    // Let the functions above run the SIMD kernels selected for the cpu, which is the default, or force their portable scalar code,
+    // e.g. to verify both give the same results. It should only be switched while none of these functions is running.
+    MEDIACORE_API void SetSimdEnabled(bool enable);
+    MEDIACORE_API bool IsSimdEnabled();
 }
\ No newline at end of file
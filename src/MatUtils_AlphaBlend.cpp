@@ -0,0 +1,394 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+#include "MatUtils.h"
+#include "MatUtils_Simd.h"
+
+using namespace std;
+
+namespace MatUtils
+{
+// The straight alpha 'over' operator, all values are normalized to [0, 1]
+//   ovlyA = ovlyAlpha*opacity
+//   outA = ovlyA+baseA*(1-ovlyA)
+//   outC = (ovlyC*ovlyA+baseC*baseA*(1-ovlyA))/outA, or 0 if outA is 0
+template<typename T> struct PixelTraits;
+template<> struct PixelTraits<uint8_t>
+{
+    static constexpr float MAX_VALUE = 255.f;
+    static uint8_t FromFloat(float v) { return (uint8_t)(v <= 0.f ? 0 : v >= 255.f ? 255 : (int)(v+0.5f)); }
+};
+template<> struct PixelTraits<uint16_t>
+{
+    static constexpr float MAX_VALUE = 65535.f;
+    static uint16_t FromFloat(float v) { return (uint16_t)(v <= 0.f ? 0 : v >= 65535.f ? 65535 : (int)(v+0.5f)); }
+};
+template<> struct PixelTraits<float>
+{
+    static constexpr float MAX_VALUE = 1.f;
+    static float FromFloat(float v) { return v; }
+};
+
+using BlendRowFunction = void (*)(void* dst, const void* base, const void* ovly, int pixelCount, float opacity);
+
+template<typename T>
+static void BlendRow_Scalar(void* dst, const void* base, const void* ovly, int pixelCount, float opacity)
+{
+    const float maxValue = PixelTraits<T>::MAX_VALUE;
+    const float invMax = 1.f/maxValue;
+    const float ovlyAlphaScale = invMax*opacity;
+    T* d = (T*)dst;
+    const T* b = (const T*)base;
+    const T* o = (const T*)ovly;
+    for (int i = 0; i < pixelCount; i++, d += 4, b += 4, o += 4)
+    {
+        const float ao = (float)o[3]*ovlyAlphaScale;
+        const float wb = (float)b[3]*invMax*(1.f-ao);
+        const float aOut = ao+wb;
+        const float invAOut = aOut > 0.f ? 1.f/aOut : 0.f;
+        for (int c = 0; c < 3; c++)
+            d[c] = PixelTraits<T>::FromFloat(((float)o[c]*ao+(float)b[c]*wb)*invAOut);
+        d[3] = PixelTraits<T>::FromFloat(aOut*maxValue);
+    }
+}
+
+#if MATUTILS_SIMD_X86
+MATUTILS_TARGET("sse4.1")
+static inline __m128 BlendPixel_Sse(__m128 o, __m128 b, __m128 ovlyAlphaScale, __m128 invMax, __m128 maxValue)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 ao = _mm_mul_ps(_mm_shuffle_ps(o, o, _MM_SHUFFLE(3, 3, 3, 3)), ovlyAlphaScale);
+    __m128 wb = _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3)), invMax), _mm_sub_ps(one, ao));
+    __m128 aOut = _mm_add_ps(ao, wb);
+    __m128 c = _mm_add_ps(_mm_mul_ps(o, ao), _mm_mul_ps(b, wb));
+    __m128 nonZero = _mm_cmpgt_ps(aOut, zero);
+    c = _mm_and_ps(_mm_div_ps(c, _mm_max_ps(aOut, _mm_set1_ps(1e-20f))), nonZero);
+    return _mm_blend_ps(c, _mm_mul_ps(aOut, maxValue), 0x8);
+}
+
+template<typename T>
+MATUTILS_TARGET("sse4.1")
+static void BlendRow_Sse41(void* dst, const void* base, const void* ovly, int pixelCount, float opacity)
+{
+    const __m128 maxValue = _mm_set1_ps(PixelTraits<T>::MAX_VALUE);
+    const __m128 invMax = _mm_set1_ps(1.f/PixelTraits<T>::MAX_VALUE);
+    const __m128 ovlyAlphaScale = _mm_set1_ps(opacity/PixelTraits<T>::MAX_VALUE);
+    T* d = (T*)dst;
+    const T* b = (const T*)base;
+    const T* o = (const T*)ovly;
+    for (int i = 0; i < pixelCount; i++, d += 4, b += 4, o += 4)
+        StorePixel_Sse(d, BlendPixel_Sse(LoadPixel_Sse(o), LoadPixel_Sse(b), ovlyAlphaScale, invMax, maxValue));
+}
+
+// avx2 kernels process 2 pixels in one 256-bit register, one pixel in each 128-bit lane
+MATUTILS_TARGET("avx2")
+static inline __m256 LoadPixels_Avx2(const uint8_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+MATUTILS_TARGET("avx2")
+static inline __m256 LoadPixels_Avx2(const uint16_t* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)));
+}
+
+MATUTILS_TARGET("avx2")
+static inline __m256 LoadPixels_Avx2(const float* p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+MATUTILS_TARGET("avx2")
+static inline void StorePixels_Avx2(uint8_t* p, __m256 v)
+{
+    __m256i i32 = _mm256_cvtps_epi32(v);
+    __m128i i16 = _mm_packus_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1));
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(i16, i16));
+}
+
+MATUTILS_TARGET("avx2")
+static inline void StorePixels_Avx2(uint16_t* p, __m256 v)
+{
+    __m256i i32 = _mm256_cvtps_epi32(v);
+    _mm_storeu_si128((__m128i*)p, _mm_packus_epi32(_mm256_castsi256_si128(i32), _mm256_extracti128_si256(i32, 1)));
+}
+
+MATUTILS_TARGET("avx2")
+static inline void StorePixels_Avx2(float* p, __m256 v)
+{
+    _mm256_storeu_ps(p, v);
+}
+
+template<typename T>
+MATUTILS_TARGET("avx2")
+static void BlendRow_Avx2(void* dst, const void* base, const void* ovly, int pixelCount, float opacity)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 tiny = _mm256_set1_ps(1e-20f);
+    const __m256 maxValue = _mm256_set1_ps(PixelTraits<T>::MAX_VALUE);
+    const __m256 invMax = _mm256_set1_ps(1.f/PixelTraits<T>::MAX_VALUE);
+    const __m256 ovlyAlphaScale = _mm256_set1_ps(opacity/PixelTraits<T>::MAX_VALUE);
+    T* d = (T*)dst;
+    const T* b = (const T*)base;
+    const T* o = (const T*)ovly;
+    int i = 0;
+    for (; i+2 <= pixelCount; i += 2, d += 8, b += 8, o += 8)
+    {
+        __m256 ov = LoadPixels_Avx2(o);
+        __m256 bv = LoadPixels_Avx2(b);
+        __m256 ao = _mm256_mul_ps(_mm256_permute_ps(ov, _MM_SHUFFLE(3, 3, 3, 3)), ovlyAlphaScale);
+        __m256 wb = _mm256_mul_ps(_mm256_mul_ps(_mm256_permute_ps(bv, _MM_SHUFFLE(3, 3, 3, 3)), invMax), _mm256_sub_ps(one, ao));
+        __m256 aOut = _mm256_add_ps(ao, wb);
+        __m256 c = _mm256_add_ps(_mm256_mul_ps(ov, ao), _mm256_mul_ps(bv, wb));
+        __m256 nonZero = _mm256_cmp_ps(aOut, zero, _CMP_GT_OQ);
+        c = _mm256_and_ps(_mm256_div_ps(c, _mm256_max_ps(aOut, tiny)), nonZero);
+        StorePixels_Avx2(d, _mm256_blend_ps(c, _mm256_mul_ps(aOut, maxValue), 0x88));
+    }
+    if (i < pixelCount)
+        BlendRow_Sse41<T>(d, b, o, pixelCount-i, opacity);
+}
+
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+template<typename T>
+static void BlendRow_Neon(void* dst, const void* base, const void* ovly, int pixelCount, float opacity)
+{
+    const float maxValue = PixelTraits<T>::MAX_VALUE;
+    const float invMax = 1.f/maxValue;
+    const float ovlyAlphaScale = invMax*opacity;
+    const float32x4_t one = vdupq_n_f32(1.f);
+    T* d = (T*)dst;
+    const T* b = (const T*)base;
+    const T* o = (const T*)ovly;
+    for (int i = 0; i < pixelCount; i++, d += 4, b += 4, o += 4)
+    {
+        float32x4_t ov = LoadPixel_Neon(o);
+        float32x4_t bv = LoadPixel_Neon(b);
+        float32x4_t ao = vdupq_n_f32(vgetq_lane_f32(ov, 3)*ovlyAlphaScale);
+        float32x4_t wb = vmulq_f32(vdupq_n_f32(vgetq_lane_f32(bv, 3)*invMax), vsubq_f32(one, ao));
+        float32x4_t aOut = vaddq_f32(ao, wb);
+        float32x4_t c = vaddq_f32(vmulq_f32(ov, ao), vmulq_f32(bv, wb));
+        // reciprocal estimate refined by two newton-raphson steps, armv7 has no vector division
+        float32x4_t safeAOut = vmaxq_f32(aOut, vdupq_n_f32(1e-20f));
+        float32x4_t recip = vrecpeq_f32(safeAOut);
+        recip = vmulq_f32(vrecpsq_f32(safeAOut, recip), recip);
+        recip = vmulq_f32(vrecpsq_f32(safeAOut, recip), recip);
+        uint32x4_t nonZero = vcgtq_f32(aOut, vdupq_n_f32(0.f));
+        c = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_f32(c, recip)), nonZero));
+        c = vsetq_lane_f32(vgetq_lane_f32(aOut, 0)*maxValue, c, 3);
+        StorePixel_Neon(d, c);
+    }
+}
+#endif // MATUTILS_SIMD_NEON
+
+template<typename T>
+static BlendRowFunction SelectBlendRowFunction()
+{
+#if MATUTILS_SIMD_X86
+    if (CpuSupportsAvx2())
+        return BlendRow_Avx2<T>;
+    if (CpuSupportsSse41())
+        return BlendRow_Sse41<T>;
+#elif MATUTILS_SIMD_NEON
+    return BlendRow_Neon<T>;
+#endif
+    return BlendRow_Scalar<T>;
+}
+
+static BlendRowFunction GetBlendRowFunction(ImDataType dtype)
+{
+    static const BlendRowFunction s_blendRowU8 = SelectBlendRowFunction<uint8_t>();
+    static const BlendRowFunction s_blendRowU16 = SelectBlendRowFunction<uint16_t>();
+    static const BlendRowFunction s_blendRowF32 = SelectBlendRowFunction<float>();
+    const bool simdEnabled = IsSimdEnabled();
+    switch (dtype)
+    {
+    case IM_DT_INT8:
+        return simdEnabled ? s_blendRowU8 : BlendRow_Scalar<uint8_t>;
+    case IM_DT_INT16:
+        return simdEnabled ? s_blendRowU16 : BlendRow_Scalar<uint16_t>;
+    case IM_DT_FLOAT32:
+        return simdEnabled ? s_blendRowF32 : BlendRow_Scalar<float>;
+    default:
+        return nullptr;
+    }
+}
+
+bool AlphaBlend(ImGui::ImMat& dstMat, const ImGui::ImMat& baseMat, const ImGui::ImMat& ovlyMat, int32_t x, int32_t y)
+{
+    if (baseMat.empty() || ovlyMat.empty() || dstMat.empty())
+        return false;
+    if (baseMat.device != IM_DD_CPU || ovlyMat.device != IM_DD_CPU || dstMat.device != IM_DD_CPU)
+        return false;
+    if (baseMat.c != 4 || ovlyMat.c != 4 || ovlyMat.type != baseMat.type)
+        return false;
+    if (dstMat.w != baseMat.w || dstMat.h != baseMat.h || dstMat.c != baseMat.c || dstMat.type != baseMat.type)
+        return false;
+    BlendRowFunction blendRow = GetBlendRowFunction(baseMat.type);
+    if (!blendRow)
+        return false;
+
+    const bool inPlace = dstMat.data == baseMat.data;
+    const size_t pixelSize = 4*baseMat.elemsize;
+    const size_t baseLineSize = baseMat.w*pixelSize;
+    const size_t ovlyLineSize = ovlyMat.w*pixelSize;
+    const int x0 = max(x, 0);
+    const int y0 = max(y, 0);
+    const int x1 = min(x+ovlyMat.w, baseMat.w);
+    const int y1 = min(y+ovlyMat.h, baseMat.h);
+    const bool hasIntersection = x0 < x1 && y0 < y1;
+
+    const uint8_t* basePtr = (const uint8_t*)baseMat.data;
+    uint8_t* dstPtr = (uint8_t*)dstMat.data;
+    for (int i = 0; i < baseMat.h; i++, basePtr += baseLineSize, dstPtr += baseLineSize)
+    {
+        if (!hasIntersection || i < y0 || i >= y1)
+        {
+            if (!inPlace)
+                memcpy(dstPtr, basePtr, baseLineSize);
+            continue;
+        }
+        if (!inPlace)
+        {
+            memcpy(dstPtr, basePtr, x0*pixelSize);
+            memcpy(dstPtr+x1*pixelSize, basePtr+x1*pixelSize, (baseMat.w-x1)*pixelSize);
+        }
+        const uint8_t* ovlyPtr = (const uint8_t*)ovlyMat.data+(i-y)*ovlyLineSize+(x0-x)*pixelSize;
+        blendRow(dstPtr+x0*pixelSize, basePtr+x0*pixelSize, ovlyPtr, x1-x0, 1.f);
+    }
+    return true;
+}
+
+template<typename T>
+static bool IsOpaqueArea(const ImGui::ImMat& mat, int x, int y, int w, int h)
+{
+    const T maxValue = (T)PixelTraits<T>::MAX_VALUE;
+    for (int i = 0; i < h; i++)
+    {
+        const T* p = (const T*)mat.data+((size_t)(y+i)*mat.w+x)*4+3;
+        for (int j = 0; j < w; j++, p += 4)
+        {
+            if (*p < maxValue)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool IsOpaqueArea(const ImGui::ImMat& mat, int x, int y, int w, int h)
+{
+    switch (mat.type)
+    {
+    case IM_DT_INT8:
+        return IsOpaqueArea<uint8_t>(mat, x, y, w, h);
+    case IM_DT_INT16:
+        return IsOpaqueArea<uint16_t>(mat, x, y, w, h);
+    case IM_DT_FLOAT32:
+        return IsOpaqueArea<float>(mat, x, y, w, h);
+    default:
+        return false;
+    }
+}
+
+bool CompositeLayers(ImGui::ImMat& dstMat, const vector<BlendLayer>& layers, uint32_t tileSize, int32_t rowBegin, int32_t rowEnd)
+{
+    if (dstMat.empty() || dstMat.device != IM_DD_CPU || dstMat.c != 4 || tileSize == 0)
+        return false;
+    if (rowEnd < 0 || rowEnd > dstMat.h)
+        rowEnd = dstMat.h;
+    if (rowBegin < 0 || rowBegin >= rowEnd)
+        return false;
+    BlendRowFunction blendRow = GetBlendRowFunction(dstMat.type);
+    if (!blendRow)
+        return false;
+    for (auto& layer : layers)
+    {
+        if (layer.mat.empty() || layer.mat.device != IM_DD_CPU || layer.mat.c != 4 || layer.mat.type != dstMat.type)
+            return false;
+    }
+
+    const size_t pixelSize = 4*dstMat.elemsize;
+    const size_t dstLineSize = dstMat.w*pixelSize;
+    const int layerCnt = (int)layers.size();
+    for (int ty = rowBegin; ty < rowEnd; ty += (int)tileSize)
+    {
+        const int th = min((int)tileSize, rowEnd-ty);
+        for (int tx = 0; tx < dstMat.w; tx += (int)tileSize)
+        {
+            const int tw = min((int)tileSize, dstMat.w-tx);
+            // find the top-most layer covering the whole tile with opaque pixels, the layers below it are invisible
+            int startIdx = -1;
+            for (int i = layerCnt-1; i >= 0; i--)
+            {
+                auto& layer = layers[i];
+                if (layer.opacity <= 0.f)
+                    continue;
+                if (layer.opacity >= 1.f && layer.x <= tx && layer.y <= ty &&
+                    layer.x+layer.mat.w >= tx+tw && layer.y+layer.mat.h >= ty+th &&
+                    IsOpaqueArea(layer.mat, tx-layer.x, ty-layer.y, tw, th))
+                {
+                    startIdx = i;
+                    break;
+                }
+            }
+
+            uint8_t* dstTilePtr = (uint8_t*)dstMat.data+ty*dstLineSize+tx*pixelSize;
+            if (startIdx >= 0)
+            {
+                auto& layer = layers[startIdx];
+                const size_t srcLineSize = layer.mat.w*pixelSize;
+                const uint8_t* srcPtr = (const uint8_t*)layer.mat.data+(ty-layer.y)*srcLineSize+(tx-layer.x)*pixelSize;
+                uint8_t* dstPtr = dstTilePtr;
+                for (int i = 0; i < th; i++, srcPtr += srcLineSize, dstPtr += dstLineSize)
+                    memcpy(dstPtr, srcPtr, tw*pixelSize);
+            }
+            else
+            {
+                uint8_t* dstPtr = dstTilePtr;
+                for (int i = 0; i < th; i++, dstPtr += dstLineSize)
+                    memset(dstPtr, 0, tw*pixelSize);
+            }
+
+            for (int li = startIdx+1; li < layerCnt; li++)
+            {
+                auto& layer = layers[li];
+                if (layer.opacity <= 0.f)
+                    continue;
+                const int x0 = max(tx, layer.x);
+                const int y0 = max(ty, layer.y);
+                const int x1 = min(tx+tw, layer.x+layer.mat.w);
+                const int y1 = min(ty+th, layer.y+layer.mat.h);
+                if (x0 >= x1 || y0 >= y1)
+                    continue;
+                const size_t srcLineSize = layer.mat.w*pixelSize;
+                const uint8_t* srcPtr = (const uint8_t*)layer.mat.data+(y0-layer.y)*srcLineSize+(x0-layer.x)*pixelSize;
+                uint8_t* dstPtr = (uint8_t*)dstMat.data+y0*dstLineSize+x0*pixelSize;
+                const float opacity = min(layer.opacity, 1.f);
+                for (int i = y0; i < y1; i++, srcPtr += srcLineSize, dstPtr += dstLineSize)
+                    blendRow(dstPtr, dstPtr, srcPtr, x1-x0, opacity);
+            }
+        }
+    }
+    return true;
+}
+}
@@ -0,0 +1,307 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+#include "MatUtils.h"
+#include "MatUtils_Simd.h"
+
+using namespace std;
+
+namespace MatUtils
+{
+// The sources are summed in groups of up to 4, so 'dst' is loaded and stored once per group instead of once per source.
+static const uint32_t MIX_GROUP_SIZE = 4;
+
+using MixSamplesFunction = void (*)(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount);
+
+static void MixSamples_Scalar(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount)
+{
+    for (uint32_t k = 0; k < srcCount; k += MIX_GROUP_SIZE)
+    {
+        const uint32_t n = min(srcCount-k, MIX_GROUP_SIZE);
+        const bool accumulate = k > 0;
+        for (uint32_t i = 0; i < sampleCount; i++)
+        {
+            float acc = accumulate ? dst[i] : 0.f;
+            for (uint32_t j = 0; j < n; j++)
+                acc += srcs[k+j][i]*gains[k+j];
+            dst[i] = acc;
+        }
+    }
+}
+
+#if MATUTILS_SIMD_X86
+MATUTILS_TARGET("sse2")
+static void MixSamples_Sse2(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount)
+{
+    for (uint32_t k = 0; k < srcCount; k += MIX_GROUP_SIZE)
+    {
+        const uint32_t n = min(srcCount-k, MIX_GROUP_SIZE);
+        const bool accumulate = k > 0;
+        __m128 g[MIX_GROUP_SIZE];
+        for (uint32_t j = 0; j < n; j++)
+            g[j] = _mm_set1_ps(gains[k+j]);
+        uint32_t i = 0;
+        for (; i+4 <= sampleCount; i += 4)
+        {
+            __m128 acc = accumulate ? _mm_loadu_ps(dst+i) : _mm_setzero_ps();
+            for (uint32_t j = 0; j < n; j++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(srcs[k+j]+i), g[j]));
+            _mm_storeu_ps(dst+i, acc);
+        }
+        for (; i < sampleCount; i++)
+        {
+            float acc = accumulate ? dst[i] : 0.f;
+            for (uint32_t j = 0; j < n; j++)
+                acc += srcs[k+j][i]*gains[k+j];
+            dst[i] = acc;
+        }
+    }
+}
+
+MATUTILS_TARGET("avx")
+static void MixSamples_Avx(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount)
+{
+    for (uint32_t k = 0; k < srcCount; k += MIX_GROUP_SIZE)
+    {
+        const uint32_t n = min(srcCount-k, MIX_GROUP_SIZE);
+        const bool accumulate = k > 0;
+        __m256 g[MIX_GROUP_SIZE];
+        for (uint32_t j = 0; j < n; j++)
+            g[j] = _mm256_set1_ps(gains[k+j]);
+        uint32_t i = 0;
+        for (; i+8 <= sampleCount; i += 8)
+        {
+            __m256 acc = accumulate ? _mm256_loadu_ps(dst+i) : _mm256_setzero_ps();
+            for (uint32_t j = 0; j < n; j++)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(srcs[k+j]+i), g[j]));
+            _mm256_storeu_ps(dst+i, acc);
+        }
+        for (; i < sampleCount; i++)
+        {
+            float acc = accumulate ? dst[i] : 0.f;
+            for (uint32_t j = 0; j < n; j++)
+                acc += srcs[k+j][i]*gains[k+j];
+            dst[i] = acc;
+        }
+    }
+    _mm256_zeroupper();
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+static void MixSamples_Neon(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount)
+{
+    for (uint32_t k = 0; k < srcCount; k += MIX_GROUP_SIZE)
+    {
+        const uint32_t n = min(srcCount-k, MIX_GROUP_SIZE);
+        const bool accumulate = k > 0;
+        uint32_t i = 0;
+        for (; i+4 <= sampleCount; i += 4)
+        {
+            float32x4_t acc = accumulate ? vld1q_f32(dst+i) : vdupq_n_f32(0.f);
+            for (uint32_t j = 0; j < n; j++)
+                acc = vmlaq_n_f32(acc, vld1q_f32(srcs[k+j]+i), gains[k+j]);
+            vst1q_f32(dst+i, acc);
+        }
+        for (; i < sampleCount; i++)
+        {
+            float acc = accumulate ? dst[i] : 0.f;
+            for (uint32_t j = 0; j < n; j++)
+                acc += srcs[k+j][i]*gains[k+j];
+            dst[i] = acc;
+        }
+    }
+}
+#endif // MATUTILS_SIMD_NEON
+
+static MixSamplesFunction SelectMixSamplesFunction()
+{
+#if MATUTILS_SIMD_X86
+    if (CpuSupportsAvx())
+        return MixSamples_Avx;
+#if defined(__SSE2__) || defined(_M_X64)
+    // sse2 is always available on x86-64
+    return MixSamples_Sse2;
+#endif
+#elif MATUTILS_SIMD_NEON
+    return MixSamples_Neon;
+#endif
+    return MixSamples_Scalar;
+}
+
+void MixAudioSamples(float* dst, const float* const* srcs, const float* gains, uint32_t srcCount, uint32_t sampleCount)
+{
+    if (srcCount == 0)
+    {
+        memset(dst, 0, sampleCount*sizeof(float));
+        return;
+    }
+    static const MixSamplesFunction s_mixSamples = SelectMixSamplesFunction();
+    const MixSamplesFunction mixSamples = IsSimdEnabled() ? s_mixSamples : MixSamples_Scalar;
+    mixSamples(dst, srcs, gains, srcCount, sampleCount);
+}
+
+using AccumulateStatsFunction = void (*)(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares);
+
+static void AccumulateStats_Scalar(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares)
+{
+    float mn = minValue, mx = maxValue, sq = sumSquares;
+    for (uint32_t i = 0; i < sampleCount; i++)
+    {
+        const float v = src[i];
+        mn = v < mn ? v : mn;
+        mx = v > mx ? v : mx;
+        sq += v*v;
+    }
+    minValue = mn; maxValue = mx; sumSquares = sq;
+}
+
+#if MATUTILS_SIMD_X86
+MATUTILS_TARGET("sse2")
+static void AccumulateStats_Sse2(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares)
+{
+    uint32_t i = 0;
+    if (sampleCount >= 4)
+    {
+        __m128 mn = _mm_set1_ps(minValue), mx = _mm_set1_ps(maxValue), sq = _mm_setzero_ps();
+        for (; i+4 <= sampleCount; i += 4)
+        {
+            const __m128 v = _mm_loadu_ps(src+i);
+            mn = _mm_min_ps(mn, v);
+            mx = _mm_max_ps(mx, v);
+            sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, mn);
+        minValue = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+        _mm_storeu_ps(lanes, mx);
+        maxValue = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+        _mm_storeu_ps(lanes, sq);
+        sumSquares += (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+    }
+    AccumulateStats_Scalar(src+i, sampleCount-i, minValue, maxValue, sumSquares);
+}
+
+MATUTILS_TARGET("avx")
+static void AccumulateStats_Avx(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares)
+{
+    uint32_t i = 0;
+    if (sampleCount >= 8)
+    {
+        __m256 mn = _mm256_set1_ps(minValue), mx = _mm256_set1_ps(maxValue), sq = _mm256_setzero_ps();
+        for (; i+8 <= sampleCount; i += 8)
+        {
+            const __m256 v = _mm256_loadu_ps(src+i);
+            mn = _mm256_min_ps(mn, v);
+            mx = _mm256_max_ps(mx, v);
+            sq = _mm256_add_ps(sq, _mm256_mul_ps(v, v));
+        }
+        float lanes[8];
+        _mm256_storeu_ps(lanes, mn);
+        minValue = *min_element(lanes, lanes+8);
+        _mm256_storeu_ps(lanes, mx);
+        maxValue = *max_element(lanes, lanes+8);
+        _mm256_storeu_ps(lanes, sq);
+        sumSquares += ((lanes[0]+lanes[1])+(lanes[2]+lanes[3]))+((lanes[4]+lanes[5])+(lanes[6]+lanes[7]));
+        _mm256_zeroupper();
+    }
+    AccumulateStats_Scalar(src+i, sampleCount-i, minValue, maxValue, sumSquares);
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+static void AccumulateStats_Neon(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares)
+{
+    uint32_t i = 0;
+    if (sampleCount >= 4)
+    {
+        float32x4_t mn = vdupq_n_f32(minValue), mx = vdupq_n_f32(maxValue), sq = vdupq_n_f32(0.f);
+        for (; i+4 <= sampleCount; i += 4)
+        {
+            const float32x4_t v = vld1q_f32(src+i);
+            mn = vminq_f32(mn, v);
+            mx = vmaxq_f32(mx, v);
+            sq = vmlaq_f32(sq, v, v);
+        }
+        float lanes[4];
+        vst1q_f32(lanes, mn);
+        minValue = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+        vst1q_f32(lanes, mx);
+        maxValue = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+        vst1q_f32(lanes, sq);
+        sumSquares += (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+    }
+    AccumulateStats_Scalar(src+i, sampleCount-i, minValue, maxValue, sumSquares);
+}
+#endif // MATUTILS_SIMD_NEON
+
+static AccumulateStatsFunction SelectAccumulateStatsFunction()
+{
+#if MATUTILS_SIMD_X86
+    if (CpuSupportsAvx())
+        return AccumulateStats_Avx;
+#if defined(__SSE2__) || defined(_M_X64)
+    return AccumulateStats_Sse2;
+#endif
+#elif MATUTILS_SIMD_NEON
+    return AccumulateStats_Neon;
+#endif
+    return AccumulateStats_Scalar;
+}
+
+void AccumulateAudioStats(const float* src, uint32_t sampleCount, float& minValue, float& maxValue, float& sumSquares)
+{
+    static const AccumulateStatsFunction s_accumulateStats = SelectAccumulateStatsFunction();
+    const AccumulateStatsFunction accumulateStats = IsSimdEnabled() ? s_accumulateStats : AccumulateStats_Scalar;
+    accumulateStats(src, sampleCount, minValue, maxValue, sumSquares);
+}
+
+ScopedFlushDenormals::ScopedFlushDenormals(bool enable)
+    : m_enabled(enable)
+{
+    if (!m_enabled)
+        return;
+#if MATUTILS_SIMD_X86
+    // FTZ is bit 15 and DAZ is bit 6 of MXCSR
+    const uint32_t csr = _mm_getcsr();
+    m_prevState = csr;
+    _mm_setcsr(csr|0x8040);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    // FZ is bit 24 of FPCR
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    m_prevState = fpcr;
+    fpcr |= (1ULL<<24);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#else
+    m_enabled = false;
+#endif
+}
+
+ScopedFlushDenormals::~ScopedFlushDenormals()
+{
+    if (!m_enabled)
+        return;
+#if MATUTILS_SIMD_X86
+    _mm_setcsr((uint32_t)m_prevState);
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(m_prevState));
+#endif
+}
+}
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MatUtils.h"
+#include "MatUtils_Simd.h"
+
+using namespace std;
+
+namespace MatUtils
+{
+using DownscaleRowFunction = void (*)(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int32_t dstWidth, int32_t sampleSize);
+
+static void DownscaleRowBox2x_Scalar(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int32_t dstWidth, int32_t sampleSize)
+{
+    for (int32_t x = 0; x < dstWidth; x++)
+    {
+        for (int32_t c = 0; c < sampleSize; c++)
+        {
+            const int32_t i = 2*x*sampleSize+c;
+            dst[x*sampleSize+c] = (uint8_t)((src0[i]+src0[i+sampleSize]+src1[i]+src1[i+sampleSize]+2)>>2);
+        }
+    }
+}
+
+#if MATUTILS_SIMD_X86
+MATUTILS_TARGET("sse2")
+static inline __m128i SumPairs_Sse2(__m128i v)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    return _mm_add_epi16(_mm_and_si128(v, lowMask), _mm_srli_epi16(v, 8));
+}
+
+MATUTILS_TARGET("sse2")
+static void DownscaleRowBox2x_Sse2(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int32_t dstWidth, int32_t sampleSize)
+{
+    // the interleaved samples average bytes 'sampleSize' apart, only the planar case is vectorized
+    if (sampleSize != 1)
+    {
+        DownscaleRowBox2x_Scalar(dst, src0, src1, dstWidth, sampleSize);
+        return;
+    }
+    const __m128i round = _mm_set1_epi16(2);
+    int32_t x = 0;
+    for (; x+16 <= dstWidth; x += 16)
+    {
+        const uint8_t* p0 = src0+2*x;
+        const uint8_t* p1 = src1+2*x;
+        __m128i lo = _mm_add_epi16(SumPairs_Sse2(_mm_loadu_si128((const __m128i*)p0)), SumPairs_Sse2(_mm_loadu_si128((const __m128i*)p1)));
+        __m128i hi = _mm_add_epi16(SumPairs_Sse2(_mm_loadu_si128((const __m128i*)(p0+16))), SumPairs_Sse2(_mm_loadu_si128((const __m128i*)(p1+16))));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+        _mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+    }
+    DownscaleRowBox2x_Scalar(dst+x, src0+2*x, src1+2*x, dstWidth-x, 1);
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+static void DownscaleRowBox2x_Neon(uint8_t* dst, const uint8_t* src0, const uint8_t* src1, int32_t dstWidth, int32_t sampleSize)
+{
+    if (sampleSize != 1)
+    {
+        DownscaleRowBox2x_Scalar(dst, src0, src1, dstWidth, sampleSize);
+        return;
+    }
+    int32_t x = 0;
+    for (; x+16 <= dstWidth; x += 16)
+    {
+        const uint8_t* p0 = src0+2*x;
+        const uint8_t* p1 = src1+2*x;
+        uint16x8_t lo = vpadalq_u8(vpaddlq_u8(vld1q_u8(p0)), vld1q_u8(p1));
+        uint16x8_t hi = vpadalq_u8(vpaddlq_u8(vld1q_u8(p0+16)), vld1q_u8(p1+16));
+        vst1q_u8(dst+x, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+    DownscaleRowBox2x_Scalar(dst+x, src0+2*x, src1+2*x, dstWidth-x, 1);
+}
+#endif // MATUTILS_SIMD_NEON
+
+static DownscaleRowFunction SelectDownscaleRowFunction()
+{
+#if MATUTILS_SIMD_X86
+#if defined(__SSE2__) || defined(_M_X64)
+    return DownscaleRowBox2x_Sse2;
+#endif
+#elif MATUTILS_SIMD_NEON
+    return DownscaleRowBox2x_Neon;
+#endif
+    return DownscaleRowBox2x_Scalar;
+}
+
+void DownscalePlaneBox2x(uint8_t* dst, int32_t dstLineSize, const uint8_t* src, int32_t srcLineSize, int32_t dstWidth, int32_t dstHeight, int32_t sampleSize)
+{
+    static const DownscaleRowFunction s_downscaleRow = SelectDownscaleRowFunction();
+    const DownscaleRowFunction downscaleRow = IsSimdEnabled() ? s_downscaleRow : DownscaleRowBox2x_Scalar;
+    for (int32_t y = 0; y < dstHeight; y++)
+    {
+        const uint8_t* src0 = src+(int64_t)(2*y)*srcLineSize;
+        downscaleRow(dst+(int64_t)y*dstLineSize, src0, src0+srcLineSize, dstWidth, sampleSize);
+    }
+}
+}
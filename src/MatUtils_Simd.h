@@ -0,0 +1,168 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+// Internal helpers shared by the SIMD kernels of MatUtils. The kernels are compiled with per-function
+// target attributes and selected at runtime, so the library itself does not require the extensions.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MATUTILS_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MATUTILS_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MATUTILS_TARGET(t) __attribute__((target(t)))
+#else
+#define MATUTILS_TARGET(t)
+#endif
+
+namespace MatUtils
+{
+#if MATUTILS_SIMD_X86
+static inline bool CpuSupportsSse41()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2]&(1<<19)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static inline bool CpuSupportsAvx()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2]&(1<<27)) != 0;
+    if (!osxsave || (_xgetbv(0)&0x6) != 0x6)
+        return false;
+    return (info[2]&(1<<28)) != 0;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+static inline bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    if (!CpuSupportsAvx())
+        return false;
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1]&(1<<5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// load/store one 4-channel pixel as 4 floats
+MATUTILS_TARGET("sse4.1")
+static inline __m128 LoadPixel_Sse(const uint8_t* p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline __m128 LoadPixel_Sse(const uint16_t* p)
+{
+    return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline __m128 LoadPixel_Sse(const float* p)
+{
+    return _mm_loadu_ps(p);
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline void StorePixel_Sse(uint8_t* p, __m128 v)
+{
+    __m128i i32 = _mm_cvtps_epi32(v);
+    __m128i i16 = _mm_packus_epi32(i32, i32);
+    int32_t u8 = _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+    memcpy(p, &u8, sizeof(u8));
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline void StorePixel_Sse(uint16_t* p, __m128 v)
+{
+    __m128i i32 = _mm_cvtps_epi32(v);
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi32(i32, i32));
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline void StorePixel_Sse(float* p, __m128 v)
+{
+    _mm_storeu_ps(p, v);
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+static inline float32x4_t LoadPixel_Neon(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    uint16x8_t u16 = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(u16)));
+}
+
+static inline float32x4_t LoadPixel_Neon(const uint16_t* p)
+{
+    return vcvtq_f32_u32(vmovl_u16(vld1_u16(p)));
+}
+
+static inline float32x4_t LoadPixel_Neon(const float* p)
+{
+    return vld1q_f32(p);
+}
+
+static inline uint32x4_t RoundToU32_Neon(float32x4_t v, float maxValue)
+{
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.f)), vdupq_n_f32(maxValue));
+    return vcvtq_u32_f32(vaddq_f32(v, vdupq_n_f32(0.5f)));
+}
+
+static inline void StorePixel_Neon(uint8_t* p, float32x4_t v)
+{
+    uint16x4_t u16 = vmovn_u32(RoundToU32_Neon(v, 255.f));
+    uint8x8_t u8 = vmovn_u16(vcombine_u16(u16, u16));
+    uint32_t u32 = vget_lane_u32(vreinterpret_u32_u8(u8), 0);
+    memcpy(p, &u32, sizeof(u32));
+}
+
+static inline void StorePixel_Neon(uint16_t* p, float32x4_t v)
+{
+    vst1_u16(p, vmovn_u32(RoundToU32_Neon(v, 65535.f)));
+}
+
+static inline void StorePixel_Neon(float* p, float32x4_t v)
+{
+    vst1q_f32(p, v);
+}
+#endif // MATUTILS_SIMD_NEON
+}
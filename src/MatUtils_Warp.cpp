@@ -0,0 +1,362 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "MatUtils.h"
+#include "MatUtils_Simd.h"
+
+using namespace std;
+
+namespace MatUtils
+{
+// The source image and its valid area, the taps outside the clip rectangle read transparent black
+template<typename T>
+struct WarpSource
+{
+    const uint8_t* data;
+    size_t lineSize;
+    int32_t clipX0, clipY0, clipX1, clipY1;
+
+    const T* Tap(int32_t x, int32_t y) const
+    {
+        static const T ZERO_PIXEL[4] = {0, 0, 0, 0};
+        if (x < clipX0 || x >= clipX1 || y < clipY0 || y >= clipY1)
+            return ZERO_PIXEL;
+        return (const T*)(data+y*lineSize)+x*4;
+    }
+};
+
+// Keys cubic convolution kernel with a = -0.5 (Catmull-Rom)
+static inline void CubicWeights(float t, float w[4])
+{
+    const float a = -0.5f;
+    const float t1 = t+1.f, t2 = 1.f-t;
+    w[0] = ((a*t1-5.f*a)*t1+8.f*a)*t1-4.f*a;
+    w[1] = ((a+2.f)*t-(a+3.f))*t*t+1.f;
+    w[2] = ((a+2.f)*t2-(a+3.f))*t2*t2+1.f;
+    w[3] = 1.f-w[0]-w[1]-w[2];
+}
+
+template<typename T> static inline T ToPixelValue(float v);
+template<> inline uint8_t ToPixelValue<uint8_t>(float v) { return (uint8_t)(v <= 0.f ? 0 : v >= 255.f ? 255 : (int)(v+0.5f)); }
+template<> inline uint16_t ToPixelValue<uint16_t>(float v) { return (uint16_t)(v <= 0.f ? 0 : v >= 65535.f ? 65535 : (int)(v+0.5f)); }
+template<> inline float ToPixelValue<float>(float v) { return v; }
+
+// Sample 'count' pixels of one output row, the source position of the first one is (u, v) and it steps by (du, dv).
+// The positions are in pixel units with the center of the source pixel (i, j) at (i+0.5, j+0.5).
+template<typename T>
+using WarpRowFunction = void (*)(T* dst, const WarpSource<T>& src, float u, float v, float du, float dv, int count, ImInterpolateMode interp);
+
+template<typename T>
+static void WarpRow_Scalar(T* dst, const WarpSource<T>& src, float u, float v, float du, float dv, int count, ImInterpolateMode interp)
+{
+    for (int i = 0; i < count; i++, u += du, v += dv, dst += 4)
+    {
+        float acc[4] = {0.f, 0.f, 0.f, 0.f};
+        if (interp == IM_INTERPOLATE_NEAREST)
+        {
+            const T* p = src.Tap((int32_t)floorf(u), (int32_t)floorf(v));
+            for (int c = 0; c < 4; c++)
+                dst[c] = p[c];
+            continue;
+        }
+        const float fx = u-0.5f, fy = v-0.5f;
+        const int32_t x0 = (int32_t)floorf(fx), y0 = (int32_t)floorf(fy);
+        const float tx = fx-x0, ty = fy-y0;
+        if (interp == IM_INTERPOLATE_BICUBIC)
+        {
+            float wx[4], wy[4];
+            CubicWeights(tx, wx);
+            CubicWeights(ty, wy);
+            for (int j = 0; j < 4; j++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    const T* p = src.Tap(x0-1+k, y0-1+j);
+                    const float w = wx[k]*wy[j];
+                    for (int c = 0; c < 4; c++)
+                        acc[c] += (float)p[c]*w;
+                }
+            }
+        }
+        else
+        {
+            const float w[4] = {(1.f-tx)*(1.f-ty), tx*(1.f-ty), (1.f-tx)*ty, tx*ty};
+            const T* p[4] = {src.Tap(x0, y0), src.Tap(x0+1, y0), src.Tap(x0, y0+1), src.Tap(x0+1, y0+1)};
+            for (int k = 0; k < 4; k++)
+                for (int c = 0; c < 4; c++)
+                    acc[c] += (float)p[k][c]*w[k];
+        }
+        for (int c = 0; c < 4; c++)
+            dst[c] = ToPixelValue<T>(acc[c]);
+    }
+}
+
+// Sample 'count' pixels of one output row, each one is the average of a grid of bilinear taps over its footprint in the source,
+// the parallelogram spanned by (du, dv) along the row and (du2, dv2) along the column. It replaces the interpolation kernels when
+// the image is shrunk to less than the half, where their few taps would skip source pixels and alias. The grid is capped at
+// 'AREA_MAX_TAPS' per axis, the 8-bit images are halved beforehand so they don't reach the cap unless shrunk anisotropically.
+static const int AREA_MAX_TAPS = 8;
+
+template<typename T>
+static void WarpRow_Area(T* dst, const WarpSource<T>& src, float u, float v, float du, float dv, float du2, float dv2, int count)
+{
+    const int nx = min(max((int)ceilf(sqrtf(du*du+dv*dv)), 1), AREA_MAX_TAPS);
+    const int ny = min(max((int)ceilf(sqrtf(du2*du2+dv2*dv2)), 1), AREA_MAX_TAPS);
+    const float norm = 1.f/(nx*ny);
+    for (int i = 0; i < count; i++, u += du, v += dv, dst += 4)
+    {
+        float acc[4] = {0.f, 0.f, 0.f, 0.f};
+        for (int b = 0; b < ny; b++)
+        {
+            const float fb = ((float)b+0.5f)/ny-0.5f;
+            for (int a = 0; a < nx; a++)
+            {
+                const float fa = ((float)a+0.5f)/nx-0.5f;
+                const float fx = u+fa*du+fb*du2-0.5f, fy = v+fa*dv+fb*dv2-0.5f;
+                const int32_t x0 = (int32_t)floorf(fx), y0 = (int32_t)floorf(fy);
+                const float tx = fx-x0, ty = fy-y0;
+                const float w[4] = {(1.f-tx)*(1.f-ty), tx*(1.f-ty), (1.f-tx)*ty, tx*ty};
+                const T* p[4] = {src.Tap(x0, y0), src.Tap(x0+1, y0), src.Tap(x0, y0+1), src.Tap(x0+1, y0+1)};
+                for (int k = 0; k < 4; k++)
+                    for (int c = 0; c < 4; c++)
+                        acc[c] += (float)p[k][c]*w[k];
+            }
+        }
+        for (int c = 0; c < 4; c++)
+            dst[c] = ToPixelValue<T>(acc[c]*norm);
+    }
+}
+
+#if MATUTILS_SIMD_X86
+template<typename T>
+MATUTILS_TARGET("sse4.1")
+static void WarpRow_Sse41(T* dst, const WarpSource<T>& src, float u, float v, float du, float dv, int count, ImInterpolateMode interp)
+{
+    if (interp == IM_INTERPOLATE_NEAREST)
+    {
+        WarpRow_Scalar<T>(dst, src, u, v, du, dv, count, interp);
+        return;
+    }
+    for (int i = 0; i < count; i++, u += du, v += dv, dst += 4)
+    {
+        const float fx = u-0.5f, fy = v-0.5f;
+        const int32_t x0 = (int32_t)floorf(fx), y0 = (int32_t)floorf(fy);
+        const float tx = fx-x0, ty = fy-y0;
+        __m128 acc;
+        if (interp == IM_INTERPOLATE_BICUBIC)
+        {
+            float wx[4], wy[4];
+            CubicWeights(tx, wx);
+            CubicWeights(ty, wy);
+            acc = _mm_setzero_ps();
+            for (int j = 0; j < 4; j++)
+            {
+                const int32_t y = y0-1+j;
+                __m128 row = _mm_mul_ps(LoadPixel_Sse(src.Tap(x0-1, y)), _mm_set1_ps(wx[0]));
+                row = _mm_add_ps(row, _mm_mul_ps(LoadPixel_Sse(src.Tap(x0, y)), _mm_set1_ps(wx[1])));
+                row = _mm_add_ps(row, _mm_mul_ps(LoadPixel_Sse(src.Tap(x0+1, y)), _mm_set1_ps(wx[2])));
+                row = _mm_add_ps(row, _mm_mul_ps(LoadPixel_Sse(src.Tap(x0+2, y)), _mm_set1_ps(wx[3])));
+                acc = _mm_add_ps(acc, _mm_mul_ps(row, _mm_set1_ps(wy[j])));
+            }
+        }
+        else
+        {
+            const __m128 vtx = _mm_set1_ps(tx), vty = _mm_set1_ps(ty);
+            const __m128 p00 = LoadPixel_Sse(src.Tap(x0, y0)), p10 = LoadPixel_Sse(src.Tap(x0+1, y0));
+            const __m128 p01 = LoadPixel_Sse(src.Tap(x0, y0+1)), p11 = LoadPixel_Sse(src.Tap(x0+1, y0+1));
+            const __m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p10, p00), vtx));
+            const __m128 bottom = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(p11, p01), vtx));
+            acc = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), vty));
+        }
+        StorePixel_Sse(dst, acc);
+    }
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+template<typename T>
+static void WarpRow_Neon(T* dst, const WarpSource<T>& src, float u, float v, float du, float dv, int count, ImInterpolateMode interp)
+{
+    if (interp == IM_INTERPOLATE_NEAREST)
+    {
+        WarpRow_Scalar<T>(dst, src, u, v, du, dv, count, interp);
+        return;
+    }
+    for (int i = 0; i < count; i++, u += du, v += dv, dst += 4)
+    {
+        const float fx = u-0.5f, fy = v-0.5f;
+        const int32_t x0 = (int32_t)floorf(fx), y0 = (int32_t)floorf(fy);
+        const float tx = fx-x0, ty = fy-y0;
+        float32x4_t acc;
+        if (interp == IM_INTERPOLATE_BICUBIC)
+        {
+            float wx[4], wy[4];
+            CubicWeights(tx, wx);
+            CubicWeights(ty, wy);
+            acc = vdupq_n_f32(0.f);
+            for (int j = 0; j < 4; j++)
+            {
+                const int32_t y = y0-1+j;
+                float32x4_t row = vmulq_n_f32(LoadPixel_Neon(src.Tap(x0-1, y)), wx[0]);
+                row = vmlaq_n_f32(row, LoadPixel_Neon(src.Tap(x0, y)), wx[1]);
+                row = vmlaq_n_f32(row, LoadPixel_Neon(src.Tap(x0+1, y)), wx[2]);
+                row = vmlaq_n_f32(row, LoadPixel_Neon(src.Tap(x0+2, y)), wx[3]);
+                acc = vmlaq_n_f32(acc, row, wy[j]);
+            }
+        }
+        else
+        {
+            const float32x4_t p00 = LoadPixel_Neon(src.Tap(x0, y0)), p10 = LoadPixel_Neon(src.Tap(x0+1, y0));
+            const float32x4_t p01 = LoadPixel_Neon(src.Tap(x0, y0+1)), p11 = LoadPixel_Neon(src.Tap(x0+1, y0+1));
+            const float32x4_t top = vmlaq_n_f32(p00, vsubq_f32(p10, p00), tx);
+            const float32x4_t bottom = vmlaq_n_f32(p01, vsubq_f32(p11, p01), tx);
+            acc = vmlaq_n_f32(top, vsubq_f32(bottom, top), ty);
+        }
+        StorePixel_Neon(dst, acc);
+    }
+}
+#endif // MATUTILS_SIMD_NEON
+
+template<typename T>
+static WarpRowFunction<T> SelectWarpRowFunction()
+{
+#if MATUTILS_SIMD_X86
+    if (CpuSupportsSse41())
+        return WarpRow_Sse41<T>;
+#elif MATUTILS_SIMD_NEON
+    return WarpRow_Neon<T>;
+#endif
+    return WarpRow_Scalar<T>;
+}
+
+// Intersect [lo, hi) with the range of x where 'a+b*x' is in (minVal, maxVal)
+static void ClipLinearRange(float a, float b, float minVal, float maxVal, float& lo, float& hi)
+{
+    if (fabsf(b) < 1e-12f)
+    {
+        if (a <= minVal || a >= maxVal)
+            hi = lo;
+        return;
+    }
+    float x0 = (minVal-a)/b, x1 = (maxVal-a)/b;
+    if (x0 > x1)
+        swap(x0, x1);
+    lo = max(lo, x0);
+    hi = min(hi, x1);
+}
+
+template<typename T>
+static void WarpAffine(ImGui::ImMat& dstMat, const float matrix[6], const WarpSource<T>& src, ImInterpolateMode interp)
+{
+    static const WarpRowFunction<T> s_warpRow = SelectWarpRowFunction<T>();
+    const WarpRowFunction<T> warpRow = IsSimdEnabled() ? s_warpRow : WarpRow_Scalar<T>;
+    // the distances in the source between two neighboring output pixels of a row and of a column
+    const float stepX = sqrtf(matrix[0]*matrix[0]+matrix[3]*matrix[3]);
+    const float stepY = sqrtf(matrix[1]*matrix[1]+matrix[4]*matrix[4]);
+    const bool areaSampling = interp != IM_INTERPOLATE_NEAREST && (stepX > 2.f || stepY > 2.f);
+    // the output pixels out of this margin around the clip rectangle get no contribution from the source
+    float margin = interp == IM_INTERPOLATE_BICUBIC ? 1.5f : interp == IM_INTERPOLATE_NEAREST ? 0.f : 0.5f;
+    if (areaSampling)
+        margin = 0.5f+0.5f*max(fabsf(matrix[0])+fabsf(matrix[1]), fabsf(matrix[3])+fabsf(matrix[4]));
+    const size_t dstLineSize = (size_t)dstMat.w*4*sizeof(T);
+    for (int y = 0; y < dstMat.h; y++)
+    {
+        T* dstRow = (T*)((uint8_t*)dstMat.data+y*dstLineSize);
+        const float cy = (float)y+0.5f;
+        // the source position of the output pixel center (x+0.5, y+0.5) is (u0+m0*x, v0+m3*x)
+        const float u0 = matrix[0]*0.5f+matrix[1]*cy+matrix[2];
+        const float v0 = matrix[3]*0.5f+matrix[4]*cy+matrix[5];
+        float lo = 0.f, hi = (float)dstMat.w;
+        ClipLinearRange(u0, matrix[0], src.clipX0-margin, src.clipX1+margin, lo, hi);
+        ClipLinearRange(v0, matrix[3], src.clipY0-margin, src.clipY1+margin, lo, hi);
+        int x0 = lo >= hi ? 0 : max(0, (int)floorf(lo));
+        int x1 = lo >= hi ? 0 : min(dstMat.w, (int)ceilf(hi));
+        if (x0 > 0)
+            memset(dstRow, 0, x0*4*sizeof(T));
+        if (x1 > x0 && areaSampling)
+            WarpRow_Area<T>(dstRow+x0*4, src, u0+matrix[0]*x0, v0+matrix[3]*x0, matrix[0], matrix[3], matrix[1], matrix[4], x1-x0);
+        else if (x1 > x0)
+            warpRow(dstRow+x0*4, src, u0+matrix[0]*x0, v0+matrix[3]*x0, matrix[0], matrix[3], x1-x0, interp);
+        else
+            x1 = x0;
+        if (x1 < dstMat.w)
+            memset(dstRow+x1*4, 0, (dstMat.w-x1)*4*sizeof(T));
+    }
+}
+
+// Halve the clipped area of an 8-bit source by averaging 2x2 blocks, as long as the output still shrinks it to a quarter or less
+// in both directions. 'matrix' is updated to map to the halved image, whose clip rectangle is the whole image.
+static WarpSource<uint8_t> PrehalveWarpSource(const WarpSource<uint8_t>& src, float matrix[6], ImInterpolateMode interp, ImGui::ImMat& halvedMat)
+{
+    WarpSource<uint8_t> result = src;
+    if (interp == IM_INTERPOLATE_NEAREST)
+        return result;
+    while (true)
+    {
+        const float stepX = sqrtf(matrix[0]*matrix[0]+matrix[3]*matrix[3]);
+        const float stepY = sqrtf(matrix[1]*matrix[1]+matrix[4]*matrix[4]);
+        const int32_t halfW = (result.clipX1-result.clipX0)/2, halfH = (result.clipY1-result.clipY0)/2;
+        if (stepX < 4.f || stepY < 4.f || halfW < 1 || halfH < 1)
+            break;
+        ImGui::ImMat mat;
+        mat.create_type(halfW, halfH, 4, IM_DT_INT8);
+        const uint8_t* srcOrigin = result.data+result.clipY0*result.lineSize+result.clipX0*4;
+        DownscalePlaneBox2x((uint8_t*)mat.data, halfW*4, srcOrigin, (int32_t)result.lineSize, halfW, halfH, 4);
+        // the source position (u, v) in the clipped area is ((u-clipX0)/2, (v-clipY0)/2) in the halved image
+        matrix[2] -= (float)result.clipX0; matrix[5] -= (float)result.clipY0;
+        for (int i = 0; i < 6; i++)
+            matrix[i] *= 0.5f;
+        halvedMat = mat;
+        result = {(const uint8_t*)halvedMat.data, (size_t)halfW*4, 0, 0, halfW, halfH};
+    }
+    return result;
+}
+
+bool WarpAffine(ImGui::ImMat& dstMat, const ImGui::ImMat& srcMat, const float matrix[6], int32_t clipX, int32_t clipY, int32_t clipW, int32_t clipH, ImInterpolateMode interp)
+{
+    if (dstMat.empty() || srcMat.empty() || dstMat.device != IM_DD_CPU || srcMat.device != IM_DD_CPU)
+        return false;
+    if (dstMat.c != 4 || srcMat.c != 4 || dstMat.type != srcMat.type)
+        return false;
+    const int32_t clipX0 = max(clipX, 0), clipY0 = max(clipY, 0);
+    const int32_t clipX1 = min(clipX+clipW, srcMat.w), clipY1 = min(clipY+clipH, srcMat.h);
+    const size_t srcLineSize = (size_t)srcMat.w*4*srcMat.elemsize;
+    switch (srcMat.type)
+    {
+    case IM_DT_INT8:
+    {
+        float halvedMatrix[6];
+        memcpy(halvedMatrix, matrix, sizeof(halvedMatrix));
+        ImGui::ImMat halvedMat;
+        const auto src = PrehalveWarpSource({(const uint8_t*)srcMat.data, srcLineSize, clipX0, clipY0, clipX1, clipY1}, halvedMatrix, interp, halvedMat);
+        WarpAffine<uint8_t>(dstMat, halvedMatrix, src, interp);
+        return true;
+    }
+    case IM_DT_INT16:
+        WarpAffine<uint16_t>(dstMat, matrix, {(const uint8_t*)srcMat.data, srcLineSize, clipX0, clipY0, clipX1, clipY1}, interp);
+        return true;
+    case IM_DT_FLOAT32:
+        WarpAffine<float>(dstMat, matrix, {(const uint8_t*)srcMat.data, srcLineSize, clipX0, clipY0, clipX1, clipY1}, interp);
+        return true;
+    default:
+        return false;
+    }
+}
+}
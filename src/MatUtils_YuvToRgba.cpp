@@ -0,0 +1,280 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+#include "MatUtils.h"
+#include "MatUtils_Simd.h"
+
+using namespace std;
+
+namespace MatUtils
+{
+// normalized luma = sample*yScale+yOffset, normalized chroma (centered at 0) = sample*cScale+cOffset
+struct YuvToRgbCoeffs
+{
+    float yScale, yOffset;
+    float cScale, cOffset;
+    float rv, gu, gv, bu;
+};
+
+static YuvToRgbCoeffs GetYuvToRgbCoeffs(const YuvImage& img)
+{
+    float kr, kb;
+    if (img.colorSpace == IM_CS_BT601)
+    {
+        kr = 0.299f; kb = 0.114f;
+    }
+    else if (img.colorSpace == IM_CS_BT2020)
+    {
+        kr = 0.2627f; kb = 0.0593f;
+    }
+    else
+    {
+        kr = 0.2126f; kb = 0.0722f;
+    }
+    const float kg = 1.f-kr-kb;
+    const float wordScale = 1.f/(float)(1<<img.sampleShift);
+    const float depthScale = (float)(1<<(img.bitDepth-8));
+    YuvToRgbCoeffs k;
+    if (img.colorRange == IM_CR_FULL_RANGE)
+    {
+        const float maxCode = (float)((1<<img.bitDepth)-1);
+        k.yScale = wordScale/maxCode;
+        k.yOffset = 0.f;
+        k.cScale = wordScale/maxCode;
+        k.cOffset = -128.f*depthScale/maxCode;
+    }
+    else
+    {
+        k.yScale = wordScale/(219.f*depthScale);
+        k.yOffset = -16.f/219.f;
+        k.cScale = wordScale/(224.f*depthScale);
+        k.cOffset = -128.f/224.f;
+    }
+    k.rv = 2.f*(1.f-kr);
+    k.gu = -2.f*kb*(1.f-kb)/kg;
+    k.gv = -2.f*kr*(1.f-kr)/kg;
+    k.bu = 2.f*(1.f-kb);
+    return k;
+}
+
+static inline float Saturate(float v)
+{
+    return v <= 0.f ? 0.f : v >= 1.f ? 1.f : v;
+}
+
+// Convert the pixels [x0, x1) of one row. 'uRow' and 'vRow' point to the chroma samples of the row, with the step of 'CStep' elements.
+template<typename T, int CStep>
+static void YuvToRgbaRow_Scalar(float* dst, const T* yRow, const T* uRow, const T* vRow, int32_t x0, int32_t x1, const YuvToRgbCoeffs& k)
+{
+    dst += x0*4;
+    for (int32_t x = x0; x < x1; x++, dst += 4)
+    {
+        const int32_t c = (x>>1)*CStep;
+        const float y = yRow[x]*k.yScale+k.yOffset;
+        const float u = uRow[c]*k.cScale+k.cOffset;
+        const float v = vRow[c]*k.cScale+k.cOffset;
+        dst[0] = Saturate(y+k.rv*v);
+        dst[1] = Saturate(y+k.gu*u+k.gv*v);
+        dst[2] = Saturate(y+k.bu*u);
+        dst[3] = 1.f;
+    }
+}
+
+template<typename T>
+using YuvToRgbaRowFunction = void (*)(float* dst, const T* yRow, const T* uRow, const T* vRow, int32_t width, const YuvToRgbCoeffs& k);
+
+template<typename T, int CStep>
+static void YuvToRgbaRow_ScalarFull(float* dst, const T* yRow, const T* uRow, const T* vRow, int32_t width, const YuvToRgbCoeffs& k)
+{
+    YuvToRgbaRow_Scalar<T, CStep>(dst, yRow, uRow, vRow, 0, width, k);
+}
+
+#if MATUTILS_SIMD_X86
+// two chroma samples, each one duplicated for the two pixels it covers
+MATUTILS_TARGET("sse4.1")
+static inline __m128 LoadChromaPair_Sse(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    const __m128 c = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+    return _mm_unpacklo_ps(c, c);
+}
+
+MATUTILS_TARGET("sse4.1")
+static inline __m128 LoadChromaPair_Sse(const uint16_t* p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    const __m128 c = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_cvtsi32_si128(v)));
+    return _mm_unpacklo_ps(c, c);
+}
+
+template<typename T, int CStep>
+MATUTILS_TARGET("sse4.1")
+static void YuvToRgbaRow_Sse41(float* dst, const T* yRow, const T* uRow, const T* vRow, int32_t width, const YuvToRgbCoeffs& k)
+{
+    const __m128 yScale = _mm_set1_ps(k.yScale), yOffset = _mm_set1_ps(k.yOffset);
+    const __m128 cScale = _mm_set1_ps(k.cScale), cOffset = _mm_set1_ps(k.cOffset);
+    const __m128 rv = _mm_set1_ps(k.rv), gu = _mm_set1_ps(k.gu), gv = _mm_set1_ps(k.gv), bu = _mm_set1_ps(k.bu);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    int32_t x = 0;
+    for (; x+4 <= width; x += 4)
+    {
+        const int32_t c = (x>>1)*CStep;
+        __m128 u, v;
+        if (CStep == 2)
+        {
+            // U0 V0 U1 V1
+            const __m128 uv = LoadPixel_Sse(uRow+c);
+            u = _mm_moveldup_ps(uv);
+            v = _mm_movehdup_ps(uv);
+        }
+        else
+        {
+            u = LoadChromaPair_Sse(uRow+c);
+            v = LoadChromaPair_Sse(vRow+c);
+        }
+        const __m128 y = _mm_add_ps(_mm_mul_ps(LoadPixel_Sse(yRow+x), yScale), yOffset);
+        u = _mm_add_ps(_mm_mul_ps(u, cScale), cOffset);
+        v = _mm_add_ps(_mm_mul_ps(v, cScale), cOffset);
+        __m128 r = _mm_add_ps(y, _mm_mul_ps(v, rv));
+        __m128 g = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(u, gu), _mm_mul_ps(v, gv)));
+        __m128 b = _mm_add_ps(y, _mm_mul_ps(u, bu));
+        __m128 a = one;
+        r = _mm_min_ps(_mm_max_ps(r, zero), one);
+        g = _mm_min_ps(_mm_max_ps(g, zero), one);
+        b = _mm_min_ps(_mm_max_ps(b, zero), one);
+        // planar r/g/b/a of 4 pixels -> 4 interleaved rgba pixels
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(dst+x*4, r);
+        _mm_storeu_ps(dst+x*4+4, g);
+        _mm_storeu_ps(dst+x*4+8, b);
+        _mm_storeu_ps(dst+x*4+12, a);
+    }
+    YuvToRgbaRow_Scalar<T, CStep>(dst, yRow, uRow, vRow, x, width, k);
+}
+#endif // MATUTILS_SIMD_X86
+
+#if MATUTILS_SIMD_NEON
+template<typename T>
+static inline float32x4_t LoadChromaPair_Neon(const T* p)
+{
+    const float c[4] = {(float)p[0], (float)p[0], (float)p[1], (float)p[1]};
+    return vld1q_f32(c);
+}
+
+template<typename T, int CStep>
+static void YuvToRgbaRow_Neon(float* dst, const T* yRow, const T* uRow, const T* vRow, int32_t width, const YuvToRgbCoeffs& k)
+{
+    const float32x4_t yOffset = vdupq_n_f32(k.yOffset), cOffset = vdupq_n_f32(k.cOffset);
+    const float32x4_t zero = vdupq_n_f32(0.f), one = vdupq_n_f32(1.f);
+    int32_t x = 0;
+    for (; x+4 <= width; x += 4)
+    {
+        const int32_t c = (x>>1)*CStep;
+        float32x4_t u, v;
+        if (CStep == 2)
+        {
+            // U0 V0 U1 V1
+            const float32x4_t uv = LoadPixel_Neon(uRow+c);
+            const float32x4x2_t t = vtrnq_f32(uv, uv);
+            u = t.val[0];
+            v = t.val[1];
+        }
+        else
+        {
+            u = LoadChromaPair_Neon(uRow+c);
+            v = LoadChromaPair_Neon(vRow+c);
+        }
+        const float32x4_t y = vmlaq_n_f32(yOffset, LoadPixel_Neon(yRow+x), k.yScale);
+        u = vmlaq_n_f32(cOffset, u, k.cScale);
+        v = vmlaq_n_f32(cOffset, v, k.cScale);
+        float32x4x4_t rgba;
+        rgba.val[0] = vminq_f32(vmaxq_f32(vmlaq_n_f32(y, v, k.rv), zero), one);
+        rgba.val[1] = vminq_f32(vmaxq_f32(vmlaq_n_f32(vmlaq_n_f32(y, u, k.gu), v, k.gv), zero), one);
+        rgba.val[2] = vminq_f32(vmaxq_f32(vmlaq_n_f32(y, u, k.bu), zero), one);
+        rgba.val[3] = one;
+        vst4q_f32(dst+x*4, rgba);
+    }
+    YuvToRgbaRow_Scalar<T, CStep>(dst, yRow, uRow, vRow, x, width, k);
+}
+#endif // MATUTILS_SIMD_NEON
+
+template<typename T, int CStep>
+static YuvToRgbaRowFunction<T> SelectYuvToRgbaRowFunction()
+{
+#if MATUTILS_SIMD_X86
+    if (CpuSupportsSse41())
+        return YuvToRgbaRow_Sse41<T, CStep>;
+#elif MATUTILS_SIMD_NEON
+    return YuvToRgbaRow_Neon<T, CStep>;
+#endif
+    return YuvToRgbaRow_ScalarFull<T, CStep>;
+}
+
+template<typename T, int CStep>
+static void ConvertYuv420ToRgbaFloat(ImGui::ImMat& dstMat, const YuvImage& srcImg, int32_t rowBegin, int32_t rowEnd)
+{
+    static const YuvToRgbaRowFunction<T> s_convertRow = SelectYuvToRgbaRowFunction<T, CStep>();
+    const YuvToRgbaRowFunction<T> convertRow = IsSimdEnabled() ? s_convertRow : YuvToRgbaRow_ScalarFull<T, CStep>;
+    const YuvToRgbCoeffs k = GetYuvToRgbCoeffs(srcImg);
+    const size_t dstLineSize = (size_t)dstMat.w*4*sizeof(float);
+    const T* vPlane = (const T*)(CStep == 2 ? srcImg.data[1]+sizeof(T) : srcImg.data[2]);
+    const int32_t vLineSize = CStep == 2 ? srcImg.lineSize[1] : srcImg.lineSize[2];
+    for (int32_t y = rowBegin; y < rowEnd; y++)
+    {
+        float* dstRow = (float*)((uint8_t*)dstMat.data+y*dstLineSize);
+        const T* yRow = (const T*)(srcImg.data[0]+(size_t)y*srcImg.lineSize[0]);
+        const T* uRow = (const T*)(srcImg.data[1]+(size_t)(y>>1)*srcImg.lineSize[1]);
+        const T* vRow = (const T*)((const uint8_t*)vPlane+(size_t)(y>>1)*vLineSize);
+        convertRow(dstRow, yRow, uRow, vRow, srcImg.width, k);
+    }
+}
+
+bool ConvertYuv420ToRgbaFloat(ImGui::ImMat& dstMat, const YuvImage& srcImg, int32_t rowBegin, int32_t rowEnd)
+{
+    if (dstMat.empty() || dstMat.device != IM_DD_CPU || dstMat.c != 4 || dstMat.type != IM_DT_FLOAT32)
+        return false;
+    if (dstMat.w != srcImg.width || dstMat.h != srcImg.height || !srcImg.data[0] || !srcImg.data[1] || (!srcImg.interleavedChroma && !srcImg.data[2]))
+        return false;
+    if (srcImg.bitDepth < 8 || srcImg.bitDepth > 16 || srcImg.sampleShift < 0 || srcImg.bitDepth+srcImg.sampleShift > (srcImg.bitDepth > 8 ? 16 : 8))
+        return false;
+    if (rowEnd < 0 || rowEnd > dstMat.h)
+        rowEnd = dstMat.h;
+    rowBegin = max(rowBegin, 0);
+    if (rowBegin >= rowEnd)
+        return true;
+
+    if (srcImg.bitDepth > 8)
+    {
+        if (srcImg.interleavedChroma)
+            ConvertYuv420ToRgbaFloat<uint16_t, 2>(dstMat, srcImg, rowBegin, rowEnd);
+        else
+            ConvertYuv420ToRgbaFloat<uint16_t, 1>(dstMat, srcImg, rowBegin, rowEnd);
+    }
+    else
+    {
+        if (srcImg.interleavedChroma)
+            ConvertYuv420ToRgbaFloat<uint8_t, 2>(dstMat, srcImg, rowBegin, rowEnd);
+        else
+            ConvertYuv420ToRgbaFloat<uint8_t, 1>(dstMat, srcImg, rowBegin, rowEnd);
+    }
+    return true;
+}
+}
@@ -17,18 +17,23 @@
 
 #include <mutex>
 #include <thread>
+#include <atomic>
 #include <chrono>
 #include <sstream>
 #include <list>
 #include <algorithm>
+#include <cstring>
 #include "MediaEncoder.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "SpscRingBuffer.h"
 extern "C"
 {
     #include "libavutil/avutil.h"
     #include "libavutil/avstring.h"
     #include "libavutil/pixdesc.h"
+    #include "libavutil/opt.h"
+    #include "libavutil/hwcontext.h"
     #include "libavformat/avformat.h"
     #include "libavcodec/avcodec.h"
     #include "libavdevice/avdevice.h"
@@ -44,6 +49,11 @@ using namespace Logger;
 
 namespace MediaCore
 {
+using SysUtils::SpscRingBuffer;
+
+// the hardware frames waiting in the video input queue hold the surfaces of the decoder's pool, which is small and fixed in size
+static const int32_t MAX_QUEUED_HW_FRAMES = 4;
+
 class MediaEncoder_Impl : public MediaEncoder
 {
 public:
@@ -212,8 +222,8 @@ public:
             m_vidinpEof = true;
         if (HasAudio())
             m_audinpEof = true;
-        while (!m_muxEof)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        m_wakeupEvt.Notify();
+        m_wakeupEvt.WaitUntil([this] { return m_muxEof; });
 
         bool success = true;
         int fferr;
@@ -236,54 +246,28 @@ public:
 
     bool EncodeVideoFrame(ImGui::ImMat& vmat, bool wait) override
     {
-        if (!m_opened)
-        {
-            m_errMsg = "This MediaEncoder has NOT opened yet!";
-            return false;
-        }
-        if (!m_started)
-        {
-            m_errMsg = "This MediaEncoder has NOT started yet!";
-            return false;
-        }
-        if (!HasVideo())
-        {
-            m_errMsg = "This MediaEncoder does NOT have video!";
-            return false;
-        }
-        lock_guard<recursive_mutex> lk(m_apiLock);
-        if (m_vidinpEof)
-        {
-            m_errMsg = "Video stream has already reaches EOF!";
-            return false;
-        }
-        if (m_encErr)
-        {
-            return false;
-        }
-
-        if (vmat.empty())
-        {
-            m_vidinpEof = true;
-            return true;
-        }
-
-        while (wait && m_vmatQ.size() >= m_vmatQMaxSize && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit)
-            return false;
-        if (m_vmatQ.size() >= m_vmatQMaxSize)
-        {
-            m_errMsg = "Queue full!";
-            return false;
-        }
+        VideoInput vinp;
+        vinp.vmat = vmat;
+        return EnqueueVideoInput(vinp, wait);
+    }
 
+    bool EncodeVideoFrame(MediaReader::VideoFrame::Holder hVfrm, bool wait) override
+    {
+        VideoInput vinp;
+        if (hVfrm)
         {
-            lock_guard<mutex> lk(m_vmatQLock);
-            m_vmatQ.push_back(vmat);
+            vinp.avfrm = hVfrm->GetAVFrame();
+            vinp.pos = hVfrm->Pos();
+            if (!vinp.avfrm && (!hVfrm->GetMat(vinp.vmat) || vinp.vmat.empty()))
+            {
+                ostringstream oss; oss << "FAILED to get the image of the video frame at pos " << hVfrm->Pos() << "!";
+                m_errMsg = oss.str();
+                return false;
+            }
+            if (vinp.avfrm && IsHwFrame(vinp.avfrm.get()) && !LimitQueuedHwFrames(vinp, wait))
+                return false;
         }
-
-        return true;
+        return EnqueueVideoInput(vinp, wait);
     }
 
     bool EncodeAudioSamples(uint8_t* buf, uint32_t size, bool wait) override
@@ -320,25 +304,22 @@ public:
             {
                 uint32_t bufoffset = m_audencfrmSmpOffset*m_audinpFrameSize;
                 memset(m_audencfrm->data[0]+bufoffset, 0, m_audencfrm->linesize[0]-bufoffset);
-                {
-                    lock_guard<mutex> lk(m_audfrmQLock);
-                    m_audfrmQ.push_back(m_audencfrm);
-                }
-                m_audencfrm = nullptr;
+                if (!PushAudioFrame())
+                    return false;
             }
             m_audinpEof = true;
+            m_wakeupEvt.Notify();
             return true;
         }
 
-        if (m_audfrmQ.size() >= m_audfrmQMaxSize)
+        if (m_audfrmQ.Size() >= m_audfrmQMaxSize)
         {
             if (!wait)
             {
                 m_errMsg = "Queue full!";
                 return false;
             }
-            while (m_audfrmQ.size() >= m_audfrmQMaxSize && !m_quit)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_wakeupEvt.WaitUntil([this] { return m_audfrmQ.Size() < m_audfrmQMaxSize || m_quit; });
             if (m_quit)
                 return false;
         }
@@ -408,10 +389,9 @@ public:
 
             if (m_audencfrmSmpOffset >= m_audencfrm->nb_samples)
             {
-                lock_guard<mutex> lk(m_audfrmQLock);
-                m_audfrmQ.push_back(m_audencfrm);
                 m_audfrmPts += m_audencfrm->nb_samples;
-                m_audencfrm = nullptr;
+                if (!PushAudioFrame())
+                    return false;
                 m_audencfrmSmpOffset = 0;
             }
         }
@@ -421,11 +401,145 @@ public:
         return true;
     }
 
+    // One call of 'EncodeAudioSamples()' can produce more frames than the free slots of 'm_audfrmQ',
+    // in that case wait for the audio encoding thread to consume some frames.
+    bool PushAudioFrame()
+    {
+        while (!m_audfrmQ.TryPush(m_audencfrm))
+        {
+            m_wakeupEvt.WaitUntil([this] { return !m_audfrmQ.Full() || m_quit; });
+            if (m_quit)
+                return false;
+        }
+        m_audencfrm = nullptr;
+        return true;
+    }
+
     bool EncodeAudioSamples(ImGui::ImMat& amat, bool wait) override
     {
         return EncodeAudioSamples((uint8_t*)amat.data, amat.total()*amat.elemsize, wait);
     }
 
+    bool EnableVideoStreamCopy(MediaParser::Holder hSrcParser) override
+    {
+        if (!m_opened)
+        {
+            m_errMsg = "This MediaEncoder has NOT opened yet!";
+            return false;
+        }
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_started)
+        {
+            m_errMsg = "Video stream copy must be enabled before this MediaEncoder starts!";
+            return false;
+        }
+        if (!HasVideo())
+        {
+            m_errMsg = "This MediaEncoder does NOT have video!";
+            return false;
+        }
+        if (!hSrcParser || !hSrcParser->IsOpened() || !hSrcParser->HasVideo() || hSrcParser->IsImageSequence())
+        {
+            m_errMsg = "INVALID source for video stream copy!";
+            return false;
+        }
+
+        CloseStreamCopySource();
+        if (!OpenStreamCopySource(hSrcParser->GetUrl()))
+        {
+            CloseStreamCopySource();
+            return false;
+        }
+        return true;
+    }
+
+    bool CopyVideoPackets(int64_t srcStartPos, int64_t srcEndPos, int64_t dstPos) override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (!m_srcFmtCtx)
+        {
+            m_errMsg = "Video stream copy is NOT enabled!";
+            return false;
+        }
+        if (srcStartPos < 0 || srcEndPos <= srcStartPos)
+        {
+            ostringstream oss; oss << "INVALID source range [" << srcStartPos << ", " << srcEndPos << ") for video stream copy!";
+            m_errMsg = oss.str();
+            return false;
+        }
+
+        AVStream* srcStm = m_srcFmtCtx->streams[m_srcVidStmIdx];
+        const int64_t srcStartTime = srcStm->start_time != AV_NOPTS_VALUE ? srcStm->start_time : 0;
+        const int64_t startPts = av_rescale_q_rnd(srcStartPos, MILLISEC_TIMEBASE, srcStm->time_base, AV_ROUND_DOWN)+srcStartTime;
+        const int64_t endPts = av_rescale_q_rnd(srcEndPos, MILLISEC_TIMEBASE, srcStm->time_base, AV_ROUND_DOWN)+srcStartTime;
+        const int64_t dstOffset = av_rescale_q(dstPos, MILLISEC_TIMEBASE, m_vidAvStm->time_base);
+        int fferr = avformat_seek_file(m_srcFmtCtx, m_srcVidStmIdx, INT64_MIN, startPts, startPts, 0);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_seek_file", fferr);
+            return false;
+        }
+
+        int64_t firstKeyPts = AV_NOPTS_VALUE;
+        uint32_t pktCnt = 0;
+        while (true)
+        {
+            SelfFreeAVPacketPtr pkt = AllocSelfFreeAVPacketPtr();
+            if (!pkt)
+            {
+                m_errMsg = "FAILED to allocate new 'SelfFreeAVPacketPtr'!";
+                return false;
+            }
+            fferr = av_read_frame(m_srcFmtCtx, pkt.get());
+            if (fferr == AVERROR_EOF)
+                break;
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("av_read_frame", fferr);
+                return false;
+            }
+            if (pkt->stream_index != m_srcVidStmIdx)
+                continue;
+
+            const bool isKeyFrame = (pkt->flags&AV_PKT_FLAG_KEY) != 0;
+            const int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (firstKeyPts == AV_NOPTS_VALUE)
+            {
+                if (!isKeyFrame || pts < startPts)
+                    continue;
+                if (pts >= endPts)
+                    break;
+                firstKeyPts = pts;
+            }
+            else if (isKeyFrame && pts >= endPts)
+                break;
+            // the leading pictures of an open GOP refer to the GOP before, they belong to the re-encoded range
+            if (pts < firstKeyPts)
+                continue;
+
+            if (pkt->pts != AV_NOPTS_VALUE)
+                pkt->pts = av_rescale_q(pkt->pts-firstKeyPts, srcStm->time_base, m_vidAvStm->time_base)+dstOffset;
+            if (pkt->dts != AV_NOPTS_VALUE)
+                pkt->dts = av_rescale_q(pkt->dts-firstKeyPts, srcStm->time_base, m_vidAvStm->time_base)+dstOffset;
+            pkt->duration = av_rescale_q(pkt->duration, srcStm->time_base, m_vidAvStm->time_base);
+            pkt->pos = -1;
+            VideoInput vinp;
+            vinp.avpkt = pkt;
+            if (!EnqueueVideoInput(vinp, true))
+                return false;
+            pktCnt++;
+        }
+        if (firstKeyPts == AV_NOPTS_VALUE)
+        {
+            ostringstream oss; oss << "NO key frame is found in the source range [" << srcStartPos << ", " << srcEndPos << ") for video stream copy!";
+            m_errMsg = oss.str();
+            return false;
+        }
+        m_logger->Log(DEBUG) << "Copied " << pktCnt << " video packets from source range [" << MillisecToString(srcStartPos) << ", "
+                << MillisecToString(srcEndPos) << ") to " << MillisecToString(dstPos) << "." << endl;
+        return true;
+    }
+
     bool IsOpened() const override
     {
         return m_opened;
@@ -448,6 +562,16 @@ public:
         return {m_videncCtx->framerate.num, m_videncCtx->framerate.den};
     }
 
+    bool IsVideoInputFull() const override
+    {
+        return HasVideo() && m_vidinpQ.Size() >= m_vidinpQMaxSize;
+    }
+
+    bool IsEncodingDone() const override
+    {
+        return m_started && m_muxEof;
+    }
+
     bool IsHwAccelEnabled() const override
     {
         return m_vidPreferUseHw;
@@ -469,6 +593,118 @@ public:
     }
 
 private:
+    // an input of the video encoder, either an image or a decoded frame to be passed through,
+    // or a packet copied from the source which goes to the muxer directly
+    struct VideoInput
+    {
+        ImGui::ImMat vmat;
+        SelfFreeAVFramePtr avfrm;
+        SelfFreeAVPacketPtr avpkt;
+        int64_t pos{0};
+        bool isHwfrm{false};
+    };
+
+    // Keep at most 'MAX_QUEUED_HW_FRAMES' hardware frames in the input queue. The ones beyond are downloaded right away, except
+    // when the encoder takes the hardware frames as they are, then the caller waits for the queued ones to be consumed.
+    bool LimitQueuedHwFrames(VideoInput& vinp, bool wait)
+    {
+        if (vinp.avfrm->format == (int)m_videncPixfmt && IsHwFrameOnEncoderDevice(vinp.avfrm.get()))
+        {
+            if (wait)
+                m_wakeupEvt.WaitUntil([this] { return m_queuedHwfrmCnt < MAX_QUEUED_HW_FRAMES || m_quit; });
+            if (m_queuedHwfrmCnt >= MAX_QUEUED_HW_FRAMES)
+            {
+                m_errMsg = "Queue full!";
+                return false;
+            }
+            vinp.isHwfrm = true;
+            return true;
+        }
+        if (m_queuedHwfrmCnt < MAX_QUEUED_HW_FRAMES)
+        {
+            vinp.isHwfrm = true;
+            return true;
+        }
+        SelfFreeAVFramePtr swfrm = AllocSelfFreeAVFramePtr();
+        if (!swfrm || !TransferHwFrameToSwFrame(swfrm.get(), vinp.avfrm.get()))
+        {
+            ostringstream oss; oss << "FAILED to download the hardware frame at pos " << vinp.pos << " for video encoding!";
+            m_errMsg = oss.str();
+            return false;
+        }
+        vinp.avfrm = swfrm;
+        return true;
+    }
+
+    // The hardware frames from another device or frames pool can not be taken by the encoder, they must be downloaded
+    bool IsHwFrameOnEncoderDevice(const AVFrame* avfrm) const
+    {
+        if (!avfrm->hw_frames_ctx)
+            return false;
+        if (m_videncCtx->hw_frames_ctx)
+            return avfrm->hw_frames_ctx->data == m_videncCtx->hw_frames_ctx->data;
+        const AVHWFramesContext* hwfrmCtx = (const AVHWFramesContext*)avfrm->hw_frames_ctx->data;
+        return m_videncHwDevCtx && hwfrmCtx->device_ref && hwfrmCtx->device_ref->data == m_videncHwDevCtx->data;
+    }
+
+    bool EnqueueVideoInput(VideoInput& vinp, bool wait)
+    {
+        if (!m_opened)
+        {
+            m_errMsg = "This MediaEncoder has NOT opened yet!";
+            return false;
+        }
+        if (!m_started)
+        {
+            m_errMsg = "This MediaEncoder has NOT started yet!";
+            return false;
+        }
+        if (!HasVideo())
+        {
+            m_errMsg = "This MediaEncoder does NOT have video!";
+            return false;
+        }
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_vidinpEof)
+        {
+            m_errMsg = "Video stream has already reaches EOF!";
+            return false;
+        }
+        if (m_encErr)
+        {
+            return false;
+        }
+
+        if (vinp.vmat.empty() && !vinp.avfrm && !vinp.avpkt)
+        {
+            m_vidinpEof = true;
+            m_wakeupEvt.Notify();
+            return true;
+        }
+        if (!vinp.avpkt && m_vidcpyHeaderMismatch)
+        {
+            m_errMsg = "Can NOT re-encode video frames, the encoder does NOT produce the same parameter sets as the source of the stream copy!";
+            return false;
+        }
+
+        if (wait)
+            m_wakeupEvt.WaitUntil([this] { return m_vidinpQ.Size() < m_vidinpQMaxSize || m_quit; });
+        if (m_quit)
+            return false;
+        const bool isHwfrm = vinp.isHwfrm;
+        if (isHwfrm)
+            m_queuedHwfrmCnt++;
+        if (m_vidinpQ.Size() >= m_vidinpQMaxSize || !m_vidinpQ.TryPush(std::move(vinp)))
+        {
+            if (isHwfrm)
+                m_queuedHwfrmCnt--;
+            m_errMsg = "Queue full!";
+            return false;
+        }
+
+        return true;
+    }
+
     string FFapiFailureMessage(const string& apiName, int fferr)
     {
         ostringstream oss;
@@ -681,7 +917,9 @@ private:
             return false;
         }
 
-        m_vmatQMaxSize = (uint32_t)(((double)m_videncCtx->framerate.num/m_videncCtx->framerate.den)*m_dataQCacheDur);
+        m_vidinpQMaxSize = (uint32_t)(((double)m_videncCtx->framerate.num/m_videncCtx->framerate.den)*m_dataQCacheDur);
+        m_vidinpQ.Reset(m_vidinpQMaxSize);
+        m_vidinpQ.SetHighWaterMark(m_vidinpQMaxSize);
 
         m_vidAvStm = avformat_new_stream(m_avfmtCtx, m_videnc);
         if (!m_vidAvStm)
@@ -847,10 +1085,207 @@ private:
             m_videncHwDevCtx = nullptr;
         }
         m_videncPixfmt = AV_PIX_FMT_NONE;
+        if (m_vidSwsCtx)
+        {
+            sws_freeContext(m_vidSwsCtx);
+            m_vidSwsCtx = nullptr;
+        }
+        CloseStreamCopySource();
         m_vidAvStm = nullptr;
         m_vidStmIdx = -1;
         m_vidinpEof = false;
         m_videncEof = false;
+        m_videncDraining = false;
+        m_videncDrained = false;
+    }
+
+    bool OpenStreamCopySource(const string& url)
+    {
+        int fferr = avformat_open_input(&m_srcFmtCtx, url.c_str(), nullptr, nullptr);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_open_input", fferr);
+            return false;
+        }
+        fferr = avformat_find_stream_info(m_srcFmtCtx, nullptr);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_find_stream_info", fferr);
+            return false;
+        }
+        m_srcVidStmIdx = av_find_best_stream(m_srcFmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (m_srcVidStmIdx < 0)
+        {
+            ostringstream oss; oss << "Source '" << url << "' does NOT have video!";
+            m_errMsg = oss.str();
+            return false;
+        }
+
+        const AVCodecParameters* srcpar = m_srcFmtCtx->streams[m_srcVidStmIdx]->codecpar;
+        if (srcpar->codec_id != m_videncCtx->codec_id || srcpar->width != m_videncCtx->width || srcpar->height != m_videncCtx->height)
+        {
+            ostringstream oss;
+            oss << "Source video (" << avcodec_get_name(srcpar->codec_id) << ", " << srcpar->width << "x" << srcpar->height
+                    << ") does NOT match the encoder (" << avcodec_get_name(m_videncCtx->codec_id) << ", " << m_videncCtx->width
+                    << "x" << m_videncCtx->height << ")!";
+            m_errMsg = oss.str();
+            return false;
+        }
+        // the encoder is drained before each copied range and reset after it
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+        const bool canFlush = (m_videnc->capabilities&AV_CODEC_CAP_ENCODER_FLUSH) != 0;
+#else
+        const bool canFlush = false;
+#endif
+        if (!canFlush)
+        {
+            ostringstream oss; oss << "Video encoder '" << m_videnc->name << "' does NOT support flushing, it can NOT work with stream copy!";
+            m_errMsg = oss.str();
+            return false;
+        }
+
+        // the copied packets refer to the parameter sets of the source, so the output stream takes the source's codec parameters
+        const bool bGlobalHeader = (m_avfmtCtx->oformat->flags&AVFMT_GLOBALHEADER) != 0;
+        m_vidcpyHeaderMismatch = bGlobalHeader && (srcpar->extradata_size != m_videncCtx->extradata_size ||
+                (srcpar->extradata_size > 0 && memcmp(srcpar->extradata, m_videncCtx->extradata, srcpar->extradata_size) != 0));
+        if (m_vidcpyHeaderMismatch)
+        {
+            // the re-encoded ranges carry their own parameter sets in-band, in the NAL unit format of the source stream
+            int nalLengthSize = 0;
+            if (srcpar->codec_id == AV_CODEC_ID_H264 && srcpar->extradata_size >= 7 && srcpar->extradata[0] == 1)
+                nalLengthSize = (srcpar->extradata[4]&0x3)+1;
+            else if (srcpar->codec_id == AV_CODEC_ID_HEVC && srcpar->extradata_size >= 23 && srcpar->extradata[0] == 1)
+                nalLengthSize = (srcpar->extradata[21]&0x3)+1;
+            if (nalLengthSize > 0 && ReopenVideoEncoderWithInBandHeaders())
+            {
+                m_vidcpyNalLengthSize = nalLengthSize;
+                m_vidcpyHeaderMismatch = false;
+                m_logger->Log(DEBUG) << "The parameter sets of video encoder '" << m_videnc->name << "' differ from the source's, "
+                        << "they are sent in-band with the re-encoded key frames." << endl;
+            }
+            else
+            {
+                m_logger->Log(WARN) << "The parameter sets of video encoder '" << m_videnc->name << "' differ from the source's, "
+                        << "only the copied ranges can be written into '" << m_avfmtCtx->oformat->name << "'." << endl;
+            }
+        }
+        fferr = avcodec_parameters_copy(m_vidAvStm->codecpar, srcpar);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avcodec_parameters_copy", fferr);
+            return false;
+        }
+        m_vidAvStm->codecpar->codec_tag = 0;
+        m_logger->Log(DEBUG) << "Enabled video stream copy from '" << url << "'." << endl;
+        return true;
+    }
+
+    void CloseStreamCopySource()
+    {
+        if (m_srcFmtCtx)
+        {
+            avformat_close_input(&m_srcFmtCtx);
+            m_srcFmtCtx = nullptr;
+        }
+        m_srcVidStmIdx = -1;
+        m_vidcpyHeaderMismatch = false;
+        m_vidcpyNalLengthSize = 0;
+    }
+
+    // Open the video encoder again with the same settings but without AV_CODEC_FLAG_GLOBAL_HEADER, then the parameter
+    // sets are sent with each key frame. The current encoder is kept if the reopening fails.
+    bool ReopenVideoEncoderWithInBandHeaders()
+    {
+        AVCodecContext* pNewCtx = avcodec_alloc_context3(m_videnc);
+        if (!pNewCtx)
+        {
+            m_errMsg = "FAILED to allocate AVCodecContext by 'avcodec_alloc_context3'!";
+            return false;
+        }
+        int fferr = av_opt_copy(pNewCtx, m_videncCtx);
+        if (fferr >= 0 && m_videncCtx->priv_data && pNewCtx->priv_data)
+            fferr = av_opt_copy(pNewCtx->priv_data, m_videncCtx->priv_data);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("av_opt_copy", fferr);
+            avcodec_free_context(&pNewCtx);
+            return false;
+        }
+        pNewCtx->pix_fmt = m_videncCtx->pix_fmt;
+        pNewCtx->width = m_videncCtx->width;
+        pNewCtx->height = m_videncCtx->height;
+        pNewCtx->time_base = m_videncCtx->time_base;
+        pNewCtx->framerate = m_videncCtx->framerate;
+        pNewCtx->bit_rate = m_videncCtx->bit_rate;
+        pNewCtx->sample_aspect_ratio = m_videncCtx->sample_aspect_ratio;
+        if (m_videncCtx->hw_device_ctx)
+            pNewCtx->hw_device_ctx = av_buffer_ref(m_videncCtx->hw_device_ctx);
+        pNewCtx->flags &= ~AV_CODEC_FLAG_GLOBAL_HEADER;
+        fferr = avcodec_open2(pNewCtx, m_videnc, nullptr);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avcodec_open2", fferr);
+            m_logger->Log(DEBUG) << "During reopening encoder '" << m_videnc->name << "' without global header. " << m_errMsg << endl;
+            avcodec_free_context(&pNewCtx);
+            return false;
+        }
+        avcodec_free_context(&m_videncCtx);
+        m_videncCtx = pNewCtx;
+        return true;
+    }
+
+    // The packets of an encoder without global header are in Annex B format, with start codes before the NAL units.
+    // The copied stream prefixes each NAL unit with its length in 'nalLengthSize' bytes instead.
+    static bool ConvertAnnexBToLengthPrefixed(AVPacket* avpkt, int nalLengthSize)
+    {
+        const uint8_t* const end = avpkt->data+avpkt->size;
+        auto FindStartCode = [end] (const uint8_t* p) {
+            for (; p+3 <= end; p++)
+                if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+                    return p;
+            return end;
+        };
+        const uint8_t* nalStart = FindStartCode(avpkt->data);
+        // no start code, the packet is already length prefixed
+        if (nalStart == end)
+            return true;
+        vector<pair<const uint8_t*, uint32_t>> nalUnits;
+        int64_t outSize = 0;
+        while (nalStart < end)
+        {
+            nalStart += 3;
+            const uint8_t* nextStart = FindStartCode(nalStart);
+            // the leading zero of a 4-byte start code and the trailing zeros are not part of the NAL unit
+            const uint8_t* nalEnd = nextStart;
+            while (nalEnd > nalStart && nalEnd[-1] == 0)
+                nalEnd--;
+            const uint32_t nalSize = (uint32_t)(nalEnd-nalStart);
+            if (nalSize > 0)
+            {
+                if (nalLengthSize < 4 && nalSize >= (1u<<(nalLengthSize*8)))
+                    return false;
+                nalUnits.push_back({nalStart, nalSize});
+                outSize += nalLengthSize+nalSize;
+            }
+            nalStart = nextStart;
+        }
+        AVBufferRef* outbuf = av_buffer_alloc(outSize+AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!outbuf)
+            return false;
+        memset(outbuf->data+outSize, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        uint8_t* dst = outbuf->data;
+        for (auto& nalu : nalUnits)
+        {
+            for (int i = nalLengthSize-1; i >= 0; i--)
+                *dst++ = (uint8_t)(nalu.second>>(i*8));
+            memcpy(dst, nalu.first, nalu.second);
+            dst += nalu.second;
+        }
+        av_buffer_unref(&avpkt->buf);
+        avpkt->buf = outbuf;
+        avpkt->data = outbuf->data;
+        avpkt->size = (int)outSize;
+        return true;
     }
 
     bool ConfigureAudioStream_Internal(const std::string& codecName,
@@ -927,6 +1362,9 @@ private:
         m_audencFrameSize = av_get_bytes_per_sample(m_audencSmpfmt)*channels;
 
         m_audfrmQMaxSize = (uint32_t)(m_dataQCacheDur*sampleRate/m_audencFrameSamples);
+        // leave room for the frames produced by one 'EncodeAudioSamples()' call beyond 'm_audfrmQMaxSize'
+        m_audfrmQ.Reset(m_audfrmQMaxSize*2);
+        m_audfrmQ.SetHighWaterMark(m_audfrmQMaxSize);
 
         m_audAvStm = avformat_new_stream(m_avfmtCtx, m_audenc);
         if (!m_audAvStm)
@@ -1019,6 +1457,7 @@ private:
     void TerminateAllThreads()
     {
         m_quit = true;
+        m_wakeupEvt.Notify();
         if (m_videncThread.joinable())
             m_videncThread.join();
         if (m_audencThread.joinable())
@@ -1029,8 +1468,13 @@ private:
 
     void FlushAllQueues()
     {
-        m_vmatQ.clear();
-        m_audfrmQ.clear();
+        m_vidinpQ.Clear();
+        m_queuedHwfrmCnt = 0;
+        m_audfrmQ.Clear();
+        {
+            lock_guard<mutex> lk(m_vidpktQLock);
+            m_vidpktQ.clear();
+        }
     }
 
     SelfFreeAVFramePtr ConvertImMatToAVFrame(ImGui::ImMat& vmat)
@@ -1048,30 +1492,114 @@ private:
         return vfrm;
     }
 
+    // Take a decoded frame as the encoder input, it's only converted if it doesn't match the encoder
+    SelfFreeAVFramePtr PassThroughAVFrame(const SelfFreeAVFramePtr& inpfrm, int64_t pos)
+    {
+        const AVFrame* srcfrm = inpfrm.get();
+        const bool isSizeMatched = srcfrm->width == m_videncCtx->width && srcfrm->height == m_videncCtx->height;
+        SelfFreeAVFramePtr swfrm;
+        if (IsHwFrame(srcfrm) && (srcfrm->format != (int)m_videncPixfmt || !isSizeMatched || !IsHwFrameOnEncoderDevice(srcfrm)))
+        {
+            swfrm = AllocSelfFreeAVFramePtr();
+            if (!swfrm || !TransferHwFrameToSwFrame(swfrm.get(), srcfrm))
+            {
+                m_logger->Log(Error) << "FAILED to download the hardware frame at pos " << pos << " for video encoding!" << endl;
+                return nullptr;
+            }
+            srcfrm = swfrm.get();
+        }
+
+        SelfFreeAVFramePtr encfrm;
+        if (srcfrm->format == (int)m_videncPixfmt && isSizeMatched)
+        {
+            // the frame is shared with the reader, only take a new reference of it
+            encfrm = swfrm ? swfrm : CloneSelfFreeAVFramePtr(srcfrm);
+            if (!encfrm)
+            {
+                m_logger->Log(Error) << "FAILED to clone the AVFrame at pos " << pos << " for video encoding!" << endl;
+                return nullptr;
+            }
+        }
+        else
+        {
+            SwsContext* swsCtx = sws_getCachedContext(m_vidSwsCtx, srcfrm->width, srcfrm->height, (AVPixelFormat)srcfrm->format,
+                    m_videncCtx->width, m_videncCtx->height, m_videncPixfmt, SWS_BICUBIC, nullptr, nullptr, nullptr);
+            if (!swsCtx)
+            {
+                m_logger->Log(Error) << "FAILED to create SwsContext from WxH(" << srcfrm->width << "x" << srcfrm->height << "):Fmt(" << srcfrm->format
+                        << ") -> WxH(" << m_videncCtx->width << "x" << m_videncCtx->height << "):Fmt(" << (int)m_videncPixfmt << ")!" << endl;
+                m_vidSwsCtx = nullptr;
+                return nullptr;
+            }
+            // the cached context is kept for the frames of the same size and format, update it when the color space or range changes
+            int srcRange, dstRange, brightness, contrast, saturation;
+            int *invTable0, *table0;
+            const int* coeffs = sws_getCoefficients(srcfrm->colorspace);
+            const int frmSrcRange = srcfrm->color_range == AVCOL_RANGE_JPEG ? 1 : 0;
+            if (sws_getColorspaceDetails(swsCtx, &invTable0, &srcRange, &table0, &dstRange, &brightness, &contrast, &saturation) >= 0
+                && (swsCtx != m_vidSwsCtx || srcRange != frmSrcRange || memcmp(invTable0, coeffs, 4*sizeof(int)) != 0))
+                sws_setColorspaceDetails(swsCtx, coeffs, frmSrcRange, coeffs, dstRange, brightness, contrast, saturation);
+            m_vidSwsCtx = swsCtx;
+            encfrm = AllocSelfFreeAVFramePtr();
+            if (!encfrm)
+            {
+                m_logger->Log(Error) << "FAILED to allocate new 'SelfFreeAVFramePtr'!" << endl;
+                return nullptr;
+            }
+            encfrm->width = m_videncCtx->width;
+            encfrm->height = m_videncCtx->height;
+            encfrm->format = (int)m_videncPixfmt;
+            int fferr = av_frame_get_buffer(encfrm.get(), 0);
+            if (fferr < 0)
+            {
+                m_logger->Log(Error) << FFapiFailureMessage("av_frame_get_buffer", fferr) << endl;
+                return nullptr;
+            }
+            sws_scale(m_vidSwsCtx, srcfrm->data, srcfrm->linesize, 0, srcfrm->height, encfrm->data, encfrm->linesize);
+            av_frame_copy_props(encfrm.get(), srcfrm);
+        }
+        encfrm->pts = av_rescale_q(pos, MILLISEC_TIMEBASE, m_videncCtx->time_base);
+        // do not force the picture types of the source on the encoder
+        encfrm->pict_type = AV_PICTURE_TYPE_NONE;
+        return encfrm;
+    }
+
+    bool IsCopiedPacketQueueEmpty()
+    {
+        lock_guard<mutex> lk(m_vidpktQLock);
+        return m_vidpktQ.empty();
+    }
+
     void VideoEncodingThreadProc()
     {
         m_logger->Log(DEBUG) << "Enter VideoEncodingThreadProc()..." << endl;
 
         SelfFreeAVFramePtr encfrm;
+        SelfFreeAVPacketPtr cpypkt;
+        uint32_t framesInEncoder = 0;
         m_vidNullFrameSent = false;
         while (!m_quit)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
             int fferr;
 
-            if (!encfrm)
+            if (!encfrm && !cpypkt)
             {
-                if (!m_vmatQ.empty())
+                VideoInput vinp;
+                if (m_vidinpQ.TryPop(vinp))
                 {
-                    ImGui::ImMat vmat;
+                    if (vinp.isHwfrm)
                     {
-                        lock_guard<mutex> lk(m_vmatQLock);
-                        vmat = m_vmatQ.front();
-                        m_vmatQ.pop_front();
+                        m_queuedHwfrmCnt--;
+                        m_wakeupEvt.Notify();
                     }
-                    encfrm = ConvertImMatToAVFrame(vmat);
+                    if (vinp.avpkt)
+                        cpypkt = vinp.avpkt;
+                    else
+                        encfrm = vinp.avfrm ? PassThroughAVFrame(vinp.avfrm, vinp.pos) : ConvertImMatToAVFrame(vinp.vmat);
                 }
-                else if (m_vidinpEof)
+                else if (m_vidinpEof && IsCopiedPacketQueueEmpty())
                 {
                     {
                         lock_guard<mutex> lk(m_videncLock);
@@ -1095,7 +1623,40 @@ private:
                 }
             }
 
-            if (encfrm)
+            // the copied packets go to the muxer only after the encoder is drained, and the encoder is reset for the frames after them
+            if (cpypkt)
+            {
+                if (framesInEncoder > 0)
+                {
+                    lock_guard<mutex> lk(m_videncLock);
+                    if (!m_videncDraining)
+                    {
+                        m_videncDraining = true;
+                        avcodec_send_frame(m_videncCtx, NULL);
+                        idleLoop = false;
+                    }
+                    else if (m_videncDrained)
+                    {
+                        avcodec_flush_buffers(m_videncCtx);
+                        m_videncDraining = false;
+                        m_videncDrained = false;
+                        framesInEncoder = 0;
+                        idleLoop = false;
+                    }
+                }
+                else
+                {
+                    lock_guard<mutex> lk(m_vidpktQLock);
+                    if (m_vidpktQ.size() < m_vidinpQMaxSize)
+                    {
+                        m_vidpktQ.push_back(cpypkt);
+                        cpypkt = nullptr;
+                        idleLoop = false;
+                    }
+                }
+            }
+
+            if (encfrm && IsCopiedPacketQueueEmpty())
             {
                 {
                     lock_guard<mutex> lk(m_videncLock);
@@ -1108,6 +1669,7 @@ private:
                     //     << MillisecToString(av_rescale_q(encfrm->pts, m_videncCtx->time_base, MILLISEC_TIMEBASE))
                     //     << "(" << encfrm->pts << ")." << endl;
                     encfrm = nullptr;
+                    framesInEncoder++;
                     idleLoop = false;
                 }
                 else
@@ -1124,10 +1686,14 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(2));
+                m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
+            else
+                m_wakeupEvt.Notify();
         }
 
-        m_logger->Log(DEBUG) << "Leave VideoEncodingThreadProc()." << endl;
+        auto qstats = m_vidinpQ.GetStats();
+        m_logger->Log(DEBUG) << "Leave VideoEncodingThreadProc(). Input queue: maxDepth=" << qstats.maxDepth << "/" << qstats.capacity
+                << ", producerStall=" << qstats.producerStallUs/1000 << "ms, consumerStall=" << qstats.consumerStallUs/1000 << "ms." << endl;
     }
 
     void AudioEncodingThreadProc()
@@ -1138,18 +1704,13 @@ private:
         m_audNullFrameSent = false;
         while (!m_quit)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
             int fferr;
 
             if (!encfrm)
             {
-                if (!m_audfrmQ.empty())
-                {
-                    lock_guard<mutex> lk(m_audfrmQLock);
-                    encfrm = m_audfrmQ.front();
-                    m_audfrmQ.pop_front();
-                }
-                else if (m_audinpEof)
+                if (!m_audfrmQ.TryPop(encfrm) && m_audinpEof)
                 {
                     {
                         lock_guard<mutex> lk(m_audencLock);
@@ -1200,10 +1761,14 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(2));
+                m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
+            else
+                m_wakeupEvt.Notify();
         }
 
-        m_logger->Log(DEBUG) << "Leave AudioEncodingThreadProc()." << endl;
+        auto qstats = m_audfrmQ.GetStats();
+        m_logger->Log(DEBUG) << "Leave AudioEncodingThreadProc(). Input queue: maxDepth=" << qstats.maxDepth << "/" << qstats.capacity
+                << ", producerStall=" << qstats.producerStallUs/1000 << "ms, consumerStall=" << qstats.consumerStallUs/1000 << "ms." << endl;
     }
 
     void MuxingThreadProc()
@@ -1212,19 +1777,50 @@ private:
 
         AVPacket avpkt{0};
         bool avpktLoaded = false;
+        bool vidpktIsCopied = false;
         int64_t vidposMts{0}, audposMts{0};
+        VideoTimestampStitcher vidTsStitcher;
+        int vidRunIsCopied = -1;
         while (!m_quit)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
             int fferr;
 
             // bool toRecvVidpkt = !m_videncEof && !avpktLoaded && (vidposMts <= audposMts || m_audencEof);
             // m_logger->Log(DEBUG) << "toRecvVidpkt=" << toRecvVidpkt << ", m_videncEof=" << m_videncEof << ", avpktLoaded=" << avpktLoaded << ", vidposMts=" << vidposMts << ", audposMts=" << audposMts << ", m_audencEof=" << m_audencEof << endl;
-            if (!m_videncEof && !avpktLoaded && (vidposMts <= audposMts || m_audencEof))
+            // the copied packets are only queued while the encoder is drained, so they are taken before any encoded packet
+            if (!avpktLoaded && (vidposMts <= audposMts || m_audencEof))
             {
+                SelfFreeAVPacketPtr cpypkt;
+                {
+                    lock_guard<mutex> lk(m_vidpktQLock);
+                    if (!m_vidpktQ.empty())
+                    {
+                        cpypkt = m_vidpktQ.front();
+                        m_vidpktQ.pop_front();
+                    }
+                }
+                if (cpypkt)
+                {
+                    av_packet_move_ref(&avpkt, cpypkt.get());
+                    avpkt.stream_index = m_vidStmIdx;
+                    avpktLoaded = true;
+                    vidpktIsCopied = true;
+                    idleLoop = false;
+                    vidposMts = av_rescale_q(avpkt.pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE);
+                    m_logger->Log(DEBUG) << "Got copied VIDEO packet at " << MillisecToString(vidposMts) << "(" << avpkt.pts << ")." << endl;
+                }
+            }
+            if (!m_videncEof && !m_videncDrained && !avpktLoaded && (vidposMts <= audposMts || m_audencEof))
+            {
+                bool isDraining;
                 {
                     lock_guard<mutex> lk(m_videncLock);
                     fferr = avcodec_receive_packet(m_videncCtx, &avpkt);
+                    isDraining = m_videncDraining;
+                    if (fferr == AVERROR_EOF && isDraining)
+                        m_videncDrained = true;
                     // m_logger->Log(DEBUG) << "\t\t\t--> Receive video packet, fferr=" << fferr << endl;
                 }
                 if (fferr == 0)
@@ -1232,13 +1828,16 @@ private:
                     avpkt.stream_index = m_vidStmIdx;
                     av_packet_rescale_ts(&avpkt, m_videncCtx->time_base, m_vidAvStm->time_base);
                     avpktLoaded = true;
+                    vidpktIsCopied = false;
                     idleLoop = false;
                     vidposMts = av_rescale_q(avpkt.pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE);
                     m_logger->Log(DEBUG) << "Got VIDEO packet at " << MillisecToString(vidposMts) << "(" << avpkt.pts << ")." << endl;
                 }
                 else if (fferr == AVERROR_EOF)
                 {
-                    m_videncEof = true;
+                    // reaching the end of a drain before a copied range is not the end of the video stream
+                    if (!isDraining)
+                        m_videncEof = true;
                     idleLoop = false;
                 }
                 else if (fferr != AVERROR(EAGAIN))
@@ -1292,6 +1891,21 @@ private:
 
             if (avpktLoaded)
             {
+                // at the joints of the copied and the re-encoded ranges, the reordering delays of the two may overlap
+                if (avpkt.stream_index == m_vidStmIdx)
+                {
+                    if (vidRunIsCopied != (int)vidpktIsCopied)
+                    {
+                        vidTsStitcher.StartRun();
+                        vidRunIsCopied = (int)vidpktIsCopied;
+                    }
+                    vidTsStitcher.Stitch(avpkt.pts, avpkt.dts);
+                    if (!vidpktIsCopied && m_vidcpyNalLengthSize > 0 && !ConvertAnnexBToLengthPrefixed(&avpkt, m_vidcpyNalLengthSize))
+                    {
+                        m_logger->Log(Error) << "In muxing thread, FAILED to convert the re-encoded VIDEO packet into the NAL unit format of the copied stream!" << endl;
+                        break;
+                    }
+                }
                 fferr = av_interleaved_write_frame(m_avfmtCtx, &avpkt);
                 if (fferr == 0)
                 {
@@ -1305,16 +1919,20 @@ private:
                     break;
                 }
             }
-            else if (((!HasVideo() || m_videncEof) && (!HasAudio() || m_audencEof)) || m_encErr)
+            else if (((!HasVideo() || (m_videncEof && IsCopiedPacketQueueEmpty())) && (!HasAudio() || m_audencEof)) || m_encErr)
             {
                 break;
             }
 
+            // packets becoming available inside the encoders are not signaled, check them with a short interval
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(1));
+                m_wakeupEvt.Wait(wakeupSeq, 2);
+            else
+                m_wakeupEvt.Notify();
         }
 
         m_muxEof = true;
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave MuxingThreadProc()." << endl;
     }
 
@@ -1324,6 +1942,8 @@ private:
     recursive_mutex m_apiLock;
     bool m_vidPreferUseHw{true};
     bool m_quit{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
     bool m_opened{false};
     bool m_started{false};
 
@@ -1339,6 +1959,7 @@ private:
     AVBufferRef* m_videncHwDevCtx{nullptr};
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
     AVPixelFormat m_videncPixfmt{AV_PIX_FMT_NONE};
+    SwsContext* m_vidSwsCtx{nullptr};
     AVCodecContext* m_audencCtx{nullptr};
     mutex m_audencLock;
     uint32_t m_audencFrameSamples{0};
@@ -1356,24 +1977,30 @@ private:
     double m_dataQCacheDur{5};
     // video encoding thread
     thread m_videncThread;
-    list<ImGui::ImMat> m_vmatQ;
-    uint32_t m_vmatQMaxSize;
-    mutex m_vmatQLock;
+    SpscRingBuffer<VideoInput> m_vidinpQ{0, &m_wakeupEvt};
+    uint32_t m_vidinpQMaxSize;
+    atomic_int32_t m_queuedHwfrmCnt{0};
     bool m_vidinpEof{false};
     bool m_vidNullFrameSent{false};
     bool m_videncEof{false};
     // audio encoding thread
     thread m_audencThread;
-    list<SelfFreeAVFramePtr> m_audfrmQ;
+    SpscRingBuffer<SelfFreeAVFramePtr> m_audfrmQ{0, &m_wakeupEvt};
     uint32_t m_audfrmQMaxSize;
-    mutex m_audfrmQLock;
     bool m_audinpEof{false};
     bool m_audNullFrameSent{false};
     bool m_audencEof{false};
     // muxing thread
     thread m_muxThread;
-    list<AVPacket*> m_vidpktQ;
+    list<SelfFreeAVPacketPtr> m_vidpktQ;
     mutex m_vidpktQLock;
+    bool m_videncDraining{false};
+    bool m_videncDrained{false};
+    // video stream copy
+    AVFormatContext* m_srcFmtCtx{nullptr};
+    int m_srcVidStmIdx{-1};
+    bool m_vidcpyHeaderMismatch{false};
+    int m_vidcpyNalLengthSize{0};
     list<AVPacket*> m_audpktQ;
     mutex m_audpktQLock;
     bool m_muxEof{false};
@@ -1396,6 +2023,92 @@ ALogger* MediaEncoder::GetLogger()
     return Logger::GetLogger("MEncoder");
 }
 
+MediaEncoder::StreamCopyRange MediaEncoder::PlanVideoStreamCopy(const MediaParser::VideoFrameIndex& frameIndex, int64_t startPos, int64_t endPos)
+{
+    StreamCopyRange range;
+    if (!Ratio::IsValid(frameIndex.timeBase) || frameIndex.keyFrames.empty() || endPos <= startPos)
+        return range;
+    const AVRational tb = { frameIndex.timeBase.num, frameIndex.timeBase.den };
+    auto GetFramePts = [&frameIndex] (uint32_t idx) {
+        auto& frm = frameIndex.frames[idx];
+        return frm.pts != AV_NOPTS_VALUE ? frm.pts : frm.dts;
+    };
+
+    // positions are relative to the stream start time, as the ones of the readers and of 'CopyVideoPackets()'
+    const int64_t originPts = frameIndex.startTime;
+    const int64_t startPts = av_rescale_q_rnd(startPos, MILLISEC_TIMEBASE, tb, AV_ROUND_UP)+originPts;
+    const int64_t endPts = av_rescale_q_rnd(endPos, MILLISEC_TIMEBASE, tb, AV_ROUND_DOWN)+originPts;
+
+    // A GOP ends where the display of the next GOP begins, which is before the next key frame if the next GOP has
+    // leading pictures. The leading pictures of the first copied GOP are dropped, they're re-encoded instead.
+    const uint32_t gopCnt = (uint32_t)frameIndex.keyFrames.size();
+    vector<int64_t> gopMinPts(gopCnt, INT64_MAX), gopMaxPts(gopCnt, INT64_MIN);
+    for (uint32_t i = 0; i < gopCnt; i++)
+    {
+        const uint32_t frmEnd = min(frameIndex.keyFrames[i]+frameIndex.gopSizes[i], (uint32_t)frameIndex.frames.size());
+        for (uint32_t j = frameIndex.keyFrames[i]; j < frmEnd; j++)
+        {
+            const int64_t pts = GetFramePts(j);
+            if (pts == AV_NOPTS_VALUE)
+                continue;
+            if (pts < gopMinPts[i]) gopMinPts[i] = pts;
+            if (pts > gopMaxPts[i]) gopMaxPts[i] = pts;
+        }
+    }
+    auto GetGopEndPts = [&] (uint32_t i) {
+        return i+1 < gopCnt ? gopMinPts[i+1] : gopMaxPts[i]+1;
+    };
+
+    uint32_t firstGop = 0;
+    while (firstGop < gopCnt && GetFramePts(frameIndex.keyFrames[firstGop]) < startPts)
+        firstGop++;
+    if (firstGop >= gopCnt)
+        return range;
+    const int64_t copyStartPts = GetFramePts(frameIndex.keyFrames[firstGop]);
+    int64_t copyEndPts = AV_NOPTS_VALUE;
+    for (uint32_t i = firstGop; i < gopCnt && GetGopEndPts(i) <= endPts; i++)
+        copyEndPts = GetGopEndPts(i);
+    if (copyEndPts == AV_NOPTS_VALUE || copyEndPts <= copyStartPts)
+        return range;
+    range.startPos = av_rescale_q_rnd(copyStartPts-originPts, tb, MILLISEC_TIMEBASE, AV_ROUND_DOWN);
+    range.endPos = av_rescale_q_rnd(copyEndPts-originPts, tb, MILLISEC_TIMEBASE, AV_ROUND_DOWN);
+    return range;
+}
+
+void MediaEncoder::VideoTimestampStitcher::StartRun()
+{
+    runStarted = false;
+}
+
+void MediaEncoder::VideoTimestampStitcher::Stitch(int64_t& pts, int64_t& dts)
+{
+    if (!runStarted)
+    {
+        // the key frame starting a run has the smallest pts of the run, delay the run if it's not after the run before
+        runOffset = 0;
+        if (dts != AV_NOPTS_VALUE && lastDts != AV_NOPTS_VALUE && dts <= lastDts)
+            runOffset = lastDts+1-dts;
+        if (pts != AV_NOPTS_VALUE && maxPts != AV_NOPTS_VALUE && pts+runOffset <= maxPts)
+            runOffset = maxPts+1-pts;
+        runStarted = true;
+    }
+    // a broken dts order inside a run delays the rest of the run, never the dts alone
+    else if (dts != AV_NOPTS_VALUE && lastDts != AV_NOPTS_VALUE && dts+runOffset <= lastDts)
+    {
+        runOffset = lastDts+1-dts;
+    }
+    if (pts != AV_NOPTS_VALUE)
+    {
+        pts += runOffset;
+        if (pts > maxPts) maxPts = pts;
+    }
+    if (dts != AV_NOPTS_VALUE)
+    {
+        dts += runOffset;
+        lastDts = dts;
+    }
+}
+
 ostream& operator<<(ostream& os, const MediaEncoder::Option::EnumValue& enumval)
 {
     os << enumval.value;
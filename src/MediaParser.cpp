@@ -24,6 +24,10 @@
 #include <unordered_map>
 #include <algorithm>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
 #include "MediaParser.h"
 #include "FFUtils.h"
 extern "C"
@@ -47,6 +51,70 @@ using std::placeholders::_1;
 
 namespace MediaCore
 {
+// Layout of the video frame index sidecar, all the numbers are little-endian
+//   header: magic 'MCFI', u32 version, u64 media file size, i64 media modify time,
+//           i32 stream index, i32 time-base num, i32 time-base den, u32 frame count, u32 key frame count
+//   frames: pts, dts and pos of each frame, as zigzag varints of the delta to the previous frame
+//   key frames: the frame index delta to the previous key frame and the gop size, as varints
+static const char VIDEO_FRAME_INDEX_MAGIC[4] = {'M', 'C', 'F', 'I'};
+static const uint32_t VIDEO_FRAME_INDEX_VERSION = 1;
+static const string VIDEO_FRAME_INDEX_SUFFIX = ".mcidx";
+
+template<typename T>
+static void WriteRaw(ostream& os, T val)
+{
+    os.write((const char*)&val, sizeof(val));
+}
+
+template<typename T>
+static bool ReadRaw(istream& is, T& val)
+{
+    is.read((char*)&val, sizeof(val));
+    return (bool)is;
+}
+
+static void WriteVarint(ostream& os, uint64_t val)
+{
+    while (val >= 0x80)
+    {
+        os.put((char)(val|0x80));
+        val >>= 7;
+    }
+    os.put((char)val);
+}
+
+static bool ReadVarint(istream& is, uint64_t& val)
+{
+    val = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = is.get();
+        if (c == EOF)
+            return false;
+        val |= (uint64_t)(c&0x7f) << shift;
+        if ((c&0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void WriteDelta(ostream& os, int64_t val, int64_t prev)
+{
+    // unsigned arithmetic, so that AV_NOPTS_VALUE does not overflow
+    int64_t delta = (int64_t)((uint64_t)val-(uint64_t)prev);
+    WriteVarint(os, ((uint64_t)delta << 1)^(uint64_t)(delta >> 63));
+}
+
+static bool ReadDelta(istream& is, int64_t& val, int64_t prev)
+{
+    uint64_t zz;
+    if (!ReadVarint(is, zz))
+        return false;
+    int64_t delta = (int64_t)(zz >> 1)^-(int64_t)(zz&1);
+    val = (int64_t)((uint64_t)prev+(uint64_t)delta);
+    return true;
+}
+
 class MediaParser_Impl : public MediaParser
 {
 public:
@@ -63,6 +131,7 @@ public:
     virtual ~MediaParser_Impl()
     {
         m_quitTaskThread = true;
+        m_taskEvt.Notify();
         {
             lock_guard<mutex> lk(m_pendingTaskQLock);
             if (m_currTask)
@@ -102,6 +171,7 @@ public:
         {
             lock_guard<mutex> lk(m_pendingTaskQLock);
             m_pendingTaskQ.push_back(hTask);
+            m_taskEvt.Notify();
         }
 
         m_opened = true;
@@ -140,6 +210,7 @@ public:
         {
             lock_guard<mutex> lk(m_pendingTaskQLock);
             m_pendingTaskQ.push_back(hTask);
+            m_taskEvt.Notify();
         }
 
         m_imgsqFrameRate = frameRate;
@@ -170,6 +241,7 @@ public:
 
         m_hMediaInfo = nullptr;
         m_hVidSeekPoints = nullptr;
+        m_hVidFrameIndex = nullptr;
 
         m_url = "";
         m_errMsg = "";
@@ -189,6 +261,7 @@ public:
             if (iter == m_taskTable.end())
             {
                 hTask = TaskHolder(new ParseTask());
+                hTask->infoType = infoType;
                 ostringstream oss;
                 switch (infoType)
                 {
@@ -204,6 +277,15 @@ public:
                             return false;
                         }
                         break;
+                    case VIDEO_FRAME_INDEX:
+                        if (!m_isImageSequence)
+                            hTask->taskProc = bind(&MediaParser_Impl::ParseVideoFrameIndex, this, _1);
+                        else
+                        {
+                            m_errMsg = "Image sequence do NOT support parsing frame index!";
+                            return false;
+                        }
+                        break;
                     default:
                         oss << "Invalid argument value! There is no method to parse 'infoType'(" << to_string((int)infoType) << ").";
                         m_errMsg = oss.str();
@@ -215,11 +297,28 @@ public:
         if (hTask)
         {
             lock_guard<mutex> lk(m_pendingTaskQLock);
-            m_pendingTaskQ.push_back(hTask);
+            // the frame index scans the whole media, don't let it delay the other parsing tasks
+            auto insertPos = m_pendingTaskQ.end();
+            if (infoType != VIDEO_FRAME_INDEX)
+                insertPos = find_if(m_pendingTaskQ.begin(), m_pendingTaskQ.end(), [] (const TaskHolder& t) {
+                    return t->infoType == VIDEO_FRAME_INDEX; });
+            m_pendingTaskQ.insert(insertPos, hTask);
+            m_taskEvt.Notify();
         }
         return true;
     }
 
+    void SetFrameIndexCacheDirectory(const string& dirPath) override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        m_frmIdxCacheDir = dirPath;
+    }
+
+    string GetFrameIndexCacheDirectory() const override
+    {
+        return m_frmIdxCacheDir;
+    }
+
     bool CheckInfoReady(InfoType infoType) override
     {
         bool ready = false;
@@ -294,6 +393,13 @@ public:
         return m_hVidSeekPoints;
     }
 
+    VideoFrameIndex::Holder GetVideoFrameIndex(bool wait) override
+    {
+        if (wait)
+            WaitTaskDone(VIDEO_FRAME_INDEX);
+        return m_hVidFrameIndex;
+    }
+
     bool IsOpened() const override
     {
         return m_opened;
@@ -320,6 +426,7 @@ private:
 
     struct ParseTask
     {
+        InfoType infoType;
         function<bool(TaskHolder)> taskProc;
         bool cancel{false};
         bool failed{false};
@@ -341,6 +448,7 @@ private:
     {
         while (!m_quitTaskThread)
         {
+            const uint64_t wakeupSeq = m_taskEvt.Sequence();
             bool idleLoop = true;
             if (!m_pendingTaskQ.empty())
             {
@@ -370,7 +478,7 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_taskEvt.Wait(wakeupSeq, 1000);
         }
     }
 
@@ -486,6 +594,14 @@ private:
             return false;
         }
 
+        // the frame index sidecar saved by previous parsing makes the scanning unnecessary
+        if (m_hVidFrameIndex || LoadVideoFrameIndex())
+        {
+            m_hVidSeekPoints = GenerateSeekPointsFromFrameIndex(m_hVidFrameIndex);
+            m_logger->Log(INFO) << "Generate video seek points of media '" << m_url << "' from frame index. " << m_hVidSeekPoints->size() << " seek points are found." << endl;
+            return true;
+        }
+
         // find the 1st key frame pts
         int vidstmidx = m_bestVidStmIdx;
         AVStream* vidStream = m_avfmtCtx->streams[vidstmidx];
@@ -593,6 +709,247 @@ private:
         return true;
     }
 
+    MediaParser::SeekPointsHolder GenerateSeekPointsFromFrameIndex(VideoFrameIndex::Holder hIndex)
+    {
+        AVStream* vidStream = m_avfmtCtx->streams[m_bestVidStmIdx];
+        int64_t ptsStep = av_rescale_q((int64_t)(m_minSpIntervalSec*1000000), MICROSEC_TIMEBASE, vidStream->time_base);
+        vector<int64_t> keyPtsAry;
+        keyPtsAry.reserve(hIndex->keyFrames.size());
+        for (uint32_t frmIdx : hIndex->keyFrames)
+        {
+            auto& frm = hIndex->frames[frmIdx];
+            keyPtsAry.push_back(frm.pts != AV_NOPTS_VALUE ? frm.pts : frm.dts);
+        }
+        sort(keyPtsAry.begin(), keyPtsAry.end());
+
+        // keep the same density as the scanning approach, one seek point in every 'm_minSpIntervalSec' at least
+        SeekPointsHolder hSeekPoints(new vector<int64_t>());
+        for (int64_t pts : keyPtsAry)
+        {
+            if (pts == AV_NOPTS_VALUE)
+                continue;
+            if (hSeekPoints->empty() || pts >= hSeekPoints->back()+ptsStep)
+                hSeekPoints->push_back(pts);
+        }
+        return hSeekPoints;
+    }
+
+    bool ParseVideoFrameIndex(TaskHolder hTask)
+    {
+        if (m_bestVidStmIdx < 0)
+        {
+            hTask->errMsg = "No video stream found!";
+            return false;
+        }
+        if (m_hVidFrameIndex || LoadVideoFrameIndex())
+            return true;
+        if (!ResetAVFormatContext(hTask))
+            return false;
+
+        // only the packets of the video stream are needed, let the demuxer skip the others
+        const int vidstmidx = m_bestVidStmIdx;
+        AVStream* vidStream = m_avfmtCtx->streams[vidstmidx];
+        vector<AVDiscard> discardFlags(m_avfmtCtx->nb_streams);
+        for (unsigned i = 0; i < m_avfmtCtx->nb_streams; i++)
+        {
+            discardFlags[i] = m_avfmtCtx->streams[i]->discard;
+            if ((int)i != vidstmidx)
+                m_avfmtCtx->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        VideoFrameIndex::Holder hIndex(new VideoFrameIndex());
+        hIndex->timeBase = { vidStream->time_base.num, vidStream->time_base.den };
+        hIndex->startTime = vidStream->start_time != AV_NOPTS_VALUE ? vidStream->start_time : 0;
+        AVPacket avpkt = {0};
+        int fferr = 0;
+        while (!hTask->cancel)
+        {
+            fferr = av_read_frame(m_avfmtCtx, &avpkt);
+            if (fferr < 0)
+                break;
+            if (avpkt.stream_index == vidstmidx)
+            {
+                if ((avpkt.flags&AV_PKT_FLAG_KEY) != 0)
+                    hIndex->keyFrames.push_back((uint32_t)hIndex->frames.size());
+                hIndex->frames.push_back({ avpkt.pts, avpkt.dts, avpkt.pos });
+            }
+            av_packet_unref(&avpkt);
+        }
+        for (unsigned i = 0; i < m_avfmtCtx->nb_streams; i++)
+            m_avfmtCtx->streams[i]->discard = discardFlags[i];
+        if (hTask->cancel)
+            return true;
+        if (fferr != AVERROR_EOF)
+        {
+            hTask->errMsg = FFapiFailureMessage("av_read_frame", fferr);
+            return false;
+        }
+        if (hIndex->keyFrames.empty())
+        {
+            hTask->errMsg = "No key-frame is found!";
+            return false;
+        }
+
+        hIndex->gopSizes.resize(hIndex->keyFrames.size());
+        for (size_t i = 0; i < hIndex->keyFrames.size(); i++)
+        {
+            uint32_t nextKeyIdx = i+1 < hIndex->keyFrames.size() ? hIndex->keyFrames[i+1] : (uint32_t)hIndex->frames.size();
+            hIndex->gopSizes[i] = nextKeyIdx-hIndex->keyFrames[i];
+        }
+        m_hVidFrameIndex = hIndex;
+        m_logger->Log(INFO) << "Parse video frame index of media '" << m_url << "' done. " << hIndex->frames.size() << " frames, "
+                << hIndex->keyFrames.size() << " key frames are found." << endl;
+        SaveVideoFrameIndex(hIndex);
+        return true;
+    }
+
+    string GetVideoFrameIndexPath() const
+    {
+        if (m_frmIdxCacheDir.empty())
+            return "";
+        string dirPath = m_frmIdxCacheDir;
+        if (dirPath.back() != '/' && dirPath.back() != '\\')
+            dirPath += "/";
+        ostringstream oss;
+        oss << dirPath << hex << setw(16) << setfill('0') << SysUtils::Fnv1aHash(m_url) << VIDEO_FRAME_INDEX_SUFFIX;
+        return oss.str();
+    }
+
+    bool LoadVideoFrameIndex()
+    {
+        const string idxPath = GetVideoFrameIndexPath();
+        if (idxPath.empty())
+            return false;
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (!SysUtils::GetFileStatus(m_url, fileSize, modifyTime))
+            return false;
+        ifstream ifs(idxPath, ios::in|ios::binary);
+        if (!ifs.is_open())
+            return false;
+
+        char magic[4];
+        uint32_t version, frameCount, keyFrameCount;
+        uint64_t recFileSize;
+        int64_t recModifyTime;
+        int32_t stmidx, tbNum, tbDen;
+        ifs.read(magic, sizeof(magic));
+        if (!ifs || memcmp(magic, VIDEO_FRAME_INDEX_MAGIC, sizeof(magic)) != 0
+            || !ReadRaw(ifs, version) || version != VIDEO_FRAME_INDEX_VERSION
+            || !ReadRaw(ifs, recFileSize) || !ReadRaw(ifs, recModifyTime)
+            || !ReadRaw(ifs, stmidx) || !ReadRaw(ifs, tbNum) || !ReadRaw(ifs, tbDen)
+            || !ReadRaw(ifs, frameCount) || !ReadRaw(ifs, keyFrameCount))
+        {
+            m_logger->Log(WARN) << "Video frame index file '" << idxPath << "' is INVALID or of an unsupported version." << endl;
+            return false;
+        }
+        AVStream* vidStream = m_avfmtCtx->streams[m_bestVidStmIdx];
+        if (recFileSize != fileSize || recModifyTime != modifyTime || stmidx != m_bestVidStmIdx
+            || tbNum != vidStream->time_base.num || tbDen != vidStream->time_base.den)
+        {
+            m_logger->Log(INFO) << "Video frame index file '" << idxPath << "' is OUT OF DATE." << endl;
+            return false;
+        }
+
+        VideoFrameIndex::Holder hIndex(new VideoFrameIndex());
+        hIndex->timeBase = { tbNum, tbDen };
+        hIndex->startTime = vidStream->start_time != AV_NOPTS_VALUE ? vidStream->start_time : 0;
+        hIndex->frames.resize(frameCount);
+        VideoFrameIndex::Frame prev = { 0, 0, 0 };
+        for (auto& frm : hIndex->frames)
+        {
+            if (!ReadDelta(ifs, frm.pts, prev.pts) || !ReadDelta(ifs, frm.dts, prev.dts) || !ReadDelta(ifs, frm.pos, prev.pos))
+            {
+                m_logger->Log(WARN) << "Video frame index file '" << idxPath << "' is TRUNCATED." << endl;
+                return false;
+            }
+            prev = frm;
+        }
+        hIndex->keyFrames.resize(keyFrameCount);
+        hIndex->gopSizes.resize(keyFrameCount);
+        uint32_t prevKeyIdx = 0;
+        for (uint32_t i = 0; i < keyFrameCount; i++)
+        {
+            uint64_t keyIdxDelta, gopSize;
+            if (!ReadVarint(ifs, keyIdxDelta) || !ReadVarint(ifs, gopSize) || prevKeyIdx+keyIdxDelta >= frameCount)
+            {
+                m_logger->Log(WARN) << "Video frame index file '" << idxPath << "' is TRUNCATED." << endl;
+                return false;
+            }
+            prevKeyIdx += (uint32_t)keyIdxDelta;
+            hIndex->keyFrames[i] = prevKeyIdx;
+            hIndex->gopSizes[i] = (uint32_t)gopSize;
+        }
+        if (hIndex->keyFrames.empty())
+            return false;
+
+        m_hVidFrameIndex = hIndex;
+        m_logger->Log(INFO) << "Load video frame index of media '" << m_url << "' from '" << idxPath << "'. " << frameCount << " frames, "
+                << keyFrameCount << " key frames." << endl;
+        return true;
+    }
+
+    bool SaveVideoFrameIndex(VideoFrameIndex::Holder hIndex)
+    {
+        const string idxPath = GetVideoFrameIndexPath();
+        if (idxPath.empty())
+            return false;
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (!SysUtils::GetFileStatus(m_url, fileSize, modifyTime))
+            return false;
+        // write to a temporary file first, so an interrupted writing never leaves a broken index
+        const string tmpPath = SysUtils::MakeUniqueTempPath(idxPath);
+        {
+            ofstream ofs(tmpPath, ios::out|ios::binary|ios::trunc);
+            if (!ofs.is_open())
+            {
+                m_logger->Log(WARN) << "CANNOT create video frame index file '" << tmpPath << "'." << endl;
+                return false;
+            }
+            ofs.write(VIDEO_FRAME_INDEX_MAGIC, sizeof(VIDEO_FRAME_INDEX_MAGIC));
+            WriteRaw(ofs, VIDEO_FRAME_INDEX_VERSION);
+            WriteRaw(ofs, fileSize);
+            WriteRaw(ofs, modifyTime);
+            WriteRaw(ofs, (int32_t)m_bestVidStmIdx);
+            WriteRaw(ofs, hIndex->timeBase.num);
+            WriteRaw(ofs, hIndex->timeBase.den);
+            WriteRaw(ofs, (uint32_t)hIndex->frames.size());
+            WriteRaw(ofs, (uint32_t)hIndex->keyFrames.size());
+            VideoFrameIndex::Frame prev = { 0, 0, 0 };
+            for (auto& frm : hIndex->frames)
+            {
+                WriteDelta(ofs, frm.pts, prev.pts);
+                WriteDelta(ofs, frm.dts, prev.dts);
+                WriteDelta(ofs, frm.pos, prev.pos);
+                prev = frm;
+            }
+            uint32_t prevKeyIdx = 0;
+            for (size_t i = 0; i < hIndex->keyFrames.size(); i++)
+            {
+                WriteVarint(ofs, hIndex->keyFrames[i]-prevKeyIdx);
+                WriteVarint(ofs, hIndex->gopSizes[i]);
+                prevKeyIdx = hIndex->keyFrames[i];
+            }
+            if (!ofs)
+            {
+                m_logger->Log(WARN) << "FAILED to write video frame index file '" << tmpPath << "'." << endl;
+                ofs.close();
+                remove(tmpPath.c_str());
+                return false;
+            }
+        }
+        remove(idxPath.c_str());
+        if (rename(tmpPath.c_str(), idxPath.c_str()) != 0)
+        {
+            m_logger->Log(WARN) << "FAILED to rename '" << tmpPath << "' to '" << idxPath << "'." << endl;
+            remove(tmpPath.c_str());
+            return false;
+        }
+        m_logger->Log(DEBUG) << "Saved video frame index to '" << idxPath << "'." << endl;
+        return true;
+    }
+
     bool ResetAVFormatContext(TaskHolder hTask)
     {
         int fferr = avformat_seek_file(m_avfmtCtx, -1, INT64_MIN, m_avfmtCtx->start_time, m_avfmtCtx->start_time, 0);
@@ -611,7 +968,8 @@ private:
         {
             lock_guard<mutex> lk(m_taskTableLock);
             auto iter = m_taskTable.find(type);
-            hTask = iter->second;
+            if (iter != m_taskTable.end())
+                hTask = iter->second;
         }
         if (!hTask)
             return;
@@ -626,6 +984,7 @@ private:
     thread m_taskThread;
     TaskHolder m_currTask;
     bool m_quitTaskThread{false};
+    SysUtils::WaitableEvent m_taskEvt;
     list<TaskHolder> m_pendingTaskQ;
     mutex m_pendingTaskQLock;
     condition_variable m_taskDoneCv;
@@ -641,6 +1000,8 @@ private:
 
     SeekPointsHolder m_hVidSeekPoints;
     double m_minSpIntervalSec{2};
+    VideoFrameIndex::Holder m_hVidFrameIndex;
+    string m_frmIdxCacheDir;
 
     SysUtils::FileIterator::Holder m_hFileIter;
     bool m_isImageSequence{false};
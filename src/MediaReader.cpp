@@ -26,6 +26,10 @@
 #include "MediaReader.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "ThreadPoolExecutor.h"
+#include "SpscRingBuffer.h"
+#include "VideoFrameCache.h"
+#include "MemoryGovernor.h"
 extern "C"
 {
     #include "libavutil/avutil.h"
@@ -48,6 +52,12 @@ using namespace Logger;
 
 namespace MediaCore
 {
+using SysUtils::ThreadPoolExecutor;
+using SysUtils::SpscRingBuffer;
+
+// the frames within this count of frame intervals from a seek target are put into the shared frame cache
+static const int64_t FRAME_CACHE_TARGET_FRAMES = 2;
+
 class MediaReader_Impl : public MediaReader
 {
 public:
@@ -300,6 +310,8 @@ public:
 
     bool Start(bool suspend) override
     {
+        // declared before the lock guard, so the notification is issued after 'm_apiLock' is released
+        SysUtils::ScopedNotifier lockReleaseNotifier(m_wakeupEvt);
         lock_guard<recursive_mutex> lk(m_apiLock);
         if (!m_configured)
         {
@@ -363,6 +375,7 @@ public:
         m_readForward = true;
         m_seekPosUpdated = false;
         m_seekPos = 0;
+        m_frmCacheTargetPos = 0;
         m_vidfrmIntvMts = 0;
         m_hSeekPoints = nullptr;
         m_vidDurMts = 0;
@@ -392,6 +405,7 @@ public:
     void Close() override
     {
         m_close = true;
+        m_wakeupEvt.Notify();
         lock_guard<recursive_mutex> lk(m_apiLock);
         WaitAllThreadsQuit();
         FlushAllQueues();
@@ -437,6 +451,7 @@ public:
         m_readForward = true;
         m_seekPosUpdated = false;
         m_seekPos = 0;
+        m_frmCacheTargetPos = 0;
         m_vidfrmIntvMts = 0;
         m_hSeekPoints = nullptr;
         m_vidDurMts = 0;
@@ -454,6 +469,7 @@ public:
             delete m_pFrmCvt;
             m_pFrmCvt = nullptr;
         }
+        m_hFrameCache = nullptr;
 
         m_prepared = false;
         m_started = false;
@@ -487,6 +503,7 @@ public:
         m_logger->Log(DEBUG) << "--> seek pos: " << pos << endl;
         if (m_isVideoReader)
         {
+            m_frmCacheTargetPos = pos;
             bool deferred = true;
             if (m_apiLock.try_lock())
             {
@@ -502,6 +519,7 @@ public:
                 lock_guard<mutex> lk(m_seekPosLock);
                 m_seekPos = pos;
                 m_seekPosUpdated = true;
+                m_wakeupEvt.Notify();
             }
         }
         else
@@ -539,6 +557,7 @@ public:
             if (m_prepared)
                 UpdateCacheWindow(m_cacheWnd.readPos, true);
             m_audReadEof = false;
+            m_wakeupEvt.Notify();
         }
     }
 
@@ -558,6 +577,7 @@ public:
 
     void Wakeup() override
     {
+        SysUtils::ScopedNotifier lockReleaseNotifier(m_wakeupEvt);
         lock_guard<recursive_mutex> lk(m_apiLock);
         if (!m_started)
         {
@@ -617,8 +637,8 @@ public:
             eof = false;
             return true;
         }
-        while (!m_quitThread && !m_prepared && wait)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        if (wait)
+            m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
         if (m_close)
         {
             m_errMsg = "This 'MediaReader' instance is CLOSED!";
@@ -631,6 +651,15 @@ public:
             m = m_prevReadImg;
             return true;
         }
+        // another reader of the same source may have the frame converted already
+        if (m_hFrameCache && m_hFrameCache->Get(m_frmCacheKey, CvtMtsToPts(pos), m, m_vidfrmIntvPts-1))
+        {
+            m.time_stamp = (double)pos/1000;
+            m_prevReadPos = pos;
+            m_prevReadImg = m;
+            UpdateCacheWindow(pos);
+            return true;
+        }
         if (IsSuspended() && !m_isImage)
         {
             m_errMsg = "This 'MediaReader' instance is SUSPENDED!";
@@ -666,8 +695,7 @@ public:
             m_errMsg = "This 'MediaReader' instance is NOT STARTED yet!";
             return false;
         }
-        while (!m_quitThread && !m_prepared)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
         if (m_close)
         {
             m_errMsg = "This 'MediaReader' instance is closed!";
@@ -790,6 +818,43 @@ public:
         return { m_forwardCacheDur, m_backwardCacheDur };
     }
 
+    void SetReverseBufferFrames(uint32_t frames) override
+    {
+        // the backward reading of this reader is bounded by the cache duration
+    }
+
+    void EnableScrubMode(bool enable) override
+    {
+        // the seeking of this reader always decodes up to the exact frame
+    }
+
+    bool IsScrubModeEnabled() const override
+    {
+        return false;
+    }
+
+    void SetMemoryPriority(int32_t priority) override
+    {
+        // the cache is bounded by 'SetCacheDuration()' and not registered to the memory governor, the priority
+        // is only kept for 'GetMemoryPrioritySetting()'
+        m_memPriority = priority;
+    }
+
+    int32_t GetMemoryPrioritySetting() const override
+    {
+        return m_memPriority;
+    }
+
+    void ResetReadState() override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_opened)
+            SetDirection(true);
+        m_memPriority = MemoryGovernor::PRIORITY_NORMAL;
+        m_prevReadPos = 0;
+        m_prevReadImg.release();
+    }
+
     MediaInfo::Holder GetMediaInfo() const override
     {
         return m_hMediaInfo;
@@ -869,8 +934,7 @@ public:
         if (m_outFrmSize > 0 || !m_started)
             return m_outFrmSize;
 
-        while (!m_quitThread && !m_prepared)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
         return m_outFrmSize;
     }
 
@@ -884,6 +948,16 @@ public:
         m_vidPreferUseHw = enable;
     }
 
+    void SetVideoConvertThreadCount(uint32_t count) override
+    {
+        m_cvtThreadCount = count;
+    }
+
+    void SetKeepHwFrames(bool keep) override
+    {
+        // the frames of this reader are always converted into ImMat, there is no frame to keep
+    }
+
     void SetLogLevel(Logger::Level l) override
     {
         m_logger->SetShowLevels(l);
@@ -984,21 +1058,9 @@ private:
         m_prepared = false;
     }
 
+    // 'm_apiLock' must be held when calling this method
     bool Prepare()
     {
-        bool locked = false;
-        do {
-            locked = m_apiLock.try_lock();
-            if (!locked)
-                this_thread::sleep_for(chrono::milliseconds(5));
-        } while (!locked && !m_quitThread);
-        if (m_quitThread)
-        {
-            m_logger->Log(WARN) << "Abort 'Prepare' procedure! 'm_quitThread' is set!" << endl;
-            return false;
-        }
-
-        lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
         int fferr;
         if (!m_streamInfoFound)
         {
@@ -1035,9 +1097,29 @@ private:
             m_vidStartTime = m_vidAvStm->start_time != AV_NOPTS_VALUE ? m_vidAvStm->start_time : 0;
             m_vidTimeBase = m_vidAvStm->time_base;
             m_vidfrmIntvPts = av_rescale_q(1, av_inv_q(m_vidAvStm->r_frame_rate), m_vidAvStm->time_base);
+            if (!m_isImage)
+            {
+                // for the demuxers relying on the generic index, feeding the key frames of the frame index
+                // lets 'avformat_seek_file()' jump to the byte offset instead of searching by reading packets.
+                // The index is only used if it is enabled on the parser, building it is a full scan of the media.
+                auto hFrmIdx = m_hParser->GetVideoFrameIndex(false);
+                if (hFrmIdx && (m_avfmtCtx->iformat->flags&AVFMT_GENERIC_INDEX) != 0)
+                {
+                    for (uint32_t frmIdx : hFrmIdx->keyFrames)
+                    {
+                        auto& frm = hFrmIdx->frames[frmIdx];
+                        int64_t ts = frm.dts != AV_NOPTS_VALUE ? frm.dts : frm.pts;
+                        if (frm.pos >= 0 && ts != AV_NOPTS_VALUE)
+                            av_add_index_entry(m_vidAvStm, frm.pos, ts, 0, 0, AVINDEX_KEYFRAME);
+                    }
+                }
+            }
 
             m_viddecOpenOpts.onlyUseSoftwareDecoder = !m_vidPreferUseHw;
             m_viddecOpenOpts.useHardwareType = m_vidUseHwType;
+            // let the decoder output reduced resolution pictures when the output images are small enough
+            m_viddecOpenOpts.minPictureWidth = m_useSizeFactor ? (uint32_t)ceil(m_vidAvStm->codecpar->width*m_ssWFactor) : m_outWidth;
+            m_viddecOpenOpts.minPictureHeight = m_useSizeFactor ? (uint32_t)ceil(m_vidAvStm->codecpar->height*m_ssHFactor) : m_outHeight;
             FFUtils::OpenVideoDecoderResult res;
             if (FFUtils::OpenVideoDecoder(m_avfmtCtx, -1, &m_viddecOpenOpts, &res))
             {
@@ -1087,6 +1169,24 @@ private:
                     m_errMsg = m_pFrmCvt->GetError();
                     return false;
                 }
+                if (!m_pFrmCvt->SetThreadCount(m_cvtThreadCount))
+                {
+                    m_errMsg = m_pFrmCvt->GetError();
+                    return false;
+                }
+            }
+
+            if (!m_isImage)
+            {
+                m_hFrameCache = VideoFrameCache::GetDefaultInstance();
+                m_frmCacheKey.url = m_hParser->GetUrl();
+                m_frmCacheKey.streamIndex = m_vidStmIdx;
+                m_frmCacheKey.width = m_pFrmCvt->GetOutWidth();
+                m_frmCacheKey.height = m_pFrmCvt->GetOutHeight();
+                m_frmCacheKey.clrfmt = m_pFrmCvt->GetOutColorFormat();
+                m_frmCacheKey.dtype = m_pFrmCvt->GetOutDataType();
+                m_frmCacheKey.interp = m_pFrmCvt->GetResizeInterpolateMode();
+                m_frmCacheKey.useVulkan = m_pFrmCvt->IsUseVulkanConverter();
             }
         }
         else
@@ -1124,6 +1224,7 @@ private:
         ResetBuildTask();
 
         m_prepared = true;
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -1206,67 +1307,67 @@ private:
         string fileName = SysUtils::ExtractFileName(m_hParser->GetUrl());
         ostringstream thnOss;
         m_quitThread = false;
-        m_demuxThread = thread(&MediaReader_Impl::DemuxThreadProc, this);
+        m_demuxTaskCtx = DemuxTaskContext();
         thnOss << (m_isVideoReader ? "V" : "A") << "rdrDmx-" << fileName;
-        SysUtils::SetThreadName(m_demuxThread, thnOss.str());
+        m_demuxTask = m_hExecutor->Submit(thnOss.str(), [this] { return DemuxThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         if (m_isVideoReader)
         {
-            m_viddecThread = thread(&MediaReader_Impl::VideoDecodeThreadProc, this);
+            m_viddecTaskCtx = VideoDecodeTaskContext();
             thnOss.str(""); thnOss << "VrdrVdc-" << fileName;
-            SysUtils::SetThreadName(m_viddecThread, thnOss.str());
-            m_genVfThread = thread(&MediaReader_Impl::GenerateVideoFrameThreadProc, this);
+            m_viddecTask = m_hExecutor->Submit(thnOss.str(), [this] { return VideoDecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_genVfTaskCtx = GenerateFrameTaskContext();
             thnOss.str(""); thnOss << "VrdrGvf-" << fileName;
-            SysUtils::SetThreadName(m_genVfThread, thnOss.str());
+            m_genVfTask = m_hExecutor->Submit(thnOss.str(), [this] { return GenerateVideoFrameThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         }
         else
         {
-            m_auddecThread = thread(&MediaReader_Impl::AudioDecodeThreadProc, this);
+            m_auddecTaskCtx = AudioDecodeTaskContext();
             thnOss.str(""); thnOss << "ArdrAdc-" << fileName;
-            SysUtils::SetThreadName(m_auddecThread, thnOss.str());
-            m_genAfThread = thread(&MediaReader_Impl::GenerateAudioSamplesThreadProc, this);
+            m_auddecTask = m_hExecutor->Submit(thnOss.str(), [this] { return AudioDecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_genAfTaskCtx = GenerateFrameTaskContext();
             thnOss.str(""); thnOss << "ArdrGaf-" << fileName;
-            SysUtils::SetThreadName(m_genAfThread, thnOss.str());
+            m_genAfTask = m_hExecutor->Submit(thnOss.str(), [this] { return GenerateAudioSamplesThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         }
         if (m_isImage)
         {
-            m_releaseThread = thread(&MediaReader_Impl::ReleaseResourceProc, this);
-            thnOss << "VrdrRls-" << fileName;
-            SysUtils::SetThreadName(m_releaseThread, thnOss.str());
+            thnOss.str(""); thnOss << "VrdrRls-" << fileName;
+            m_releaseTask = m_hExecutor->Submit(thnOss.str(), [this] { return ReleaseResourceProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         }
     }
 
     void WaitAllThreadsQuit(bool callFromReleaseProc = false)
     {
         m_quitThread = true;
-        if (!callFromReleaseProc && m_releaseThread.joinable())
+        m_wakeupEvt.Notify();
+        if (!callFromReleaseProc && m_releaseTask)
         {
-            m_releaseThread.join();
-            m_releaseThread = thread();
+            m_releaseTask->Join();
+            m_releaseTask = nullptr;
         }
-        if (m_demuxThread.joinable())
+        if (m_demuxTask)
         {
-            m_demuxThread.join();
-            m_demuxThread = thread();
+            m_demuxTask->Join();
+            m_demuxTask = nullptr;
         }
-        if (m_viddecThread.joinable())
+        if (m_viddecTask)
         {
-            m_viddecThread.join();
-            m_viddecThread = thread();
+            m_viddecTask->Join();
+            m_viddecTask = nullptr;
         }
-        if (m_genVfThread.joinable())
+        if (m_genVfTask)
         {
-            m_genVfThread.join();
-            m_genVfThread = thread();
+            m_genVfTask->Join();
+            m_genVfTask = nullptr;
         }
-        if (m_auddecThread.joinable())
+        if (m_auddecTask)
         {
-            m_auddecThread.join();
-            m_auddecThread = thread();
+            m_auddecTask->Join();
+            m_auddecTask = nullptr;
         }
-        if (m_genAfThread.joinable())
+        if (m_genAfTask)
         {
-            m_genAfThread.join();
-            m_genAfThread = thread();
+            m_genAfTask->Join();
+            m_genAfTask = nullptr;
         }
     }
 
@@ -1285,6 +1386,7 @@ private:
         int64_t pts = CvtMtsToPts(pos);
         while (!m_close)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             // check if the readPos has been changed by another operation, such as Seek.
             // if so, abort this read operation
             if (m_cacheWnd.readPos != pos)
@@ -1347,15 +1449,14 @@ private:
                 break;
             if (!targetTasks.empty() && tasksDecodeDone)
                 break;
-            this_thread::sleep_for(chrono::milliseconds(2));
+            m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
         }
 
         if (foundBestFrame)
         {
             if (wait)
             {
-                while(!m_close && pBestCandidate->vmat.empty())
-                    this_thread::sleep_for(chrono::milliseconds(2));
+                m_wakeupEvt.WaitUntil([this, pBestCandidate] { return m_close || !pBestCandidate->vmat.empty(); });
             }
             if (!pBestCandidate->vmat.empty())
                 m = pBestCandidate->vmat;
@@ -1383,6 +1484,7 @@ private:
         pos = GetReadPos();
         do
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
 
             GopDecodeTaskHolder readTask = m_audReadTask;
@@ -1532,7 +1634,7 @@ private:
 
             needLoop = ((readTask && !readTask->cancel) || (!readTask && wait) || !idleLoop) && toReadSize > readSize && !m_audReadEof && !m_close;
             if (needLoop && idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
 
             // if (!needLoop && readSize < toReadSize)
             //     m_logger->Log(WARN) << "Quit 'ReadAudioSamples()' before 'readSize'(" << readSize << ") reaches 'toReadSize'(" << toReadSize << ")! readTask is " << (readTask ? "non-NULL" : "NULL")
@@ -1572,16 +1674,18 @@ private:
 
     struct GopDecodeTask
     {
-        GopDecodeTask(MediaReader_Impl& obj) : outterObj(obj) {}
+        GopDecodeTask(MediaReader_Impl& obj) : outterObj(obj), avpktQ(obj.m_maxPendingPktCnt, &obj.m_wakeupEvt) {}
 
         ~GopDecodeTask()
         {
-            for (AVPacket* avpkt : avpktQ)
+            AVPacket* avpkt;
+            while (avpktQ.TryPop(avpkt))
                 av_packet_free(&avpkt);
             for (VideoFrame& vf : vfAry)
                 if (vf.decfrm)
                     outterObj.m_pendingVidfrmCnt--;
             vfAry.clear();
+            outterObj.m_wakeupEvt.Notify();
         }
 
         MediaReader_Impl& outterObj;
@@ -1589,10 +1693,10 @@ private:
         list<VideoFrame> vfAry;
         list<AudioFrame> afAry;
         atomic_int32_t frmCnt{0};
-        list<AVPacket*> avpktQ;
+        // the demuxing task is the only producer and the decoding task is the only consumer
+        SpscRingBuffer<AVPacket*> avpktQ;
         list<int64_t> frmPtsAry;
         pair<int64_t, int64_t> frmPtsRange{INT64_MAX, INT64_MIN};
-        mutex avpktQLock;
         bool demuxStarted{false};
         bool demuxStopped{false};
         bool demuxSeeked{false};
@@ -1618,24 +1722,56 @@ private:
         return nxttsk;
     }
 
-    void DemuxThreadProc()
+    // states of the demuxing task that are kept between the steps
+    struct DemuxTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter DemuxThreadProc()..." << endl;
+        bool entered{false};
+        AVPacket avpkt = {0};
+        bool avpktLoaded{false};
+        GopDecodeTaskHolder currTask;
+        int64_t lastPktPts{INT64_MIN};
+        int64_t prevTaskSeekPtsSecond{INT64_MIN};
+        bool fileDemuxEof{false};
+        int stmidx{-1};
+    };
 
-        if (!m_prepared && !Prepare())
+    ThreadPoolExecutor::StepResult DemuxThreadProc()
+    {
+        auto& ctx = m_demuxTaskCtx;
+        if (!ctx.entered)
         {
-            m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
-            return;
+            m_logger->Log(DEBUG) << "Enter DemuxThreadProc()..." << endl;
+            ctx.entered = true;
         }
+        if (!m_prepared)
+        {
+            if (m_quitThread)
+            {
+                m_logger->Log(WARN) << "Abort 'Prepare' procedure! 'm_quitThread' is set!" << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            // the api lock is usually held shortly by the api which starts this task, that api notifies
+            // 'm_wakeupEvt' after releasing the lock
+            if (!m_apiLock.try_lock())
+                return ThreadPoolExecutor::STEP_IDLE;
+            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+            if (!Prepare())
+            {
+                m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+        }
+        if (ctx.stmidx < 0)
+            ctx.stmidx = m_isVideoReader ? m_vidStmIdx : m_audStmIdx;
 
-        AVPacket avpkt = {0};
-        bool avpktLoaded = false;
-        GopDecodeTaskHolder currTask = nullptr;
-        int64_t lastPktPts, prevTaskSeekPtsSecond;
-        prevTaskSeekPtsSecond = INT64_MIN;
-        bool fileDemuxEof = false;
-        int stmidx = m_isVideoReader ? m_vidStmIdx : m_audStmIdx;
-        while (!m_quitThread)
+        AVPacket& avpkt = ctx.avpkt;
+        bool& avpktLoaded = ctx.avpktLoaded;
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        int64_t& lastPktPts = ctx.lastPktPts;
+        int64_t& prevTaskSeekPtsSecond = ctx.prevTaskSeekPtsSecond;
+        bool& fileDemuxEof = ctx.fileDemuxEof;
+        const int stmidx = ctx.stmidx;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
 
@@ -1684,14 +1820,14 @@ private:
                             if (fferr < 0)
                             {
                                 m_logger->Log(Error) << "avformat_seek_file() FAILED for seeking to 'currTask->startPts'(" << currTask->seekPts.first << ")! fferr = " << fferr << "!" << endl;
-                                break;
+                                return LeaveDemuxThreadProc();
                             }
                             currTask->demuxSeeked = true;
                         }
                         fileDemuxEof = false;
                         int64_t ptsAfterSeek = INT64_MIN;
                         if (!ReadNextStreamPacket(stmidx, &avpkt, &avpktLoaded, &ptsAfterSeek))
-                            break;
+                            return LeaveDemuxThreadProc();
                         if (ptsAfterSeek == INT64_MAX)
                             fileDemuxEof = true;
                         else if ((m_isVideoReader && ptsAfterSeek <= m_vidAvStm->start_time) ||
@@ -1759,23 +1895,23 @@ private:
 
                         if (!currTask->demuxStopped)
                         {
+                            // the packet queue is full, keep the loaded packet and retry after the decoder has consumed some
+                            if (!currTask->avpktQ.CanPush())
+                                return ThreadPoolExecutor::STEP_IDLE;
                             AVPacket* enqpkt = av_packet_clone(&avpkt);
                             if (!enqpkt)
                             {
                                 m_logger->Log(Error) << "FAILED to invoke 'av_packet_clone(DemuxThreadProc)'!" << endl;
-                                break;
-                            }
-                            {
-                                lock_guard<mutex> lk(currTask->avpktQLock);
-                                // m_logger->Log(DEBUG) << "-> Queuing AVPacket of stream#" << stmidx << ", pts=" << enqpkt->pts << "." << endl;
-                                currTask->avpktQ.push_back(enqpkt);
-                                currTask->frmPtsAry.push_back(enqpkt->pts);
-                                if (currTask->frmPtsRange.first > enqpkt->pts)
-                                    currTask->frmPtsRange.first = enqpkt->pts;
-                                auto pktDur = enqpkt->duration > 0 ? enqpkt->duration : m_vidfrmIntvPts;
-                                if (currTask->frmPtsRange.second < enqpkt->pts+pktDur)
-                                    currTask->frmPtsRange.second = enqpkt->pts+pktDur;
+                                return LeaveDemuxThreadProc();
                             }
+                            currTask->frmPtsAry.push_back(enqpkt->pts);
+                            if (currTask->frmPtsRange.first > enqpkt->pts)
+                                currTask->frmPtsRange.first = enqpkt->pts;
+                            auto pktDur = enqpkt->duration > 0 ? enqpkt->duration : m_vidfrmIntvPts;
+                            if (currTask->frmPtsRange.second < enqpkt->pts+pktDur)
+                                currTask->frmPtsRange.second = enqpkt->pts+pktDur;
+                            // m_logger->Log(DEBUG) << "-> Queuing AVPacket of stream#" << stmidx << ", pts=" << enqpkt->pts << "." << endl;
+                            currTask->avpktQ.TryPush(enqpkt);
                             av_packet_unref(&avpkt);
                             avpktLoaded = false;
                             idleLoop = false;
@@ -1790,14 +1926,26 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
+        return LeaveDemuxThreadProc();
+    }
 
-        if (currTask && !currTask->demuxStopped)
-            currTask->demuxStopped = true;
-        if (avpktLoaded)
-            av_packet_unref(&avpkt);
+    ThreadPoolExecutor::StepResult LeaveDemuxThreadProc()
+    {
+        auto& ctx = m_demuxTaskCtx;
+        if (ctx.currTask && !ctx.currTask->demuxStopped)
+            ctx.currTask->demuxStopped = true;
+        ctx.currTask = nullptr;
+        if (ctx.avpktLoaded)
+        {
+            av_packet_unref(&ctx.avpkt);
+            ctx.avpktLoaded = false;
+        }
         m_logger->Log(DEBUG) << "Leave DemuxThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     bool ReadNextStreamPacket(int stmIdx, AVPacket* avpkt, bool* avpktLoaded, int64_t* pts)
@@ -1916,19 +2064,34 @@ private:
         return true;
     }
 
-    void VideoDecodeThreadProc()
+    // states of the video decoding task that are kept between the steps
+    struct VideoDecodeTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter VideoDecodeThreadProc()..." << endl;
-
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
-
+        bool entered{false};
         GopDecodeTaskHolder currTask;
         AVFrame avfrm = {0};
-        bool avfrmLoaded = false;
-        bool needResetDecoder = false;
-        bool sentNullPacket = false;
-        while (!m_quitThread)
+        bool avfrmLoaded{false};
+        bool needResetDecoder{false};
+        bool sentNullPacket{false};
+    };
+
+    ThreadPoolExecutor::StepResult VideoDecodeThreadProc()
+    {
+        auto& ctx = m_viddecTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter VideoDecodeThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
+
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        AVFrame& avfrm = ctx.avfrm;
+        bool& avfrmLoaded = ctx.avfrmLoaded;
+        bool& needResetDecoder = ctx.needResetDecoder;
+        bool& sentNullPacket = ctx.sentNullPacket;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
             bool quitLoop = false;
@@ -2015,29 +2178,28 @@ private:
                     }
                     else
                     {
-                        this_thread::sleep_for(chrono::milliseconds(5));
+                        // the output queue is full, yield and retry when some frames are consumed
+                        break;
                     }
                 }
             } while (hasOutput && !m_quitThread && (!currTask || !currTask->cancel));
             if (quitLoop)
-                break;
+                return LeaveVideoDecodeThreadProc();
             if (currTask && currTask->cancel)
-                continue;
+                return ThreadPoolExecutor::STEP_BUSY;
 
             if (currTask && !sentNullPacket)
             {
                 // input packet to decoder
-                if (!currTask->avpktQ.empty())
+                AVPacket** ppkt = currTask->avpktQ.Front();
+                if (ppkt)
                 {
-                    AVPacket* avpkt = currTask->avpktQ.front();
+                    AVPacket* avpkt = *ppkt;
                     int fferr = avcodec_send_packet(m_viddecCtx, avpkt);
                     if (fferr == 0)
                     {
                         // m_logger->Log(DEBUG) << ">>> Send video packet pts=" << avpkt->pts << "(" << MillisecToString(CvtPtsToMts(avpkt->pts)) << ")." << endl;
-                        {
-                            lock_guard<mutex> lk(currTask->avpktQLock);
-                            currTask->avpktQ.pop_front();
-                        }
+                        currTask->avpktQ.Pop();
                         av_packet_free(&avpkt);
                         idleLoop = false;
                     }
@@ -2045,10 +2207,7 @@ private:
                     {
                         m_logger->Log(DEBUG) << "(VIDEO)avcodec_send_packet() return AVERROR_INVALIDDATA when decoding AVPacket with pts=" << avpkt->pts
                             << " from file '" << m_hParser->GetUrl() << "'. DISCARD this PACKET." << endl;
-                        {
-                            lock_guard<mutex> lk(currTask->avpktQLock);
-                            currTask->avpktQ.pop_front();
-                        }
+                        currTask->avpktQ.Pop();
                         av_packet_free(&avpkt);
                         idleLoop = false;
                     }
@@ -2057,7 +2216,7 @@ private:
                         m_errMsg = FFapiFailureMessage("avcodec_send_packet", fferr);
                         m_logger->Log(Error) << "FAILED to invoke 'avcodec_send_packet'(VideoDecodeThreadProc)! return code is "
                             << fferr << "." << endl;
-                        break;
+                        return LeaveVideoDecodeThreadProc();
                     }
                 }
                 else if (currTask->demuxStopped)
@@ -2068,13 +2227,26 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
+        }
+        return LeaveVideoDecodeThreadProc();
+    }
+
+    ThreadPoolExecutor::StepResult LeaveVideoDecodeThreadProc()
+    {
+        auto& ctx = m_viddecTaskCtx;
+        if (ctx.currTask && !ctx.currTask->decInputEof)
+            ctx.currTask->decInputEof = true;
+        ctx.currTask = nullptr;
+        if (ctx.avfrmLoaded)
+        {
+            av_frame_unref(&ctx.avfrm);
+            ctx.avfrmLoaded = false;
         }
-        if (currTask && !currTask->decInputEof)
-            currTask->decInputEof = true;
-        if (avfrmLoaded)
-            av_frame_unref(&avfrm);
         m_logger->Log(DEBUG) << "Leave VideoDecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     GopDecodeTaskHolder FindNextCfUpdateTask()
@@ -2090,17 +2262,34 @@ private:
         return nxttsk;
     }
 
-    void GenerateVideoFrameThreadProc()
+    // states of the frame generating tasks that are kept between the steps
+    struct GenerateFrameTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter GenerateVideoFrameThreadProc()..." << endl;
+        bool entered{false};
+        GopDecodeTaskHolder currTask;
+    };
 
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quitThread)
-            return;
+    // Only the frames around the latest seek target are put into the shared frame cache. They are the ones read again by
+    // the other readers of the same source and by repeated seeks, while caching every played frame just churns the cache.
+    bool IsNearFrameCacheTarget(int64_t pts)
+    {
+        const int64_t targetPts = CvtMtsToPts(m_frmCacheTargetPos);
+        return pts >= targetPts-m_vidfrmIntvPts*FRAME_CACHE_TARGET_FRAMES && pts <= targetPts+m_vidfrmIntvPts*FRAME_CACHE_TARGET_FRAMES;
+    }
 
-        GopDecodeTaskHolder currTask;
-        while (!m_quitThread)
+    ThreadPoolExecutor::StepResult GenerateVideoFrameThreadProc()
+    {
+        auto& ctx = m_genVfTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter GenerateVideoFrameThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
+
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
 
@@ -2115,8 +2304,13 @@ private:
                 {
                     if (vf.decfrm)
                     {
-                        if (!m_pFrmCvt->ConvertImage(vf.decfrm.get(), vf.vmat, (double)vf.pos/1000))
+                        const int64_t pts = vf.decfrm->pts;
+                        if (m_hFrameCache && m_hFrameCache->Get(m_frmCacheKey, pts, vf.vmat))
+                            vf.vmat.time_stamp = (double)vf.pos/1000;
+                        else if (!m_pFrmCvt->ConvertImage(vf.decfrm.get(), vf.vmat, (double)vf.pos/1000))
                             m_logger->Log(Error) << "FAILED to convert AVFrame to ImGui::ImMat for '" << m_hParser->GetUrl() << "' @pos " << vf.pos << "sec! Error is '" << m_pFrmCvt->GetError() << "'." << endl;
+                        else if (m_hFrameCache && IsNearFrameCacheTarget(pts))
+                            m_hFrameCache->Put(m_frmCacheKey, pts, vf.vmat);
                         vf.decfrm = nullptr;
                         currTask->frmCnt--;
                         if (currTask->frmCnt < 0)
@@ -2132,9 +2326,13 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
+        currTask = nullptr;
         m_logger->Log(DEBUG) << "Leave GenerateVideoFrameThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     bool EnqueueAudioAVFrame(AVFrame* frm)
@@ -2202,19 +2400,30 @@ private:
         return false;
     }
 
-    void AudioDecodeThreadProc()
+    // states of the audio decoding task that are kept between the steps
+    struct AudioDecodeTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter AudioDecodeThreadProc()..." << endl;
-
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quitThread)
-            return;
-
+        bool entered{false};
         GopDecodeTaskHolder currTask;
         AVFrame avfrm = {0};
-        bool avfrmLoaded = false;
-        while (!m_quitThread)
+        bool avfrmLoaded{false};
+    };
+
+    ThreadPoolExecutor::StepResult AudioDecodeThreadProc()
+    {
+        auto& ctx = m_auddecTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter AudioDecodeThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
+
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        AVFrame& avfrm = ctx.avfrm;
+        bool& avfrmLoaded = ctx.avfrmLoaded;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
             bool quitLoop = false;
@@ -2289,20 +2498,18 @@ private:
                     }
                 } while (hasOutput && !m_quitThread);
                 if (quitLoop)
-                    break;
+                    return LeaveAudioDecodeThreadProc();
 
                 // input packet to decoder
-                if (!currTask->avpktQ.empty())
+                AVPacket** ppkt = currTask->avpktQ.Front();
+                if (ppkt)
                 {
-                    AVPacket* avpkt = currTask->avpktQ.front();
+                    AVPacket* avpkt = *ppkt;
                     int fferr = avcodec_send_packet(m_auddecCtx, avpkt);
                     if (fferr == 0)
                     {
                         // m_logger->Log(DEBUG) << ">>> Send audio packet pts=" << avpkt->pts << "(" << MillisecToString(CvtPtsToMts(avpkt->pts)) << ")." << endl;
-                        {
-                            lock_guard<mutex> lk(currTask->avpktQLock);
-                            currTask->avpktQ.pop_front();
-                        }
+                        currTask->avpktQ.Pop();
                         av_packet_free(&avpkt);
                         idleLoop = false;
                     }
@@ -2311,7 +2518,7 @@ private:
                         m_errMsg = FFapiFailureMessage("avcodec_send_packet", fferr);
                         m_logger->Log(Error) << "FAILED to invoke 'avcodec_send_packet'(AudioDecodeThreadProc)! return code is "
                             << fferr << "." << endl;
-                        break;
+                        return LeaveAudioDecodeThreadProc();
                     }
                 }
                 else if (currTask->demuxStopped)
@@ -2322,26 +2529,41 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
-        if (avfrmLoaded)
-            av_frame_unref(&avfrm);
-        m_logger->Log(DEBUG) << "Leave AudioDecodeThreadProc()." << endl;
+        return LeaveAudioDecodeThreadProc();
     }
 
-    void GenerateAudioSamplesThreadProc()
+    ThreadPoolExecutor::StepResult LeaveAudioDecodeThreadProc()
     {
-        m_logger->Log(DEBUG) << "Enter GenerateAudioSamplesThreadProc()..." << endl;
+        auto& ctx = m_auddecTaskCtx;
+        ctx.currTask = nullptr;
+        if (ctx.avfrmLoaded)
+        {
+            av_frame_unref(&ctx.avfrm);
+            ctx.avfrmLoaded = false;
+        }
+        m_logger->Log(DEBUG) << "Leave AudioDecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
+    }
 
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quitThread)
-            return;
+    ThreadPoolExecutor::StepResult GenerateAudioSamplesThreadProc()
+    {
+        auto& ctx = m_genAfTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter GenerateAudioSamplesThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
 
-        GopDecodeTaskHolder currTask;
-        AVRational audTimebase = m_audAvStm->time_base;
-        while (!m_quitThread)
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        if (!m_quitThread)
         {
+            AVRational audTimebase = m_audAvStm->time_base;
             bool idleLoop = true;
 
             if (!currTask || currTask->cancel || currTask->frmCnt <= 0)
@@ -2449,9 +2671,13 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
+        currTask = nullptr;
         m_logger->Log(DEBUG) << "Leave GenerateAudioSamplesThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     SelfFreeAVFramePtr GenerateBackwardAudioFrame(SelfFreeAVFramePtr fwdfrm)
@@ -2632,6 +2858,7 @@ private:
             m_needUpdateBldtsk = true;
         }
         m_cacheWnd.readPos = readPos;
+        m_wakeupEvt.Notify();
         m_logger->Log(VERBOSE) << "Cache window updated: { readPos=" << readPos << ", cacheBeginTs=" << m_cacheWnd.cacheBeginMts << ", cacheEndTs=" << m_cacheWnd.cacheEndMts
                 << ", seekPosShow=" << m_cacheWnd.seekPosShow << ", seekPos00=" << m_cacheWnd.seekPos00 << ", seekPos10=" << m_cacheWnd.seekPos10 << " }" << endl;
     }
@@ -3203,58 +3430,52 @@ private:
         return m_audReadTask;
     }
 
-    void ReleaseResourceProc()
+    ThreadPoolExecutor::StepResult ReleaseResourceProc()
     {
         if (!m_isImage)
         {
             m_logger->Log(VERBOSE) << "Quit 'ReleaseResourceProc()', this only works for IMAGE source." << endl;
-            return;
+            return ThreadPoolExecutor::STEP_DONE;
         }
-        while (!m_quitThread)
+        if (m_quitThread)
+            return ThreadPoolExecutor::STEP_DONE;
+
+        bool imgEof = true;
         {
-            bool imgEof = true;
+            lock_guard<mutex> lk(m_bldtskByPriLock);
+            GopDecodeTaskHolder nxttsk = nullptr;
+            for (auto& tsk : m_bldtskPriOrder)
             {
-                lock_guard<mutex> lk(m_bldtskByPriLock);
-                GopDecodeTaskHolder nxttsk = nullptr;
-                for (auto& tsk : m_bldtskPriOrder)
+                if (!tsk->decodeStopped)
                 {
-                    if (!tsk->decodeStopped)
+                    imgEof = false;
+                    break;
+                }
+                for (auto& vf : tsk->vfAry)
+                {
+                    // if (!vf.ownfrm)
+                    if (vf.vmat.empty())
                     {
                         imgEof = false;
                         break;
                     }
-                    for (auto& vf : tsk->vfAry)
-                    {
-                        // if (!vf.ownfrm)
-                        if (vf.vmat.empty())
-                        {
-                            imgEof = false;
-                            break;
-                        }
-                    }
-                    if (!imgEof)
-                        break;
                 }
+                if (!imgEof)
+                    break;
             }
-            if (!m_prepared || !imgEof)
-                this_thread::sleep_for(chrono::milliseconds(100));
-            else
-                break;
-        }
-        if (!m_quitThread)
-        {
-            bool lockAquired = false;
-            while (!(lockAquired = m_apiLock.try_lock()) && !m_quitThread)
-                this_thread::sleep_for(chrono::milliseconds(5));
-            if (m_quitThread)
-            {
-                if (lockAquired) m_apiLock.unlock();
-                return;
-            }
-            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
-            m_logger->Log(DEBUG) << "AUTO RELEASE decoding resources." << endl;
-            ReleaseResources(true);
         }
+        if (!m_prepared || !imgEof)
+            return ThreadPoolExecutor::STEP_IDLE;
+
+        // retry later if the api lock is held by the other thread
+        if (!m_apiLock.try_lock())
+            return ThreadPoolExecutor::STEP_IDLE;
+        lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+        if (m_quitThread)
+            return ThreadPoolExecutor::STEP_DONE;
+        m_logger->Log(DEBUG) << "AUTO RELEASE decoding resources." << endl;
+        ReleaseResources(true);
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     void ReleaseResources(bool callFromReleaseProc = false)
@@ -3314,6 +3535,8 @@ private:
     bool m_prepared{false};
     recursive_mutex m_apiLock;
     bool m_close{false}, m_quitThread{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
 
     AVFormatContext* m_avfmtCtx{nullptr};
     int m_vidStmIdx{-1};
@@ -3324,6 +3547,7 @@ private:
     FFUtils::OpenVideoDecoderOptions m_viddecOpenOpts;
     AVCodecContext* m_viddecCtx{nullptr};
     bool m_vidPreferUseHw{true};
+    uint32_t m_cvtThreadCount{1};
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
     int64_t m_vidStartTime{0};
     AVRational m_vidTimeBase;
@@ -3345,18 +3569,25 @@ private:
     uint32_t m_outFrmSize{0};
     bool m_isOutFmtPlanar{false};
 
-    // demuxing thread
-    thread m_demuxThread;
-    // video decoding thread
-    thread m_viddecThread;
-    // update snapshots thread
-    thread m_genVfThread;
-    // audio decoding thread
-    thread m_auddecThread;
-    // swr thread
-    thread m_genAfThread;
-    // release resource thread
-    thread m_releaseThread;
+    // all the pipeline stages run as tasks on the shared executor
+    ThreadPoolExecutor::Holder m_hExecutor{ThreadPoolExecutor::GetDefaultInstance()};
+    // demuxing task
+    ThreadPoolExecutor::Task::Holder m_demuxTask;
+    DemuxTaskContext m_demuxTaskCtx;
+    // video decoding task
+    ThreadPoolExecutor::Task::Holder m_viddecTask;
+    VideoDecodeTaskContext m_viddecTaskCtx;
+    // update snapshots task
+    ThreadPoolExecutor::Task::Holder m_genVfTask;
+    GenerateFrameTaskContext m_genVfTaskCtx;
+    // audio decoding task
+    ThreadPoolExecutor::Task::Holder m_auddecTask;
+    AudioDecodeTaskContext m_auddecTaskCtx;
+    // swr task
+    ThreadPoolExecutor::Task::Holder m_genAfTask;
+    GenerateFrameTaskContext m_genAfTaskCtx;
+    // release resource task
+    ThreadPoolExecutor::Task::Holder m_releaseTask;
 
     int64_t m_prevReadPos{0};
     ImGui::ImMat m_prevReadImg;
@@ -3372,8 +3603,11 @@ private:
     mutex m_bldtskByPriLock;
     atomic_int32_t m_pendingVidfrmCnt{0};
     int32_t m_maxPendingVidfrmCnt{2};
+    // capacity of the packet queue of each GopDecodeTask
+    uint32_t m_maxPendingPktCnt{256};
     double m_forwardCacheDur{1.5};
     double m_backwardCacheDur{0.5};
+    atomic_int32_t m_memPriority{MemoryGovernor::PRIORITY_NORMAL};
     CacheWindow m_cacheWnd;
     CacheWindow m_bldtskSnapWnd;
     bool m_needUpdateBldtsk{false};
@@ -3394,6 +3628,10 @@ private:
     ImColorFormat m_outClrFmt;
     ImInterpolateMode m_interpMode;
     AVFrameToImMatConverter* m_pFrmCvt{nullptr};
+    VideoFrameCache::Holder m_hFrameCache;
+    VideoFrameCache::Key m_frmCacheKey;
+    // position of the latest seek in millisecond
+    atomic<int64_t> m_frmCacheTargetPos{0};
 
     bool m_dumpPcm{false};
     FILE* m_fpPcmFile{NULL};
@@ -3427,6 +3665,11 @@ public:
         return true;
     }
 
+    shared_ptr<AVFrame> GetAVFrame() override
+    {
+        return nullptr;
+    }
+
     int64_t Pos() const override
     {
         return (int64_t)(m_vmat.time_stamp*1000);
@@ -0,0 +1,277 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include "MediaReaderPool.h"
+
+using namespace std;
+using namespace Logger;
+
+namespace MediaCore
+{
+class MediaReaderPool_Impl : public MediaReaderPool, public enable_shared_from_this<MediaReaderPool_Impl>
+{
+public:
+    MediaReaderPool_Impl(uint32_t maxIdleCount)
+        : m_maxIdleCount(maxIdleCount)
+    {
+        m_logger = GetLogger("RdrPool");
+    }
+
+    ~MediaReaderPool_Impl()
+    {
+        Trim();
+    }
+
+    MediaReader::Holder AcquireVideoReader(MediaParser::Holder hParser, uint32_t outWidth, uint32_t outHeight,
+            ImColorFormat outClrfmt, ImDataType outDtype, ImInterpolateMode interpMode, bool enableHwAccel, const string& loggerName) override
+    {
+        ReaderKey key(hParser.get(), READER_VIDEO, outWidth, outHeight, (int)outClrfmt, (int)outDtype, (int)interpMode, enableHwAccel, "");
+        auto hReader = CheckOut(key);
+        if (hReader)
+            return MakeLease(hReader, key);
+
+        hReader = MediaReader::CreateVideoInstance(loggerName);
+        hReader->EnableHwAccel(enableHwAccel);
+        if (!hReader->Open(hParser))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        if (!hReader->ConfigVideoReader(outWidth, outHeight, outClrfmt, outDtype, interpMode))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        return MakeLease(hReader, key);
+    }
+
+    MediaReader::Holder AcquireImageReader(MediaParser::Holder hParser, uint32_t outWidth, uint32_t outHeight,
+            ImColorFormat outClrfmt, ImDataType outDtype, ImInterpolateMode interpMode, const string& loggerName) override
+    {
+        ReaderKey key(hParser.get(), READER_IMAGE, outWidth, outHeight, (int)outClrfmt, (int)outDtype, (int)interpMode, false, "");
+        auto hReader = CheckOut(key);
+        if (hReader)
+            return MakeLease(hReader, key);
+
+        // the generic reader decodes an image once and releases its decoder, see its 'ReleaseResourceProc()'
+        hReader = MediaReader::CreateInstance(loggerName);
+        if (!hReader->Open(hParser))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        if (!hReader->ConfigVideoReader(outWidth, outHeight, outClrfmt, outDtype, interpMode))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        return MakeLease(hReader, key);
+    }
+
+    MediaReader::Holder AcquireAudioReader(MediaParser::Holder hParser, uint32_t outChannels, uint32_t outSampleRate,
+            const string& outPcmFormat, const string& loggerName) override
+    {
+        ReaderKey key(hParser.get(), READER_AUDIO, outChannels, outSampleRate, 0, 0, 0, false, outPcmFormat);
+        auto hReader = CheckOut(key);
+        if (hReader)
+            return MakeLease(hReader, key);
+
+        hReader = MediaReader::CreateInstance(loggerName);
+        if (!hReader->Open(hParser))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        if (!hReader->ConfigAudioReader(outChannels, outSampleRate, outPcmFormat))
+        {
+            m_errMsg = hReader->GetError();
+            return nullptr;
+        }
+        return MakeLease(hReader, key);
+    }
+
+    void Trim() override
+    {
+        list<MediaReader::Holder> evictList;
+        {
+            lock_guard<mutex> lk(m_lock);
+            for (auto& entry : m_idleReaders)
+                evictList.push_back(entry.hReader);
+            m_evictCount += m_idleReaders.size();
+            m_idleReaders.clear();
+        }
+        for (auto& hEvicted : evictList)
+            hEvicted->Close();
+        if (!evictList.empty())
+            m_logger->Log(DEBUG) << "Closed " << evictList.size() << " idle readers." << endl;
+    }
+
+    void SetMaxIdleCount(uint32_t count) override
+    {
+        list<MediaReader::Holder> evictList;
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_maxIdleCount = count;
+            while (m_idleReaders.size() > m_maxIdleCount)
+            {
+                evictList.push_back(m_idleReaders.front().hReader);
+                m_idleReaders.pop_front();
+                m_evictCount++;
+            }
+        }
+        for (auto& hEvicted : evictList)
+            hEvicted->Close();
+    }
+
+    Stats GetStats() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        Stats stats;
+        stats.idleCount = m_idleReaders.size();
+        stats.inUseCount = m_inUseCount;
+        stats.acquireCount = m_acquireCount;
+        stats.reuseCount = m_reuseCount;
+        stats.evictCount = m_evictCount;
+        return stats;
+    }
+
+    string GetError() const override
+    {
+        return m_errMsg;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+private:
+    enum ReaderType
+    {
+        READER_VIDEO = 0,
+        READER_IMAGE,
+        READER_AUDIO,
+    };
+    // (parser, reader type, width/channels, height/sample rate, color format, data type, interpolation mode, hw accel, pcm format)
+    using ReaderKey = tuple<MediaParser*, int, uint32_t, uint32_t, int, int, int, bool, string>;
+
+    struct IdleReader
+    {
+        ReaderKey key;
+        MediaReader::Holder hReader;
+    };
+
+    MediaReader::Holder CheckOut(const ReaderKey& key)
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_acquireCount++;
+        // take the most recently released one, it's the most likely to be positioned near the new read position
+        for (auto iter = m_idleReaders.rbegin(); iter != m_idleReaders.rend(); iter++)
+        {
+            if (iter->key == key)
+            {
+                auto hReader = iter->hReader;
+                m_idleReaders.erase(next(iter).base());
+                m_reuseCount++;
+                m_logger->Log(DEBUG) << "Reuse pooled " << (get<1>(key) == READER_AUDIO ? "audio" : get<1>(key) == READER_IMAGE ? "image" : "video") << " reader of '" << get<0>(key)->GetUrl() << "'." << endl;
+                return hReader;
+            }
+        }
+        return nullptr;
+    }
+
+    MediaReader::Holder MakeLease(MediaReader::Holder hReader, const ReaderKey& key)
+    {
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_inUseCount++;
+        }
+        weak_ptr<MediaReaderPool_Impl> wkPool = shared_from_this();
+        return MediaReader::Holder(hReader.get(), [wkPool, hReader, key] (MediaReader*) {
+            auto hPool = wkPool.lock();
+            if (hPool)
+                hPool->GiveBack(hReader, key);
+        });
+    }
+
+    void GiveBack(MediaReader::Holder hReader, const ReaderKey& key)
+    {
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_inUseCount--;
+        }
+        if (!hReader->IsOpened())
+            return;
+        // the next user must not inherit the direction, scrub mode, memory priority or last image of this one
+        hReader->ResetReadState();
+        // a pooled video reader must not keep decoding nor hold the decoder resources
+        if (hReader->IsVideoReader() && hReader->IsStarted() && !hReader->IsSuspended())
+            hReader->Suspend();
+        list<MediaReader::Holder> evictList;
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_idleReaders.push_back({key, hReader});
+            while (m_idleReaders.size() > m_maxIdleCount)
+            {
+                evictList.push_back(m_idleReaders.front().hReader);
+                m_idleReaders.pop_front();
+                m_evictCount++;
+            }
+        }
+        // closing a reader waits for its threads to quit, so do it out of the lock
+        for (auto& hEvicted : evictList)
+            hEvicted->Close();
+    }
+
+private:
+    ALogger* m_logger;
+    mutable mutex m_lock;
+    // ordered from the least recently released to the most recently released
+    list<IdleReader> m_idleReaders;
+    uint32_t m_inUseCount{0};
+    uint32_t m_maxIdleCount;
+    uint64_t m_acquireCount{0};
+    uint64_t m_reuseCount{0};
+    uint64_t m_evictCount{0};
+    string m_errMsg;
+};
+
+static const auto MEDIA_READER_POOL_HOLDER_DELETER = [] (MediaReaderPool* p) {
+    MediaReaderPool_Impl* ptr = dynamic_cast<MediaReaderPool_Impl*>(p);
+    delete ptr;
+};
+
+MediaReaderPool::Holder MediaReaderPool::CreateInstance(uint32_t maxIdleCount)
+{
+    return MediaReaderPool::Holder(new MediaReaderPool_Impl(maxIdleCount), MEDIA_READER_POOL_HOLDER_DELETER);
+}
+
+static MediaReaderPool::Holder g_defaultReaderPool;
+static mutex g_defaultReaderPoolLock;
+
+MediaReaderPool::Holder MediaReaderPool::GetDefaultInstance()
+{
+    lock_guard<mutex> lk(g_defaultReaderPoolLock);
+    if (!g_defaultReaderPool)
+        g_defaultReaderPool = CreateInstance(8);
+    return g_defaultReaderPool;
+}
+}
@@ -0,0 +1,162 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "MemoryGovernor.h"
+
+using namespace std;
+using namespace Logger;
+
+namespace MediaCore
+{
+class MemoryGovernor_Impl : public MemoryGovernor
+{
+public:
+    MemoryGovernor_Impl(uint64_t budget) : m_budget(budget)
+    {
+        m_logger = GetLogger("MemGov");
+    }
+
+    void Register(Consumer* consumer) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        if (find(m_consumers.begin(), m_consumers.end(), consumer) == m_consumers.end())
+        {
+            m_consumers.push_back(consumer);
+            m_totalUsage += (int64_t)consumer->GetMemoryUsage();
+        }
+    }
+
+    void Unregister(Consumer* consumer) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        auto iter = find(m_consumers.begin(), m_consumers.end(), consumer);
+        if (iter != m_consumers.end())
+        {
+            m_consumers.erase(iter);
+            m_totalUsage -= (int64_t)consumer->GetMemoryUsage();
+        }
+    }
+
+    bool RequestMemory(Consumer* consumer, uint64_t bytes) override
+    {
+        const uint64_t budget = m_budget.load();
+        if (budget == 0 || GetTotalUsage()+bytes <= budget)
+            return true;
+
+        lock_guard<mutex> lk(m_lock);
+        const int32_t priority = consumer->GetMemoryPriority();
+        vector<pair<Consumer*, uint64_t>> victims;
+        for (auto c : m_consumers)
+        {
+            if (c == consumer || c->GetMemoryPriority() >= priority)
+                continue;
+            auto usage = c->GetMemoryUsage();
+            if (usage > 0)
+                victims.push_back({c, usage});
+        }
+        sort(victims.begin(), victims.end(), [] (auto& a, auto& b) {
+            auto pa = a.first->GetMemoryPriority(), pb = b.first->GetMemoryPriority();
+            return pa < pb || (pa == pb && a.second > b.second);
+        });
+        // the victims report what they release, so the total is re-read after each shrinking
+        uint64_t total = GetTotalUsage();
+        for (auto& v : victims)
+        {
+            if (total+bytes <= budget)
+                return true;
+            const uint64_t released = v.first->Shrink(total+bytes-budget);
+            m_logger->Log(VERBOSE) << "'" << v.first->GetMemoryConsumerName() << "' released " << released << " bytes for '"
+                    << consumer->GetMemoryConsumerName() << "'." << endl;
+            total = GetTotalUsage();
+        }
+        if (total+bytes <= budget)
+            return true;
+        m_logger->Log(DEBUG) << "Refused " << bytes << " bytes to '" << consumer->GetMemoryConsumerName() << "', total usage is "
+                << total << " bytes, budget is " << budget << " bytes." << endl;
+        return false;
+    }
+
+    void ReportUsageChange(int64_t deltaBytes) override
+    {
+        m_totalUsage += deltaBytes;
+    }
+
+    void SetBudget(uint64_t bytes) override
+    {
+        m_budget = bytes;
+        m_logger->Log(DEBUG) << "Memory budget is set to " << bytes << " bytes." << endl;
+    }
+
+    uint64_t GetBudget() const override
+    {
+        return m_budget.load();
+    }
+
+    uint64_t GetTotalUsage() const override
+    {
+        const int64_t total = m_totalUsage.load();
+        return total > 0 ? (uint64_t)total : 0;
+    }
+
+    vector<ConsumerUsage> GetUsage() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        vector<ConsumerUsage> usages;
+        usages.reserve(m_consumers.size());
+        for (auto c : m_consumers)
+            usages.push_back({c->GetMemoryConsumerName(), c->GetMemoryPriority(), c->GetMemoryUsage()});
+        return usages;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+private:
+    ALogger* m_logger;
+    mutable mutex m_lock;
+    list<Consumer*> m_consumers;
+    atomic<uint64_t> m_budget;
+    atomic<int64_t> m_totalUsage{0};
+};
+
+static const auto MEMORY_GOVERNOR_HOLDER_DELETER = [] (MemoryGovernor* p) {
+    MemoryGovernor_Impl* ptr = dynamic_cast<MemoryGovernor_Impl*>(p);
+    delete ptr;
+};
+
+MemoryGovernor::Holder MemoryGovernor::CreateInstance(uint64_t budget)
+{
+    return MemoryGovernor::Holder(new MemoryGovernor_Impl(budget), MEMORY_GOVERNOR_HOLDER_DELETER);
+}
+
+static MemoryGovernor::Holder g_defaultMemoryGovernor;
+static mutex g_defaultMemoryGovernorLock;
+
+MemoryGovernor::Holder MemoryGovernor::GetDefaultInstance()
+{
+    lock_guard<mutex> lk(g_defaultMemoryGovernorLock);
+    if (!g_defaultMemoryGovernor)
+        g_defaultMemoryGovernor = CreateInstance(4ULL*1024*1024*1024);
+    return g_defaultMemoryGovernor;
+}
+}
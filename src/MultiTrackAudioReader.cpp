@@ -26,6 +26,8 @@
 #include "MultiTrackAudioReader.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "MatUtils.h"
+#include "ImMatPool.h"
 #include "DebugHelper.h"
 extern "C"
 {
@@ -35,9 +37,6 @@ extern "C"
     #include "libavformat/avformat.h"
     #include "libavcodec/avcodec.h"
     #include "libavdevice/avdevice.h"
-    #include "libavfilter/avfilter.h"
-    #include "libavfilter/buffersrc.h"
-    #include "libavfilter/buffersink.h"
     #include "libswscale/swscale.h"
     #include "libswresample/swresample.h"
 }
@@ -82,7 +81,6 @@ public:
         m_readSamples = 0;
         m_frameSize = outChannels*4;  // for now, output sample format only supports float32 data type, thus 4 bytes per sample.
         m_isTrackOutputPlanar = av_sample_fmt_is_planar(m_trackOutSmpfmt);
-        m_matAvfrmCvter = new AudioImMatAVFrameConverter();
         m_mixOutDataType = GetDataTypeFromSampleFormat(m_mixOutSmpfmt);
         m_outMtsPerFrame = av_rescale_q(m_outSamplesPerFrame, {1, (int)m_outSampleRate}, MILLISEC_TIMEBASE);
 
@@ -125,7 +123,6 @@ public:
         lock_guard<recursive_mutex> lk(m_apiLock);
         TerminateMixingThread();
 
-        ReleaseMixer();
         m_tracks.clear();
         m_outputMats.clear();
         m_configured = false;
@@ -137,11 +134,6 @@ public:
 #endif
         m_outSampleRate = 0;
         m_outSamplesPerFrame = 1024;
-        if (m_matAvfrmCvter)
-        {
-            delete m_matAvfrmCvter;
-            m_matAvfrmCvter = nullptr;
-        }
     }
 
     AudioTrack::Holder AddTrack(int64_t trackId) override
@@ -153,8 +145,6 @@ public:
             return nullptr;
         }
 
-        TerminateMixingThread();
-
         uint32_t outChannels;
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
         outChannels = m_outChannels;
@@ -164,20 +154,16 @@ public:
         AudioTrack::Holder hTrack = AudioTrack::CreateInstance(trackId, outChannels, m_outSampleRate, av_get_sample_fmt_name(m_trackOutSmpfmt));
         hTrack->SetDirection(m_readForward);
         {
+            // the mixer holds 'm_trackLock' while mixing one frame, so the track list can be changed without stopping it
             lock_guard<recursive_mutex> lk2(m_trackLock);
             m_tracks.push_back(hTrack);
             UpdateDuration();
             int64_t pos = m_samplePos*1000/m_outSampleRate;
             for (auto track : m_tracks)
                 track->SeekTo(pos);
+            lock_guard<mutex> lk3(m_outputMatsLock);
             m_outputMats.clear();
         }
-
-        ReleaseMixer();
-        if (!CreateMixer())
-            return nullptr;
-
-        StartMixingThread();
         return hTrack;
     }
 
@@ -195,8 +181,6 @@ public:
             return nullptr;
         }
 
-        TerminateMixingThread();
-
         AudioTrack::Holder delTrack;
         {
             lock_guard<recursive_mutex> lk2(m_trackLock);
@@ -213,18 +197,10 @@ public:
                 UpdateDuration();
                 for (auto track : m_tracks)
                     track->SeekTo(ReadPos());
+                lock_guard<mutex> lk3(m_outputMatsLock);
                 m_outputMats.clear();
-
-                ReleaseMixer();
-                if (!m_tracks.empty())
-                {
-                    if (!CreateMixer())
-                        return nullptr;
-                }
             }
         }
-
-        StartMixingThread();
         return delTrack;
     }
 
@@ -237,8 +213,6 @@ public:
             return nullptr;
         }
 
-        TerminateMixingThread();
-
         AudioTrack::Holder delTrack;
         {
             lock_guard<recursive_mutex> lk2(m_trackLock);
@@ -252,18 +226,10 @@ public:
                 UpdateDuration();
                 for (auto track : m_tracks)
                     track->SeekTo(ReadPos());
+                lock_guard<mutex> lk3(m_outputMatsLock);
                 m_outputMats.clear();
-
-                ReleaseMixer();
-                if (!m_tracks.empty())
-                {
-                    if (!CreateMixer())
-                        return nullptr;
-                }
             }
         }
-
-        StartMixingThread();
         return delTrack;
     }
 
@@ -285,12 +251,6 @@ public:
         m_samplePos = seekPos*m_outSampleRate/1000;
 
         m_outputMats.clear();
-        ReleaseMixer();
-        if (!m_tracks.empty())
-        {
-            if (!CreateMixer())
-                return false;
-        }
 
         StartMixingThread();
         return true;
@@ -362,6 +322,11 @@ public:
         return false;
     }
 
+    void SetFlushDenormals(bool enable) override
+    {
+        m_flushDenormals = enable;
+    }
+
 
     bool ReadAudioSamplesEx(vector<CorrelativeFrame>& amats, bool& eof) override
     {
@@ -581,162 +546,69 @@ private:
         }
     }
 
-    bool CreateMixer()
+    // Sum the samples of all the tracks into one frame of interleaved float samples. The tracks output planar float samples,
+    // so the planes of all the tracks are summed as flat arrays first, then interleaved into the output frame.
+    ImGui::ImMat MixTrackSamples(vector<CorrelativeFrame>& corFrames)
     {
-        const AVFilter *abuffersrc  = avfilter_get_by_name("abuffer");
-        const AVFilter *abuffersink = avfilter_get_by_name("abuffersink");
-
-        m_filterGraph = avfilter_graph_alloc();
-        if (!m_filterGraph)
-        {
-            m_errMsg = "FAILED to allocate new 'AVFilterGraph'!";
-            return false;
-        }
-
-        ostringstream oss;
-        oss << "time_base=1/" << m_outSampleRate << ":sample_rate=" << m_outSampleRate
-            << ":sample_fmt=" << av_get_sample_fmt_name(m_trackOutSmpfmt);
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
-        oss << ":channel_layout=" << av_get_default_channel_layout(m_outChannels);
+        int outChannels = m_outChannels;
 #else
-        char chlytDescBuff[256] = {0};
-        av_channel_layout_describe(&m_outChlyt, chlytDescBuff, sizeof(chlytDescBuff));
-        oss << ":channel_layout=" << chlytDescBuff;
+        int outChannels = m_outChlyt.nb_channels;
 #endif
-        string bufsrcArgs = oss.str(); oss.str("");
-        int fferr;
-
-        AVFilterInOut* prevFiltInOutPtr = nullptr;
-        for (uint32_t i = 0; i < m_tracks.size(); i++)
+        const int64_t pts = m_samplePos;
+        const uint32_t mixSize = m_outSamplesPerFrame*outChannels;
+        vector<const float*> srcs;
+        vector<float> gains;
+        for (auto& track : m_tracks)
         {
-            oss << "in_" << i;
-            string filtName = oss.str(); oss.str("");
-            m_logger->Log(DEBUG) << "buffersrc name '" << filtName << "'." << endl;
-
-            AVFilterContext* bufSrcCtx = nullptr;
-            fferr = avfilter_graph_create_filter(&bufSrcCtx, abuffersrc, filtName.c_str(), bufsrcArgs.c_str(), nullptr, m_filterGraph);
-            if (fferr < 0)
-            {
-                oss << "FAILED when invoking 'avfilter_graph_create_filter' for INPUTs! fferr=" << fferr << ".";
-                m_errMsg = oss.str();
-                return false;
-            }
-
-            AVFilterInOut* filtInOutPtr = avfilter_inout_alloc();
-            if (!filtInOutPtr)
-            {
-                m_errMsg = "FAILED to allocate 'AVFilterInOut' instance!";
-                return false;
-            }
-            filtInOutPtr->name       = av_strdup(filtName.c_str());
-            filtInOutPtr->filter_ctx = bufSrcCtx;
-            filtInOutPtr->pad_idx    = 0;
-            filtInOutPtr->next       = nullptr;
-            if (prevFiltInOutPtr)
-                prevFiltInOutPtr->next = filtInOutPtr;
-            else
-                m_filterOutputs = filtInOutPtr;
-            prevFiltInOutPtr = filtInOutPtr;
-
-            m_bufSrcCtxs.push_back(bufSrcCtx);
+            ImGui::ImMat amat = track->ReadAudioSamples(m_outSamplesPerFrame);
+            corFrames.push_back({CorrelativeFrame::PHASE_AFTER_TRANSITION, 0, track->Id(), amat});
+            // a muted track only outputs silence, skip summing it
+            if (track->IsMuted() || amat.empty() || amat.total() < mixSize)
+                continue;
+            srcs.push_back((const float*)amat.data);
+            gains.push_back(1.f);
         }
-
-        {
-            string filtName = "out";
-
-            AVFilterContext* bufSinkCtx = nullptr;
-            fferr = avfilter_graph_create_filter(&bufSinkCtx, abuffersink, filtName.c_str(), nullptr, nullptr, m_filterGraph);
-            if (fferr < 0)
-            {
-                oss << "FAILED when invoking 'avfilter_graph_create_filter' for OUTPUTS! fferr=" << fferr << ".";
-                m_errMsg = oss.str();
-                return false;
-            }
-
-            const AVSampleFormat out_sample_fmts[] = { m_mixOutSmpfmt, (AVSampleFormat)-1 };
-            fferr = av_opt_set_int_list(bufSinkCtx, "sample_fmts", out_sample_fmts, -1, AV_OPT_SEARCH_CHILDREN);
-            if (fferr < 0)
-            {
-                oss << "FAILED when invoking 'av_opt_set_int_list' for OUTPUTS! fferr=" << fferr << ".";
-                m_errMsg = oss.str();
-                return false;
-            }
-
-            AVFilterInOut* filtInOutPtr = avfilter_inout_alloc();
-            if (!filtInOutPtr)
+        if (m_readForward)
+            m_samplePos += m_outSamplesPerFrame;
+        else
+            m_samplePos -= m_outSamplesPerFrame;
+
+        ImGui::ImMat amat;
+        if (!m_hMatPool->Acquire(amat, (int)m_outSamplesPerFrame, 1, outChannels, IM_DT_FLOAT32))
+            amat.create((int)m_outSamplesPerFrame, 1, outChannels, (size_t)4);
+        const bool needInterleave = m_isTrackOutputPlanar && outChannels > 1;
+        if (needInterleave)
+            m_mixBuffer.resize(mixSize);
+        float* mixBuf = needInterleave ? m_mixBuffer.data() : (float*)amat.data;
+        MatUtils::MixAudioSamples(mixBuf, srcs.data(), gains.data(), (uint32_t)srcs.size(), mixSize);
+        if (needInterleave)
+        {
+            float* dstPtr = (float*)amat.data;
+            for (uint32_t i = 0; i < m_outSamplesPerFrame; i++)
             {
-                m_errMsg = "FAILED to allocate 'AVFilterInOut' instance!";
-                return false;
+                const float* srcPtr = mixBuf+i;
+                for (int j = 0; j < outChannels; j++, srcPtr += m_outSamplesPerFrame)
+                    *dstPtr++ = *srcPtr;
             }
-            filtInOutPtr->name        = av_strdup(filtName.c_str());
-            filtInOutPtr->filter_ctx  = bufSinkCtx;
-            filtInOutPtr->pad_idx     = 0;
-            filtInOutPtr->next        = nullptr;
-            m_filterInputs = filtInOutPtr;
-
-            m_bufSinkCtxs.push_back(bufSinkCtx);
-        }
-
-        for (uint32_t i = 0; i < m_tracks.size(); i++)
-            oss << "[in_" << i << "]";
-        oss << "amix=inputs=" << m_tracks.size();
-#if (LIBAVFILTER_VERSION_MAJOR > 7) || (LIBAVFILTER_VERSION_MAJOR == 7) && (LIBAVFILTER_VERSION_MINOR > 110)
-        oss << ":normalize=0";
-#else
-        oss << ":sum=1";
-#endif
-        string filtArgs = oss.str(); oss.str("");
-        m_logger->Log(DEBUG) << "'MultiTrackAudioReader' mixer filter args: '" << filtArgs << "'." << endl;
-        fferr = avfilter_graph_parse_ptr(m_filterGraph, filtArgs.c_str(), &m_filterInputs, &m_filterOutputs, nullptr);
-        if (fferr < 0)
-        {
-            oss << "FAILED to invoke 'avfilter_graph_parse_ptr'! fferr=" << fferr << ".";
-            m_errMsg = oss.str();
-            return false;
-        }
-
-        fferr = avfilter_graph_config(m_filterGraph, nullptr);
-        if (fferr < 0)
-        {
-            oss << "FAILED to invoke 'avfilter_graph_config'! fferr=" << fferr << ".";
-            m_errMsg = oss.str();
-            return false;
-        }
-
-        FreeAVFilterInOutPtrs();
-        return true;
-    }
-
-    void ReleaseMixer()
-    {
-        if (m_filterGraph)
-        {
-            avfilter_graph_free(&m_filterGraph);
-            m_filterGraph = nullptr;
         }
-        m_bufSrcCtxs.clear();
-        m_bufSinkCtxs.clear();
-
-        FreeAVFilterInOutPtrs();
-    }
-
-    void FreeAVFilterInOutPtrs()
-    {
-        if (m_filterOutputs)
-            avfilter_inout_free(&m_filterOutputs);
-        if (m_filterInputs)
-            avfilter_inout_free(&m_filterInputs);
+        amat.time_stamp = ConvertPtsToTs(pts);
+        amat.type = m_mixOutDataType;
+        amat.flags = IM_MAT_FLAGS_AUDIO_FRAME;
+        amat.rate = { (int)m_outSampleRate, 1 };
+        amat.elempack = outChannels;
+        amat.index_count = pts;
+        return amat;
     }
 
     void MixingThreadProc()
     {
         m_logger->Log(DEBUG) << "Enter MixingThreadProc(AUDIO)..." << endl;
 
-        SelfFreeAVFramePtr outfrm = AllocSelfFreeAVFramePtr();
         while (!m_quit)
         {
+            MatUtils::ScopedFlushDenormals flushDenormals(m_flushDenormals);
             bool idleLoop = true;
-            int fferr;
 
             bool seekPosChanged;
             int64_t seekPos;
@@ -807,101 +679,30 @@ private:
 
                 vector<CorrelativeFrame> corFrames;
                 corFrames.push_back({CorrelativeFrame::PHASE_AFTER_MIXING, 0, 0, ImGui::ImMat()});
-                if (!m_tracks.empty())
                 {
+                    lock_guard<recursive_mutex> lk(m_trackLock);
+                    ImGui::ImMat amat = MixTrackSamples(corFrames);
+                    if (!m_tracks.empty())
                     {
-                        lock_guard<recursive_mutex> lk(m_trackLock);
-                        uint32_t i = 0;
-                        for (auto iter = m_tracks.begin(); iter != m_tracks.end(); iter++, i++)
+                        list<ImGui::ImMat> aeOutMats;
+                        if (!m_aeFilter->ProcessData(amat, aeOutMats))
                         {
-                            auto& track = *iter;
-                            ImGui::ImMat amat = track->ReadAudioSamples(m_outSamplesPerFrame);
-                            corFrames.push_back({CorrelativeFrame::PHASE_AFTER_TRANSITION, 0, track->Id(), amat});
-                            SelfFreeAVFramePtr audfrm = AllocSelfFreeAVFramePtr();
-                            m_matAvfrmCvter->ConvertImMatToAVFrame(amat, audfrm.get(), m_samplePos);
-                            fferr = av_buffersrc_add_frame(m_bufSrcCtxs[i], audfrm.get());
-                            if (fferr < 0)
-                            {
-                                m_logger->Log(Error) << "FAILED to invoke 'av_buffersrc_add_frame'(In MixingThreadProc)! fferr=" << fferr << "." << endl;
-                                break;
-                            }
+                            m_logger->Log(Error) << "FAILED to apply AudioEffectFilter after mixing! Error is '" << m_aeFilter->GetError() << "'." << endl;
                         }
-                        if (m_readForward)
-                            m_samplePos += m_outSamplesPerFrame;
+                        else if (aeOutMats.size() != 1)
+                            m_logger->Log(Error) << "After mixing AudioEffectFilter returns " << aeOutMats.size() << " mats!" << endl;
                         else
-                            m_samplePos -= m_outSamplesPerFrame;
-                    }
-
-                    fferr = av_buffersink_get_frame(m_bufSinkCtxs[0], outfrm.get());
-                    if (fferr >= 0)
-                    {
-                        ImGui::ImMat amat;
-#if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
-                        int outChannels = m_outChannels;
-#else
-                        int outChannels = m_outChlyt.nb_channels;
-#endif
-                        amat.create((int)m_outSamplesPerFrame, 1, outChannels, (size_t)4);
-                        if (amat.total()*4 == outfrm->linesize[0])
                         {
-                            memcpy(amat.data, outfrm->data[0], outfrm->linesize[0]);
-                            amat.time_stamp = ConvertPtsToTs(outfrm->pts);
-                            amat.type = m_mixOutDataType;
-                            amat.flags = IM_MAT_FLAGS_AUDIO_FRAME;
-                            amat.rate = { (int)m_outSampleRate, 1 };
-                            amat.elempack = outChannels;
-                            amat.index_count = outfrm->pts;
-                            av_frame_unref(outfrm.get());
-                            list<ImGui::ImMat> aeOutMats;
-                            if (!m_aeFilter->ProcessData(amat, aeOutMats))
-                            {
-                                m_logger->Log(Error) << "FAILED to apply AudioEffectFilter after mixing! Error is '" << m_aeFilter->GetError() << "'." << endl;
-                            }
-                            else if (aeOutMats.size() != 1)
-                                m_logger->Log(Error) << "After mixing AudioEffectFilter returns " << aeOutMats.size() << " mats!" << endl;
+                            auto& frontMat = aeOutMats.front();
+                            if (frontMat.total() != amat.total())
+                                m_logger->Log(Error) << "After mixing AudioEffectFilter, front mat has different size (" << (frontMat.total()*4)
+                                    << ") against input mat (" << (amat.total()*4) << ")!" << endl;
                             else
-                            {
-                                auto& frontMat = aeOutMats.front();
-                                if (frontMat.total() != amat.total())
-                                    m_logger->Log(Error) << "After mixing AudioEffectFilter, front mat has different size (" << (frontMat.total()*4)
-                                        << ") against input mat (" << (amat.total()*4) << ")!" << endl;
-                                else
-                                    amat = frontMat;
-                            }
-                            corFrames[0].frame = amat;
-                            lock_guard<mutex> lk(m_outputMatsLock);
-                            m_outputMats.push_back(corFrames);
-                            idleLoop = false;
+                                amat = frontMat;
                         }
-                        else
-                            m_logger->Log(Error) << "Audio frame linesize(" << outfrm->linesize[0] << ") is ABNORMAL!" << endl;
-                    }
-                    else if (fferr != AVERROR(EAGAIN))
-                    {
-                        m_logger->Log(Error) << "FAILED to invoke 'av_buffersink_get_frame'(In MixingThreadProc)! fferr=" << fferr << "." << endl;
                     }
-                }
-                else
-                {
-                    ImGui::ImMat amat;
-#if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
-                    int outChannels = m_outChannels;
-#else
-                    int outChannels = m_outChlyt.nb_channels;
-#endif
-                    amat.create((int)m_outSamplesPerFrame, 1, outChannels, (size_t)4);
-                    memset(amat.data, 0, amat.total()*amat.elemsize);
-                    amat.time_stamp = ConvertPtsToTs(m_samplePos);
-                    amat.flags = IM_MAT_FLAGS_AUDIO_FRAME;
-                    amat.rate = { (int)m_outSampleRate, 1 };
-                    amat.elempack = outChannels;
-                    if (m_readForward)
-                        m_samplePos += m_outSamplesPerFrame;
-                    else
-                        m_samplePos -= m_outSamplesPerFrame;
-                    amat.index_count = m_samplePos;
                     corFrames[0].frame = amat;
-                    lock_guard<mutex> lk(m_outputMatsLock);
+                    lock_guard<mutex> lk2(m_outputMatsLock);
                     m_outputMats.push_back(corFrames);
                     idleLoop = false;
                 }
@@ -956,7 +757,6 @@ private:
     int64_t m_seekPos{INT64_MIN};
     int64_t m_prevSeekPos{INT64_MIN};
 
-    AudioImMatAVFrameConverter* m_matAvfrmCvter{nullptr};
     list<vector<CorrelativeFrame>> m_outputMats;
     mutex m_outputMatsLock;
     uint32_t m_outputMatsMaxCount{4};
@@ -965,11 +765,9 @@ private:
     bool m_started{false};
     bool m_quit{false};
 
-    AVFilterGraph* m_filterGraph{nullptr};
-    AVFilterInOut* m_filterOutputs{nullptr};
-    AVFilterInOut* m_filterInputs{nullptr};
-    vector<AVFilterContext*> m_bufSrcCtxs;
-    vector<AVFilterContext*> m_bufSinkCtxs;
+    vector<float> m_mixBuffer;
+    ImMatPool::Holder m_hMatPool{ImMatPool::GetSharedInstance("AudioFrame")};
+    bool m_flushDenormals{true};
 
     AudioEffectFilter::Holder m_aeFilter;
 };
@@ -1003,13 +801,6 @@ MultiTrackAudioReader::Holder MultiTrackAudioReader_Impl::CloneAndConfigure(uint
         newInstance->m_tracks.push_back(track->Clone(outChannels, outSampleRate, av_get_sample_fmt_name(m_trackOutSmpfmt)));
     }
     newInstance->UpdateDuration();
-    // create mixer in the new instance
-    if (!newInstance->CreateMixer())
-    {
-        m_errMsg = newInstance->GetError();
-        newInstance->Close(); delete newInstance;
-        return nullptr;
-    }
 
     // seek to 0
     newInstance->m_outputMats.clear();
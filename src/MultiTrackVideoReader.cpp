@@ -16,6 +16,7 @@
 */
 
 #include <thread>
+#include <functional>
 #include <algorithm>
 #include <atomic>
 #include <sstream>
@@ -25,13 +26,17 @@
 #include "VideoBlender.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "MatUtils.h"
+#include "ThreadPoolExecutor.h"
+#include "MemoryGovernor.h"
+#include "DebugHelper.h"
 
 using namespace std;
 using namespace Logger;
 
 namespace MediaCore
 {
-class MultiTrackVideoReader_Impl : public MultiTrackVideoReader
+class MultiTrackVideoReader_Impl : public MultiTrackVideoReader, public MemoryGovernor::Consumer
 {
 public:
     static ALogger* s_logger;
@@ -39,6 +44,12 @@ public:
     MultiTrackVideoReader_Impl()
     {
         m_logger = MultiTrackVideoReader::GetLogger();
+        m_hMemGov->Register(this);
+    }
+
+    virtual ~MultiTrackVideoReader_Impl()
+    {
+        m_hMemGov->Unregister(this);
     }
 
     MultiTrackVideoReader_Impl(const MultiTrackVideoReader_Impl&) = delete;
@@ -402,8 +413,16 @@ public:
         m_prevOutFrame = nullptr;
         const auto frameRate = m_hSettings->VideoOutFrameRate();
         m_readFrameIdx = (int64_t)(floor((double)pos*frameRate.num/(frameRate.den*1000)));
+        if (m_scrubMode)
+        {
+            if (m_scrubRefined)
+                SetTracksScrubMode(true);
+            m_scrubRefined = false;
+            m_lastScrubTp = GetTimePoint();
+        }
         AddSeekingTask(m_readFrameIdx);
         m_inSeeking = true;
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -417,8 +436,16 @@ public:
         }
         m_logger->Log(DEBUG) << "=======> StopConsecutiveSeek" << endl;
         m_inSeeking = false;
+        m_wakeupEvt.Notify();
         int step = m_readForward ? 1 : -1;
         auto reuseTask = ExtractSeekingTask(m_readFrameIdx);
+        // the frame of an unrefined scrubbing task is not the exact one
+        if (m_scrubMode && !m_scrubRefined)
+        {
+            SetTracksScrubMode(false);
+            m_scrubRefined = true;
+            reuseTask = nullptr;
+        }
         if (reuseTask && reuseTask->TriggerStart())
         {
             AddMixFrameTask(reuseTask, true);
@@ -431,6 +458,20 @@ public:
         return true;
     }
 
+    void EnableScrubMode(bool enable, uint32_t refineDelay) override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        m_scrubRefineDelay = refineDelay;
+        if (m_scrubMode == enable)
+            return;
+        m_scrubMode = enable;
+        if (!enable && !m_scrubRefined)
+        {
+            SetTracksScrubMode(false);
+            m_scrubRefined = true;
+        }
+    }
+
     bool SetTrackVisible(int64_t id, bool visible) override
     {
         auto track = GetTrackById(id, false);
@@ -577,6 +618,7 @@ public:
                     mft->outputReady = false;
             }
         }
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -823,6 +865,59 @@ public:
         return m_errMsg;
     }
 
+    string GetMemoryConsumerName() const override
+    {
+        return m_logger->GetName();
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_memUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return MemoryGovernor::PRIORITY_LOW;
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        // drop the mixed frames which are not going to be output. The task list locks are only tried, since a thread
+        // holding one of them can be waiting on the governor.
+        const int64_t readFrameIdx = m_readFrameIdx;
+        uint64_t released = 0;
+        {
+            unique_lock<mutex> lk(m_seekingTasksLock, try_to_lock);
+            if (lk.owns_lock() && !m_seekingTasks.empty())
+            {
+                // keep the latest seeking task, and the one shown as the seeking flash
+                const auto hKeepTask = FindClosestReadyTask(m_seekingTasks, readFrameIdx);
+                const auto hLastTask = m_seekingTasks.back();
+                released += DropMixedFrames(m_seekingTasks, bytes, [&hKeepTask, &hLastTask] (const MixFrameTask::Holder& hTask) {
+                    return hTask != hKeepTask && hTask != hLastTask;
+                });
+            }
+        }
+        if (released < bytes)
+        {
+            unique_lock<recursive_mutex> lk(m_mixFrameTasksLock, try_to_lock);
+            if (lk.owns_lock() && !m_mixFrameTasks.empty())
+            {
+                // the tasks behind the read position are not going to be output, except the one output
+                // as the candidate when the frame at the read position is not ready yet
+                const bool readForward = m_readForward;
+                const auto hKeepTask = FindClosestReadyTask(m_mixFrameTasks, readFrameIdx);
+                released += DropMixedFrames(m_mixFrameTasks, bytes-released, [&hKeepTask, readFrameIdx, readForward] (const MixFrameTask::Holder& hTask) {
+                    const bool isBehind = readForward ? hTask->frameIndex < readFrameIdx : hTask->frameIndex > readFrameIdx;
+                    return isBehind && hTask != hKeepTask;
+                });
+            }
+        }
+        if (released > 0)
+            m_logger->Log(DEBUG) << "Shrink: dropped " << released << " bytes of mixed frames." << endl;
+        return released;
+    }
+
 private:
     bool ReadVideoFrameWithoutSubtitle(int64_t frameIndex, vector<CorrelativeFrame>& frames, bool nonblocking, bool precise)
     {
@@ -870,9 +965,11 @@ private:
 
             if (!nonblocking && precise)
             {
+                uint64_t wakeupSeq = m_wakeupEvt.Sequence();
                 while (!m_quit && !m_inSeeking)
                 {
-                    this_thread::sleep_for(chrono::milliseconds(5));
+                    m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
+                    wakeupSeq = m_wakeupEvt.Sequence();
                     hCandiFrame = FindCandidateAndRemoveDeprecatedTasks(frameIndex, precise);
                     if (!hCandiFrame)
                     {
@@ -910,6 +1007,7 @@ private:
         if (m_mixingThread.joinable())
         {
             m_quit = true;
+            m_wakeupEvt.Notify();
             m_mixingThread.join();
         }
     }
@@ -927,12 +1025,20 @@ private:
             }
             readFrameTaskTable.clear();
             outputFrames.clear();
+            if (memBytes > 0)
+                owner->ChangeMemoryUsage(-(int64_t)memBytes);
         }
 
+        MultiTrackVideoReader_Impl* owner{nullptr};
         int64_t frameIndex;
         vector<pair<VideoTrack::Holder, ReadFrameTask::Holder>> readFrameTaskTable;
-        bool outputReady{false};
+        atomic_bool outputReady{false};
         vector<CorrelativeFrame> outputFrames;
+        // the bytes of the mixed frame reported to the memory governor
+        uint64_t memBytes{0};
+        // the compositing job running on the executor, and the frames it works on
+        SysUtils::ThreadPoolExecutor::Task::Holder mixingJob;
+        shared_ptr<vector<CorrelativeFrame>> mixingFrames;
         atomic_uint8_t state{0};  // lsb#1 means this task is dropped, lsb#2 means this task is started
         static const uint8_t DROP_BIT, START_BIT;
 
@@ -1059,6 +1165,7 @@ private:
                 tracks = m_tracks;
             }
             hTask = MixFrameTask::Holder(new MixFrameTask());
+            hTask->owner = this;
             hTask->frameIndex = frameIndex;
             for (auto& trk : tracks)
             {
@@ -1068,6 +1175,7 @@ private:
             }
             m_logger->Log(DEBUG) << "++ AddMixFrameTask: frameIndex=" << frameIndex << ", canDrop=" << canDrop << endl;
             m_mixFrameTasks.push_back(hTask);
+            m_wakeupEvt.Notify();
         }
         else
         {
@@ -1084,6 +1192,7 @@ private:
         {
             ClearAllMixFrameTasks();
             m_mixFrameTasks.push_back(hMft);
+            m_wakeupEvt.Notify();
             m_logger->Log(DEBUG) << "++ AddMixFrameTask[2-0]: frameIndex=" << frameIndex << endl;
         }
         else
@@ -1104,6 +1213,7 @@ private:
 
                 m_logger->Log(DEBUG) << "++ AddMixFrameTask[2-1]: frameIndex=" << frameIndex << endl;
                 m_mixFrameTasks.push_back(hMft);
+                m_wakeupEvt.Notify();
             }
             else
             {
@@ -1191,6 +1301,7 @@ private:
                 tracks = m_tracks;
             }
             hTask = MixFrameTask::Holder(new MixFrameTask());
+            hTask->owner = this;
             hTask->frameIndex = frameIndex;
             for (auto& trk : tracks)
             {
@@ -1199,6 +1310,7 @@ private:
             }
             m_logger->Log(DEBUG) << "++ AddSeekingTask: frameIndex=" << frameIndex << endl;
             m_seekingTasks.push_back(hTask);
+            m_wakeupEvt.Notify();
         }
         else
         {
@@ -1207,6 +1319,36 @@ private:
         return hTask;
     }
 
+    void SetTracksScrubMode(bool enable)
+    {
+        lock_guard<recursive_mutex> trackLk(m_trackLock);
+        for (auto& trk : m_tracks)
+            trk->EnableScrubMode(enable);
+    }
+
+    // when the scrubbing position has been stable for the refine delay, replace the approximate frame with the exact one
+    void RefineScrubbingFrame()
+    {
+        // it's called from the mixing thread, which 'Close()' waits for with the api lock held
+        unique_lock<recursive_mutex> lk(m_apiLock, try_to_lock);
+        if (!lk.owns_lock())
+            return;
+        if (!m_inSeeking || !m_scrubMode || m_scrubRefined)
+            return;
+        if (CountElapsedMillisec(m_lastScrubTp, GetTimePoint()) < (int64_t)m_scrubRefineDelay)
+            return;
+        m_logger->Log(DEBUG) << "=======> Refine scrubbing frame at frameIndex=" << m_readFrameIdx << endl;
+        SetTracksScrubMode(false);
+        m_scrubRefined = true;
+        auto hApproxTask = ExtractSeekingTask(m_readFrameIdx);
+        if (hApproxTask)
+        {
+            for (auto& elem : hApproxTask->readFrameTaskTable)
+                elem.second->SetDiscarded();
+        }
+        AddSeekingTask(m_readFrameIdx);
+    }
+
     MixFrameTask::Holder ExtractSeekingTask(int64_t frameIndex)
     {
         if (frameIndex < 0)
@@ -1241,6 +1383,50 @@ private:
         }
     }
 
+    MixFrameTask::Holder FindClosestReadyTask(const list<MixFrameTask::Holder>& taskList, int64_t frameIndex)
+    {
+        MixFrameTask::Holder hClosestTask;
+        for (auto& mft : taskList)
+        {
+            if (!mft->outputReady)
+                continue;
+            if (!hClosestTask || std::abs(hClosestTask->frameIndex-frameIndex) > std::abs(mft->frameIndex-frameIndex))
+                hClosestTask = mft;
+        }
+        return hClosestTask;
+    }
+
+    // drop the ready tasks accepted by 'canDrop' until 'bytes' bytes are released, return the released bytes
+    uint64_t DropMixedFrames(list<MixFrameTask::Holder>& taskList, uint64_t bytes, const function<bool(const MixFrameTask::Holder&)>& canDrop)
+    {
+        uint64_t released = 0;
+        auto iter = taskList.begin();
+        while (iter != taskList.end() && released < bytes)
+        {
+            auto& mft = *iter;
+            if (!mft->outputReady || mft->memBytes == 0 || !canDrop(mft))
+            {
+                iter++;
+                continue;
+            }
+            for (auto& elem : mft->readFrameTaskTable)
+            {
+                auto& rft = elem.second;
+                rft->SetDiscarded();
+            }
+            released += mft->memBytes;
+            iter = taskList.erase(iter);
+        }
+        return released;
+    }
+
+    // report the change of the memory taken by the mixed frames to the governor
+    void ChangeMemoryUsage(int64_t deltaBytes)
+    {
+        m_memUsage.fetch_add((uint64_t)deltaBytes);
+        m_hMemGov->ReportUsageChange(deltaBytes);
+    }
+
     void RemoveDiscardedTasks(list<MixFrameTask::Holder>& taskList)
     {
         auto iter = taskList.begin();
@@ -1263,6 +1449,61 @@ private:
         }
     }
 
+    ImGui::ImMat MixLayers(vector<MatUtils::BlendLayer>& layers, uint32_t outWidth, uint32_t outHeight, ImDataType matDtype)
+    {
+        ImGui::ImMat mixedFrame;
+        if (layers.empty())
+        {
+            if (!m_hMatPool->Acquire(mixedFrame, outWidth, outHeight, 4, matDtype))
+                mixedFrame.create_type(outWidth, outHeight, 4, matDtype);
+            memset(mixedFrame.data, 0, mixedFrame.total()*mixedFrame.elemsize);
+            return mixedFrame;
+        }
+        if (layers.size() == 1)
+            return layers.front().mat;
+
+        if (m_hMatPool->Acquire(mixedFrame, outWidth, outHeight, 4, layers.front().mat.type) && CompositeLayersInBands(mixedFrame, layers))
+            return mixedFrame;
+        // the compositor can not handle the frames, e.g. they reside in gpu memory, blend them pairwise
+        lock_guard<mutex> lk(m_mixBlenderLock);
+        mixedFrame = layers.front().mat;
+        for (auto iter = layers.begin()+1; iter != layers.end(); iter++)
+            mixedFrame = m_hMixBlender->Blend(mixedFrame, iter->mat);
+        return mixedFrame;
+    }
+
+    bool CompositeLayersInBands(ImGui::ImMat& dstMat, const vector<MatUtils::BlendLayer>& layers)
+    {
+        const uint32_t tileSize = 64;
+        const uint32_t minBandHeight = 2*tileSize;
+        auto hExecutor = SysUtils::ThreadPoolExecutor::GetDefaultInstance();
+        uint32_t bandCount = min(hExecutor->GetThreadCount(), (uint32_t)dstMat.h/minBandHeight);
+        if (bandCount <= 1)
+            return MatUtils::CompositeLayers(dstMat, layers, tileSize);
+
+        // keep the band boundaries on the tile grid
+        const uint32_t tileRows = ((uint32_t)dstMat.h+tileSize-1)/tileSize;
+        const uint32_t bandHeight = (tileRows+bandCount-1)/bandCount*tileSize;
+        bandCount = ((uint32_t)dstMat.h+bandHeight-1)/bandHeight;
+        vector<SysUtils::ThreadPoolExecutor::Task::Holder> bandJobs;
+        atomic_bool success{true};
+        for (uint32_t i = 1; i < bandCount; i++)
+        {
+            const int32_t rowBegin = i*bandHeight;
+            const int32_t rowEnd = min(rowBegin+(int32_t)bandHeight, dstMat.h);
+            bandJobs.push_back(hExecutor->Submit("MtvMixBand", [&dstMat, &layers, &success, tileSize, rowBegin, rowEnd] () {
+                if (!MatUtils::CompositeLayers(dstMat, layers, tileSize, rowBegin, rowEnd))
+                    success = false;
+                return SysUtils::ThreadPoolExecutor::STEP_DONE;
+            }));
+        }
+        if (!MatUtils::CompositeLayers(dstMat, layers, tileSize, 0, bandHeight))
+            success = false;
+        for (auto& job : bandJobs)
+            job->Join();
+        return success;
+    }
+
     void MixingThreadProc()
     {
         m_logger->Log(DEBUG) << "Enter MixingThreadProc(VIDEO)..." << endl;
@@ -1273,9 +1514,13 @@ private:
         const auto matDtype = m_hSettings->VideoOutDataType();
         bool afterSeek = false;
         bool prevInSeekingState = m_inSeeking;
+        list<SysUtils::ThreadPoolExecutor::Task::Holder> pendingMixingJobs;
         while (!m_quit)
         {
+            pendingMixingJobs.remove_if([] (auto& job) { return job->IsDone(); });
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             bool idleLoop = true;
+            bool pendingOnSource = false;
 
             list<MixFrameTask::Holder> mixFrameTasks;
             if (m_inSeeking)
@@ -1285,6 +1530,8 @@ private:
                     prevInSeekingState = m_inSeeking;
                     ClearAllMixFrameTasks();
                 }
+                if (m_scrubMode && !m_scrubRefined)
+                    RefineScrubbingFrame();
                 lock_guard<mutex> lk(m_seekingTasksLock);
                 // auto statusLog = PrintMixFrameTaskListStatus(m_seekingTasks, "SeekingTasks");
                 // m_logger->Log(DEBUG) << statusLog << endl;
@@ -1310,6 +1557,22 @@ private:
                 auto& mft = *mftIter++;
                 if (mft->outputReady)
                     continue;
+                if (mft->mixingJob)
+                {
+                    if (mft->mixingJob->IsDone())
+                    {
+                        mft->outputFrames = *mft->mixingFrames;
+                        m_seekingFlash = std::move(*mft->mixingFrames);
+                        const auto& mixedFrame = mft->outputFrames[0].frame;
+                        mft->memBytes = mixedFrame.empty() ? 0 : (uint64_t)mixedFrame.total()*mixedFrame.elemsize;
+                        ChangeMemoryUsage((int64_t)mft->memBytes);
+                        mft->outputReady = true;
+                        m_logger->Log(DEBUG) << "---------> Got mixed frame at frameIndex=" << mft->frameIndex
+                            << ", pos=" << (int64_t)(mft->outputFrames[0].frame.time_stamp*1000) << endl;
+                        idleLoop = false;
+                    }
+                    continue;
+                }
 
                 bool allProcessed = true;
                 bool allSourceReady = true;
@@ -1326,10 +1589,13 @@ private:
                 }
                 if (allProcessed)
                 {
-                    ImGui::ImMat mixedFrame;
+                    if (pendingMixingJobs.size() >= m_maxMixingJobs)
+                        continue;
                     vector<CorrelativeFrame> frames;
-                    frames.push_back({CorrelativeFrame::PHASE_AFTER_MIXING, 0, 0, mixedFrame});
+                    frames.push_back({CorrelativeFrame::PHASE_AFTER_MIXING, 0, 0, ImGui::ImMat()});
                     double timestamp = (double)mft->frameIndex*frameRate.den/frameRate.num;
+                    // the tracks in front of the task table are on top, collect the layers from bottom to top
+                    vector<MatUtils::BlendLayer> layers;
                     auto rftIter = mft->readFrameTaskTable.begin();
                     while (rftIter != mft->readFrameTaskTable.end())
                     {
@@ -1341,31 +1607,33 @@ private:
                             rft->GetVideoFrame(frames, vmat);
                         if (!vmat.empty())
                         {
-                            if (mixedFrame.empty())
-                                mixedFrame = vmat;
-                            else
-                                mixedFrame = m_hMixBlender->Blend(vmat, mixedFrame);
+                            MatUtils::BlendLayer layer;
+                            layer.mat = vmat;
+                            layers.insert(layers.begin(), layer);
                             if (abs(timestamp-vmat.time_stamp) > 0.001)
                                 m_logger->Log(WARN) << "'vmat' read from track #" << trk->Id() << " has WRONG TIMESTAMP! timestamp("
                                     << timestamp << ") != vmat(" << vmat.time_stamp << ")." << endl;
                         }
                     }
 
-                    if (mixedFrame.empty())
-                    {
-                        mixedFrame.create_type(outWidth, outHeight, 4, matDtype);
-                        memset(mixedFrame.data, 0, mixedFrame.total()*mixedFrame.elemsize);
-                    }
-                    mixedFrame.time_stamp = timestamp;
-                    mixedFrame.flags |= IM_MAT_FLAGS_VIDEO_FRAME;
-                    mixedFrame.rate.num = frameRate.num;
-                    mixedFrame.rate.den = frameRate.den;
-                    mixedFrame.index_count = mft->frameIndex;
-                    frames[0].frame = mixedFrame;
-                    mft->outputFrames = frames;
-                    m_seekingFlash = std::move(frames);
-                    mft->outputReady = true;
-                    m_logger->Log(DEBUG) << "---------> Got mixed frame at frameIndex=" << mft->frameIndex << ", pos=" << (int64_t)(timestamp*1000) << endl;
+                    // mix on the executor, so several frames can be mixed at the same time. The result is published
+                    // on this thread once the job is done.
+                    auto hMixingFrames = make_shared<vector<CorrelativeFrame>>(std::move(frames));
+                    mft->mixingFrames = hMixingFrames;
+                    const auto frameIndex = mft->frameIndex;
+                    auto hExecutor = SysUtils::ThreadPoolExecutor::GetDefaultInstance();
+                    mft->mixingJob = hExecutor->Submit("MtvMixFrame", [this, hMixingFrames, layers, frameIndex, timestamp, outWidth, outHeight, frameRate, matDtype] () mutable {
+                        auto& mixedFrame = (*hMixingFrames)[0].frame;
+                        mixedFrame = MixLayers(layers, outWidth, outHeight, matDtype);
+                        mixedFrame.time_stamp = timestamp;
+                        mixedFrame.flags |= IM_MAT_FLAGS_VIDEO_FRAME;
+                        mixedFrame.rate.num = frameRate.num;
+                        mixedFrame.rate.den = frameRate.den;
+                        mixedFrame.index_count = frameIndex;
+                        m_wakeupEvt.Notify();
+                        return SysUtils::ThreadPoolExecutor::STEP_DONE;
+                    });
+                    pendingMixingJobs.push_back(mft->mixingJob);
                     idleLoop = false;
                 }
                 else if (allSourceReady)
@@ -1375,12 +1643,23 @@ private:
                         auto& rft = elem.second;
                         rft->StartProcessing();
                     }
+                    pendingOnSource = true;
+                }
+                else
+                {
+                    pendingOnSource = true;
                 }
             }
 
+            // the track read-frame tasks do not signal 'm_wakeupEvt', so keep a short poll interval while there are
+            // mixing tasks waiting for them; otherwise sleep until a new task is added
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                m_wakeupEvt.Wait(wakeupSeq, pendingOnSource ? 5 : m_idleWaitTimeout);
+            else
+                m_wakeupEvt.Notify();
         }
+        for (auto& job : pendingMixingJobs)
+            job->Join();
 
         m_logger->Log(DEBUG) << "Leave MixingThreadProc(VIDEO)." << endl;
     }
@@ -1481,6 +1760,13 @@ private:
     list<VideoTrack::Holder> m_tracks;
     recursive_mutex m_trackLock;
     VideoBlender::Holder m_hMixBlender;
+    mutex m_mixBlenderLock;
+    ImMatPool::Holder m_hMatPool{ImMatPool::GetSharedInstance("MixedFrame")};
+    // the mixed frames held by the tasks are accounted to the process-wide memory governor
+    MemoryGovernor::Holder m_hMemGov{MemoryGovernor::GetDefaultInstance()};
+    atomic_uint64_t m_memUsage{0};
+    // the max count of the frames being mixed at the same time
+    uint32_t m_maxMixingJobs{4};
 
     list<MixFrameTask::Holder> m_mixFrameTasks;
     recursive_mutex m_mixFrameTasksLock;
@@ -1489,6 +1775,11 @@ private:
     list<MixFrameTask::Holder> m_seekingTasks;
     mutex m_seekingTasksLock;
     vector<CorrelativeFrame> m_seekingFlash;
+    // scrub mode of the consecutive seeking
+    bool m_scrubMode{false};
+    bool m_scrubRefined{true};
+    uint32_t m_scrubRefineDelay{150};
+    TimePoint m_lastScrubTp;
 
     SharedSettings::Holder m_hSettings;
     double m_frameInterval{0};
@@ -1503,6 +1794,8 @@ private:
     bool m_configured{false};
     bool m_started{false};
     bool m_quit{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
 };
 
 const uint8_t MultiTrackVideoReader_Impl::MixFrameTask::DROP_BIT = 0x1;
@@ -16,14 +16,24 @@
 */
 
 #include <sstream>
+#include <fstream>
+#include <iomanip>
 #include <thread>
+#include <mutex>
 #include <algorithm>
 #include <list>
 #include <cmath>
+#include <limits>
+#include <atomic>
 #include "Overview.h"
 #include "MediaReader.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "ThreadPoolExecutor.h"
+#include "MemoryGovernor.h"
+#include "SpscRingBuffer.h"
+#include "VideoFrameCache.h"
+#include "MatUtils.h"
 extern "C"
 {
     #include "libavutil/avutil.h"
@@ -44,19 +54,176 @@ using namespace Logger;
 
 namespace MediaCore
 {
-class Overview_Impl : public Overview
+using SysUtils::ThreadPoolExecutor;
+using SysUtils::SpscRingBuffer;
+
+// number of pcm samples aggregated by one entry of the level 0 of the waveform pyramid
+static const uint32_t WAVEFORM_PYRAMID_BASE_SAMPLES = 256;
+
+static const char OVERVIEW_CACHE_MAGIC[4] = {'M', 'C', 'O', 'V'};
+static const uint32_t OVERVIEW_CACHE_VERSION = 1;
+static const string OVERVIEW_CACHE_SUFFIX = ".mcovw";
+// upper limit of the array sizes read from a cache file, to reject a corrupted file before allocating memory
+static const uint64_t OVERVIEW_CACHE_MAX_ARRAY_SIZE = 1ULL << 32;
+// the finer pyramid levels are 15/16 of the pyramid size, they are not saved to the cache
+static const uint32_t OVERVIEW_CACHE_MIN_LEVEL_SAMPLES = 4096;
+
+static string g_overviewCacheDir;
+static uint64_t g_overviewCacheSizeLimit = 256ULL*1024*1024;
+static mutex g_overviewCacheDirLock;
+
+template<typename T>
+static void WriteRaw(ostream& os, T val)
+{
+    os.write((const char*)&val, sizeof(val));
+}
+
+template<typename T>
+static bool ReadRaw(istream& is, T& val)
+{
+    is.read((char*)&val, sizeof(val));
+    return (bool)is;
+}
+
+static void WriteBytes(ostream& os, const void* data, uint64_t size)
+{
+    WriteRaw(os, size);
+    os.write((const char*)data, size);
+}
+
+template<typename T>
+static bool ReadBytes(istream& is, vector<T>& data)
+{
+    uint64_t size;
+    if (!ReadRaw(is, size) || size > OVERVIEW_CACHE_MAX_ARRAY_SIZE || size%sizeof(T) != 0)
+        return false;
+    data.resize(size/sizeof(T));
+    is.read((char*)data.data(), size);
+    return (bool)is;
+}
+
+static AVPixelFormat GetSnapshotPngPixelFormat(int channels)
+{
+    switch (channels)
+    {
+    case 1: return AV_PIX_FMT_GRAY8;
+    case 3: return AV_PIX_FMT_RGB24;
+    case 4: return AV_PIX_FMT_RGBA;
+    default: return AV_PIX_FMT_NONE;
+    }
+}
+
+// Compress an 8-bit interleaved snapshot image into png. The channel order is kept as is, it's not interpreted.
+static bool EncodeSnapshotPng(const ImGui::ImMat& img, vector<uint8_t>& pngData, string& errMsg)
+{
+    const AVPixelFormat pixfmt = GetSnapshotPngPixelFormat(img.c);
+    if (pixfmt == AV_PIX_FMT_NONE)
+    {
+        errMsg = "Unsupported channel count!";
+        return false;
+    }
+    const AVCodec* pngEnc = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!pngEnc)
+    {
+        errMsg = "Png encoder is NOT available!";
+        return false;
+    }
+    AVCodecContext* encCtx = avcodec_alloc_context3(pngEnc);
+    AVFrame* avfrm = av_frame_alloc();
+    AVPacket* avpkt = av_packet_alloc();
+    bool success = false;
+    int fferr = -1;
+    if (encCtx && avfrm && avpkt)
+    {
+        encCtx->width = img.w;
+        encCtx->height = img.h;
+        encCtx->pix_fmt = pixfmt;
+        encCtx->time_base = {1, 25};
+        avfrm->format = pixfmt;
+        avfrm->width = img.w;
+        avfrm->height = img.h;
+        if ((fferr = avcodec_open2(encCtx, pngEnc, nullptr)) >= 0 && (fferr = av_frame_get_buffer(avfrm, 0)) >= 0)
+        {
+            const int lineSize = img.w*img.c;
+            const uint8_t* srcPtr = (const uint8_t*)img.data;
+            for (int i = 0; i < img.h; i++)
+                memcpy(avfrm->data[0]+i*avfrm->linesize[0], srcPtr+i*lineSize, lineSize);
+            if ((fferr = avcodec_send_frame(encCtx, avfrm)) >= 0 && (fferr = avcodec_receive_packet(encCtx, avpkt)) >= 0)
+            {
+                pngData.assign(avpkt->data, avpkt->data+avpkt->size);
+                success = true;
+            }
+        }
+    }
+    if (!success)
+    {
+        ostringstream oss; oss << "Encode png FAILED! fferr=" << fferr << ".";
+        errMsg = oss.str();
+    }
+    av_packet_free(&avpkt);
+    av_frame_free(&avfrm);
+    avcodec_free_context(&encCtx);
+    return success;
+}
+
+static bool DecodeSnapshotPng(const vector<uint8_t>& pngData, ImGui::ImMat& img, string& errMsg)
+{
+    const AVCodec* pngDec = avcodec_find_decoder(AV_CODEC_ID_PNG);
+    if (!pngDec)
+    {
+        errMsg = "Png decoder is NOT available!";
+        return false;
+    }
+    AVCodecContext* decCtx = avcodec_alloc_context3(pngDec);
+    AVFrame* avfrm = av_frame_alloc();
+    AVPacket* avpkt = av_packet_alloc();
+    bool success = false;
+    int fferr = -1;
+    if (decCtx && avfrm && avpkt && (fferr = avcodec_open2(decCtx, pngDec, nullptr)) >= 0
+        && (fferr = av_new_packet(avpkt, (int)pngData.size())) >= 0)
+    {
+        memcpy(avpkt->data, pngData.data(), pngData.size());
+        if ((fferr = avcodec_send_packet(decCtx, avpkt)) >= 0 && (fferr = avcodec_receive_frame(decCtx, avfrm)) >= 0)
+        {
+            if (avfrm->width == img.w && avfrm->height == img.h && avfrm->format == GetSnapshotPngPixelFormat(img.c))
+            {
+                const int lineSize = img.w*img.c;
+                uint8_t* dstPtr = (uint8_t*)img.data;
+                for (int i = 0; i < img.h; i++)
+                    memcpy(dstPtr+i*lineSize, avfrm->data[0]+i*avfrm->linesize[0], lineSize);
+                success = true;
+            }
+        }
+    }
+    if (!success)
+    {
+        ostringstream oss; oss << "Decode png FAILED! fferr=" << fferr << ".";
+        errMsg = oss.str();
+    }
+    av_packet_free(&avpkt);
+    av_frame_free(&avfrm);
+    avcodec_free_context(&decCtx);
+    return success;
+}
+
+class Overview_Impl : public Overview, public MemoryGovernor::Consumer
 {
 public:
     Overview_Impl()
     {
         m_logger = Overview::GetLogger();
+        m_hMemGov->Register(this);
     }
 
     Overview_Impl(const Overview_Impl&) = delete;
     Overview_Impl(Overview_Impl&&) = delete;
     Overview_Impl& operator=(const Overview_Impl&) = delete;
 
-    virtual ~Overview_Impl() {}
+    virtual ~Overview_Impl()
+    {
+        ResetMemoryUsage();
+        m_hMemGov->Unregister(this);
+    }
 
     bool Open(const string& url, uint32_t snapshotCount) override
     {
@@ -153,6 +320,71 @@ public:
         return m_hWaveform;
     }
 
+    bool GetWaveformPeaks(uint32_t channel, double startPos, double duration, uint32_t pixels, WaveformPeaks& peaks) override
+    {
+        lock_guard<mutex> lk(m_wfPyramidLock);
+        Waveform::Holder hWaveform = m_hWaveform;
+        if (!hWaveform || hWaveform->pyramid.empty())
+        {
+            m_errMsg = "No waveform is available!";
+            return false;
+        }
+        const auto& pyramid = hWaveform->pyramid;
+        if (channel >= pyramid[0].minv.size())
+        {
+            ostringstream oss; oss << "Argument 'channel'(" << channel << ") is out of range, there are " << pyramid[0].minv.size() << " channels!";
+            m_errMsg = oss.str();
+            return false;
+        }
+        if (pixels == 0 || duration <= 0)
+        {
+            m_errMsg = "Argument 'pixels' and 'duration' must be positive!";
+            return false;
+        }
+
+        // pick the coarsest level whose entries are not larger than one column
+        const double samplesPerPixel = duration*hWaveform->sampleRate/pixels;
+        uint32_t lvIdx = 0;
+        while (lvIdx+1 < pyramid.size() && pyramid[lvIdx+1].aggregateSamples <= samplesPerPixel)
+            lvIdx++;
+        const auto& level = pyramid[lvIdx];
+        const auto& minv = level.minv[channel];
+        const auto& maxv = level.maxv[channel];
+        const auto& rms = level.rms[channel];
+        const int64_t validCount = level.validCount;
+        const double entriesPerPixel = samplesPerPixel/level.aggregateSamples;
+        const double startEntry = startPos*hWaveform->sampleRate/level.aggregateSamples;
+
+        peaks.minv.assign(pixels, 0);
+        peaks.maxv.assign(pixels, 0);
+        peaks.rms.assign(pixels, 0);
+        for (uint32_t i = 0; i < pixels; i++)
+        {
+            int64_t beginIdx = (int64_t)floor(startEntry+i*entriesPerPixel);
+            int64_t endIdx = (int64_t)floor(startEntry+(i+1)*entriesPerPixel);
+            if (endIdx <= beginIdx)
+                endIdx = beginIdx+1;
+            if (beginIdx < 0)
+                beginIdx = 0;
+            if (endIdx > validCount)
+                endIdx = validCount;
+            if (beginIdx >= endIdx)
+                continue;
+            float minVal = minv[beginIdx], maxVal = maxv[beginIdx];
+            double sumSquares = 0;
+            for (int64_t j = beginIdx; j < endIdx; j++)
+            {
+                if (minVal > minv[j]) minVal = minv[j];
+                if (maxVal < maxv[j]) maxVal = maxv[j];
+                sumSquares += (double)rms[j]*rms[j];
+            }
+            peaks.minv[i] = minVal;
+            peaks.maxv[i] = maxVal;
+            peaks.rms[i] = (float)sqrt(sumSquares/(endIdx-beginIdx));
+        }
+        return true;
+    }
+
     bool SetSingleFramePixels(uint32_t pixels) override
     {
         m_singleFramePixels = pixels;
@@ -180,6 +412,11 @@ public:
         return m_genSsEof;
     }
 
+    bool IsLoadedFromCache() const override
+    {
+        return m_loadedFromCache;
+    }
+
     bool HasVideo() const override
     {
         return m_vidStmIdx >= 0;
@@ -352,11 +589,47 @@ public:
         m_vidPreferUseHw = enable;
     }
 
+    void EnableKeyFrameOnly(bool enable) override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_keyFrameOnly == enable)
+            return;
+        m_keyFrameOnly = enable;
+        if (IsOpened())
+            RebuildSnapshots();
+    }
+
+    bool IsKeyFrameOnly() const override
+    {
+        return m_keyFrameOnly;
+    }
+
     string GetError() const override
     {
         return m_errMsg;
     }
 
+    string GetMemoryConsumerName() const override
+    {
+        return m_logger->GetName();
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_memUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return MemoryGovernor::PRIORITY_LOW;
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        // the snapshots are the result of the overview rather than a cache, they are only released with the instance
+        return 0;
+    }
+
 private:
     struct Snapshot
     {
@@ -365,8 +638,29 @@ private:
         uint32_t sameAsIndex{0};
         int64_t ssFrmPts{INT64_MIN};
         ImGui::ImMat img;
+        // the bytes of 'img' reported to the memory governor
+        uint64_t memBytes{0};
     };
 
+    // report the change of the memory taken by the image of 'ss' to the governor
+    void UpdateMemoryUsage(Snapshot& ss)
+    {
+        const uint64_t bytes = ss.img.empty() ? 0 : (uint64_t)ss.img.total()*ss.img.elemsize;
+        if (bytes == ss.memBytes)
+            return;
+        const int64_t delta = (int64_t)bytes-(int64_t)ss.memBytes;
+        ss.memBytes = bytes;
+        m_memUsage.fetch_add((uint64_t)delta);
+        m_hMemGov->ReportUsageChange(delta);
+    }
+
+    void ResetMemoryUsage()
+    {
+        const uint64_t prevUsage = m_memUsage.exchange(0);
+        if (prevUsage > 0)
+            m_hMemGov->ReportUsageChange(-(int64_t)prevUsage);
+    }
+
     string FFapiFailureMessage(const string& apiName, int fferr)
     {
         ostringstream oss;
@@ -374,6 +668,36 @@ private:
         return oss.str();
     }
 
+    VideoFrameCache::Key GetFrameCacheKey() const
+    {
+        VideoFrameCache::Key key;
+        key.url = m_hParser->GetUrl();
+        key.streamIndex = m_vidStmIdx;
+        key.width = m_frmCvt.GetOutWidth();
+        key.height = m_frmCvt.GetOutHeight();
+        key.clrfmt = m_frmCvt.GetOutColorFormat();
+        key.dtype = m_frmCvt.GetOutDataType();
+        key.interp = m_frmCvt.GetResizeInterpolateMode();
+        key.useVulkan = m_frmCvt.IsUseVulkanConverter();
+        return key;
+    }
+
+    bool ConvertSnapshotImage(AVFrame* frm, ImGui::ImMat& img, double ts)
+    {
+        if (m_isImage)
+            return m_frmCvt.ConvertImage(frm, img, ts);
+        const auto key = GetFrameCacheKey();
+        if (m_hFrameCache->Get(key, frm->pts, img))
+        {
+            img.time_stamp = ts;
+            return true;
+        }
+        if (!m_frmCvt.ConvertImage(frm, img, ts))
+            return false;
+        m_hFrameCache->Put(key, frm->pts, img);
+        return true;
+    }
+
     bool OpenMedia(MediaParser::Holder hParser)
     {
         if (!hParser->IsImageSequence())
@@ -473,6 +797,23 @@ private:
                 hWaveform->pcm.resize(1);
             for (auto& chpcm : hWaveform->pcm)
                 chpcm.resize(waveformSamples, 0);
+            // only the levels are created here, their entries are appended as the samples are decoded
+            hWaveform->sampleRate = audStream->sampleRate;
+            const uint64_t totalSamples = (uint64_t)ceil(audStream->duration*audStream->sampleRate);
+            uint32_t levelAggsmp = WAVEFORM_PYRAMID_BASE_SAMPLES;
+            uint64_t levelSize;
+            do
+            {
+                levelSize = (totalSamples+levelAggsmp-1)/levelAggsmp;
+                Waveform::Level level;
+                level.aggregateSamples = levelAggsmp;
+                level.minv.resize(audStream->channels);
+                level.maxv.resize(audStream->channels);
+                level.rms.resize(audStream->channels);
+                hWaveform->pyramid.push_back(move(level));
+                levelAggsmp <<= 1;
+            } while (levelSize > 1 && levelAggsmp > 0);
+            lock_guard<mutex> lk(m_wfPyramidLock);
             m_hWaveform = hWaveform;
         }
 
@@ -497,11 +838,16 @@ private:
                 m_vidAvStm = m_avfmtCtx->streams[m_vidStmIdx];
 
                 m_viddecOpenOpts.onlyUseSoftwareDecoder = !m_vidPreferUseHw;
+                // let the decoder output reduced resolution pictures when the snapshots are small enough
+                m_viddecOpenOpts.minPictureWidth = m_frmCvt.GetOutWidth();
+                m_viddecOpenOpts.minPictureHeight = m_frmCvt.GetOutHeight();
                 FFUtils::OpenVideoDecoderResult res;
                 if (FFUtils::OpenVideoDecoder(m_avfmtCtx, -1, &m_viddecOpenOpts, &res))
                 {
                     m_viddecCtx = res.decCtx;
                     openVideoFailed = false;
+                    if (m_keyFrameOnly)
+                        m_viddecCtx->skip_frame = AVDISCARD_NONKEY;
                 }
                 else
                 {
@@ -538,6 +884,7 @@ private:
         }
 
         m_prepared = true;
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -608,12 +955,35 @@ private:
         {
             m_swrPassThrough = true;
         }
+
+        // the waveform pyramid covers all the source channels, it's fed from the decoded frames converted to planar float only
+        if (inSmpfmt != AV_SAMPLE_FMT_FLTP)
+        {
+#if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
+            m_pyrSwrCtx = swr_alloc_set_opts(NULL, inChnLyt, AV_SAMPLE_FMT_FLTP, inSampleRate, inChnLyt, inSmpfmt, inSampleRate, 0, nullptr);
+            if (!m_pyrSwrCtx)
+#else
+            fferr = swr_alloc_set_opts2(&m_pyrSwrCtx, &inChlyt, AV_SAMPLE_FMT_FLTP, inSampleRate, &inChlyt, inSmpfmt, inSampleRate, 0, nullptr);
+            if (fferr < 0)
+#endif
+            {
+                m_errMsg = "FAILED to invoke 'swr_alloc_set_opts()' to create 'SwrContext' for the waveform pyramid!";
+                return false;
+            }
+            int fferr = swr_init(m_pyrSwrCtx);
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("swr_init", fferr);
+                return false;
+            }
+        }
         return true;
     }
 
     void BuildSnapshots()
     {
         m_snapshots.clear();
+        ResetMemoryUsage();
         for (uint32_t i = 0; i < m_ssCount; i++)
         {
             Snapshot ss;
@@ -621,9 +991,331 @@ private:
             ss.img.time_stamp = (m_ssIntvMts*i+m_vidStartMts)/1000.;
             m_snapshots.push_back(ss);
         }
+        m_cacheKey = MakeCacheKey();
+        m_loadedFromCache = LoadFromCache();
+        if (m_loadedFromCache)
+            return;
         StartAllThreads();
     }
 
+    // the key identifies the media file by its path, size and modification time, and includes all the settings that
+    // affect the overview, it's empty if the cache is disabled or the media is not a local file
+    string MakeCacheKey() const
+    {
+        if (GetCacheDirectory().empty() || m_hParser->IsImageSequence())
+            return "";
+        const string& url = m_hParser->GetUrl();
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (!SysUtils::GetFileStatus(url, fileSize, modifyTime))
+            return "";
+        ostringstream oss;
+        oss << setprecision(17) << url << "|" << fileSize << "|" << modifyTime << "|" << m_vidStmIdx << "|" << m_audStmIdx;
+        if (HasVideo())
+            oss << "|" << m_keyFrameOnly << "|" << m_ssCount << "|" << m_frmCvt.GetOutWidth() << "x" << m_frmCvt.GetOutHeight() << "|" << (int)m_frmCvt.GetOutColorFormat()
+                << "|" << (int)m_frmCvt.GetOutDataType() << "|" << (int)m_frmCvt.GetResizeInterpolateMode();
+        if (HasAudio() && m_hWaveform)
+            oss << "|" << m_hWaveform->aggregateSamples << "|" << WAVEFORM_PYRAMID_BASE_SAMPLES;
+        return oss.str();
+    }
+
+    static string GetCacheFilePath(const string& cacheKey)
+    {
+        string dirPath = GetCacheDirectory();
+        if (!dirPath.empty() && dirPath.back() != '/' && dirPath.back() != '\\')
+            dirPath += "/";
+        ostringstream oss;
+        oss << dirPath << hex << setw(16) << setfill('0') << SysUtils::Fnv1aHash(cacheKey) << OVERVIEW_CACHE_SUFFIX;
+        return oss.str();
+    }
+
+    bool LoadFromCache()
+    {
+        if (m_cacheKey.empty())
+            return false;
+        const string cachePath = GetCacheFilePath(m_cacheKey);
+        ifstream ifs(cachePath, ios::in|ios::binary);
+        if (!ifs.is_open())
+            return false;
+
+        char magic[4];
+        uint32_t version;
+        vector<char> recKey;
+        ifs.read(magic, sizeof(magic));
+        if (!ifs || memcmp(magic, OVERVIEW_CACHE_MAGIC, sizeof(magic)) != 0
+            || !ReadRaw(ifs, version) || version != OVERVIEW_CACHE_VERSION || !ReadBytes(ifs, recKey))
+        {
+            m_logger->Log(WARN) << "Overview cache file '" << cachePath << "' is INVALID or of an unsupported version." << endl;
+            return false;
+        }
+        // the file name is only a hash of the key, a different key means a hash collision
+        if (string(recKey.begin(), recKey.end()) != m_cacheKey)
+            return false;
+
+        vector<Snapshot> snapshots;
+        uint32_t ssCount;
+        if (!ReadRaw(ifs, ssCount) || ssCount != (HasVideo() ? m_ssCount : 0))
+            return false;
+        string errMsg;
+        for (uint32_t i = 0; i < ssCount; i++)
+        {
+            Snapshot ss;
+            uint8_t sameFrame, hasImg;
+            if (!ReadRaw(ifs, ss.index) || !ReadRaw(ifs, sameFrame) || !ReadRaw(ifs, ss.sameAsIndex) || !ReadRaw(ifs, ss.ssFrmPts)
+                || !ReadRaw(ifs, hasImg) || ss.index != i || (sameFrame && ss.sameAsIndex >= ssCount))
+            {
+                m_logger->Log(WARN) << "Overview cache file '" << cachePath << "' is TRUNCATED." << endl;
+                return false;
+            }
+            ss.sameFrame = sameFrame != 0;
+            double timestamp;
+            if (!ReadRaw(ifs, timestamp))
+                return false;
+            if (hasImg)
+            {
+                int32_t w, h, c, clrfmt, clrspc, clrrng, flags;
+                vector<uint8_t> pngData;
+                if (!ReadRaw(ifs, w) || !ReadRaw(ifs, h) || !ReadRaw(ifs, c) || !ReadRaw(ifs, clrfmt) || !ReadRaw(ifs, clrspc)
+                    || !ReadRaw(ifs, clrrng) || !ReadRaw(ifs, flags) || !ReadBytes(ifs, pngData) || w <= 0 || h <= 0)
+                {
+                    m_logger->Log(WARN) << "Overview cache file '" << cachePath << "' is TRUNCATED." << endl;
+                    return false;
+                }
+                ss.img.create_type(w, h, c, IM_DT_INT8);
+                if (!DecodeSnapshotPng(pngData, ss.img, errMsg))
+                {
+                    m_logger->Log(WARN) << "FAILED to decode snapshot #" << i << " from overview cache file '" << cachePath << "'! " << errMsg << endl;
+                    return false;
+                }
+                ss.img.color_format = (ImColorFormat)clrfmt;
+                ss.img.color_space = (ImColorSpace)clrspc;
+                ss.img.color_range = (ImColorRange)clrrng;
+                ss.img.flags = flags;
+            }
+            ss.img.time_stamp = timestamp;
+            snapshots.push_back(ss);
+        }
+
+        Waveform::Holder hWaveform;
+        uint8_t hasWaveform;
+        if (!ReadRaw(ifs, hasWaveform) || (hasWaveform != 0) != (HasAudio() && m_hWaveform))
+            return false;
+        if (hasWaveform)
+        {
+            hWaveform = Waveform::Holder(new Waveform);
+            uint32_t chCount, levelCount;
+            bool valid = ReadRaw(ifs, hWaveform->aggregateSamples) && ReadRaw(ifs, hWaveform->aggregateDuration)
+                    && ReadRaw(ifs, hWaveform->minSample) && ReadRaw(ifs, hWaveform->maxSample)
+                    && ReadRaw(ifs, hWaveform->validSampleCount) && ReadRaw(ifs, hWaveform->sampleRate)
+                    && ReadRaw(ifs, chCount) && chCount <= 2;
+            for (uint32_t i = 0; valid && i < chCount; i++)
+            {
+                hWaveform->pcm.emplace_back();
+                valid = ReadBytes(ifs, hWaveform->pcm.back());
+            }
+            valid = valid && ReadRaw(ifs, levelCount) && ReadRaw(ifs, chCount) && levelCount <= 64;
+            for (uint32_t i = 0; valid && i < levelCount; i++)
+            {
+                Waveform::Level level;
+                valid = ReadRaw(ifs, level.aggregateSamples) && ReadRaw(ifs, level.validCount);
+                level.minv.resize(chCount);
+                level.maxv.resize(chCount);
+                level.rms.resize(chCount);
+                for (uint32_t j = 0; valid && j < chCount; j++)
+                    valid = ReadBytes(ifs, level.minv[j]) && ReadBytes(ifs, level.maxv[j]) && ReadBytes(ifs, level.rms[j]);
+                hWaveform->pyramid.push_back(move(level));
+            }
+            if (!valid)
+            {
+                m_logger->Log(WARN) << "Overview cache file '" << cachePath << "' is TRUNCATED." << endl;
+                return false;
+            }
+            hWaveform->parseDone = true;
+        }
+
+        m_snapshots = move(snapshots);
+        for (auto& ss : m_snapshots)
+            UpdateMemoryUsage(ss);
+        if (hWaveform)
+        {
+            lock_guard<mutex> lk(m_wfPyramidLock);
+            m_hWaveform = hWaveform;
+        }
+        m_genSsEof = true;
+        m_genWfEof = true;
+        ifs.close();
+        // the modification time of a cache file is its last use, the least recently used files are removed first
+        SysUtils::TouchFile(cachePath);
+        m_logger->Log(INFO) << "Load overview of media '" << m_hParser->GetUrl() << "' from '" << cachePath << "'." << endl;
+        return true;
+    }
+
+    // 'm_apiLock' must be held when calling this method
+    bool CanSaveToCache() const
+    {
+        if (m_cacheKey.empty())
+            return false;
+        // only a complete overview of 8-bit images is cached
+        for (auto& ss : m_snapshots)
+        {
+            if (ss.sameFrame)
+                continue;
+            if (ss.img.empty() || ss.img.device != IM_DD_CPU || ss.img.type != IM_DT_INT8
+                || (ss.img.c > 1 && ss.img.elempack != ss.img.c) || GetSnapshotPngPixelFormat(ss.img.c) == AV_PIX_FMT_NONE)
+                return false;
+        }
+        if (HasAudio() && m_hWaveform && !m_hWaveform->parseDone)
+            return false;
+        return true;
+    }
+
+    // Called without 'm_apiLock', the arguments are the copies of the complete overview taken by 'CanSaveToCache()'s caller.
+    bool SaveToCache(const string& cacheKey, const vector<Snapshot>& snapshots, Waveform::Holder hWaveform)
+    {
+        // write to a temporary file first, so an interrupted writing never leaves a broken cache file
+        const string cachePath = GetCacheFilePath(cacheKey);
+        const string tmpPath = SysUtils::MakeUniqueTempPath(cachePath);
+        {
+            ofstream ofs(tmpPath, ios::out|ios::binary|ios::trunc);
+            if (!ofs.is_open())
+            {
+                m_logger->Log(WARN) << "CANNOT create overview cache file '" << tmpPath << "'." << endl;
+                return false;
+            }
+            ofs.write(OVERVIEW_CACHE_MAGIC, sizeof(OVERVIEW_CACHE_MAGIC));
+            WriteRaw(ofs, OVERVIEW_CACHE_VERSION);
+            WriteBytes(ofs, cacheKey.data(), cacheKey.size());
+
+            WriteRaw(ofs, (uint32_t)snapshots.size());
+            string errMsg;
+            for (auto& ss : snapshots)
+            {
+                WriteRaw(ofs, ss.index);
+                WriteRaw(ofs, (uint8_t)(ss.sameFrame ? 1 : 0));
+                WriteRaw(ofs, ss.sameAsIndex);
+                WriteRaw(ofs, ss.ssFrmPts);
+                const bool hasImg = !ss.sameFrame;
+                WriteRaw(ofs, (uint8_t)(hasImg ? 1 : 0));
+                WriteRaw(ofs, ss.img.time_stamp);
+                if (hasImg)
+                {
+                    vector<uint8_t> pngData;
+                    if (!EncodeSnapshotPng(ss.img, pngData, errMsg))
+                    {
+                        m_logger->Log(WARN) << "FAILED to encode snapshot #" << ss.index << " for the overview cache! " << errMsg << endl;
+                        ofs.close();
+                        remove(tmpPath.c_str());
+                        return false;
+                    }
+                    WriteRaw(ofs, (int32_t)ss.img.w);
+                    WriteRaw(ofs, (int32_t)ss.img.h);
+                    WriteRaw(ofs, (int32_t)ss.img.c);
+                    WriteRaw(ofs, (int32_t)ss.img.color_format);
+                    WriteRaw(ofs, (int32_t)ss.img.color_space);
+                    WriteRaw(ofs, (int32_t)ss.img.color_range);
+                    WriteRaw(ofs, (int32_t)ss.img.flags);
+                    WriteBytes(ofs, pngData.data(), pngData.size());
+                }
+            }
+
+            const bool hasWaveform = HasAudio() && hWaveform;
+            WriteRaw(ofs, (uint8_t)(hasWaveform ? 1 : 0));
+            if (hasWaveform)
+            {
+                const auto& wf = *hWaveform;
+                WriteRaw(ofs, wf.aggregateSamples);
+                WriteRaw(ofs, wf.aggregateDuration);
+                WriteRaw(ofs, wf.minSample);
+                WriteRaw(ofs, wf.maxSample);
+                WriteRaw(ofs, wf.validSampleCount);
+                WriteRaw(ofs, wf.sampleRate);
+                WriteRaw(ofs, (uint32_t)wf.pcm.size());
+                for (auto& chpcm : wf.pcm)
+                    WriteBytes(ofs, chpcm.data(), chpcm.size()*sizeof(float));
+                const uint32_t chCount = wf.pyramid.empty() ? 0 : (uint32_t)wf.pyramid[0].minv.size();
+                // keep at least the coarsest level, for a short audio
+                size_t firstLevel = 0;
+                while (firstLevel+1 < wf.pyramid.size() && wf.pyramid[firstLevel].aggregateSamples < OVERVIEW_CACHE_MIN_LEVEL_SAMPLES)
+                    firstLevel++;
+                WriteRaw(ofs, (uint32_t)(wf.pyramid.size()-firstLevel));
+                WriteRaw(ofs, chCount);
+                for (size_t i = firstLevel; i < wf.pyramid.size(); i++)
+                {
+                    auto& level = wf.pyramid[i];
+                    WriteRaw(ofs, level.aggregateSamples);
+                    WriteRaw(ofs, level.validCount);
+                    for (uint32_t j = 0; j < chCount; j++)
+                    {
+                        WriteBytes(ofs, level.minv[j].data(), level.minv[j].size()*sizeof(float));
+                        WriteBytes(ofs, level.maxv[j].data(), level.maxv[j].size()*sizeof(float));
+                        WriteBytes(ofs, level.rms[j].data(), level.rms[j].size()*sizeof(float));
+                    }
+                }
+            }
+            if (!ofs)
+            {
+                m_logger->Log(WARN) << "FAILED to write overview cache file '" << tmpPath << "'." << endl;
+                ofs.close();
+                remove(tmpPath.c_str());
+                return false;
+            }
+        }
+        remove(cachePath.c_str());
+        if (rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+        {
+            m_logger->Log(WARN) << "FAILED to rename '" << tmpPath << "' to '" << cachePath << "'." << endl;
+            remove(tmpPath.c_str());
+            return false;
+        }
+        m_logger->Log(DEBUG) << "Saved overview of media '" << m_hParser->GetUrl() << "' to '" << cachePath << "'." << endl;
+        TrimCacheDirectory(cachePath);
+        return true;
+    }
+
+    // remove the least recently used cache files until the total size fits in the limit, 'keepPath' is never removed
+    void TrimCacheDirectory(const string& keepPath)
+    {
+        const uint64_t sizeLimit = GetCacheSizeLimit();
+        const string dirPath = GetCacheDirectory();
+        if (sizeLimit == 0 || dirPath.empty())
+            return;
+        auto hFileIter = SysUtils::FileIterator::CreateInstance(dirPath);
+        if (!hFileIter)
+            return;
+        hFileIter->SetFilterPattern(".*\\"+OVERVIEW_CACHE_SUFFIX, true);
+        struct CacheFile
+        {
+            string path;
+            uint64_t size;
+            int64_t lastUse;
+        };
+        vector<CacheFile> cacheFiles;
+        uint64_t totalSize = 0;
+        for (auto& relPath : hFileIter->GetAllFilePaths())
+        {
+            CacheFile cf;
+            cf.path = hFileIter->JoinBaseDirPath(relPath);
+            if (!SysUtils::GetFileStatus(cf.path, cf.size, cf.lastUse))
+                continue;
+            totalSize += cf.size;
+            if (SysUtils::ExtractFileName(cf.path) != SysUtils::ExtractFileName(keepPath))
+                cacheFiles.push_back(cf);
+        }
+        if (totalSize <= sizeLimit)
+            return;
+        sort(cacheFiles.begin(), cacheFiles.end(), [] (const CacheFile& a, const CacheFile& b) { return a.lastUse < b.lastUse; });
+        for (auto& cf : cacheFiles)
+        {
+            if (totalSize <= sizeLimit)
+                break;
+            if (remove(cf.path.c_str()) == 0)
+            {
+                totalSize -= cf.size;
+                m_logger->Log(DEBUG) << "Removed overview cache file '" << cf.path << "' to fit in the cache size limit." << endl;
+            }
+        }
+    }
+
     void StartAllThreads()
     {
         string fileName = SysUtils::ExtractFileName(m_hParser->GetUrl());
@@ -634,94 +1326,97 @@ private:
         {
             if (!m_hParser->IsImageSequence())
             {
-                m_demuxVidThread = thread(&Overview_Impl::DemuxVideoThreadProc, this);
+                m_demuxVidTaskCtx = DemuxVideoTaskContext();
                 thnOss.str(""); thnOss << "OvwVdmx-" << fileName;
-                SysUtils::SetThreadName(m_demuxVidThread, thnOss.str());
-                m_viddecThread = thread(&Overview_Impl::VideoDecodeThreadProc, this);
+                m_demuxVidTask = m_hExecutor->Submit(thnOss.str(), [this] { return DemuxVideoThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+                m_viddecTaskCtx = DecodeTaskContext();
                 thnOss.str(""); thnOss << "OvwVdc-" << fileName;
-                SysUtils::SetThreadName(m_viddecThread, thnOss.str());
-                m_genSsThread = thread(&Overview_Impl::GenerateSsThreadProc, this);
+                m_viddecTask = m_hExecutor->Submit(thnOss.str(), [this] { return VideoDecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+                m_genSsTaskEntered = false;
                 thnOss.str(""); thnOss << "OvwGss-" << fileName;
-                SysUtils::SetThreadName(m_genSsThread, thnOss.str());
+                m_genSsTask = m_hExecutor->Submit(thnOss.str(), [this] { return GenerateSsThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
             }
             else
             {
-                m_genSsThread = thread(&Overview_Impl::GenerateSsByImgsqThreadProc, this);
+                m_imgsqTaskCtx = ImgsqTaskContext();
                 thnOss.str(""); thnOss << "OvwGss-" << fileName;
-                SysUtils::SetThreadName(m_genSsThread, thnOss.str());
+                // the image-sequence readers do not signal 'm_wakeupEvt', poll them with a short interval
+                m_genSsTask = m_hExecutor->Submit(thnOss.str(), [this] { return GenerateSsByImgsqThreadProc(); }, &m_wakeupEvt, 5);
                 startReleaseResourceThread = false;
             }
         }
         if (HasAudio())
         {
-            m_demuxAudThread = thread(&Overview_Impl::DemuxAudioThreadProc, this);
+            m_demuxAudTaskCtx = DemuxAudioTaskContext();
             thnOss.str(""); thnOss << "OvwAdmx-" << fileName;
-            SysUtils::SetThreadName(m_demuxAudThread, thnOss.str());
-            m_auddecThread = thread(&Overview_Impl::AudioDecodeThreadProc, this);
+            m_demuxAudTask = m_hExecutor->Submit(thnOss.str(), [this] { return DemuxAudioThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_auddecTaskCtx = DecodeTaskContext();
             thnOss.str(""); thnOss << "OvwAdc-" << fileName;
-            SysUtils::SetThreadName(m_auddecThread, thnOss.str());
-            m_genWfThread = thread(&Overview_Impl::GenWaveformThreadProc, this);
+            m_auddecTask = m_hExecutor->Submit(thnOss.str(), [this] { return AudioDecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_genWfTaskCtx = GenWaveformTaskContext();
             thnOss.str(""); thnOss << "OvwGwf-" << fileName;
-            SysUtils::SetThreadName(m_genWfThread, thnOss.str());
+            m_genWfTask = m_hExecutor->Submit(thnOss.str(), [this] { return GenWaveformThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         }
         if (startReleaseResourceThread)
-            m_releaseThread = thread(&Overview_Impl::ReleaseResourceProc, this);
+        {
+            thnOss.str(""); thnOss << "OvwRls-" << fileName;
+            m_releaseTask = m_hExecutor->Submit(thnOss.str(), [this] { return ReleaseResourceProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+        }
     }
 
     void WaitAllThreadsQuit(bool callFromReleaseProc = false)
     {
         m_quit = true;
-        if (!callFromReleaseProc && m_releaseThread.joinable())
+        m_wakeupEvt.Notify();
+        if (!callFromReleaseProc && m_releaseTask)
         {
-            m_releaseThread.join();
-            m_releaseThread = thread();
+            m_releaseTask->Join();
+            m_releaseTask = nullptr;
         }
-        if (m_demuxVidThread.joinable())
+        if (m_demuxVidTask)
         {
-            m_demuxVidThread.join();
-            m_demuxVidThread = thread();
+            m_demuxVidTask->Join();
+            m_demuxVidTask = nullptr;
         }
-        if (m_viddecThread.joinable())
+        if (m_viddecTask)
         {
-            m_viddecThread.join();
-            m_viddecThread = thread();
+            m_viddecTask->Join();
+            m_viddecTask = nullptr;
         }
-        if (m_genSsThread.joinable())
+        if (m_genSsTask)
         {
-            m_genSsThread.join();
-            m_genSsThread = thread();
+            m_genSsTask->Join();
+            m_genSsTask = nullptr;
         }
-        if (m_demuxAudThread.joinable())
+        if (m_demuxAudTask)
         {
-            m_demuxAudThread.join();
-            m_demuxAudThread = thread();
+            m_demuxAudTask->Join();
+            m_demuxAudTask = nullptr;
         }
-        if (m_auddecThread.joinable())
+        if (m_auddecTask)
         {
-            m_auddecThread.join();
-            m_auddecThread = thread();
+            m_auddecTask->Join();
+            m_auddecTask = nullptr;
         }
-        if (m_genWfThread.joinable())
+        if (m_genWfTask)
         {
-            m_genWfThread.join();
-            m_genWfThread = thread();
+            m_genWfTask->Join();
+            m_genWfTask = nullptr;
         }
     }
 
     void FlushAllQueues()
     {
-        for (AVPacket* avpkt : m_vidpktQ)
+        AVPacket* avpkt;
+        while (m_vidpktQ.TryPop(avpkt))
             av_packet_free(&avpkt);
-        m_vidpktQ.clear();
-        for (AVPacket* avpkt : m_audpktQ)
+        while (m_audpktQ.TryPop(avpkt))
             av_packet_free(&avpkt);
-        m_audpktQ.clear();
-        for (AVFrame* avfrm : m_vidfrmQ)
+        AVFrame* avfrm;
+        while (m_vidfrmQ.TryPop(avfrm))
             av_frame_free(&avfrm);
-        m_vidfrmQ.clear();
-        for (AVFrame* avfrm : m_audfrmQ)
+        while (m_audfrmQ.TryPop(avfrm))
             av_frame_free(&avfrm);
-        m_audfrmQ.clear();
     }
 
     void RebuildSnapshots()
@@ -731,41 +1426,97 @@ private:
 
         WaitAllThreadsQuit();
         FlushAllQueues();
+        if (m_viddecCtx && !m_viddecCtx->hw_device_ctx && m_avfmtCtx)
+        {
+            // the reduced resolution can not be changed on an opened decoder, reopen it if the snapshot size needs another one
+            const int lowres = FFUtils::GetVideoDecoderLowres(m_viddecCtx->codec, m_vidAvStm->codecpar->width, m_vidAvStm->codecpar->height,
+                    m_frmCvt.GetOutWidth(), m_frmCvt.GetOutHeight());
+            if (lowres != m_viddecCtx->lowres)
+            {
+                avcodec_free_context(&m_viddecCtx);
+                m_viddecOpenOpts.minPictureWidth = m_frmCvt.GetOutWidth();
+                m_viddecOpenOpts.minPictureHeight = m_frmCvt.GetOutHeight();
+                FFUtils::OpenVideoDecoderResult res;
+                if (FFUtils::OpenVideoDecoder(m_avfmtCtx, m_vidStmIdx, &m_viddecOpenOpts, &res, false))
+                {
+                    m_viddecCtx = res.decCtx;
+                }
+                else
+                {
+                    m_logger->Log(Error) << "FAILED to reopen video decoder for the new snapshot size! Error is '" << res.errMsg << "'." << endl;
+                    m_viddecCtx = nullptr;
+                    m_decodeVideo = false;
+                }
+            }
+        }
         if (m_viddecCtx)
+        {
             avcodec_flush_buffers(m_viddecCtx);
+            m_viddecCtx->skip_frame = m_keyFrameOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+        }
         if (m_auddecCtx)
             avcodec_flush_buffers(m_auddecCtx);
         BuildSnapshots();
     }
 
-    void DemuxVideoThreadProc()
+    // states of the video demuxing task that are kept between the steps
+    struct DemuxVideoTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter DemuxVideoThreadProc()..." << endl;
+        bool entered{false};
+        AVPacket avpkt = {0};
+        bool avpktLoaded{false};
+        // index of the snapshot whose packets are being demuxed, -1 means seeking to the next one
+        int32_t ssIdx{-1};
+    };
 
-        if (!m_prepared && !Prepare())
-        {
-            m_logger->Log(Error) << "Prepare() FAILED for url '" << m_hParser->GetUrl() << "'! Error is '" << m_errMsg << "'." << endl;
-            return;
-        }
-        if (!m_decodeVideo)
+    // pick the key frame nearest to 'pts' from the seek points, if they are parsed already
+    int64_t FindNearestKeyFramePts(int64_t pts) const
+    {
+        auto hSeekPoints = m_hParser->GetVideoSeekPoints(false);
+        if (!hSeekPoints || hSeekPoints->empty())
+            return pts;
+        auto iter = lower_bound(hSeekPoints->begin(), hSeekPoints->end(), pts);
+        if (iter == hSeekPoints->end())
+            return hSeekPoints->back();
+        if (iter != hSeekPoints->begin() && pts-*(iter-1) <= *iter-pts)
+            iter--;
+        return *iter;
+    }
+
+    ThreadPoolExecutor::StepResult DemuxVideoThreadProc()
+    {
+        auto& ctx = m_demuxVidTaskCtx;
+        if (!ctx.entered)
         {
-            m_demuxVidEof = true;
-            return;
+            m_logger->Log(DEBUG) << "Enter DemuxVideoThreadProc()..." << endl;
+            ctx.entered = true;
+            if (!m_prepared && !Prepare())
+            {
+                m_logger->Log(Error) << "Prepare() FAILED for url '" << m_hParser->GetUrl() << "'! Error is '" << m_errMsg << "'." << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            m_wakeupEvt.Notify();
+            if (!m_decodeVideo)
+            {
+                m_demuxVidEof = true;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
         }
+        if (m_quit)
+            return LeaveDemuxVideoThreadProc();
 
-        AVPacket avpkt = {0};
-        bool avpktLoaded = false;
-        while (!m_quit)
+        AVPacket& avpkt = ctx.avpkt;
+        bool& avpktLoaded = ctx.avpktLoaded;
+        bool idleLoop = true;
+        if (HasVideo())
         {
-            bool idleLoop = true;
-
-            if (HasVideo())
+            if (ctx.ssIdx < 0)
             {
                 auto iter = find_if(m_snapshots.begin(), m_snapshots.end(), [](const Snapshot& ss) {
                     return ss.ssFrmPts == INT64_MIN;
                 });
                 if (iter == m_snapshots.end())
-                    break;
+                    return LeaveDemuxVideoThreadProc();
 
                 Snapshot& ss = *iter;
                 int fferr;
@@ -773,204 +1524,238 @@ private:
                 {
                     int64_t seekTargetPts = ss.ssFrmPts != INT64_MIN ? ss.ssFrmPts :
                         av_rescale_q((int64_t)(m_ssIntvMts*ss.index+m_vidStartMts), MILLISEC_TIMEBASE, m_vidAvStm->time_base);
+                    if (m_keyFrameOnly && ss.ssFrmPts == INT64_MIN)
+                        seekTargetPts = FindNearestKeyFramePts(seekTargetPts);
                     fferr = avformat_seek_file(m_avfmtCtx, m_vidStmIdx, INT64_MIN, seekTargetPts, seekTargetPts, 0);
                     if (fferr < 0)
                     {
                         m_logger->Log(Error) << "avformat_seek_file() FAILED for seeking to pts(" << seekTargetPts << ")! fferr = " << fferr << "!" << endl;
-                        break;
+                        return LeaveDemuxVideoThreadProc();
                     }
                 }
+                ctx.ssIdx = iter-m_snapshots.begin();
+            }
 
-                bool enqDone = false;
-                while (!m_quit && !enqDone)
+            auto iter = m_snapshots.begin()+ctx.ssIdx;
+            Snapshot& ss = *iter;
+            bool enqDone = false;
+            if (!avpktLoaded)
+            {
+                int fferr = av_read_frame(m_avfmtCtx, &avpkt);
+                if (fferr == 0)
                 {
-                    bool idleLoop2 = true;
-                    if (!avpktLoaded)
+                    avpktLoaded = true;
+                    idleLoop = false;
+                    ss.ssFrmPts = avpkt.pts;
+                    auto iter2 = iter;
+                    if (avpkt.stream_index == m_vidStmIdx && iter2 != m_snapshots.begin())
                     {
-                        int fferr = av_read_frame(m_avfmtCtx, &avpkt);
-                        if (fferr == 0)
+                        iter2--;
+                        if (iter2->ssFrmPts == ss.ssFrmPts)
                         {
-                            avpktLoaded = true;
-                            idleLoop = idleLoop2 = false;
-                            ss.ssFrmPts = avpkt.pts;
-                            auto iter2 = iter;
-                            if (avpkt.stream_index == m_vidStmIdx && iter2 != m_snapshots.begin())
-                            {
-                                iter2--;
-                                if (iter2->ssFrmPts == ss.ssFrmPts)
-                                {
-                                    ss.sameFrame = true;
-                                    ss.sameAsIndex = iter2->sameFrame ? iter2->sameAsIndex : iter2->index;
-                                    av_packet_unref(&avpkt);
-                                    avpktLoaded = false;
-                                    enqDone = true;
-                                }
-                            }
-                        }
-                        else
-                        {
-                            if (fferr != AVERROR_EOF)
-                                m_logger->Log(Error) << "Demuxer ERROR! 'av_read_frame()' returns " << fferr << "." << endl;
-                            break;
+                            ss.sameFrame = true;
+                            ss.sameAsIndex = iter2->sameFrame ? iter2->sameAsIndex : iter2->index;
+                            av_packet_unref(&avpkt);
+                            avpktLoaded = false;
+                            enqDone = true;
                         }
                     }
+                    // skip decoding if this key frame has been converted by another reader of the same source
+                    if (!enqDone && avpkt.stream_index == m_vidStmIdx && !m_isImage
+                        && m_hFrameCache->Get(GetFrameCacheKey(), avpkt.pts, ss.img))
+                    {
+                        ss.img.time_stamp = (double)av_rescale_q(avpkt.pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE)/1000.;
+                        UpdateMemoryUsage(ss);
+                        av_packet_unref(&avpkt);
+                        avpktLoaded = false;
+                        enqDone = true;
+                    }
+                }
+                else
+                {
+                    if (fferr != AVERROR_EOF)
+                        m_logger->Log(Error) << "Demuxer ERROR! 'av_read_frame()' returns " << fferr << "." << endl;
+                    ctx.ssIdx = -1;
+                    return ThreadPoolExecutor::STEP_IDLE;
+                }
+            }
 
-                    if (avpktLoaded)
+            if (avpktLoaded)
+            {
+                if (avpkt.stream_index == m_vidStmIdx)
+                {
+                    if (m_vidpktQ.CanPush())
                     {
-                        if (avpkt.stream_index == m_vidStmIdx)
-                        {
-                            if (m_vidpktQ.size() < m_vidpktQMaxSize)
-                            {
-                                AVPacket* enqpkt = av_packet_clone(&avpkt);
-                                if (!enqpkt)
-                                {
-                                    m_logger->Log(Error) << "FAILED to invoke 'av_packet_clone(DemuxVideoThreadProc)'!" << endl;
-                                    break;
-                                }
-                                {
-                                    lock_guard<mutex> lk(m_vidpktQLock);
-                                    m_vidpktQ.push_back(enqpkt);
-                                }
-                                av_packet_unref(&avpkt);
-                                avpktLoaded = false;
-                                idleLoop = idleLoop2 = false;
-                                if (enqpkt->pts > m_vidAvStm->start_time)
-                                    enqDone = true;
-                            }
-                        }
-                        else
+                        AVPacket* enqpkt = av_packet_clone(&avpkt);
+                        if (!enqpkt)
                         {
-                            av_packet_unref(&avpkt);
-                            avpktLoaded = false;
+                            m_logger->Log(Error) << "FAILED to invoke 'av_packet_clone(DemuxVideoThreadProc)'!" << endl;
+                            ctx.ssIdx = -1;
+                            return ThreadPoolExecutor::STEP_IDLE;
                         }
+                        // 'enqpkt' belongs to the decoding task once it is queued
+                        if (enqpkt->pts > m_vidAvStm->start_time)
+                            enqDone = true;
+                        m_vidpktQ.TryPush(enqpkt);
+                        av_packet_unref(&avpkt);
+                        avpktLoaded = false;
+                        idleLoop = false;
                     }
-                    if (idleLoop2)
-                        this_thread::sleep_for(chrono::milliseconds(5));
+                }
+                else
+                {
+                    av_packet_unref(&avpkt);
+                    avpktLoaded = false;
                 }
             }
-            else
-            {
-                m_logger->Log(Error) << "Demux procedure to non-video media is NOT IMPLEMENTED yet!" << endl;
-            }
+            if (enqDone)
+                ctx.ssIdx = -1;
+        }
+        else
+        {
+            m_logger->Log(Error) << "Demux procedure to non-video media is NOT IMPLEMENTED yet!" << endl;
+        }
 
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
+
+    ThreadPoolExecutor::StepResult LeaveDemuxVideoThreadProc()
+    {
+        auto& ctx = m_demuxVidTaskCtx;
+        if (ctx.avpktLoaded)
+        {
+            av_packet_unref(&ctx.avpkt);
+            ctx.avpktLoaded = false;
         }
-        if (avpktLoaded)
-            av_packet_unref(&avpkt);
         m_demuxVidEof = true;
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave DemuxVideoThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void VideoDecodeThreadProc()
+    // states of the decoding tasks that are kept between the steps
+    struct DecodeTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter VideoDecodeThreadProc()..." << endl;
+        bool entered{false};
+        AVFrame avfrm = {0};
+        bool avfrmLoaded{false};
+        bool inputEof{false};
+    };
 
-        while (!m_prepared && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit || !m_decodeVideo)
+    ThreadPoolExecutor::StepResult VideoDecodeThreadProc()
+    {
+        auto& ctx = m_viddecTaskCtx;
+        if (!ctx.entered)
         {
-            m_viddecEof = true;
-            return;
+            m_logger->Log(DEBUG) << "Enter VideoDecodeThreadProc()..." << endl;
+            ctx.entered = true;
         }
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
+        if (m_quit || !m_decodeVideo)
+            return LeaveVideoDecodeThreadProc();
 
-        AVFrame avfrm = {0};
-        bool avfrmLoaded = false;
-        bool inputEof = false;
-        while (!m_quit)
-        {
-            bool idleLoop = true;
-            bool quitLoop = false;
-
-            // retrieve output frame
-            bool hasOutput;
-            do{
-                bool idleLoop2 = true;
-                if (!avfrmLoaded)
+        AVFrame& avfrm = ctx.avfrm;
+        bool& avfrmLoaded = ctx.avfrmLoaded;
+        bool idleLoop = true;
+
+        // retrieve output frame
+        bool hasOutput;
+        do{
+            if (!avfrmLoaded)
+            {
+                int fferr = avcodec_receive_frame(m_viddecCtx, &avfrm);
+                if (fferr == 0)
                 {
-                    int fferr = avcodec_receive_frame(m_viddecCtx, &avfrm);
-                    if (fferr == 0)
+                    m_logger->Log(DEBUG) << "<<< Get video frame pts=" << avfrm.pts << "(" << MillisecToString(av_rescale_q(avfrm.pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE)) << ")." << endl;
+                    avfrmLoaded = true;
+                    idleLoop = false;
+                }
+                else if (fferr != AVERROR(EAGAIN))
+                {
+                    if (fferr != AVERROR_EOF)
                     {
-                        m_logger->Log(DEBUG) << "<<< Get video frame pts=" << avfrm.pts << "(" << MillisecToString(av_rescale_q(avfrm.pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE)) << ")." << endl;
-                        avfrmLoaded = true;
-                        idleLoop = idleLoop2 = false;
+                        m_logger->Log(Error) << "FAILED to invoke 'avcodec_receive_frame'(VideoDecodeThreadProc)! return code is "
+                            << fferr << "." << endl;
                     }
-                    else if (fferr != AVERROR(EAGAIN))
+                    else
                     {
-                        if (fferr != AVERROR_EOF)
-                        {
-                            m_logger->Log(Error) << "FAILED to invoke 'avcodec_receive_frame'(VideoDecodeThreadProc)! return code is "
-                                << fferr << "." << endl;
-                        }
-                        else
-                        {
-                            m_logger->Log(VERBOSE) << "---> EOF received" << endl;
-                        }
-                        quitLoop = true;
+                        m_logger->Log(VERBOSE) << "---> EOF received" << endl;
                     }
+                    return LeaveVideoDecodeThreadProc();
                 }
+            }
 
-                hasOutput = avfrmLoaded;
-                if (avfrmLoaded && m_vidfrmQ.size() < m_vidfrmQMaxSize)
+            hasOutput = avfrmLoaded;
+            if (avfrmLoaded)
+            {
+                if (!m_vidfrmQ.CanPush())
                 {
-                    AVFrame* enqfrm = av_frame_clone(&avfrm);
-                    {
-                        lock_guard<mutex> lk(m_vidfrmQLock);
-                        m_vidfrmQ.push_back(enqfrm);
-                    }
-                    av_frame_unref(&avfrm);
-                    avfrmLoaded = false;
-                    idleLoop = idleLoop2 = false;
+                    // the output queue is full, retry when some frames are consumed
+                    return idleLoop ? ThreadPoolExecutor::STEP_IDLE : ThreadPoolExecutor::STEP_BUSY;
                 }
+                AVFrame* enqfrm = av_frame_clone(&avfrm);
+                m_vidfrmQ.TryPush(enqfrm);
+                av_frame_unref(&avfrm);
+                avfrmLoaded = false;
+                idleLoop = false;
+            }
+        } while (hasOutput && !m_quit);
 
-                if (idleLoop2)
-                    this_thread::sleep_for(chrono::milliseconds(5));
-            } while (hasOutput && !m_quit);
-            if (quitLoop)
-                break;
-
-            // input packet to decoder
-            if (!inputEof)
+        // input packet to decoder
+        if (!ctx.inputEof)
+        {
+            AVPacket** ppkt = m_vidpktQ.Front();
+            if (ppkt)
             {
-                if (!m_vidpktQ.empty())
+                AVPacket* avpkt = *ppkt;
+                int fferr = avcodec_send_packet(m_viddecCtx, avpkt);
+                if (fferr == 0)
                 {
-                    AVPacket* avpkt = m_vidpktQ.front();
-                    int fferr = avcodec_send_packet(m_viddecCtx, avpkt);
-                    if (fferr == 0)
-                    {
-                        // m_logger->Log(DEBUG) << ">>> Send video packet pts=" << avpkt->pts << "(" << MillisecToString(av_rescale_q(avpkt->pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE))
-                        //     << "), size=" << avpkt->size << "." << endl;
-                        {
-                            lock_guard<mutex> lk(m_vidpktQLock);
-                            m_vidpktQ.pop_front();
-                        }
-                        av_packet_free(&avpkt);
-                        idleLoop = false;
-                    }
-                    else if (fferr != AVERROR(EAGAIN))
-                    {
-                        m_logger->Log(WARN) << "FAILED to invoke 'avcodec_send_packet'(VideoDecodeThreadProc)! return code is "
-                            << fferr << ". url = '" << m_hParser->GetUrl() << "'." << endl;
-                        {
-                            lock_guard<mutex> lk(m_vidpktQLock);
-                            m_vidpktQ.pop_front();
-                        }
-                        av_packet_free(&avpkt);
-                    }
+                    // m_logger->Log(DEBUG) << ">>> Send video packet pts=" << avpkt->pts << "(" << MillisecToString(av_rescale_q(avpkt->pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE))
+                    //     << "), size=" << avpkt->size << "." << endl;
+                    m_vidpktQ.Pop();
+                    av_packet_free(&avpkt);
+                    idleLoop = false;
                 }
-                else if (m_demuxVidEof)
+                else if (fferr != AVERROR(EAGAIN))
                 {
-                    m_logger->Log(VERBOSE) << "---------------------------> send nullptr <--------------------------" << endl;
-                    avcodec_send_packet(m_viddecCtx, nullptr);
-                    inputEof = true;
+                    m_logger->Log(WARN) << "FAILED to invoke 'avcodec_send_packet'(VideoDecodeThreadProc)! return code is "
+                        << fferr << ". url = '" << m_hParser->GetUrl() << "'." << endl;
+                    m_vidpktQ.Pop();
+                    av_packet_free(&avpkt);
                 }
             }
+            else if (m_demuxVidEof)
+            {
+                m_logger->Log(VERBOSE) << "---------------------------> send nullptr <--------------------------" << endl;
+                avcodec_send_packet(m_viddecCtx, nullptr);
+                ctx.inputEof = true;
+                idleLoop = false;
+            }
+        }
 
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
+
+    ThreadPoolExecutor::StepResult LeaveVideoDecodeThreadProc()
+    {
+        auto& ctx = m_viddecTaskCtx;
+        if (ctx.avfrmLoaded)
+        {
+            av_frame_unref(&ctx.avfrm);
+            ctx.avfrmLoaded = false;
         }
         m_viddecEof = true;
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave VideoDecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     void FillBlankSsByDuplication()
@@ -1000,86 +1785,91 @@ private:
         }
     }
 
-    void GenerateSsThreadProc()
+    ThreadPoolExecutor::StepResult GenerateSsThreadProc()
     {
-        m_logger->Log(DEBUG) << "Enter GenerateSsThreadProc()." << endl;
-        while (!m_prepared && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit || !m_decodeVideo)
+        if (!m_genSsTaskEntered)
+        {
+            m_logger->Log(DEBUG) << "Enter GenerateSsThreadProc()." << endl;
+            m_genSsTaskEntered = true;
+        }
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
+        if (!m_decodeVideo)
         {
             m_genSsEof = true;
-            return;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_DONE;
+        }
+        if (m_quit || (m_vidfrmQ.Empty() && m_viddecEof))
+        {
+            FillBlankSsByDuplication();
+
+            m_genSsEof = true;
+            m_wakeupEvt.Notify();
+            m_logger->Log(DEBUG) << "Leave GenerateSsThreadProc()." << endl;
+            return ThreadPoolExecutor::STEP_DONE;
         }
 
-        while (!m_quit)
+        bool idleLoop = true;
+
+        AVFrame* frm;
+        if (m_vidfrmQ.TryPop(frm))
         {
-            bool idleLoop = true;
 
-            if (!m_vidfrmQ.empty())
+            double ts = (double)av_rescale_q(frm->pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE)/1000.;
+            auto iter = find_if(m_snapshots.begin(), m_snapshots.end(), [frm](const Snapshot& ss){
+                return ss.ssFrmPts == frm->pts;
+            });
+            if (iter != m_snapshots.end())
             {
-                AVFrame* frm = m_vidfrmQ.front();
-                {
-                    lock_guard<mutex> lk(m_vidfrmQLock);
-                    m_vidfrmQ.pop_front();
-                }
-
-                double ts = (double)av_rescale_q(frm->pts, m_vidAvStm->time_base, MILLISEC_TIMEBASE)/1000.;
-                auto iter = find_if(m_snapshots.begin(), m_snapshots.end(), [frm](const Snapshot& ss){
-                    return ss.ssFrmPts == frm->pts;
-                });
-                if (iter != m_snapshots.end())
-                {
-                    if (!m_frmCvt.ConvertImage(frm, iter->img, ts))
-                        m_logger->Log(Error) << "FAILED to convert AVFrame to ImGui::ImMat! Message is '" << m_frmCvt.GetError() << "'." << endl;
-                    // else
-                    //     m_logger->Log(DEBUG) << "Add SS#" << iter->index << "." << endl;
-                }
-                else
+                if (!ConvertSnapshotImage(frm, iter->img, ts))
+                    m_logger->Log(Error) << "FAILED to convert AVFrame to ImGui::ImMat! Message is '" << m_frmCvt.GetError() << "'." << endl;
+                UpdateMemoryUsage(*iter);
+                // else
+                //     m_logger->Log(DEBUG) << "Add SS#" << iter->index << "." << endl;
+            }
+            else
+            {
+                bool discarded = false;
+                if (!m_snapshots.empty())
                 {
-                    bool discarded = false;
-                    if (!m_snapshots.empty())
+                    auto bestMatchIter = m_snapshots.begin();
+                    int64_t minDiff = abs(bestMatchIter->ssFrmPts-frm->pts);
+                    auto searchIter = bestMatchIter; searchIter++;
+                    while (searchIter != m_snapshots.end())
                     {
-                        auto bestMatchIter = m_snapshots.begin();
-                        int64_t minDiff = abs(bestMatchIter->ssFrmPts-frm->pts);
-                        auto searchIter = bestMatchIter; searchIter++;
-                        while (searchIter != m_snapshots.end())
-                        {
-                            const int64_t diff = abs(searchIter->ssFrmPts-frm->pts);
-                            if (diff < minDiff)
-                            {
-                                bestMatchIter = searchIter;
-                                minDiff = diff;
-                            }
-                            else
-                                break;
-                        }
-                        if (bestMatchIter->img.empty())
+                        const int64_t diff = abs(searchIter->ssFrmPts-frm->pts);
+                        if (diff < minDiff)
                         {
-                            if (!m_frmCvt.ConvertImage(frm, bestMatchIter->img, ts))
-                                m_logger->Log(Error) << "FAILED to convert AVFrame to ImGui::ImMat! Message is '" << m_frmCvt.GetError() << "'." << endl;
+                            bestMatchIter = searchIter;
+                            minDiff = diff;
                         }
                         else
-                            discarded = true;
+                            break;
+                    }
+                    if (bestMatchIter->img.empty())
+                    {
+                        if (!ConvertSnapshotImage(frm, bestMatchIter->img, ts))
+                            m_logger->Log(Error) << "FAILED to convert AVFrame to ImGui::ImMat! Message is '" << m_frmCvt.GetError() << "'." << endl;
+                        UpdateMemoryUsage(*bestMatchIter);
                     }
                     else
                         discarded = true;
-                    if (discarded)
-                        m_logger->Log(WARN) << "Discard AVFrame with pts=" << frm->pts << "(ts=" << ts << ")!" << endl;
                 }
-
-                av_frame_free(&frm);
-                idleLoop = false;
+                else
+                    discarded = true;
+                if (discarded)
+                    m_logger->Log(WARN) << "Discard AVFrame with pts=" << frm->pts << "(ts=" << ts << ")!" << endl;
             }
-            else if (m_viddecEof)
-                break;
 
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            av_frame_free(&frm);
+            idleLoop = false;
         }
-        FillBlankSsByDuplication();
 
-        m_genSsEof = true;
-        m_logger->Log(DEBUG) << "Leave GenerateSsThreadProc()." << endl;
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
     }
 
     struct ImgsqDecodeContext
@@ -1130,386 +1920,494 @@ private:
             hImgsqDecCtx->m_hImgsqReader->Start();
     }
 
-    void GenerateSsByImgsqThreadProc()
+    // states of the image-sequence snapshot generating task that are kept between the steps
+    struct ImgsqTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter GenerateSsByImgsqThreadProc()." << endl;
-        if (!m_prepared && !Prepare())
-        {
-            m_logger->Log(Error) << "Prepare() FAILED for url '" << m_hParser->GetUrl() << "'! Error is '" << m_errMsg << "'." << endl;
-            return;
-        }
-
+        bool entered{false};
         list<ImgsqDecodeContext::Holder> imgsqDecCtxList;
-        for (auto i = 0; i < m_maxImgsqDecNum; i++)
-            imgsqDecCtxList.push_back(CreateImgsqDecodeContext());
+        // index of the next snapshot to be assigned to an idle decode context
+        uint32_t nextSsIdx{0};
+    };
 
-        auto ssIter = m_snapshots.begin();
-        while (!m_quit && ssIter != m_snapshots.end())
+    ThreadPoolExecutor::StepResult GenerateSsByImgsqThreadProc()
+    {
+        auto& ctx = m_imgsqTaskCtx;
+        if (!ctx.entered)
         {
-            bool idleLoop = true;
+            m_logger->Log(DEBUG) << "Enter GenerateSsByImgsqThreadProc()." << endl;
+            ctx.entered = true;
+            if (!m_prepared && !Prepare())
+            {
+                m_logger->Log(Error) << "Prepare() FAILED for url '" << m_hParser->GetUrl() << "'! Error is '" << m_errMsg << "'." << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            m_wakeupEvt.Notify();
+            for (auto i = 0; i < m_maxImgsqDecNum; i++)
+                ctx.imgsqDecCtxList.push_back(CreateImgsqDecodeContext());
+        }
+        if (m_quit || (ctx.nextSsIdx >= m_snapshots.size() && ctx.imgsqDecCtxList.empty()))
+            return LeaveGenerateSsByImgsqThreadProc();
 
+        auto& imgsqDecCtxList = ctx.imgsqDecCtxList;
+        bool idleLoop = true;
+        if (ctx.nextSsIdx < m_snapshots.size())
+        {
             auto idleDecIter = find_if(imgsqDecCtxList.begin(), imgsqDecCtxList.end(), [] (auto& hImgsqDecCtx) {
                 return hImgsqDecCtx->isIdle;
             });
 
             if (idleDecIter != imgsqDecCtxList.end())
             {
-                AssignDecodeContextToSs(*ssIter++, *idleDecIter);
+                AssignDecodeContextToSs(m_snapshots[ctx.nextSsIdx++], *idleDecIter);
                 idleLoop = false;
             }
-
-            for (auto& hImgsqDecCtx : imgsqDecCtxList)
-            {
-                if (!hImgsqDecCtx->m_hVfrm)
-                {
-                    bool eof = false;
-                    auto hVfrm = hImgsqDecCtx->m_hImgsqReader->ReadVideoFrame(hImgsqDecCtx->pos, eof, false);
-                    if (hVfrm)
-                    {
-                        hVfrm->SetAutoConvertToMat(true);
-                        hImgsqDecCtx->m_hVfrm = hVfrm;
-                    }
-                }
-                if (hImgsqDecCtx->m_hVfrm && hImgsqDecCtx->m_hVfrm->IsReady())
-                {
-                    if (hImgsqDecCtx->m_hVfrm->GetMat(hImgsqDecCtx->m_pSs->img))
-                        hImgsqDecCtx->m_pSs->ssFrmPts = hImgsqDecCtx->m_pSs->index;
-                    else
-                        m_logger->Log(WARN) << "FAILED to GetMat for image-sequence at pos " << hImgsqDecCtx->m_pSs->img.time_stamp << "." << endl;
-                    hImgsqDecCtx->isIdle = true;
-                    hImgsqDecCtx->m_hVfrm = nullptr;
-                    idleLoop = false;
-                }
-            }
-
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
         }
 
-        // wait for all decode context finish
-        while (!m_quit && !imgsqDecCtxList.empty())
+        // when all the snapshots are assigned, wait for all decode context finish
+        const bool allSsAssigned = ctx.nextSsIdx >= m_snapshots.size();
+        auto decIter = imgsqDecCtxList.begin();
+        while (decIter != imgsqDecCtxList.end())
         {
-            bool idleLoop = true;
-
-            auto decIter = imgsqDecCtxList.begin();
-            while (decIter != imgsqDecCtxList.end())
+            auto& hImgsqDecCtx = *decIter;
+            if (hImgsqDecCtx->isIdle)
             {
-                auto& hImgsqDecCtx = *decIter;
-                if (!hImgsqDecCtx->m_hVfrm)
-                {
-                    bool eof = false;
-                    auto hVfrm = hImgsqDecCtx->m_hImgsqReader->ReadVideoFrame(hImgsqDecCtx->pos, eof, false);
-                    if (hVfrm)
-                    {
-                        hVfrm->SetAutoConvertToMat(true);
-                        hImgsqDecCtx->m_hVfrm = hVfrm;
-                    }
-                }
-                if (hImgsqDecCtx->m_hVfrm && hImgsqDecCtx->m_hVfrm->IsReady())
-                {
-                    if (hImgsqDecCtx->m_hVfrm->GetMat(hImgsqDecCtx->m_pSs->img))
-                        hImgsqDecCtx->m_pSs->ssFrmPts = hImgsqDecCtx->m_pSs->index;
-                    else
-                        m_logger->Log(WARN) << "FAILED to GetMat for image-sequence at pos " << hImgsqDecCtx->m_pSs->img.time_stamp << "." << endl;
-                    hImgsqDecCtx->isIdle = true;
-                    hImgsqDecCtx->m_hVfrm = nullptr;
+                if (allSsAssigned)
                     decIter = imgsqDecCtxList.erase(decIter);
-                    idleLoop = false;
-                }
                 else
                     decIter++;
+                continue;
             }
-
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            if (!hImgsqDecCtx->m_hVfrm)
+            {
+                bool eof = false;
+                auto hVfrm = hImgsqDecCtx->m_hImgsqReader->ReadVideoFrame(hImgsqDecCtx->pos, eof, false);
+                if (hVfrm)
+                {
+                    hVfrm->SetAutoConvertToMat(true);
+                    hImgsqDecCtx->m_hVfrm = hVfrm;
+                }
+            }
+            if (hImgsqDecCtx->m_hVfrm && hImgsqDecCtx->m_hVfrm->IsReady())
+            {
+                if (hImgsqDecCtx->m_hVfrm->GetMat(hImgsqDecCtx->m_pSs->img))
+                    hImgsqDecCtx->m_pSs->ssFrmPts = hImgsqDecCtx->m_pSs->index;
+                else
+                    m_logger->Log(WARN) << "FAILED to GetMat for image-sequence at pos " << hImgsqDecCtx->m_pSs->img.time_stamp << "." << endl;
+                UpdateMemoryUsage(*hImgsqDecCtx->m_pSs);
+                hImgsqDecCtx->isIdle = true;
+                hImgsqDecCtx->m_hVfrm = nullptr;
+                idleLoop = false;
+            }
+            decIter++;
         }
 
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
+
+    ThreadPoolExecutor::StepResult LeaveGenerateSsByImgsqThreadProc()
+    {
+        m_imgsqTaskCtx.imgsqDecCtxList.clear();
         if (!m_quit)
             FillBlankSsByDuplication();
 
         m_genSsEof = true;
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave GenerateSsByImgsqThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void DemuxAudioThreadProc()
+    // states of the audio demuxing task that are kept between the steps
+    struct DemuxAudioTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter DemuxAudioThreadProc()..." << endl;
+        bool entered{false};
+        AVFormatContext* avfmtCtx{nullptr};
+        AVPacket avpkt = {0};
+        bool avpktLoaded{false};
+    };
 
-        if (!HasVideo() && !m_prepared && !Prepare())
-        {
-            m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
-            return;
-        }
-        else
+    ThreadPoolExecutor::StepResult DemuxAudioThreadProc()
+    {
+        auto& ctx = m_demuxAudTaskCtx;
+        if (!ctx.entered)
         {
-            while (!m_prepared && !m_quit)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_logger->Log(DEBUG) << "Enter DemuxAudioThreadProc()..." << endl;
+            ctx.entered = true;
+            if (!HasVideo() && !m_prepared)
+            {
+                if (!Prepare())
+                {
+                    m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
+                    return ThreadPoolExecutor::STEP_DONE;
+                }
+                m_wakeupEvt.Notify();
+            }
         }
-        if (m_quit || !m_decodeAudio)
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
+        if (!ctx.avfmtCtx)
         {
-            m_demuxAudEof = true;
-            return;
+            if (m_quit || !m_decodeAudio)
+            {
+                m_demuxAudEof = true;
+                m_wakeupEvt.Notify();
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            int fferr = avformat_open_input(&ctx.avfmtCtx, m_hParser->GetUrl().c_str(), nullptr, nullptr);
+            if (fferr)
+            {
+                m_logger->Log(Error) << "'avformat_open_input' FAILED with return code " << fferr << "! Quit Waveform demux thread." << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
         }
+        if (m_quit)
+            return LeaveDemuxAudioThreadProc();
 
-        int fferr;
-        AVFormatContext* avfmtCtx = nullptr;
-        fferr = avformat_open_input(&avfmtCtx, m_hParser->GetUrl().c_str(), nullptr, nullptr);
-        if (fferr)
-        {
-            m_logger->Log(Error) << "'avformat_open_input' FAILED with return code " << fferr << "! Quit Waveform demux thread." << endl;
-            return;
-        }
+        AVPacket& avpkt = ctx.avpkt;
+        bool& avpktLoaded = ctx.avpktLoaded;
+        bool idleLoop = true;
 
-        AVPacket avpkt = {0};
-        bool avpktLoaded = false;
-        while (!m_quit)
+        if (!avpktLoaded)
         {
-            bool idleLoop = true;
-
-            if (!avpktLoaded)
+            int fferr = av_read_frame(ctx.avfmtCtx, &avpkt);
+            if (fferr == 0)
             {
-                int fferr = av_read_frame(avfmtCtx, &avpkt);
-                if (fferr == 0)
-                {
-                    avpktLoaded = true;
-                    idleLoop = false;
-                }
-                else
-                {
-                    if (fferr != AVERROR_EOF)
-                        m_logger->Log(Error) << "Demuxer ERROR! 'av_read_frame(DemuxAudioThreadProc)' returns " << fferr << "." << endl;
-                    break;
-                }
+                avpktLoaded = true;
+                idleLoop = false;
             }
+            else
+            {
+                if (fferr != AVERROR_EOF)
+                    m_logger->Log(Error) << "Demuxer ERROR! 'av_read_frame(DemuxAudioThreadProc)' returns " << fferr << "." << endl;
+                return LeaveDemuxAudioThreadProc();
+            }
+        }
 
-            if (avpktLoaded)
+        if (avpktLoaded)
+        {
+            if (avpkt.stream_index == m_audStmIdx)
             {
-                if (avpkt.stream_index == m_audStmIdx)
+                if (m_audpktQ.CanPush())
                 {
-                    if (m_audpktQ.size() < m_audpktQMaxSize)
+                    AVPacket* enqpkt = av_packet_clone(&avpkt);
+                    if (!enqpkt)
                     {
-                        AVPacket* enqpkt = av_packet_clone(&avpkt);
-                        if (!enqpkt)
-                        {
-                            m_logger->Log(Error) << "FAILED to invoke 'av_packet_clone(DemuxAudioThreadProc)'!" << endl;
-                            break;
-                        }
-                        {
-                            lock_guard<mutex> lk(m_audpktQLock);
-                            m_audpktQ.push_back(enqpkt);
-                        }
-                        av_packet_unref(&avpkt);
-                        avpktLoaded = false;
-                        idleLoop = false;
+                        m_logger->Log(Error) << "FAILED to invoke 'av_packet_clone(DemuxAudioThreadProc)'!" << endl;
+                        return LeaveDemuxAudioThreadProc();
                     }
-                }
-                else
-                {
+                    m_audpktQ.TryPush(enqpkt);
                     av_packet_unref(&avpkt);
                     avpktLoaded = false;
+                    idleLoop = false;
                 }
             }
+            else
+            {
+                av_packet_unref(&avpkt);
+                avpktLoaded = false;
+            }
+        }
+
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
 
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(1));
+    ThreadPoolExecutor::StepResult LeaveDemuxAudioThreadProc()
+    {
+        auto& ctx = m_demuxAudTaskCtx;
+        if (ctx.avpktLoaded)
+        {
+            av_packet_unref(&ctx.avpkt);
+            ctx.avpktLoaded = false;
         }
-        if (avpktLoaded)
-            av_packet_unref(&avpkt);
-        if (avfmtCtx)
-            avformat_close_input(&avfmtCtx);
+        if (ctx.avfmtCtx)
+            avformat_close_input(&ctx.avfmtCtx);
         m_demuxAudEof = true;
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave DemuxAudioThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void AudioDecodeThreadProc()
+    ThreadPoolExecutor::StepResult AudioDecodeThreadProc()
     {
-        m_logger->Log(DEBUG) << "Enter AudioDecodeThreadProc()..." << endl;
-
-        while (!m_prepared && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit || !m_decodeAudio)
+        auto& ctx = m_auddecTaskCtx;
+        if (!ctx.entered)
         {
-            m_auddecEof = true;
-            return;
+            m_logger->Log(DEBUG) << "Enter AudioDecodeThreadProc()..." << endl;
+            ctx.entered = true;
         }
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
+        if (m_quit || !m_decodeAudio)
+            return LeaveAudioDecodeThreadProc();
 
-        AVFrame avfrm = {0};
-        bool avfrmLoaded = false;
-        bool inputEof = false;
-        while (!m_quit)
-        {
-            bool idleLoop = true;
-            bool quitLoop = false;
+        AVFrame& avfrm = ctx.avfrm;
+        bool& avfrmLoaded = ctx.avfrmLoaded;
+        bool idleLoop = true;
 
-            // retrieve output frame
-            bool hasOutput;
-            do{
-                if (!avfrmLoaded)
+        // retrieve output frame
+        bool hasOutput;
+        do{
+            if (!avfrmLoaded)
+            {
+                int fferr = avcodec_receive_frame(m_auddecCtx, &avfrm);
+                if (fferr == 0)
                 {
-                    int fferr = avcodec_receive_frame(m_auddecCtx, &avfrm);
-                    if (fferr == 0)
-                    {
-                        avfrmLoaded = true;
-                        idleLoop = false;
-                        // update average audio frame duration, for calculating audio queue size
-                        double frmDur = (double)avfrm.nb_samples/m_audAvStm->codecpar->sample_rate;
-                        m_audfrmAvgDur = (m_audfrmAvgDur*(m_audfrmAvgDurCalcCnt-1)+frmDur)/m_audfrmAvgDurCalcCnt;
-                        m_audfrmQMaxSize = (int)ceil(m_audQDuration/m_audfrmAvgDur);
-                    }
-                    else if (fferr != AVERROR(EAGAIN))
-                    {
-                        if (fferr != AVERROR_EOF)
-                            m_logger->Log(Error) << "FAILED to invoke 'avcodec_receive_frame'(AudioDecodeThreadProc)! return code is "
-                                << fferr << "." << endl;
-                        quitLoop = true;
-                        break;
-                    }
+                    avfrmLoaded = true;
+                    idleLoop = false;
+                    // update average audio frame duration, for calculating audio queue size
+                    double frmDur = (double)avfrm.nb_samples/m_audAvStm->codecpar->sample_rate;
+                    m_audfrmAvgDur = (m_audfrmAvgDur*(m_audfrmAvgDurCalcCnt-1)+frmDur)/m_audfrmAvgDurCalcCnt;
+                    m_audfrmQMaxSize = (uint32_t)ceil(m_audQDuration/m_audfrmAvgDur);
+                    m_audfrmQ.SetHighWaterMark(m_audfrmQMaxSize);
                 }
+                else if (fferr != AVERROR(EAGAIN))
+                {
+                    if (fferr != AVERROR_EOF)
+                        m_logger->Log(Error) << "FAILED to invoke 'avcodec_receive_frame'(AudioDecodeThreadProc)! return code is "
+                            << fferr << "." << endl;
+                    return LeaveAudioDecodeThreadProc();
+                }
+            }
 
-                hasOutput = avfrmLoaded;
-                if (avfrmLoaded)
+            hasOutput = avfrmLoaded;
+            if (avfrmLoaded)
+            {
+                if (m_audfrmQ.Size() < m_audfrmQMaxSize && m_audfrmQ.CanPush())
                 {
-                    if (m_audfrmQ.size() < m_audfrmQMaxSize)
-                    {
-                        lock_guard<mutex> lk(m_audfrmQLock);
-                        AVFrame* enqfrm = av_frame_clone(&avfrm);
-                        m_audfrmQ.push_back(enqfrm);
-                        av_frame_unref(&avfrm);
-                        avfrmLoaded = false;
-                        idleLoop = false;
-                    }
-                    else
-                        break;
+                    AVFrame* enqfrm = av_frame_clone(&avfrm);
+                    m_audfrmQ.TryPush(enqfrm);
+                    av_frame_unref(&avfrm);
+                    avfrmLoaded = false;
+                    idleLoop = false;
                 }
-            } while (hasOutput);
-            if (quitLoop)
-                break;
+                else
+                    break;
+            }
+        } while (hasOutput);
 
-            // input packet to decoder
-            if (!inputEof)
+        // input packet to decoder
+        if (!ctx.inputEof)
+        {
+            if (!m_audpktQ.Empty())
             {
-                if (!m_audpktQ.empty())
+                AVPacket** ppkt;
+                while ((ppkt = m_audpktQ.Front()) != nullptr)
                 {
-                    while (!m_audpktQ.empty())
+                    AVPacket* avpkt = *ppkt;
+                    int fferr = avcodec_send_packet(m_auddecCtx, avpkt);
+                    if (fferr == 0)
                     {
-                        AVPacket* avpkt = m_audpktQ.front();
-                        int fferr = avcodec_send_packet(m_auddecCtx, avpkt);
-                        if (fferr == 0)
-                        {
-                            lock_guard<mutex> lk(m_audpktQLock);
-                            m_audpktQ.pop_front();
-                            av_packet_free(&avpkt);
-                            idleLoop = false;
-                        }
-                        else
+                        m_audpktQ.Pop();
+                        av_packet_free(&avpkt);
+                        idleLoop = false;
+                    }
+                    else
+                    {
+                        if (fferr != AVERROR(EAGAIN))
                         {
-                            if (fferr != AVERROR(EAGAIN))
-                            {
-                                m_logger->Log(Error) << "FAILED to invoke 'avcodec_send_packet'(AudioDecodeThreadProc)! return code is "
-                                    << fferr << "." << endl;
-                                quitLoop = true;
-                            }
-                            break;
+                            m_logger->Log(Error) << "FAILED to invoke 'avcodec_send_packet'(AudioDecodeThreadProc)! return code is "
+                                << fferr << "." << endl;
+                            return LeaveAudioDecodeThreadProc();
                         }
-                    }
-                    if (quitLoop)
                         break;
+                    }
                 }
-                else
+            }
+            else
+            {
+                if (m_demuxAudEof)
                 {
-                    if (m_demuxAudEof)
-                    {
-                        avcodec_send_packet(m_auddecCtx, nullptr);
-                        idleLoop = false;
-                        inputEof = true;
-                    }
-                    // m_logger->Log(DEBUG) << "Audio pkt Q is empty!" << endl;
+                    avcodec_send_packet(m_auddecCtx, nullptr);
+                    idleLoop = false;
+                    ctx.inputEof = true;
                 }
+                // m_logger->Log(DEBUG) << "Audio pkt Q is empty!" << endl;
             }
-
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(1));
         }
+
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
+
+    ThreadPoolExecutor::StepResult LeaveAudioDecodeThreadProc()
+    {
+        auto& ctx = m_auddecTaskCtx;
         m_auddecEof = true;
-        if (avfrmLoaded)
-            av_frame_unref(&avfrm);
+        if (ctx.avfrmLoaded)
+        {
+            av_frame_unref(&ctx.avfrm);
+            ctx.avfrmLoaded = false;
+        }
+        m_wakeupEvt.Notify();
         m_logger->Log(DEBUG) << "Leave AudioDecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void GenWaveformThreadProc()
+    // statistics of the pyramid entry being generated for one channel
+    struct WaveformAccumulator
     {
-        m_logger->Log(DEBUG) << "Enter GenWaveformThreadProc()..." << endl;
-
-        while (!m_prepared && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit)
-            return;
+        float minv{numeric_limits<float>::max()};
+        float maxv{numeric_limits<float>::lowest()};
+        double sumSquares{0};
+        uint32_t sampleCount{0};
+        uint32_t childCount{0};
+        int64_t entryIdx{0};
+    };
 
-        double wfStep = 0;
-        double wfAggsmpCnt = m_hWaveform->aggregateSamples;
-        uint32_t wfIdx = 0;
-        uint32_t wfSize = m_hWaveform->pcm[0].size();
-        vector<float>* wf1 = &m_hWaveform->pcm[0];
-        vector<float>* wf2 = nullptr;
+    // states of the waveform generating task that are kept between the steps
+    struct GenWaveformTaskContext
+    {
+        bool entered{false};
+        bool initialized{false};
+        double wfStep{0};
+        double wfAggsmpCnt{0};
+        uint32_t wfIdx{0};
+        uint32_t wfSize{0};
+        vector<float>* wf1{nullptr};
+        vector<float>* wf2{nullptr};
         float minSmp{1.f}, maxSmp{-1.f};
-        if (m_hWaveform->pcm.size() > 1)
-            wf2 = &m_hWaveform->pcm[1];
-        while (!m_quit && wfIdx < wfSize)
+        // accumulators of the pyramid entries being generated, indexed by [level][channel]
+        vector<vector<WaveformAccumulator>> wfAccums;
+        // planar float samples of all the source channels, when the decoded format is not
+        vector<vector<float>> pyrBufs;
+        vector<const float*> pyrChPtrs;
+    };
+
+    ThreadPoolExecutor::StepResult GenWaveformThreadProc()
+    {
+        auto& ctx = m_genWfTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter GenWaveformThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
+        if (!ctx.initialized)
+        {
+            if (m_quit)
+                return ThreadPoolExecutor::STEP_DONE;
+            ctx.wfAggsmpCnt = m_hWaveform->aggregateSamples;
+            ctx.wfSize = m_hWaveform->pcm[0].size();
+            ctx.wf1 = &m_hWaveform->pcm[0];
+            if (m_hWaveform->pcm.size() > 1)
+                ctx.wf2 = &m_hWaveform->pcm[1];
+            const auto& pyramid = m_hWaveform->pyramid;
+            ctx.wfAccums.resize(pyramid.size());
+            for (uint32_t i = 0; i < pyramid.size(); i++)
+                ctx.wfAccums[i].resize(pyramid[i].minv.size());
+            ctx.initialized = true;
+        }
+        if (m_quit || ctx.wfIdx >= ctx.wfSize || (m_audfrmQ.Empty() && m_auddecEof))
+            return LeaveGenWaveformThreadProc();
+
+        double& wfStep = ctx.wfStep;
+        const double wfAggsmpCnt = ctx.wfAggsmpCnt;
+        uint32_t& wfIdx = ctx.wfIdx;
+        const uint32_t wfSize = ctx.wfSize;
+        vector<float>* wf1 = ctx.wf1;
+        vector<float>* wf2 = ctx.wf2;
+        float& minSmp = ctx.minSmp;
+        float& maxSmp = ctx.maxSmp;
+
+        bool idleLoop = true;
+        AVFrame** ppfrm = m_audfrmQ.Front();
+        if (ppfrm)
         {
-            bool idleLoop = true;
-            if (!m_audfrmQ.empty())
+            AVFrame* srcfrm = *ppfrm;
+            AVFrame* dstfrm = nullptr;
+            if (m_swrPassThrough)
             {
-                AVFrame* srcfrm = m_audfrmQ.front();
-                AVFrame* dstfrm = nullptr;
-                if (m_swrPassThrough)
+                dstfrm = srcfrm;
+            }
+            else
+            {
+                dstfrm = av_frame_alloc();
+                if (!dstfrm)
                 {
-                    dstfrm = srcfrm;
+                    m_logger->Log(Error) << "FAILED to allocate new AVFrame for 'swr_convert()'!" << endl;
+                    return LeaveGenWaveformThreadProc();
                 }
-                else
-                {
-                    dstfrm = av_frame_alloc();
-                    if (!dstfrm)
-                    {
-                        m_logger->Log(Error) << "FAILED to allocate new AVFrame for 'swr_convert()'!" << endl;
-                        break;
-                    }
-                    dstfrm->format = (int)m_swrOutSmpfmt;
-                    dstfrm->sample_rate = m_swrOutSampleRate;
+                dstfrm->format = (int)m_swrOutSmpfmt;
+                dstfrm->sample_rate = m_swrOutSampleRate;
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
-                    dstfrm->channels = m_swrOutChannels;
-                    dstfrm->channel_layout = m_swrOutChnLyt;
+                dstfrm->channels = m_swrOutChannels;
+                dstfrm->channel_layout = m_swrOutChnLyt;
 #else
-                    dstfrm->ch_layout = m_swrOutChlyt;
+                dstfrm->ch_layout = m_swrOutChlyt;
 #endif
-                    dstfrm->nb_samples = swr_get_out_samples(m_swrCtx, srcfrm->nb_samples);
-                    int fferr = av_frame_get_buffer(dstfrm, 0);
-                    if (fferr < 0)
-                    {
-                        m_logger->Log(Error) << "av_frame_get_buffer(GenWaveformThreadProc) FAILED with return code " << fferr << endl;
-                        break;
-                    }
-                    av_frame_copy_props(dstfrm, srcfrm);
-                    dstfrm->pts = swr_next_pts(m_swrCtx, srcfrm->pts);
-                    fferr = swr_convert(m_swrCtx, dstfrm->data, dstfrm->nb_samples, (const uint8_t **)srcfrm->data, srcfrm->nb_samples);
-                    if (fferr < 0)
-                    {
-                        m_logger->Log(Error) << "swr_convert(GenWaveformThreadProc) FAILED with return code " << fferr << endl;
-                        break;
-                    }
+                dstfrm->nb_samples = swr_get_out_samples(m_swrCtx, srcfrm->nb_samples);
+                int fferr = av_frame_get_buffer(dstfrm, 0);
+                if (fferr < 0)
+                {
+                    m_logger->Log(Error) << "av_frame_get_buffer(GenWaveformThreadProc) FAILED with return code " << fferr << endl;
+                    return LeaveGenWaveformThreadProc();
+                }
+                av_frame_copy_props(dstfrm, srcfrm);
+                dstfrm->pts = swr_next_pts(m_swrCtx, srcfrm->pts);
+                fferr = swr_convert(m_swrCtx, dstfrm->data, dstfrm->nb_samples, (const uint8_t **)srcfrm->data, srcfrm->nb_samples);
+                if (fferr < 0)
+                {
+                    m_logger->Log(Error) << "swr_convert(GenWaveformThreadProc) FAILED with return code " << fferr << endl;
+                    return LeaveGenWaveformThreadProc();
                 }
+            }
+            m_audfrmQ.Pop();
+
+            float* ch1ptr = (float*)dstfrm->data[0];
+            float chMaxWf, chMinWf;
+            chMaxWf = -1.f; chMinWf = 1.f;
+            double currWfStep = wfStep;
+            uint32_t currWfIdx = wfIdx;
+            for (int i = 0; i < dstfrm->nb_samples; i++)
+            {
+                float chVal = *ch1ptr++;
+                if (chMaxWf < chVal)
                 {
-                    lock_guard<mutex> lk(m_audfrmQLock);
-                    m_audfrmQ.pop_front();
+                    chMaxWf = chVal;
+                    if (maxSmp < chVal)
+                        maxSmp = chVal;
+                }
+                if (chMinWf > chVal)
+                {
+                    chMinWf = chVal;
+                    if (minSmp > chVal)
+                        minSmp = chVal;
                 }
 
-                float* ch1ptr = (float*)dstfrm->data[0];
-                float chMaxWf, chMinWf;
+                currWfStep++;
+                if (currWfStep >= wfAggsmpCnt)
+                {
+                    currWfStep -= wfAggsmpCnt;
+                    (*wf1)[currWfIdx] = abs(chMaxWf) > abs(chMinWf) ? chMaxWf : chMinWf;
+                    currWfIdx++;
+                    if (currWfIdx >= wfSize)
+                        break;
+                    chMaxWf = -1.f; chMinWf = 1.f;
+                }
+            }
+            int dstCh;
+#if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
+            dstCh = dstfrm->channels;
+#else
+            dstCh = dstfrm->ch_layout.nb_channels;
+#endif
+            float* ch2ptr = dstCh > 1 && wf2 ? (float*)dstfrm->data[1] : nullptr;
+            if (ch2ptr)
+            {
                 chMaxWf = -1.f; chMinWf = 1.f;
-                double currWfStep = wfStep;
-                uint32_t currWfIdx = wfIdx;
+                currWfStep = wfStep;
+                currWfIdx = wfIdx;
                 for (int i = 0; i < dstfrm->nb_samples; i++)
                 {
-                    float chVal = *ch1ptr++;
+                    float chVal = *ch2ptr++;
                     if (chMaxWf < chVal)
                     {
                         chMaxWf = chVal;
@@ -1527,73 +2425,160 @@ private:
                     if (currWfStep >= wfAggsmpCnt)
                     {
                         currWfStep -= wfAggsmpCnt;
-                        (*wf1)[currWfIdx] = abs(chMaxWf) > abs(chMinWf) ? chMaxWf : chMinWf;
+                        (*wf2)[currWfIdx] = abs(chMaxWf) > abs(chMinWf) ? chMaxWf : chMinWf;
                         currWfIdx++;
                         if (currWfIdx >= wfSize)
                             break;
                         chMaxWf = -1.f; chMinWf = 1.f;
                     }
                 }
-                int dstCh;
+            }
+            wfStep = currWfStep;
+            wfIdx = currWfIdx;
+            if (!ctx.wfAccums.empty())
+                AddWaveformPyramidFrame(srcfrm);
+            m_hWaveform->maxSample = maxSmp;
+            m_hWaveform->minSample = minSmp;
+            m_hWaveform->validSampleCount = wfIdx;
+
+            if (dstfrm != srcfrm)
+                av_frame_free(&dstfrm);
+            av_frame_free(&srcfrm);
+            idleLoop = false;
+        }
+
+        if (idleLoop)
+            return ThreadPoolExecutor::STEP_IDLE;
+        m_wakeupEvt.Notify();
+        return ThreadPoolExecutor::STEP_BUSY;
+    }
+
+    void AddWaveformPyramidFrame(const AVFrame* srcfrm)
+    {
+        auto& ctx = m_genWfTaskCtx;
+        int srcCh;
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
-                dstCh = dstfrm->channels;
+        srcCh = srcfrm->channels;
 #else
-                dstCh = dstfrm->ch_layout.nb_channels;
+        srcCh = srcfrm->ch_layout.nb_channels;
 #endif
-                float* ch2ptr = dstCh > 1 && wf2 ? (float*)dstfrm->data[1] : nullptr;
-                if (ch2ptr)
-                {
-                    chMaxWf = -1.f; chMinWf = 1.f;
-                    currWfStep = wfStep;
-                    currWfIdx = wfIdx;
-                    for (int i = 0; i < dstfrm->nb_samples; i++)
-                    {
-                        float chVal = *ch2ptr++;
-                        if (chMaxWf < chVal)
-                        {
-                            chMaxWf = chVal;
-                            if (maxSmp < chVal)
-                                maxSmp = chVal;
-                        }
-                        if (chMinWf > chVal)
-                        {
-                            chMinWf = chVal;
-                            if (minSmp > chVal)
-                                minSmp = chVal;
-                        }
-
-                        currWfStep++;
-                        if (currWfStep >= wfAggsmpCnt)
-                        {
-                            currWfStep -= wfAggsmpCnt;
-                            (*wf2)[currWfIdx] = abs(chMaxWf) > abs(chMinWf) ? chMaxWf : chMinWf;
-                            currWfIdx++;
-                            if (currWfIdx >= wfSize)
-                                break;
-                            chMaxWf = -1.f; chMinWf = 1.f;
-                        }
-                    }
-                }
-                wfStep = currWfStep;
-                wfIdx = currWfIdx;
-                m_hWaveform->maxSample = maxSmp;
-                m_hWaveform->minSample = minSmp;
-                m_hWaveform->validSampleCount = wfIdx;
-
-                if (dstfrm != srcfrm)
-                    av_frame_free(&dstfrm);
-                av_frame_free(&srcfrm);
-                idleLoop = false;
+        const uint32_t pyrChannels = min((uint32_t)srcCh, (uint32_t)ctx.wfAccums[0].size());
+        int sampleCount = srcfrm->nb_samples;
+        ctx.pyrChPtrs.resize(pyrChannels);
+        if (!m_pyrSwrCtx)
+        {
+            for (uint32_t ch = 0; ch < pyrChannels; ch++)
+                ctx.pyrChPtrs[ch] = (const float*)srcfrm->extended_data[ch];
+        }
+        else
+        {
+            ctx.pyrBufs.resize(srcCh);
+            vector<uint8_t*> outPtrs(srcCh);
+            for (int ch = 0; ch < srcCh; ch++)
+            {
+                if (ctx.pyrBufs[ch].size() < (size_t)sampleCount)
+                    ctx.pyrBufs[ch].resize(sampleCount);
+                outPtrs[ch] = (uint8_t*)ctx.pyrBufs[ch].data();
             }
-            else if (m_auddecEof)
-                break;
+            sampleCount = swr_convert(m_pyrSwrCtx, outPtrs.data(), sampleCount, (const uint8_t**)srcfrm->extended_data, srcfrm->nb_samples);
+            if (sampleCount < 0)
+            {
+                m_logger->Log(Error) << "swr_convert(AddWaveformPyramidFrame) FAILED with return code " << sampleCount << endl;
+                return;
+            }
+            for (uint32_t ch = 0; ch < pyrChannels; ch++)
+                ctx.pyrChPtrs[ch] = ctx.pyrBufs[ch].data();
+        }
+
+        lock_guard<mutex> lk(m_wfPyramidLock);
+        for (uint32_t ch = 0; ch < pyrChannels; ch++)
+            AddWaveformPyramidSamples(ch, ctx.pyrChPtrs[ch], (uint32_t)sampleCount);
+        UpdateWaveformPyramidValidCount();
+    }
+
+    void AddWaveformPyramidSamples(uint32_t ch, const float* samples, uint32_t sampleCount)
+    {
+        auto& acc = m_genWfTaskCtx.wfAccums[0][ch];
+        uint32_t i = 0;
+        while (i < sampleCount)
+        {
+            const uint32_t n = min(sampleCount-i, WAVEFORM_PYRAMID_BASE_SAMPLES-acc.sampleCount);
+            float sumSquares = 0;
+            MatUtils::AccumulateAudioStats(samples+i, n, acc.minv, acc.maxv, sumSquares);
+            acc.sumSquares += sumSquares;
+            acc.sampleCount += n;
+            i += n;
+            if (acc.sampleCount >= WAVEFORM_PYRAMID_BASE_SAMPLES)
+                EmitWaveformPyramidEntry(0, ch);
+        }
+    }
+
+    // write the entry accumulated at level 'lvIdx' for channel 'ch', and merge it into the entry of the upper level
+    void EmitWaveformPyramidEntry(uint32_t lvIdx, uint32_t ch)
+    {
+        auto& wfAccums = m_genWfTaskCtx.wfAccums;
+        auto& acc = wfAccums[lvIdx][ch];
+        auto& level = m_hWaveform->pyramid[lvIdx];
+        level.minv[ch].push_back(acc.minv);
+        level.maxv[ch].push_back(acc.maxv);
+        level.rms[ch].push_back((float)sqrt(acc.sumSquares/acc.sampleCount));
+        acc.entryIdx++;
+        if (lvIdx+1 < wfAccums.size())
+        {
+            auto& upper = wfAccums[lvIdx+1][ch];
+            upper.minv = min(upper.minv, acc.minv);
+            upper.maxv = max(upper.maxv, acc.maxv);
+            upper.sumSquares += acc.sumSquares;
+            upper.sampleCount += acc.sampleCount;
+            upper.childCount++;
+        }
+        const int64_t entryIdx = acc.entryIdx;
+        acc = WaveformAccumulator();
+        acc.entryIdx = entryIdx;
+        if (lvIdx+1 < wfAccums.size() && wfAccums[lvIdx+1][ch].childCount >= 2)
+            EmitWaveformPyramidEntry(lvIdx+1, ch);
+    }
+
+    // 'm_wfPyramidLock' must be held when calling this method
+    void UpdateWaveformPyramidValidCount()
+    {
+        for (auto& level : m_hWaveform->pyramid)
+        {
+            int64_t validCount = level.minv.empty() ? 0 : (int64_t)level.minv[0].size();
+            for (auto& chEntries : level.minv)
+                validCount = min(validCount, (int64_t)chEntries.size());
+            level.validCount = validCount;
+        }
+    }
 
-            if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(1));
+    // write the partial entries left at the end of the audio, from the bottom level up
+    void FlushWaveformPyramid()
+    {
+        lock_guard<mutex> lk(m_wfPyramidLock);
+        auto& wfAccums = m_genWfTaskCtx.wfAccums;
+        for (uint32_t i = 0; i < wfAccums.size(); i++)
+        {
+            for (uint32_t ch = 0; ch < wfAccums[i].size(); ch++)
+            {
+                if (wfAccums[i][ch].sampleCount > 0)
+                    EmitWaveformPyramidEntry(i, ch);
+            }
         }
+        UpdateWaveformPyramidValidCount();
+    }
+
+    ThreadPoolExecutor::StepResult LeaveGenWaveformThreadProc()
+    {
+        if (m_genWfTaskCtx.initialized && !m_quit)
+            FlushWaveformPyramid();
         m_hWaveform->parseDone = true;
         m_genWfEof = true;
-        m_logger->Log(DEBUG) << "Leave GenWaveformThreadProc(), " << wfIdx << " samples generated." << endl;
+        m_wakeupEvt.Notify();
+        m_logger->Log(DEBUG) << "Leave GenWaveformThreadProc(), " << m_genWfTaskCtx.wfIdx << " samples generated." << endl;
+        auto qstats = m_audfrmQ.GetStats();
+        m_logger->Log(DEBUG) << "Audio frame queue: maxDepth=" << qstats.maxDepth << "/" << qstats.capacity << ", pushed=" << qstats.pushCount
+                << ", producerStall=" << qstats.producerStallUs/1000 << "ms, consumerStall=" << qstats.consumerStallUs/1000 << "ms." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     void ReleaseResources(bool callFromReleaseProc = false)
@@ -1606,6 +2591,11 @@ private:
             swr_free(&m_swrCtx);
             m_swrCtx = nullptr;
         }
+        if (m_pyrSwrCtx)
+        {
+            swr_free(&m_pyrSwrCtx);
+            m_pyrSwrCtx = nullptr;
+        }
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
         m_swrOutChannels = 0;
         m_swrOutChnLyt = 0;
@@ -1649,29 +2639,39 @@ private:
         m_prepared = false;
     }
 
-    void ReleaseResourceProc()
+    ThreadPoolExecutor::StepResult ReleaseResourceProc()
     {
-        while (!m_quit)
-        {
-            if (!m_prepared || (m_viddecCtx && !m_genSsEof) || (m_auddecCtx && !m_genWfEof))
-                this_thread::sleep_for(chrono::milliseconds(100));
-            else
-                break;
-        }
-        if (!m_quit)
+        if (m_quit)
+            return ThreadPoolExecutor::STEP_DONE;
+        if (!m_prepared || (m_viddecCtx && !m_genSsEof) || (m_auddecCtx && !m_genWfEof))
+            return ThreadPoolExecutor::STEP_IDLE;
+
+        // retry later if the api lock is held by the other thread
+        if (!m_apiLock.try_lock())
+            return ThreadPoolExecutor::STEP_IDLE;
+        // the overview is complete, take its copies and write the cache file after releasing the api lock
+        bool toSaveCache;
+        string cacheKey;
+        vector<Snapshot> snapshots;
+        Waveform::Holder hWaveform;
         {
-            bool lockAquired = false;
-            while (!(lockAquired = m_apiLock.try_lock()) && !m_quit)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
             if (m_quit)
+                return ThreadPoolExecutor::STEP_DONE;
+            toSaveCache = CanSaveToCache();
+            if (toSaveCache)
             {
-                if (lockAquired) m_apiLock.unlock();
-                return;
+                cacheKey = m_cacheKey;
+                snapshots = m_snapshots;
+                lock_guard<mutex> lk2(m_wfPyramidLock);
+                hWaveform = m_hWaveform;
             }
-            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
             m_logger->Log(DEBUG) << "AUTO RELEASE decoding resources." << endl;
             ReleaseResources(true);
         }
+        if (toSaveCache)
+            SaveToCache(cacheKey, snapshots, hWaveform);
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
 private:
@@ -1679,6 +2679,7 @@ private:
     string m_errMsg;
     bool m_opened{false};
     bool m_vidPreferUseHw{true};
+    bool m_keyFrameOnly{false};
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
 
     MediaParser::Holder m_hParser;
@@ -1701,6 +2702,7 @@ private:
     AVHWDeviceType m_viddecDevType{AV_HWDEVICE_TYPE_NONE};
     AVBufferRef* m_viddecHwDevCtx{nullptr};
     SwrContext* m_swrCtx{nullptr};
+    SwrContext* m_pyrSwrCtx{nullptr};
     AVSampleFormat m_swrOutSmpfmt{AV_SAMPLE_FMT_FLTP};
     int m_swrOutSampleRate;
 #if !defined(FF_API_OLD_CHANNEL_LAYOUT) && (LIBAVUTIL_VERSION_MAJOR < 58)
@@ -1710,45 +2712,53 @@ private:
     AVChannelLayout m_swrOutChlyt{AV_CHANNEL_ORDER_UNSPEC, 0};
 #endif
 
-    // demux video thread
-    thread m_demuxVidThread;
-    list<AVPacket*> m_vidpktQ;
-    int m_vidpktQMaxSize{8};
-    mutex m_vidpktQLock;
+    // the snapshot images are accounted to the process-wide memory governor
+    MemoryGovernor::Holder m_hMemGov{MemoryGovernor::GetDefaultInstance()};
+    atomic_uint64_t m_memUsage{0};
+    // all the pipeline stages run as tasks on the shared executor
+    ThreadPoolExecutor::Holder m_hExecutor{ThreadPoolExecutor::GetDefaultInstance()};
+    // demux video task
+    ThreadPoolExecutor::Task::Holder m_demuxVidTask;
+    DemuxVideoTaskContext m_demuxVidTaskCtx;
+    SpscRingBuffer<AVPacket*> m_vidpktQ{8, &m_wakeupEvt};
     bool m_demuxVidEof{false};
-    // video decoding thread
-    thread m_viddecThread;
-    list<AVFrame*> m_vidfrmQ;
-    int m_vidfrmQMaxSize{4};
-    mutex m_vidfrmQLock;
+    // video decoding task
+    ThreadPoolExecutor::Task::Holder m_viddecTask;
+    DecodeTaskContext m_viddecTaskCtx;
+    SpscRingBuffer<AVFrame*> m_vidfrmQ{4, &m_wakeupEvt};
     bool m_viddecEof{false};
-    // generate snapshots thread
-    thread m_genSsThread;
+    // generate snapshots task
+    ThreadPoolExecutor::Task::Holder m_genSsTask;
+    bool m_genSsTaskEntered{false};
+    ImgsqTaskContext m_imgsqTaskCtx;
     bool m_genSsEof{false};
-    // demux audio thread
-    thread m_demuxAudThread;
-    list<AVPacket*> m_audpktQ;
-    int m_audpktQMaxSize{64};
-    mutex m_audpktQLock;
+    // demux audio task
+    ThreadPoolExecutor::Task::Holder m_demuxAudTask;
+    DemuxAudioTaskContext m_demuxAudTaskCtx;
+    SpscRingBuffer<AVPacket*> m_audpktQ{64, &m_wakeupEvt};
     bool m_demuxAudEof{false};
-    // audio decoding thread
-    thread m_auddecThread;
-    list<AVFrame*> m_audfrmQ;
-    int m_audfrmQMaxSize{25};
+    // audio decoding task
+    ThreadPoolExecutor::Task::Holder m_auddecTask;
+    DecodeTaskContext m_auddecTaskCtx;
+    // 'm_audfrmQMaxSize' follows the average frame duration, the ring buffer capacity is its upper bound
+    SpscRingBuffer<AVFrame*> m_audfrmQ{512, &m_wakeupEvt};
+    uint32_t m_audfrmQMaxSize{25};
     double m_audfrmAvgDur{0.021};
     uint32_t m_audfrmAvgDurCalcCnt{10};
     float m_audQDuration{5.f};
-    mutex m_audfrmQLock;
     bool m_auddecEof{false};
-    // generate waveform samples thread
-    thread m_genWfThread;
+    // generate waveform samples task
+    ThreadPoolExecutor::Task::Holder m_genWfTask;
+    GenWaveformTaskContext m_genWfTaskCtx;
     bool m_swrPassThrough{false};
     bool m_genWfEof{false};
-    // thread to release computer resources after all snapshots are finished
-    thread m_releaseThread;
+    // task to release computer resources after all snapshots are finished
+    ThreadPoolExecutor::Task::Holder m_releaseTask;
 
     recursive_mutex m_apiLock;
     bool m_quit{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
 
     // video snapshots
     vector<Snapshot> m_snapshots;
@@ -1764,15 +2774,22 @@ private:
 
     // audio waveform
     Waveform::Holder m_hWaveform;
+    // guards the growing waveform pyramid against 'GetWaveformPeaks()'
+    mutex m_wfPyramidLock;
     uint32_t m_singleFramePixels{200};
     double m_minAggregateSamples{5};
     double m_fixedAggregateSamples{0};
 
+    // persistent cache
+    string m_cacheKey;
+    bool m_loadedFromCache{false};
+
     // AVFrame -> ImMat
     bool m_useRszFactor{false};
     bool m_ssSizeChanged{false};
     float m_ssWFacotr{1.f}, m_ssHFacotr{1.f};
     AVFrameToImMatConverter m_frmCvt;
+    VideoFrameCache::Holder m_hFrameCache{VideoFrameCache::GetDefaultInstance()};
 };
 
 static const auto OVERVIEW_HOLDER_DELETER = [] (Overview* p) {
@@ -1790,4 +2807,28 @@ ALogger* Overview::GetLogger()
 {
     return Logger::GetLogger("MOverview");
 }
+
+void Overview::SetCacheDirectory(const string& dirPath)
+{
+    lock_guard<mutex> lk(g_overviewCacheDirLock);
+    g_overviewCacheDir = dirPath;
+}
+
+string Overview::GetCacheDirectory()
+{
+    lock_guard<mutex> lk(g_overviewCacheDirLock);
+    return g_overviewCacheDir;
+}
+
+void Overview::SetCacheSizeLimit(uint64_t bytes)
+{
+    lock_guard<mutex> lk(g_overviewCacheDirLock);
+    g_overviewCacheSizeLimit = bytes;
+}
+
+uint64_t Overview::GetCacheSizeLimit()
+{
+    lock_guard<mutex> lk(g_overviewCacheDirLock);
+    return g_overviewCacheSizeLimit;
+}
 }
@@ -0,0 +1,511 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <atomic>
+#include <list>
+#include <unordered_map>
+#include <cstdio>
+#include "ProxyManager.h"
+#include "MediaReader.h"
+#include "MediaEncoder.h"
+#include "ThreadPoolExecutor.h"
+#include "DebugHelper.h"
+#include "SysUtils.h"
+
+using namespace std;
+using namespace Logger;
+using SysUtils::ThreadPoolExecutor;
+
+namespace MediaCore
+{
+static const string PROXY_FILE_SUFFIX = ".mov";
+static const string PROXY_TMPFILE_SUFFIX = ".tmp.mov";
+static const string PROXY_VIDEO_CODEC = "mjpeg";
+// a generation task fails if no frame is read for this long
+static const int64_t PROXY_READ_STALL_TIMEOUT = 10000;
+
+class ProxyManager_Impl : public ProxyManager
+{
+public:
+    ProxyManager_Impl(const string& proxyDir) : m_proxyDir(proxyDir)
+    {
+        m_logger = GetLogger("ProxyMgr");
+        // the default manager is destroyed with the statics, the executor it joins must outlive it
+        m_hExecutor = ThreadPoolExecutor::GetDefaultInstance();
+    }
+
+    ~ProxyManager_Impl()
+    {
+        ThreadPoolExecutor::Task::Holder hTask;
+        {
+            lock_guard<mutex> lk(m_lock);
+            m_jobQ.clear();
+            if (m_activeJob)
+            {
+                m_activeJob->cancel = true;
+                hTask = m_activeJob->hTask;
+            }
+        }
+        if (hTask)
+            hTask->Join();
+    }
+
+    bool RequestProxy(MediaParser::Holder hParser) override
+    {
+        if (!hParser || !hParser->IsOpened())
+        {
+            m_errMsg = "Argument 'hParser' is NULL or NOT OPENED!";
+            return false;
+        }
+        auto vidStm = hParser->GetBestVideoStream();
+        if (!vidStm || vidStm->isImage || hParser->IsImageSequence())
+        {
+            m_errMsg = "Proxy is only generated for the VIDEO media!";
+            return false;
+        }
+        if (vidStm->width == 0 || vidStm->height == 0 || vidStm->duration <= 0)
+        {
+            m_errMsg = "INVALID video stream, its size or duration is 0!";
+            return false;
+        }
+        string proxyKey, proxyPath;
+        if (!MakeProxyPath(hParser, proxyKey, proxyPath))
+            return false;
+        const string dirPath = GetProxyDirectory();
+        if (!SysUtils::IsDirectory(dirPath))
+        {
+            m_errMsg = "Proxy directory '"+dirPath+"' does NOT exist!";
+            return false;
+        }
+
+        lock_guard<mutex> lk(m_lock);
+        auto& entry = m_entries[proxyKey];
+        if (entry.state == PROXY_QUEUED || entry.state == PROXY_GENERATING || entry.state == PROXY_READY)
+            return true;
+        entry.proxyPath = proxyPath;
+        entry.progress = 0;
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (SysUtils::GetFileStatus(proxyPath, fileSize, modifyTime))
+        {
+            entry.state = PROXY_READY;
+            entry.progress = 1;
+            return true;
+        }
+
+        auto job = make_shared<ProxyJob>();
+        job->proxyKey = proxyKey;
+        job->hParser = hParser;
+        job->proxyPath = proxyPath;
+        job->tmpPath = proxyPath.substr(0, proxyPath.size()-PROXY_FILE_SUFFIX.size())+PROXY_TMPFILE_SUFFIX;
+        job->outHeight = m_proxyHeight < vidStm->height ? m_proxyHeight : vidStm->height;
+        job->outWidth = (uint32_t)((double)vidStm->width*job->outHeight/vidStm->height+0.5);
+        job->outWidth += job->outWidth&0x1;
+        job->outHeight += job->outHeight&0x1;
+        job->frameRate = Ratio::IsValid(vidStm->avgFrameRate) ? vidStm->avgFrameRate : vidStm->realFrameRate;
+        if (!Ratio::IsValid(job->frameRate) || job->frameRate.num < 0 || job->frameRate.den < 0)
+            job->frameRate = {25, 1};
+        job->durMts = (int64_t)(vidStm->duration*1000);
+        m_jobQ.push_back(job);
+        entry.state = PROXY_QUEUED;
+        m_logger->Log(DEBUG) << "Queued proxy " << job->outWidth << "x" << job->outHeight << " '" << proxyPath << "' of '" << hParser->GetUrl() << "'." << endl;
+        ScheduleNextJob_l();
+        return true;
+    }
+
+    void CancelProxy(MediaParser::Holder hParser) override
+    {
+        string proxyKey, proxyPath;
+        if (!MakeProxyPath(hParser, proxyKey, proxyPath))
+            return;
+        lock_guard<mutex> lk(m_lock);
+        auto iter = m_entries.find(proxyKey);
+        if (iter == m_entries.end() || iter->second.state == PROXY_READY)
+            return;
+        m_jobQ.remove_if([&proxyKey] (const ProxyJob::Holder& job) { return job->proxyKey == proxyKey; });
+        if (m_activeJob && m_activeJob->proxyKey == proxyKey)
+            m_activeJob->cancel = true;
+        m_entries.erase(iter);
+    }
+
+    ProxyState GetProxyState(MediaParser::Holder hParser) override
+    {
+        string proxyKey, proxyPath;
+        if (!MakeProxyPath(hParser, proxyKey, proxyPath))
+            return PROXY_NONE;
+        lock_guard<mutex> lk(m_lock);
+        auto iter = m_entries.find(proxyKey);
+        if (iter != m_entries.end())
+            return iter->second.state;
+        uint64_t fileSize;
+        int64_t modifyTime;
+        return SysUtils::GetFileStatus(proxyPath, fileSize, modifyTime) ? PROXY_READY : PROXY_NONE;
+    }
+
+    float GetProxyProgress(MediaParser::Holder hParser) override
+    {
+        string proxyKey, proxyPath;
+        if (!MakeProxyPath(hParser, proxyKey, proxyPath))
+            return 0;
+        lock_guard<mutex> lk(m_lock);
+        auto iter = m_entries.find(proxyKey);
+        if (iter != m_entries.end())
+            return iter->second.progress;
+        uint64_t fileSize;
+        int64_t modifyTime;
+        return SysUtils::GetFileStatus(proxyPath, fileSize, modifyTime) ? 1.f : 0.f;
+    }
+
+    MediaParser::Holder GetProxyParser(MediaParser::Holder hParser) override
+    {
+        string proxyKey, proxyPath;
+        if (!hParser || !MakeProxyPath(hParser, proxyKey, proxyPath))
+            return nullptr;
+        {
+            lock_guard<mutex> lk(m_lock);
+            auto iter = m_entries.find(proxyKey);
+            if (iter != m_entries.end())
+            {
+                if (iter->second.state != PROXY_READY)
+                    return nullptr;
+                if (iter->second.hProxyParser)
+                    return iter->second.hProxyParser;
+            }
+        }
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (!SysUtils::GetFileStatus(proxyPath, fileSize, modifyTime))
+            return nullptr;
+
+        // open the parser out of the lock, it reads the file
+        auto hProxyParser = MediaParser::CreateInstance();
+        if (!hProxyParser->Open(proxyPath) || hProxyParser->GetBestVideoStreamIndex() < 0)
+        {
+            m_logger->Log(WARN) << "FAILED to open proxy '" << proxyPath << "'! Error is '" << hProxyParser->GetError() << "'." << endl;
+            return nullptr;
+        }
+        lock_guard<mutex> lk(m_lock);
+        auto& entry = m_entries[proxyKey];
+        if (entry.state != PROXY_NONE && entry.state != PROXY_READY)
+            return nullptr;
+        entry.state = PROXY_READY;
+        entry.progress = 1;
+        entry.proxyPath = proxyPath;
+        if (!entry.hProxyParser)
+            entry.hProxyParser = hProxyParser;
+        return entry.hProxyParser;
+    }
+
+    void SetProxyDirectory(const string& dirPath) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_proxyDir = dirPath;
+    }
+
+    string GetProxyDirectory() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        return m_proxyDir;
+    }
+
+    void SetProxyHeight(uint32_t height) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_proxyHeight = height > 0 ? height : 1;
+    }
+
+    uint32_t GetProxyHeight() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        return m_proxyHeight;
+    }
+
+    string GetError() const override
+    {
+        return m_errMsg;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+private:
+    struct ProxyEntry
+    {
+        ProxyState state{PROXY_NONE};
+        float progress{0};
+        string proxyPath;
+        MediaParser::Holder hProxyParser;
+    };
+
+    struct ProxyJob
+    {
+        using Holder = shared_ptr<ProxyJob>;
+        string proxyKey;
+        MediaParser::Holder hParser;
+        string proxyPath;
+        string tmpPath;
+        uint32_t outWidth{0}, outHeight{0};
+        Ratio frameRate;
+        int64_t durMts{0};
+        MediaReader::Holder hReader;
+        MediaEncoder::Holder hEncoder;
+        int64_t frameIndex{0};
+        int64_t prevPos{-1};
+        bool eofSent{false};
+        TimePoint readTp;
+        atomic_bool cancel{false};
+        ThreadPoolExecutor::Task::Holder hTask;
+        string errMsg;
+    };
+
+    // the key identifies the source by its path, size and modification time, and includes the proxy height
+    bool MakeProxyPath(MediaParser::Holder hParser, string& proxyKey, string& proxyPath)
+    {
+        string dirPath;
+        uint32_t proxyHeight;
+        {
+            lock_guard<mutex> lk(m_lock);
+            dirPath = m_proxyDir;
+            proxyHeight = m_proxyHeight;
+        }
+        if (dirPath.empty())
+        {
+            m_errMsg = "Proxy directory is NOT set!";
+            return false;
+        }
+        if (!hParser)
+        {
+            m_errMsg = "Argument 'hParser' is NULL!";
+            return false;
+        }
+        const string& url = hParser->GetUrl();
+        uint64_t fileSize;
+        int64_t modifyTime;
+        if (!SysUtils::GetFileStatus(url, fileSize, modifyTime))
+        {
+            m_errMsg = "Proxy is only generated for the local files, FAILED to get the status of '"+url+"'!";
+            return false;
+        }
+        ostringstream oss;
+        oss << url << "|" << fileSize << "|" << modifyTime << "|" << proxyHeight;
+        const string key = oss.str();
+        oss.str("");
+        oss << hex << setw(16) << setfill('0') << SysUtils::Fnv1aHash(key);
+        proxyKey = oss.str();
+        if (dirPath.back() != '/' && dirPath.back() != '\\')
+            dirPath += "/";
+        proxyPath = dirPath+proxyKey+PROXY_FILE_SUFFIX;
+        return true;
+    }
+
+    void ScheduleNextJob_l()
+    {
+        if (m_activeJob || m_jobQ.empty())
+            return;
+        auto job = m_jobQ.front();
+        m_jobQ.pop_front();
+        m_entries[job->proxyKey].state = PROXY_GENERATING;
+        m_activeJob = job;
+        job->hTask = m_hExecutor->Submit("ProxyGen", [this, job] () {
+            return GenerateProxyStep(job);
+        }, nullptr, 10);
+    }
+
+    bool StartGenerating(ProxyJob::Holder job)
+    {
+        // the reader output size sets the lowres decoding, the encoder scales the decoded frames to the proxy size
+        job->hReader = MediaReader::CreateVideoInstance("ProxyRdr");
+        if (!job->hReader->Open(job->hParser) ||
+            !job->hReader->ConfigVideoReader(job->outWidth, job->outHeight, IM_CF_RGBA, IM_DT_INT8, IM_INTERPOLATE_AREA) ||
+            !job->hReader->Start())
+        {
+            job->errMsg = "FAILED to setup the reader! Error is '"+job->hReader->GetError()+"'.";
+            return false;
+        }
+        job->hEncoder = MediaEncoder::CreateInstance();
+        string imageFormat;
+        const uint64_t bitRate = (uint64_t)((double)job->outWidth*job->outHeight*job->frameRate.num/job->frameRate.den*1.5);
+        if (!job->hEncoder->Open(job->tmpPath) ||
+            !job->hEncoder->ConfigureVideoStream(PROXY_VIDEO_CODEC, imageFormat, job->outWidth, job->outHeight, job->frameRate, bitRate) ||
+            !job->hEncoder->Start())
+        {
+            job->errMsg = "FAILED to setup the encoder! Error is '"+job->hEncoder->GetError()+"'.";
+            return false;
+        }
+        job->readTp = GetTimePoint();
+        m_logger->Log(DEBUG) << "Start generating proxy '" << job->proxyPath << "' of '" << job->hParser->GetUrl() << "'." << endl;
+        return true;
+    }
+
+    // read the source without waiting, this task shares the executor with the pipeline of the reader
+    ThreadPoolExecutor::StepResult GenerateProxyStep(ProxyJob::Holder job)
+    {
+        if (job->cancel)
+        {
+            FinishJob(job, false);
+            return ThreadPoolExecutor::STEP_DONE;
+        }
+        if (!job->hEncoder)
+        {
+            if (!StartGenerating(job))
+            {
+                FinishJob(job, false);
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            return ThreadPoolExecutor::STEP_BUSY;
+        }
+
+        const int64_t pos = job->frameIndex*1000*job->frameRate.den/job->frameRate.num;
+        if (!job->eofSent && pos < job->durMts)
+        {
+            // neither the reading nor the encoding waits, a full encoder input queue is retried later
+            if (job->hEncoder->IsVideoInputFull())
+            {
+                job->readTp = GetTimePoint();
+                return ThreadPoolExecutor::STEP_IDLE;
+            }
+            bool eof = false;
+            auto hVfrm = job->hReader->ReadVideoFrame(pos, eof, false);
+            if (hVfrm)
+            {
+                job->readTp = GetTimePoint();
+                job->frameIndex++;
+                // a frame longer than the frame interval is read more than once, encode it once
+                if (hVfrm->Pos() > job->prevPos)
+                {
+                    if (!job->hEncoder->EncodeVideoFrame(hVfrm, false))
+                    {
+                        job->errMsg = "FAILED to encode the frame at pos "+to_string(hVfrm->Pos())+"! Error is '"+job->hEncoder->GetError()+"'.";
+                        FinishJob(job, false);
+                        return ThreadPoolExecutor::STEP_DONE;
+                    }
+                    job->prevPos = hVfrm->Pos();
+                }
+                lock_guard<mutex> lk(m_lock);
+                m_entries[job->proxyKey].progress = (float)pos/job->durMts;
+                return ThreadPoolExecutor::STEP_BUSY;
+            }
+            if (!eof)
+            {
+                if (CountElapsedMillisec(job->readTp, GetTimePoint()) <= PROXY_READ_STALL_TIMEOUT)
+                    return ThreadPoolExecutor::STEP_IDLE;
+                job->errMsg = "Timed out reading the frame at pos "+to_string(pos)+"! Error is '"+job->hReader->GetError()+"'.";
+                FinishJob(job, false);
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+        }
+
+        // mark the end of the input, then wait in idle steps until the encoder has written everything
+        if (!job->eofSent)
+        {
+            if (!job->hEncoder->EncodeVideoFrame(MediaReader::VideoFrame::Holder(), false))
+            {
+                job->errMsg = "FAILED to end the video input! Error is '"+job->hEncoder->GetError()+"'.";
+                FinishJob(job, false);
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            job->eofSent = true;
+        }
+        if (!job->hEncoder->IsEncodingDone())
+            return ThreadPoolExecutor::STEP_IDLE;
+        bool success = true;
+        if (!job->hEncoder->FinishEncoding())
+        {
+            job->errMsg = "FAILED to finish the encoding! Error is '"+job->hEncoder->GetError()+"'.";
+            success = false;
+        }
+        FinishJob(job, success);
+        return ThreadPoolExecutor::STEP_DONE;
+    }
+
+    void FinishJob(ProxyJob::Holder job, bool success)
+    {
+        if (job->hEncoder)
+            job->hEncoder->Close();
+        if (job->hReader)
+            job->hReader->Close();
+        if (success)
+        {
+            remove(job->proxyPath.c_str());
+            if (rename(job->tmpPath.c_str(), job->proxyPath.c_str()) != 0)
+            {
+                job->errMsg = "FAILED to rename '"+job->tmpPath+"' to '"+job->proxyPath+"'.";
+                success = false;
+            }
+        }
+        if (!success)
+            remove(job->tmpPath.c_str());
+
+        lock_guard<mutex> lk(m_lock);
+        if (job->cancel)
+            m_logger->Log(DEBUG) << "Cancelled generating proxy '" << job->proxyPath << "'." << endl;
+        else if (success)
+            m_logger->Log(DEBUG) << "Generated proxy '" << job->proxyPath << "' of '" << job->hParser->GetUrl() << "'." << endl;
+        else
+            m_logger->Log(WARN) << "FAILED to generate proxy '" << job->proxyPath << "' of '" << job->hParser->GetUrl() << "'! " << job->errMsg << endl;
+        auto iter = m_entries.find(job->proxyKey);
+        if (iter != m_entries.end() && !job->cancel)
+        {
+            iter->second.state = success ? PROXY_READY : PROXY_FAILED;
+            iter->second.progress = success ? 1.f : 0.f;
+        }
+        if (m_activeJob == job)
+            m_activeJob = nullptr;
+        job->hReader = nullptr;
+        job->hEncoder = nullptr;
+        job->hParser = nullptr;
+        ScheduleNextJob_l();
+    }
+
+private:
+    ALogger* m_logger;
+    mutable mutex m_lock;
+    string m_proxyDir;
+    uint32_t m_proxyHeight{540};
+    unordered_map<string, ProxyEntry> m_entries;
+    list<ProxyJob::Holder> m_jobQ;
+    ProxyJob::Holder m_activeJob;
+    ThreadPoolExecutor::Holder m_hExecutor;
+    string m_errMsg;
+};
+
+static const auto PROXY_MANAGER_HOLDER_DELETER = [] (ProxyManager* p) {
+    ProxyManager_Impl* ptr = dynamic_cast<ProxyManager_Impl*>(p);
+    delete ptr;
+};
+
+ProxyManager::Holder ProxyManager::CreateInstance(const string& proxyDir)
+{
+    return ProxyManager::Holder(new ProxyManager_Impl(proxyDir), PROXY_MANAGER_HOLDER_DELETER);
+}
+
+static ProxyManager::Holder g_defaultProxyManager;
+static mutex g_defaultProxyManagerLock;
+
+ProxyManager::Holder ProxyManager::GetDefaultInstance()
+{
+    lock_guard<mutex> lk(g_defaultProxyManagerLock);
+    if (!g_defaultProxyManager)
+        g_defaultProxyManager = CreateInstance();
+    return g_defaultProxyManager;
+}
+}
@@ -0,0 +1,502 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <mutex>
+#include <list>
+#include <atomic>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "SegmentedExporter.h"
+#include "FFUtils.h"
+#include "SysUtils.h"
+extern "C"
+{
+    #include "libavutil/avutil.h"
+    #include "libavformat/avformat.h"
+    #include "libavcodec/avcodec.h"
+}
+
+using namespace std;
+using namespace Logger;
+
+namespace MediaCore
+{
+class SegmentedExporter_Impl : public SegmentedExporter
+{
+public:
+    SegmentedExporter_Impl()
+    {
+        m_logger = SegmentedExporter::GetLogger();
+    }
+
+    SegmentedExporter_Impl(const SegmentedExporter_Impl&) = delete;
+    SegmentedExporter_Impl(SegmentedExporter_Impl&&) = delete;
+    SegmentedExporter_Impl& operator=(const SegmentedExporter_Impl&) = delete;
+
+    bool Configure(MultiTrackVideoReader::Holder hMtvReader, const string& codecName, const string& imageFormat,
+            uint64_t bitRate, const vector<MediaEncoder::Option>& extraOpts) override
+    {
+        lock_guard<mutex> lk(m_apiLock);
+        if (!hMtvReader || !hMtvReader->GetSharedSettings())
+        {
+            m_errMsg = "INVALID argument! 'hMtvReader' is null or NOT configured.";
+            return false;
+        }
+        m_hMtvReader = hMtvReader;
+        m_codecName = codecName;
+        m_imageFormat = imageFormat;
+        m_bitRate = bitRate;
+        m_extraOpts = extraOpts;
+        m_gopSize = 0;
+        for (auto& opt : m_extraOpts)
+        {
+            if (opt.name == "g" && opt.value.type == Value::VT_INT && opt.value.numval.i64 > 0)
+                m_gopSize = (uint32_t)opt.value.numval.i64;
+        }
+        return true;
+    }
+
+    void SetSegmentCount(uint32_t count) override
+    {
+        m_segmentCount = count;
+    }
+
+    void SetMinSegmentDuration(int64_t duration) override
+    {
+        m_minSegmentDuration = duration;
+    }
+
+    bool Export(const string& url, int64_t startPos, int64_t endPos) override
+    {
+        lock_guard<mutex> lk(m_apiLock);
+        if (!m_hMtvReader)
+        {
+            m_errMsg = "This SegmentedExporter is NOT configured yet!";
+            return false;
+        }
+        if (endPos < 0)
+            endPos = m_hMtvReader->Duration();
+        if (startPos < 0 || endPos <= startPos)
+        {
+            ostringstream oss; oss << "INVALID export range [" << startPos << ", " << endPos << ")!";
+            m_errMsg = oss.str();
+            return false;
+        }
+
+        m_cancel = false;
+        m_encodedFrames = 0;
+        m_totalFrames = 0;
+        if (!SplitSegments(url, startPos, endPos))
+            return false;
+
+        m_logger->Log(DEBUG) << "Export [" << MillisecToString(startPos) << ", " << MillisecToString(endPos) << ") into '" << url
+                << "' with " << m_segments.size() << " segments." << endl;
+        const uint32_t workerCnt = (uint32_t)min(m_segments.size(), (size_t)max(thread::hardware_concurrency(), 1u));
+        m_nextSegIter = m_segments.begin();
+        vector<thread> workers(workerCnt);
+        for (uint32_t i = 0; i < workerCnt; i++)
+        {
+            workers[i] = thread(&SegmentedExporter_Impl::EncodeSegmentsProc, this);
+            ostringstream thnOss; thnOss << "SegExp-" << i;
+            SysUtils::SetThreadName(workers[i], thnOss.str());
+        }
+        for (auto& worker : workers)
+            worker.join();
+        bool success = !m_cancel;
+        string errMsg;
+        for (auto& seg : m_segments)
+        {
+            if (!seg.success)
+            {
+                success = false;
+                if (errMsg.empty())
+                    errMsg = seg.errMsg;
+            }
+        }
+        if (!success)
+            m_errMsg = errMsg.empty() ? "Export is cancelled!" : errMsg;
+
+        if (success)
+            success = ConcatSegments(url);
+        for (auto& seg : m_segments)
+            remove(seg.url.c_str());
+        m_segments.clear();
+        return success;
+    }
+
+    void Cancel() override
+    {
+        m_cancel = true;
+    }
+
+    float GetProgress() const override
+    {
+        const int64_t total = m_totalFrames;
+        if (total <= 0)
+            return 0.f;
+        return (float)m_encodedFrames/total;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+    string GetError() const override
+    {
+        return m_errMsg;
+    }
+
+private:
+    struct Segment
+    {
+        uint32_t index;
+        string url;
+        // frame indices of the output, [frameBegin, frameEnd)
+        int64_t frameBegin;
+        int64_t frameEnd;
+        bool success{false};
+        string errMsg;
+    };
+
+    bool SplitSegments(const string& url, int64_t startPos, int64_t endPos)
+    {
+        const auto frameRate = m_hMtvReader->GetSharedSettings()->VideoOutFrameRate();
+        if (!Ratio::IsValid(frameRate))
+        {
+            m_errMsg = "The video frame rate of the reader is INVALID!";
+            return false;
+        }
+        const int64_t frameBegin = (int64_t)ceil((double)startPos*frameRate.num/(frameRate.den*1000));
+        const int64_t frameEnd = (int64_t)ceil((double)endPos*frameRate.num/(frameRate.den*1000));
+        const int64_t totalFrames = frameEnd-frameBegin;
+        if (totalFrames <= 0)
+        {
+            m_errMsg = "NO frame is in the export range!";
+            return false;
+        }
+
+        uint32_t segCnt = m_segmentCount > 0 ? m_segmentCount : thread::hardware_concurrency();
+        if (segCnt < 1) segCnt = 1;
+        const int64_t minSegFrames = max((int64_t)1, (int64_t)ceil((double)m_minSegmentDuration*frameRate.num/(frameRate.den*1000)));
+        segCnt = (uint32_t)min((int64_t)segCnt, max((int64_t)1, totalFrames/minSegFrames));
+        // keep the GOP cadence of a single encoder, each segment starts a new GOP
+        int64_t segFrames = (totalFrames+segCnt-1)/segCnt;
+        if (m_gopSize > 0)
+            segFrames = (segFrames+m_gopSize-1)/m_gopSize*m_gopSize;
+
+        const string extName = SysUtils::ExtractFileExtName(url);
+        const string urlBase = url.substr(0, url.size()-extName.size());
+        m_segments = list<Segment>();
+        for (int64_t segBegin = frameBegin; segBegin < frameEnd; segBegin += segFrames)
+        {
+            m_segments.emplace_back();
+            auto& seg = m_segments.back();
+            seg.index = (uint32_t)m_segments.size()-1;
+            // the temporary files must not collide with the user's files or with another export to the same output,
+            // they keep the extension of the output for the muxer to choose the same container format
+            ostringstream oss; oss << urlBase << ".seg" << seg.index;
+            seg.url = SysUtils::MakeUniqueTempPath(oss.str())+extName;
+            seg.frameBegin = segBegin;
+            seg.frameEnd = min(segBegin+segFrames, frameEnd);
+        }
+        m_totalFrames = totalFrames;
+        return true;
+    }
+
+    static int64_t FrameIndexToPos(int64_t frameIndex, const Ratio& frameRate)
+    {
+        // the smallest position which the reader maps to this frame index
+        return (int64_t)ceil((double)frameIndex*frameRate.den*1000/frameRate.num);
+    }
+
+    // Each worker encodes the segments not taken by the other workers yet, until all are taken or the export is cancelled.
+    void EncodeSegmentsProc()
+    {
+        while (!m_cancel)
+        {
+            Segment* pSeg;
+            {
+                lock_guard<mutex> lk(m_segmentsLock);
+                if (m_nextSegIter == m_segments.end())
+                    break;
+                pSeg = &*m_nextSegIter++;
+            }
+            EncodeSegmentProc(pSeg);
+        }
+    }
+
+    void EncodeSegmentProc(Segment* pSeg)
+    {
+        m_logger->Log(DEBUG) << "Enter EncodeSegmentProc() of segment #" << pSeg->index << " [" << pSeg->frameBegin << ", " << pSeg->frameEnd << ")..." << endl;
+        pSeg->success = EncodeSegment(pSeg);
+        if (!pSeg->success)
+            m_cancel = true;
+        m_logger->Log(DEBUG) << "Leave EncodeSegmentProc() of segment #" << pSeg->index << ", success=" << pSeg->success << "." << endl;
+    }
+
+    bool EncodeSegment(Segment* pSeg)
+    {
+        // the export always reads the original media, even if the preview reads the proxies
+        auto hSettings = m_hMtvReader->GetSharedSettings()->Clone();
+        hSettings->EnableProxyMedia(false);
+        auto hReader = m_hMtvReader->CloneAndConfigure(hSettings);
+        if (!hReader)
+        {
+            pSeg->errMsg = "FAILED to clone the MultiTrackVideoReader! Error is '"+m_hMtvReader->GetError()+"'.";
+            return false;
+        }
+        const auto frameRate = hSettings->VideoOutFrameRate();
+        auto hEncoder = MediaEncoder::CreateInstance();
+        string imageFormat = m_imageFormat;
+        vector<MediaEncoder::Option> extraOpts = m_extraOpts;
+        if (!hEncoder->Open(pSeg->url) || !hEncoder->ConfigureVideoStream(m_codecName, imageFormat,
+                hSettings->VideoOutWidth(), hSettings->VideoOutHeight(), frameRate, m_bitRate, &extraOpts) || !hEncoder->Start())
+        {
+            pSeg->errMsg = "FAILED to setup the encoder of segment '"+pSeg->url+"'! Error is '"+hEncoder->GetError()+"'.";
+            return false;
+        }
+
+        hReader->SeekTo(FrameIndexToPos(pSeg->frameBegin, frameRate));
+        bool success = true;
+        for (int64_t i = pSeg->frameBegin; i < pSeg->frameEnd && !m_cancel; i++)
+        {
+            ImGui::ImMat vmat;
+            if (!hReader->ReadVideoFrame(FrameIndexToPos(i, frameRate), vmat) || vmat.empty())
+            {
+                ostringstream oss; oss << "FAILED to read frame #" << i << " of segment '" << pSeg->url << "'! Error is '" << hReader->GetError() << "'.";
+                pSeg->errMsg = oss.str();
+                success = false;
+                break;
+            }
+            // timestamps of a segment start from 0, they're shifted to the segment position when concatenated
+            vmat.time_stamp = (double)(i-pSeg->frameBegin)*frameRate.den/frameRate.num;
+            if (!hEncoder->EncodeVideoFrame(vmat))
+            {
+                pSeg->errMsg = "FAILED to encode the frame of segment '"+pSeg->url+"'! Error is '"+hEncoder->GetError()+"'.";
+                success = false;
+                break;
+            }
+            m_encodedFrames++;
+        }
+        if (!hEncoder->FinishEncoding() && success)
+        {
+            pSeg->errMsg = "FAILED to finish the encoding of segment '"+pSeg->url+"'! Error is '"+hEncoder->GetError()+"'.";
+            success = false;
+        }
+        hEncoder->Close();
+        hReader->Close();
+        return success;
+    }
+
+    bool ConcatSegments(const string& url)
+    {
+        AVFormatContext* outFmtCtx = nullptr;
+        int fferr = avformat_alloc_output_context2(&outFmtCtx, nullptr, nullptr, url.c_str());
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_alloc_output_context2", fferr);
+            return false;
+        }
+        AVStream* outStm = nullptr;
+        MediaEncoder::VideoTimestampStitcher tsStitcher;
+        bool success = true;
+        for (auto& seg : m_segments)
+        {
+            tsStitcher.StartRun();
+            success = AppendSegment(outFmtCtx, outStm, seg, tsStitcher);
+            if (!success)
+                break;
+        }
+        if (outStm)
+        {
+            fferr = av_write_trailer(outFmtCtx);
+            if (fferr < 0 && success)
+            {
+                m_errMsg = FFapiFailureMessage("av_write_trailer", fferr);
+                success = false;
+            }
+        }
+        if ((outFmtCtx->oformat->flags&AVFMT_NOFILE) == 0)
+            avio_closep(&outFmtCtx->pb);
+        avformat_free_context(outFmtCtx);
+        if (!success)
+            remove(url.c_str());
+        return success;
+    }
+
+    bool AppendSegment(AVFormatContext* outFmtCtx, AVStream*& outStm, const Segment& seg, MediaEncoder::VideoTimestampStitcher& tsStitcher)
+    {
+        AVFormatContext* inFmtCtx = nullptr;
+        int fferr = avformat_open_input(&inFmtCtx, seg.url.c_str(), nullptr, nullptr);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_open_input", fferr);
+            return false;
+        }
+        bool success = AppendSegment_Internal(outFmtCtx, outStm, inFmtCtx, seg, tsStitcher);
+        avformat_close_input(&inFmtCtx);
+        return success;
+    }
+
+    bool AppendSegment_Internal(AVFormatContext* outFmtCtx, AVStream*& outStm, AVFormatContext* inFmtCtx, const Segment& seg, MediaEncoder::VideoTimestampStitcher& tsStitcher)
+    {
+        int fferr = avformat_find_stream_info(inFmtCtx, nullptr);
+        if (fferr < 0)
+        {
+            m_errMsg = FFapiFailureMessage("avformat_find_stream_info", fferr);
+            return false;
+        }
+        const int inStmIdx = av_find_best_stream(inFmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (inStmIdx < 0)
+        {
+            m_errMsg = "Segment '"+seg.url+"' does NOT have video!";
+            return false;
+        }
+        AVStream* inStm = inFmtCtx->streams[inStmIdx];
+        const AVCodecParameters* inpar = inStm->codecpar;
+        if (!outStm)
+        {
+            outStm = avformat_new_stream(outFmtCtx, nullptr);
+            if (!outStm)
+            {
+                m_errMsg = "FAILED to create new stream by 'avformat_new_stream'!";
+                return false;
+            }
+            fferr = avcodec_parameters_copy(outStm->codecpar, inpar);
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("avcodec_parameters_copy", fferr);
+                return false;
+            }
+            outStm->codecpar->codec_tag = 0;
+            outStm->time_base = inStm->time_base;
+            outStm->avg_frame_rate = inStm->avg_frame_rate;
+            if ((outFmtCtx->oformat->flags&AVFMT_NOFILE) == 0)
+            {
+                fferr = avio_open(&outFmtCtx->pb, outFmtCtx->url, AVIO_FLAG_WRITE);
+                if (fferr < 0)
+                {
+                    m_errMsg = FFapiFailureMessage("avio_open", fferr);
+                    return false;
+                }
+            }
+            fferr = avformat_write_header(outFmtCtx, nullptr);
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("avformat_write_header", fferr);
+                return false;
+            }
+        }
+        else
+        {
+            // the packets of all the segments are decoded with the codec parameters of the first one
+            const AVCodecParameters* outpar = outStm->codecpar;
+            if (inpar->codec_id != outpar->codec_id || inpar->width != outpar->width || inpar->height != outpar->height
+                || inpar->extradata_size != outpar->extradata_size
+                || (inpar->extradata_size > 0 && memcmp(inpar->extradata, outpar->extradata, inpar->extradata_size) != 0))
+            {
+                m_errMsg = "The codec parameters of segment '"+seg.url+"' differ from the first segment's, they can NOT be concatenated!";
+                return false;
+            }
+        }
+
+        const auto frameRate = m_hMtvReader->GetSharedSettings()->VideoOutFrameRate();
+        const AVRational frameTb = { frameRate.den, frameRate.num };
+        const int64_t tsOffset = av_rescale_q(seg.frameBegin-m_segments.front().frameBegin, frameTb, outStm->time_base);
+        AVPacket avpkt{0};
+        while (true)
+        {
+            fferr = av_read_frame(inFmtCtx, &avpkt);
+            if (fferr == AVERROR_EOF)
+                break;
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("av_read_frame", fferr);
+                return false;
+            }
+            if (avpkt.stream_index != inStmIdx)
+            {
+                av_packet_unref(&avpkt);
+                continue;
+            }
+            av_packet_rescale_ts(&avpkt, inStm->time_base, outStm->time_base);
+            if (avpkt.pts != AV_NOPTS_VALUE)
+                avpkt.pts += tsOffset;
+            if (avpkt.dts != AV_NOPTS_VALUE)
+                avpkt.dts += tsOffset;
+            // the reordering delay at the start of a segment may overlap the end of the segment before
+            tsStitcher.Stitch(avpkt.pts, avpkt.dts);
+            avpkt.stream_index = outStm->index;
+            avpkt.pos = -1;
+            fferr = av_interleaved_write_frame(outFmtCtx, &avpkt);
+            av_packet_unref(&avpkt);
+            if (fferr < 0)
+            {
+                m_errMsg = FFapiFailureMessage("av_interleaved_write_frame", fferr);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    string FFapiFailureMessage(const string& apiName, int fferr)
+    {
+        ostringstream oss;
+        oss << "FF api '" << apiName << "' returns error! fferr=" << fferr << ".";
+        return oss.str();
+    }
+
+private:
+    ALogger* m_logger;
+    mutex m_apiLock;
+    string m_errMsg;
+    MultiTrackVideoReader::Holder m_hMtvReader;
+    string m_codecName;
+    string m_imageFormat;
+    uint64_t m_bitRate{0};
+    vector<MediaEncoder::Option> m_extraOpts;
+    uint32_t m_gopSize{0};
+    uint32_t m_segmentCount{0};
+    int64_t m_minSegmentDuration{10000};
+    list<Segment> m_segments;
+    list<Segment>::iterator m_nextSegIter;
+    mutex m_segmentsLock;
+    atomic_bool m_cancel{false};
+    atomic<int64_t> m_encodedFrames{0};
+    atomic<int64_t> m_totalFrames{0};
+};
+
+static const auto SEGMENTED_EXPORTER_HOLDER_DELETER = [] (SegmentedExporter* p) {
+    SegmentedExporter_Impl* ptr = dynamic_cast<SegmentedExporter_Impl*>(p);
+    delete ptr;
+};
+
+SegmentedExporter::Holder SegmentedExporter::CreateInstance()
+{
+    return SegmentedExporter::Holder(new SegmentedExporter_Impl(), SEGMENTED_EXPORTER_HOLDER_DELETER);
+}
+
+ALogger* SegmentedExporter::GetLogger()
+{
+    return Logger::GetLogger("SegExporter");
+}
+}
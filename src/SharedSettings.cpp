@@ -6,6 +6,9 @@ namespace MediaCore
 {
 class SharedSettings_Impl : public SharedSettings
 {
+public:
+    Holder Clone() const override;
+
     // getters
     uint32_t VideoOutWidth() const override
     {
@@ -32,6 +35,16 @@ class SharedSettings_Impl : public SharedSettings
         return m_vidOutDataType;
     }
 
+    bool IsProxyMediaEnabled() const override
+    {
+        return m_proxyMediaEnabled;
+    }
+
+    string VideoFrameIndexCacheDirectory() const override
+    {
+        return m_vidFrmIdxCacheDir;
+    }
+
     // setters
     void SetVideoOutWidth(uint32_t width) override
     {
@@ -58,12 +71,24 @@ class SharedSettings_Impl : public SharedSettings
         m_vidOutDataType = datatype;
     }
 
+    void EnableProxyMedia(bool enable) override
+    {
+        m_proxyMediaEnabled = enable;
+    }
+
+    void SetVideoFrameIndexCacheDirectory(const string& dirPath) override
+    {
+        m_vidFrmIdxCacheDir = dirPath;
+    }
+
 private:
     uint32_t m_vidOutWidth{0};
     uint32_t m_vidOutHeight{0};
     Ratio m_vidOutFrameRate;
     ImColorFormat m_vidOutColorFormat{IM_CF_RGBA};
     ImDataType m_vidOutDataType{IM_DT_FLOAT32};
+    bool m_proxyMediaEnabled{false};
+    string m_vidFrmIdxCacheDir;
 };
 
 static const auto SHARED_SETTINGS_DELETER = [] (SharedSettings* p) {
@@ -75,4 +100,9 @@ SharedSettings::Holder SharedSettings::CreateInstance()
 {
     return SharedSettings::Holder(new SharedSettings_Impl(), SHARED_SETTINGS_DELETER);
 }
+
+SharedSettings::Holder SharedSettings_Impl::Clone() const
+{
+    return SharedSettings::Holder(new SharedSettings_Impl(*this), SHARED_SETTINGS_DELETER);
+}
 }
\ No newline at end of file
@@ -31,6 +31,9 @@
 #include "MediaReader.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "ThreadPoolExecutor.h"
+#include "MemoryGovernor.h"
+#include "VideoFrameCache.h"
 #include "DebugHelper.h"
 extern "C"
 {
@@ -54,14 +57,22 @@ static AVPixelFormat get_hw_format(AVCodecContext *ctx, const AVPixelFormat *pix
 
 namespace MediaCore
 {
+using SysUtils::ThreadPoolExecutor;
+
 namespace Snapshot
 {
-class Generator_Impl : public Snapshot::Generator
+class Generator_Impl : public Snapshot::Generator, public MemoryGovernor::Consumer
 {
 public:
     Generator_Impl()
     {
         m_logger = Snapshot::GetLogger();
+        m_hMemGov->Register(this);
+    }
+
+    virtual ~Generator_Impl()
+    {
+        m_hMemGov->Unregister(this);
     }
 
     bool Open(const string& url) override
@@ -375,6 +386,50 @@ public:
         return true;
     }
 
+    string GetMemoryConsumerName() const override
+    {
+        return m_logger->GetName();
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_memUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return MemoryGovernor::PRIORITY_LOW;
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        // narrow the cache window down to the view windows, the demuxing task then drops the tasks out of it.
+        // the api lock can be held by a thread waiting on the governor, so it's only tried here.
+        if (!m_apiLock.try_lock())
+            return 0;
+        lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+        const int32_t ssCount = m_memSsCount.load();
+        const uint64_t usage = m_memUsage.load();
+        const uint32_t minCacheSize = (uint32_t)floor(m_wndFrmCnt)+2;
+        if (!m_prepared || ssCount <= 0 || usage == 0 || m_maxCacheSize <= minCacheSize)
+            return 0;
+        const uint64_t ssBytes = usage/ssCount;
+        uint32_t shrinkCount = ssBytes > 0 ? (uint32_t)((bytes+ssBytes-1)/ssBytes) : m_maxCacheSize;
+        if (shrinkCount > m_maxCacheSize-minCacheSize)
+            shrinkCount = m_maxCacheSize-minCacheSize;
+        // the cache window is restored by 'ConfigSnapWindow()' or 'SetCacheFactor()'
+        m_maxCacheSize -= shrinkCount;
+        m_prevWndCacheSize = (m_maxCacheSize-minCacheSize)/2;
+        for (auto& hViewer : m_viewers)
+        {
+            Viewer_Impl* viewer = dynamic_cast<Viewer_Impl*>(hViewer.get());
+            viewer->UpdateSnapwnd(viewer->GetCurrWindowPos(), true);
+        }
+        m_logger->Log(DEBUG) << "Shrink: reduced 'm_maxCacheSize' to " << m_maxCacheSize << "." << endl;
+        const uint64_t released = (uint64_t)shrinkCount*ssBytes;
+        return released < usage ? released : usage;
+    }
+
     double GetMinWindowSize() const override
     {
         return CalcMinWindowSize(m_wndFrmCnt);
@@ -397,7 +452,11 @@ public:
             return false;
         }
         if (m_prepared)
+        {
+            if (m_viddecCtx && m_viddecDevType == AV_HWDEVICE_TYPE_NONE && m_viddecCtx->lowres != GetVideoDecoderLowres())
+                return ReopenVideoDecoderForSnapshotSize();
             ResetGopDecodeTaskList();
+        }
         return true;
     }
 
@@ -534,6 +593,21 @@ public:
         m_vidPreferUseHw = enable;
     }
 
+    void EnableKeyFrameOnly(bool enable) override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_keyFrameOnly == enable)
+            return;
+        m_keyFrameOnly = enable;
+        if (m_prepared)
+            ResetGopDecodeTaskList();
+    }
+
+    bool IsKeyFrameOnly() const override
+    {
+        return m_keyFrameOnly;
+    }
+
     void SetLogLevel(Logger::Level l) override
     {
         m_logger->SetShowLevels(l);
@@ -557,6 +631,34 @@ private:
         return oss.str();
     }
 
+    VideoFrameCache::Key GetFrameCacheKey() const
+    {
+        VideoFrameCache::Key key;
+        key.url = m_hParser->GetUrl();
+        key.streamIndex = m_vidStmIdx;
+        key.width = m_frmCvt.GetOutWidth();
+        key.height = m_frmCvt.GetOutHeight();
+        key.clrfmt = m_frmCvt.GetOutColorFormat();
+        key.dtype = m_frmCvt.GetOutDataType();
+        key.interp = m_frmCvt.GetResizeInterpolateMode();
+        key.useVulkan = m_frmCvt.IsUseVulkanConverter();
+        return key;
+    }
+
+    bool ConvertSnapshotImage(const AVFrame* frm, ImGui::ImMat& img, double ts)
+    {
+        const auto key = GetFrameCacheKey();
+        if (m_hFrameCache->Get(key, frm->pts, img))
+        {
+            img.time_stamp = ts;
+            return true;
+        }
+        if (!m_frmCvt.ConvertImage(frm, img, ts))
+            return false;
+        m_hFrameCache->Put(key, frm->pts, img);
+        return true;
+    }
+
     double CalcMinWindowSize(double windowFrameCount) const
     {
         return m_vidfrmIntvMts*windowFrameCount/1000.;
@@ -652,18 +754,9 @@ private:
         return true;
     }
 
+    // 'm_apiLock' must be held when calling this method
     bool Prepare()
     {
-        bool lockAquired;
-        while (!(lockAquired = m_apiLock.try_lock()) && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
-        if (m_quit)
-        {
-            if (lockAquired) m_apiLock.unlock();
-            return false;
-        }
-
-        lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
         if (!m_hParser->IsImageSequence())
         {
             m_hParser->EnableParseInfo(MediaParser::VIDEO_SEEK_POINTS);
@@ -729,37 +822,90 @@ private:
         m_logger->Log(DEBUG) << ">>>> Prepared: m_snapWindowSize=" << m_snapWindowSize << ", m_wndFrmCnt=" << m_wndFrmCnt
             << ", m_vidMaxIndex=" << m_vidMaxIndex << ", m_maxCacheSize=" << m_maxCacheSize << ", m_prevWndCacheSize=" << m_prevWndCacheSize << endl;
         m_prepared = true;
+        m_wakeupEvt.Notify();
         return true;
     }
 
     bool OpenVideoDecoder()
     {
-        m_viddecCtx = avcodec_alloc_context3(m_viddec);
-        if (!m_viddecCtx)
+        m_viddecCtx = CreateVideoDecoderContext(GetVideoDecoderLowres());
+        return m_viddecCtx != nullptr;
+    }
+
+    // Open a sw decoder context decoding at the reduced resolution level 'lowres', return null on failure.
+    AVCodecContext* CreateVideoDecoderContext(int lowres)
+    {
+        AVCodecContext* viddecCtx = avcodec_alloc_context3(m_viddec);
+        if (!viddecCtx)
         {
             m_errMsg = "FAILED to allocate new AVCodecContext!";
-            return false;
+            return nullptr;
         }
-        m_viddecCtx->opaque = this;
+        viddecCtx->opaque = this;
 
         int fferr;
-        fferr = avcodec_parameters_to_context(m_viddecCtx, m_vidStream->codecpar);
+        fferr = avcodec_parameters_to_context(viddecCtx, m_vidStream->codecpar);
         if (fferr < 0)
         {
             m_errMsg = FFapiFailureMessage("avcodec_parameters_to_context", fferr);
-            return false;
+            avcodec_free_context(&viddecCtx);
+            return nullptr;
         }
 
-        m_viddecCtx->thread_count = 8;
-        // m_viddecCtx->thread_type = FF_THREAD_FRAME;
-        fferr = avcodec_open2(m_viddecCtx, m_viddec, nullptr);
+        viddecCtx->thread_count = 8;
+        // viddecCtx->thread_type = FF_THREAD_FRAME;
+        viddecCtx->lowres = lowres;
+        fferr = avcodec_open2(viddecCtx, m_viddec, nullptr);
         if (fferr < 0)
         {
             m_errMsg = FFapiFailureMessage("avcodec_open2", fferr);
-            return false;
+            avcodec_free_context(&viddecCtx);
+            return nullptr;
         }
-        m_logger->Log(DEBUG) << "Video decoder '" << m_viddec->name << "' opened." << " thread_count=" << m_viddecCtx->thread_count
-            << ", thread_type=" << m_viddecCtx->thread_type << endl;
+        m_logger->Log(DEBUG) << "Video decoder '" << m_viddec->name << "' opened." << " thread_count=" << viddecCtx->thread_count
+            << ", thread_type=" << viddecCtx->thread_type << ", lowres=" << viddecCtx->lowres << endl;
+        return viddecCtx;
+    }
+
+    // the reduced resolution level of the sw decoder for the current snapshot size
+    int GetVideoDecoderLowres() const
+    {
+        return FFUtils::GetVideoDecoderLowres(m_viddec, m_vidStream->codecpar->width, m_vidStream->codecpar->height,
+                m_frmCvt.GetOutWidth(), m_frmCvt.GetOutHeight());
+    }
+
+    // the reduced resolution can not be changed on an opened decoder, so reopen it when the snapshot size needs another one
+    bool ReopenVideoDecoderForSnapshotSize()
+    {
+        // open the new decoder before dropping the current one, a decoder rejecting the lowres level decodes at full resolution
+        AVCodecContext* newDecCtx = CreateVideoDecoderContext(GetVideoDecoderLowres());
+        if (!newDecCtx)
+        {
+            m_logger->Log(WARN) << "FAILED to open video decoder with lowres=" << GetVideoDecoderLowres() << "! Error is '" << m_errMsg
+                    << "'. Fall back to lowres=0." << endl;
+            if (m_viddecCtx->lowres == 0)
+                return true;
+            newDecCtx = CreateVideoDecoderContext(0);
+            if (!newDecCtx)
+            {
+                m_logger->Log(Error) << "FAILED to reopen video decoder for the new snapshot size! Error is '" << m_errMsg << "'." << endl;
+                return false;
+            }
+        }
+        WaitAllThreadsQuit();
+        FlushAllQueues();
+        avcodec_free_context(&m_viddecCtx);
+        m_viddecCtx = newDecCtx;
+        ResetGopDecodeTaskList();
+        {
+            lock_guard<mutex> lk(m_viewerListLock);
+            for (auto& hViewer : m_viewers)
+            {
+                Viewer_Impl* viewer = dynamic_cast<Viewer_Impl*>(hViewer.get());
+                viewer->UpdateSnapwnd(viewer->GetCurrWindowPos(), true);
+            }
+        }
+        StartAllThreads();
         return true;
     }
 
@@ -826,23 +972,36 @@ private:
         return true;
     }
 
-    void DemuxThreadProc()
+    ThreadPoolExecutor::StepResult DemuxThreadProc()
     {
-        m_logger->Log(VERBOSE) << "Enter DemuxThreadProc()..." << endl;
-
-        if (!m_prepared && !Prepare())
+        auto& ctx = m_demuxTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(VERBOSE) << "Enter DemuxThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared)
         {
-            if (!m_quit)
+            if (m_quit)
+                return LeaveDemuxThreadProc();
+            // the api lock is usually held shortly by the api which starts this task, and its release
+            // is not notified, so retry without parking this task
+            if (!m_apiLock.try_lock())
+                return ThreadPoolExecutor::STEP_BUSY;
+            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+            if (!Prepare())
+            {
                 m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
-            return;
+                return LeaveDemuxThreadProc();
+            }
         }
 
-        AVPacket avpkt = {0};
-        bool avpktLoaded = false;
-        GopDecodeTaskHolder currTask = nullptr;
-        int64_t lastGopSsPts;
-        bool demuxEof = false;
-        while (!m_quit)
+        AVPacket& avpkt = ctx.avpkt;
+        bool& avpktLoaded = ctx.avpktLoaded;
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        int64_t& lastGopSsPts = ctx.lastGopSsPts;
+        bool& demuxEof = ctx.demuxEof;
+        if (!m_quit)
         {
             bool idleLoop = true;
 
@@ -856,6 +1015,12 @@ private:
                     if (currTask && currTask->cancel)
                         m_logger->Log(VERBOSE) << "~~~~ Current demux task canceled" << endl;
                     currTask = FindNextDemuxTask();
+                    // the snapshots out of the view windows are only built when the memory budget allows
+                    if (currTask && !currTask->IsInView() && !RequestMemoryForTask(currTask))
+                    {
+                        m_logger->Log(VERBOSE) << "~~~~ Memory request for the next demux task is refused" << endl;
+                        currTask = nullptr;
+                    }
                     if (currTask)
                     {
                         currTask->demuxing = true;
@@ -884,12 +1049,12 @@ private:
                             if (fferr < 0)
                             {
                                 m_logger->Log(Error) << "avformat_seek_file() FAILED for seeking to 'currTask->startPts'(" << seekPts0 << ")! fferr = " << fferr << "!" << endl;
-                                break;
+                                return LeaveDemuxThreadProc();
                             }
                             demuxEof = false;
                             int64_t ptsAfterSeek = INT64_MIN;
                             if (!ReadNextStreamPacket(m_vidStmIdx, &avpkt, &avpktLoaded, &ptsAfterSeek))
-                                break;
+                                return LeaveDemuxThreadProc();
                             if (ptsAfterSeek == INT64_MAX)
                                 demuxEof = true;
                             else if (ptsAfterSeek != seekPts0)
@@ -921,7 +1086,30 @@ private:
 
                     if (avpktLoaded)
                     {
-                        if (avpkt.stream_index == m_vidStmIdx)
+                        if (avpkt.stream_index == m_vidStmIdx && m_keyFrameOnly)
+                        {
+                            // only the key frame which starts this GOP is needed
+                            if ((avpkt.flags&AV_PKT_FLAG_KEY) != 0)
+                            {
+                                m_logger->Log(VERBOSE) << "--> Queuing key video packet, pts=" << avpkt.pts << endl;
+                                AVPacket* enqpkt = av_packet_clone(&avpkt);
+                                if (!enqpkt)
+                                {
+                                    m_logger->Log(Error) << "FAILED to invoke [DEMUX]av_packet_clone()!" << endl;
+                                    return LeaveDemuxThreadProc();
+                                }
+                                lock_guard<mutex> lk(currTask->avpktQLock);
+                                if (!currTask->demuxerEof)
+                                    currTask->avpktQ.push_back(enqpkt);
+                                else
+                                    av_packet_free(&enqpkt);
+                                currTask->demuxerEof = true;
+                            }
+                            av_packet_unref(&avpkt);
+                            avpktLoaded = false;
+                            idleLoop = false;
+                        }
+                        else if (avpkt.stream_index == m_vidStmIdx)
                         {
                             if (avpkt.pts >= currTask->TaskRange().SeekPts().second || avpkt.pts > lastGopSsPts)
                             {
@@ -955,7 +1143,7 @@ private:
                                 if (!enqpkt)
                                 {
                                     m_logger->Log(Error) << "FAILED to invoke [DEMUX]av_packet_clone()!" << endl;
-                                    break;
+                                    return LeaveDemuxThreadProc();
                                 }
                                 {
                                     lock_guard<mutex> lk(currTask->avpktQLock);
@@ -985,13 +1173,26 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
+        }
+        return LeaveDemuxThreadProc();
+    }
+
+    ThreadPoolExecutor::StepResult LeaveDemuxThreadProc()
+    {
+        auto& ctx = m_demuxTaskCtx;
+        if (ctx.currTask && !ctx.currTask->demuxerEof)
+            ctx.currTask->demuxerEof = true;
+        ctx.currTask = nullptr;
+        if (ctx.avpktLoaded)
+        {
+            av_packet_unref(&ctx.avpkt);
+            ctx.avpktLoaded = false;
         }
-        if (currTask && !currTask->demuxerEof)
-            currTask->demuxerEof = true;
-        if (avpktLoaded)
-            av_packet_unref(&avpkt);
         m_logger->Log(VERBOSE) << "Leave DemuxThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     bool ReadNextStreamPacket(int stmIdx, AVPacket* avpkt, bool* avpktLoaded, int64_t* pts)
@@ -1029,19 +1230,23 @@ private:
         return true;
     }
 
-    void VideoDecodeThreadProc()
+    ThreadPoolExecutor::StepResult VideoDecodeThreadProc()
     {
-        m_logger->Log(VERBOSE) << "Enter VideoDecodeThreadProc()..." << endl;
-
-        while (!m_prepared && !m_quit)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        auto& ctx = m_viddecTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(VERBOSE) << "Enter VideoDecodeThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quit)
+            return ThreadPoolExecutor::STEP_IDLE;
 
-        GopDecodeTaskHolder currTask;
-        AVFrame avfrm = {0};
-        bool avfrmLoaded = false;
-        bool needResetDecoder = false;
-        bool sentNullPacket = false;
-        while (!m_quit)
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        AVFrame& avfrm = ctx.avfrm;
+        bool& avfrmLoaded = ctx.avfrmLoaded;
+        bool& needResetDecoder = ctx.needResetDecoder;
+        bool& sentNullPacket = ctx.sentNullPacket;
+        if (!m_quit)
         {
             bool idleLoop = true;
             bool quitLoop = false;
@@ -1053,6 +1258,7 @@ private:
                 if (currTask)
                 {
                     currTask->decoding = true;
+                    m_viddecCtx->skip_frame = m_keyFrameOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
                     m_logger->Log(DEBUG) << "==> Change decoding task to build SS ["
                         << currTask->m_range.SsIdx().first << ", " << currTask->m_range.SsIdx().second << "), pts=["
                         << currTask->m_range.SeekPts().first << "(" << MillisecToString(CvtVidPtsToMts(currTask->m_range.SeekPts().first)) << "), "
@@ -1118,47 +1324,52 @@ private:
                 }
 
                 hasOutput = avfrmLoaded;
-                if (avfrmLoaded)
+                if (avfrmLoaded && m_keyFrameOnly)
                 {
-                    while (!m_quit)
+                    if (m_pendingVidfrmCnt >= m_maxPendingVidfrmCnt)
+                        break;
+                    EnqueueKeyFrameSnapshots(&avfrm);
+                    av_frame_unref(&avfrm);
+                    avfrmLoaded = false;
+                    idleLoop = false;
+                }
+                else if (avfrmLoaded)
+                {
+                    int32_t ssIdx{-1};
+                    uint32_t bias{UINT32_MAX};
+                    list<GopDecodeTaskHolder> ssGopTasks = FindFrameSsPosition(avfrm.pts, ssIdx, bias);
+                    if (ssGopTasks.empty())
                     {
-                        int32_t ssIdx{-1};
-                        uint32_t bias{UINT32_MAX};
-                        list<GopDecodeTaskHolder> ssGopTasks = FindFrameSsPosition(avfrm.pts, ssIdx, bias);
-                        if (ssGopTasks.empty())
-                        {
-                            m_logger->Log(VERBOSE) << "Drop video frame pts=" << avfrm.pts << ", ssIdx=" << ssIdx << ". No corresponding GopDecoderTask can be found." << endl;
-                            av_frame_unref(&avfrm);
-                            avfrmLoaded = false;
-                            idleLoop = false;
-                            break;
-                        }
-                        if (m_pendingVidfrmCnt < m_maxPendingVidfrmCnt)
-                        {
-                            for (auto& t : ssGopTasks)
-                            {
-                                m_logger->Log(DEBUG) << "Enqueue SS#" << ssIdx << ", pts=" << avfrm.pts << "(ts=" << MillisecToString(CvtVidPtsToMts(avfrm.pts))
-                                    << ") to _GopDecodeTask: ssIdxPair=[" << t->m_range.SsIdx().first << ", " << t->m_range.SsIdx().second
-                                    << "), ptsPair=[" << t->m_range.SeekPts().first << ", " << t->m_range.SeekPts().second << ")." << endl;
-                            }
-                            if (!EnqueueSnapshotAVFrame(ssGopTasks, &avfrm, ssIdx, bias))
-                                m_logger->Log(WARN) << "FAILED to enqueue SS#" << ssIdx << ", pts=" << avfrm.pts << "(ts=" << MillisecToString(CvtVidPtsToMts(avfrm.pts)) << ")." << endl;
-                            av_frame_unref(&avfrm);
-                            avfrmLoaded = false;
-                            idleLoop = false;
-                            break;
-                        }
-                        else
+                        m_logger->Log(VERBOSE) << "Drop video frame pts=" << avfrm.pts << ", ssIdx=" << ssIdx << ". No corresponding GopDecoderTask can be found." << endl;
+                        av_frame_unref(&avfrm);
+                        avfrmLoaded = false;
+                        idleLoop = false;
+                    }
+                    else if (m_pendingVidfrmCnt < m_maxPendingVidfrmCnt)
+                    {
+                        for (auto& t : ssGopTasks)
                         {
-                            this_thread::sleep_for(chrono::milliseconds(5));
+                            m_logger->Log(DEBUG) << "Enqueue SS#" << ssIdx << ", pts=" << avfrm.pts << "(ts=" << MillisecToString(CvtVidPtsToMts(avfrm.pts))
+                                << ") to _GopDecodeTask: ssIdxPair=[" << t->m_range.SsIdx().first << ", " << t->m_range.SsIdx().second
+                                << "), ptsPair=[" << t->m_range.SeekPts().first << ", " << t->m_range.SeekPts().second << ")." << endl;
                         }
+                        if (!EnqueueSnapshotAVFrame(ssGopTasks, &avfrm, ssIdx, bias))
+                            m_logger->Log(WARN) << "FAILED to enqueue SS#" << ssIdx << ", pts=" << avfrm.pts << "(ts=" << MillisecToString(CvtVidPtsToMts(avfrm.pts)) << ")." << endl;
+                        av_frame_unref(&avfrm);
+                        avfrmLoaded = false;
+                        idleLoop = false;
+                    }
+                    else
+                    {
+                        // the pending snapshot queue is full, yield and retry when some snapshots are consumed
+                        break;
                     }
                 }
             } while (hasOutput && !m_quit);
             if (quitLoop)
-                break;
+                return LeaveVideoDecodeThreadProc();
             if (currTask && (currTask->decoderEof || currTask->cancel || currTask->redoDecoding))
-                continue;
+                return ThreadPoolExecutor::STEP_BUSY;
 
             if (currTask && !sentNullPacket)
             {
@@ -1198,24 +1409,42 @@ private:
                     idleLoop = false;
                 }
                 if (quitLoop)
-                    break;
+                    return LeaveVideoDecodeThreadProc();
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
+        }
+        return LeaveVideoDecodeThreadProc();
+    }
+
+    ThreadPoolExecutor::StepResult LeaveVideoDecodeThreadProc()
+    {
+        auto& ctx = m_viddecTaskCtx;
+        if (ctx.currTask && !ctx.currTask->decoderEof)
+            ctx.currTask->decoderEof = true;
+        ctx.currTask = nullptr;
+        if (ctx.avfrmLoaded)
+        {
+            av_frame_unref(&ctx.avfrm);
+            ctx.avfrmLoaded = false;
         }
-        if (currTask && !currTask->decoderEof)
-            currTask->decoderEof = true;
-        if (avfrmLoaded)
-            av_frame_unref(&avfrm);
         m_logger->Log(VERBOSE) << "Leave VideoDecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void UpdateSnapshotThreadProc()
+    ThreadPoolExecutor::StepResult UpdateSnapshotThreadProc()
     {
-        m_logger->Log(VERBOSE) << "Enter UpdateSnapshotThreadProc()." << endl;
-        GopDecodeTaskHolder currTask;
-        while (!m_quit)
+        auto& ctx = m_updateSsTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(VERBOSE) << "Enter UpdateSnapshotThreadProc()." << endl;
+            ctx.entered = true;
+        }
+        GopDecodeTaskHolder& currTask = ctx.currTask;
+        if (!m_quit)
         {
             bool idleLoop = true;
 
@@ -1237,7 +1466,7 @@ private:
                     if (ss->frm)
                     {
                         double ts = (double)CvtVidPtsToMts(ss->frm->pts)/1000.;
-                        if (!m_frmCvt.ConvertImage(ss->frm.get(), ss->img->mImgMat, ts))
+                        if (!ConvertSnapshotImage(ss->frm.get(), ss->img->mImgMat, ts))
                         {
                             m_logger->Log(WARN) << "FAILED to convert AVFrame(pts=" << ss->frm->pts << ", mts=" << CvtVidPtsToMts(ss->frm->pts)
                                     << ") to ImGui::ImMat! Message is '" << m_frmCvt.GetError() << "'. REDO-decoding on this task." << endl;
@@ -1249,6 +1478,7 @@ private:
 
                         ss->frm = nullptr;
                         ss->img->mTimestampMs = CalcSnapshotMts(ss->index);
+                        ss->UpdateMemoryUsage();
                         idleLoop = false;
                     }
                     if (!ss->img->mImgMat.empty())
@@ -1275,27 +1505,45 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
+        ctx.currTask = nullptr;
         m_logger->Log(VERBOSE) << "Leave UpdateSnapshotThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void BuildSnapshotFromImageSequenceProc()
+    ThreadPoolExecutor::StepResult BuildSnapshotFromImageSequenceProc()
     {
-        m_logger->Log(VERBOSE) << "Enter BuildSnapshotFromImageSequence()." << endl;
-
-        if (!m_prepared && !Prepare())
+        auto& ctx = m_imgsqTaskCtx;
+        if (!ctx.entered)
         {
-            if (!m_quit)
+            m_logger->Log(VERBOSE) << "Enter BuildSnapshotFromImageSequence()." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared)
+        {
+            if (m_quit)
+                return LeaveBuildSnapshotFromImageSequenceProc();
+            if (!m_apiLock.try_lock())
+                return ThreadPoolExecutor::STEP_BUSY;
+            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+            if (!Prepare())
+            {
                 m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
-            return;
+                return LeaveBuildSnapshotFromImageSequenceProc();
+            }
         }
 
-        list<ImgsqDecodeContext::Holder> imgsqDecCtxList;
-        for (auto i = 0; i < m_maxImgsqDecNum; i++)
-            imgsqDecCtxList.push_back(CreateImgsqDecodeContext());
+        list<ImgsqDecodeContext::Holder>& imgsqDecCtxList = ctx.imgsqDecCtxList;
+        if (imgsqDecCtxList.empty())
+        {
+            for (auto i = 0; i < m_maxImgsqDecNum; i++)
+                imgsqDecCtxList.push_back(CreateImgsqDecodeContext());
+        }
 
-        while (!m_quit)
+        if (!m_quit)
         {
             bool idleLoop = true;
 
@@ -1364,6 +1612,7 @@ private:
                         m_logger->Log(WARN) << "FAILED to GetMat for image-sequence at ss index@" << hImgsqDecCtx->m_hSs->index << ", pos@" << hImgsqDecCtx->m_hSs->img->mTimestampMs << "." << endl;
                     m_logger->Log(INFO) << "<--- Finished decoding ss-idx=" << hImgsqDecCtx->m_hSs->index << ", pos=" << hImgsqDecCtx->m_hSs->img->mTimestampMs <<
                             ", mat.timestamp=" << hImgsqDecCtx->m_hSs->img->mImgMat.time_stamp << "." << endl;
+                    hImgsqDecCtx->m_hSs->UpdateMemoryUsage();
                     hImgsqDecCtx->isIdle = true;
                     hImgsqDecCtx->m_hVfrm = nullptr;
                     hImgsqDecCtx->m_hSs = nullptr;
@@ -1371,10 +1620,20 @@ private:
                 }
             }
 
+            // the image-sequence readers do not signal 'm_wakeupEvt', this task is submitted with a short idle timeout to poll them
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
+        return LeaveBuildSnapshotFromImageSequenceProc();
+    }
+
+    ThreadPoolExecutor::StepResult LeaveBuildSnapshotFromImageSequenceProc()
+    {
+        m_imgsqTaskCtx.imgsqDecCtxList.clear();
         m_logger->Log(VERBOSE) << "Leave BuildSnapshotFromImageSequence()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
     void StartAllThreads()
@@ -1384,21 +1643,21 @@ private:
         m_quit = false;
         if (!IsImageSequence())
         {
-            m_demuxThread = thread(&Generator_Impl::DemuxThreadProc, this);
+            m_demuxTaskCtx = DemuxTaskContext();
             thnOss << "SsgDmx-" << fileName;
-            SysUtils::SetThreadName(m_demuxThread, thnOss.str());
-            m_viddecThread = thread(&Generator_Impl::VideoDecodeThreadProc, this);
+            m_demuxTask = m_hExecutor->Submit(thnOss.str(), [this] { return DemuxThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_viddecTaskCtx = VideoDecodeTaskContext();
             thnOss.str(""); thnOss << "SsgVdc-" << fileName;
-            SysUtils::SetThreadName(m_viddecThread, thnOss.str());
-            m_updateSsThread = thread(&Generator_Impl::UpdateSnapshotThreadProc, this);
+            m_viddecTask = m_hExecutor->Submit(thnOss.str(), [this] { return VideoDecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+            m_updateSsTaskCtx = UpdateSnapshotTaskContext();
             thnOss.str(""); thnOss << "SsgUss-" << fileName;
-            SysUtils::SetThreadName(m_updateSsThread, thnOss.str());
+            m_updateSsTask = m_hExecutor->Submit(thnOss.str(), [this] { return UpdateSnapshotThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
         }
         else
         {
-            m_updateSsThread = thread(&Generator_Impl::BuildSnapshotFromImageSequenceProc, this);
+            m_imgsqTaskCtx = ImgsqTaskContext();
             thnOss.str(""); thnOss << "SsgUss-" << fileName;
-            SysUtils::SetThreadName(m_updateSsThread, thnOss.str());
+            m_updateSsTask = m_hExecutor->Submit(thnOss.str(), [this] { return BuildSnapshotFromImageSequenceProc(); }, &m_wakeupEvt, 5);
         }
     }
 
@@ -1406,20 +1665,21 @@ private:
     {
         // AutoSection _as("WATQ");
         m_quit = true;
-        if (m_demuxThread.joinable())
+        m_wakeupEvt.Notify();
+        if (m_demuxTask)
         {
-            m_demuxThread.join();
-            m_demuxThread = thread();
+            m_demuxTask->Join();
+            m_demuxTask = nullptr;
         }
-        if (m_viddecThread.joinable())
+        if (m_viddecTask)
         {
-            m_viddecThread.join();
-            m_viddecThread = thread();
+            m_viddecTask->Join();
+            m_viddecTask = nullptr;
         }
-        if (m_updateSsThread.joinable())
+        if (m_updateSsTask)
         {
-            m_updateSsThread.join();
-            m_updateSsThread = thread();
+            m_updateSsTask->Join();
+            m_updateSsTask = nullptr;
         }
     }
 
@@ -1440,6 +1700,23 @@ private:
             pts = _frm ? _frm->pts : 0;
         }
 
+        ~_Picture()
+        {
+            if (memBytes > 0)
+                m_owner->ChangeMemoryUsage(-(int64_t)memBytes, -1);
+        }
+
+        // account the converted image to the memory usage of the owner
+        void UpdateMemoryUsage()
+        {
+            const uint64_t bytes = img->mImgMat.empty() ? 0 : (uint64_t)img->mImgMat.total()*img->mImgMat.elemsize;
+            if (bytes == memBytes)
+                return;
+            const int32_t countDelta = memBytes == 0 ? 1 : (bytes == 0 ? -1 : 0);
+            m_owner->ChangeMemoryUsage((int64_t)bytes-(int64_t)memBytes, countDelta);
+            memBytes = bytes;
+        }
+
         Generator_Impl* m_owner;
         DisplayData::Holder img;
         int32_t index;
@@ -1447,8 +1724,17 @@ private:
         int64_t pts;
         int64_t bias;
         bool fixed{false};
+        uint64_t memBytes{0};
     };
 
+    // report the change of the memory taken by the snapshot images to the governor
+    void ChangeMemoryUsage(int64_t deltaBytes, int32_t deltaCount)
+    {
+        m_memUsage.fetch_add((uint64_t)deltaBytes);
+        m_memSsCount.fetch_add(deltaCount);
+        m_hMemGov->ReportUsageChange(deltaBytes);
+    }
+
     struct ImgsqDecodeContext
     {
         using Holder = shared_ptr<ImgsqDecodeContext>;
@@ -2128,6 +2414,15 @@ private:
         return candidateTask;
     }
 
+    bool RequestMemoryForTask(const GopDecodeTaskHolder& hTask)
+    {
+        const int32_t ssCount = m_memSsCount.load();
+        if (ssCount <= 0)
+            return true;
+        const uint64_t ssBytes = m_memUsage.load()/ssCount;
+        return m_hMemGov->RequestMemory(this, ssBytes*hTask->ssCandidates.size());
+    }
+
     GopDecodeTaskHolder FindNextDecoderTask()
     {
         lock_guard<mutex> lk(m_goptskListReadLocks[1]);
@@ -2186,6 +2481,41 @@ private:
         return nxttsk;
     }
 
+    // in key-frame-only mode, the key frame of a GOP task is used for all the snapshots of that task
+    void EnqueueKeyFrameSnapshots(AVFrame* avfrm)
+    {
+        list<GopDecodeTaskHolder> tasks;
+        {
+            lock_guard<mutex> lk(m_goptskListReadLocks[0]);
+            for (auto& t : m_goptskList)
+            {
+                const auto& seekPts = t->TaskRange().SeekPts();
+                if (!t->cancel && avfrm->pts >= seekPts.first && avfrm->pts < seekPts.second)
+                    tasks.push_back(t);
+            }
+        }
+        if (tasks.empty())
+        {
+            m_logger->Log(VERBOSE) << "Drop key frame pts=" << avfrm->pts << ". No corresponding GopDecoderTask can be found." << endl;
+            return;
+        }
+        for (auto& t : tasks)
+        {
+            list<int32_t> ssIdxList;
+            for (auto& elem : t->ssCandidates)
+            {
+                if (!elem.second.frmEnqueued)
+                    ssIdxList.push_back(elem.first);
+            }
+            for (int32_t ssIdx : ssIdxList)
+            {
+                const uint32_t bias = (uint32_t)floor(abs(m_ssIntvPts*ssIdx-avfrm->pts));
+                if (!EnqueueSnapshotAVFrame({t}, avfrm, ssIdx, bias))
+                    m_logger->Log(WARN) << "FAILED to enqueue key frame pts=" << avfrm->pts << " as SS#" << ssIdx << "." << endl;
+            }
+        }
+    }
+
     bool EnqueueSnapshotAVFrame(list<GopDecodeTaskHolder> ssGopTasks, AVFrame* avfrm, int32_t ssIdx, uint32_t bias)
     {
         if (ssGopTasks.empty())
@@ -2202,6 +2532,7 @@ private:
             {
                 av_frame_free(&p);
                 m_pendingVidfrmCnt--;
+                m_wakeupEvt.Notify();
             }
         });
         m_pendingVidfrmCnt++;
@@ -2419,6 +2750,7 @@ public:
                 lock_guard<mutex> lk(m_taskRangeLock);
                 m_taskRanges = taskRanges;
                 m_taskRangeChanged = true;
+                m_owner->m_wakeupEvt.Notify();
             }
         }
 
@@ -2444,6 +2776,8 @@ private:
     bool m_prepared{false};
     recursive_mutex m_apiLock;
     bool m_quit{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
 
     AVFormatContext* m_avfmtCtx{nullptr};
     int m_vidStmIdx{-1};
@@ -2452,18 +2786,65 @@ private:
     AVCodecPtr m_viddec{nullptr};
     AVCodecContext* m_viddecCtx{nullptr};
     bool m_vidPreferUseHw{true};
+    atomic_bool m_keyFrameOnly{false};
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
     AVPixelFormat m_vidHwPixFmt{AV_PIX_FMT_NONE};
     AVHWDeviceType m_viddecDevType{AV_HWDEVICE_TYPE_NONE};
     AVBufferRef* m_viddecHwDevCtx{nullptr};
 
-    // demuxing thread
-    thread m_demuxThread;
+    // states of the demuxing task that are kept between the steps
+    struct DemuxTaskContext
+    {
+        bool entered{false};
+        AVPacket avpkt = {0};
+        bool avpktLoaded{false};
+        GopDecodeTaskHolder currTask;
+        int64_t lastGopSsPts{INT64_MAX};
+        bool demuxEof{false};
+    };
+
+    // states of the video decoding task that are kept between the steps
+    struct VideoDecodeTaskContext
+    {
+        bool entered{false};
+        GopDecodeTaskHolder currTask;
+        AVFrame avfrm = {0};
+        bool avfrmLoaded{false};
+        bool needResetDecoder{false};
+        bool sentNullPacket{false};
+    };
+
+    // states of the snapshot updating task that are kept between the steps
+    struct UpdateSnapshotTaskContext
+    {
+        bool entered{false};
+        GopDecodeTaskHolder currTask;
+    };
+
+    // states of the image-sequence snapshot building task that are kept between the steps
+    struct ImgsqTaskContext
+    {
+        bool entered{false};
+        list<ImgsqDecodeContext::Holder> imgsqDecCtxList;
+    };
+
+    // the snapshot images are accounted to the process-wide memory governor
+    MemoryGovernor::Holder m_hMemGov{MemoryGovernor::GetDefaultInstance()};
+    atomic_uint64_t m_memUsage{0};
+    atomic_int32_t m_memSsCount{0};
+    // all the pipeline stages run as tasks on the shared executor
+    ThreadPoolExecutor::Holder m_hExecutor{ThreadPoolExecutor::GetDefaultInstance()};
+    // demuxing task
+    ThreadPoolExecutor::Task::Holder m_demuxTask;
+    DemuxTaskContext m_demuxTaskCtx;
     uint32_t m_maxPendingTaskCountForDecoding = 8;
-    // video decoding thread
-    thread m_viddecThread;
-    // update snapshots thread
-    thread m_updateSsThread;
+    // video decoding task
+    ThreadPoolExecutor::Task::Holder m_viddecTask;
+    VideoDecodeTaskContext m_viddecTaskCtx;
+    // update snapshots task, or build snapshots from image-sequence task
+    ThreadPoolExecutor::Task::Holder m_updateSsTask;
+    UpdateSnapshotTaskContext m_updateSsTaskCtx;
+    ImgsqTaskContext m_imgsqTaskCtx;
 
     int64_t m_vidStartMts{0};
     int64_t m_vidStartPts{0};
@@ -2497,6 +2878,7 @@ private:
     bool m_ssSizeChanged{false};
     float m_ssWFacotr{1.f}, m_ssHFacotr{1.f};
     AVFrameToImMatConverter m_frmCvt;
+    VideoFrameCache::Holder m_hFrameCache{VideoFrameCache::GetDefaultInstance()};
 
     static const DisplayData::Holder S_NULL_DISPLAY_DATA;
 };
@@ -1698,7 +1698,8 @@ SubtitleImage SubtitleTrack_AssImpl::RenderSubtitleClip(SubtitleClip* clip, int6
         frmW = assBox.w;
         frmH = assBox.h;
     }
-    vmat.create_type((int)frmW, (int)frmH, 4, IM_DT_INT8);
+    if (!m_hMatPool->Acquire(vmat, (int)frmW, (int)frmH, 4, IM_DT_INT8))
+        vmat.create_type((int)frmW, (int)frmH, 4, IM_DT_INT8);
     vmat.color_format = IM_CF_ABGR;
 
     // calculate the final display box
@@ -18,6 +18,7 @@
 #pragma once
 #include <list>
 #include "SubtitleTrack.h"
+#include "ImMatPool.h"
 extern "C"
 {
     #include "libavformat/avformat.h"
@@ -222,6 +223,7 @@ namespace MediaCore
         bool m_useOverrideStyle{false};
         SubtitleTrackStyle_AssImpl m_overrideStyle;
         SubtitleImage m_prevRenderedImage;
+        ImMatPool::Holder m_hMatPool{ImMatPool::GetSharedInstance("Subtitle")};
 
         AVFormatContext* m_pAvfmtCtx{nullptr};
         AVCodecContext* m_pAvCdcCtx{nullptr};
@@ -23,18 +23,25 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 #include "SysUtils.h"
 #include "Logger.h"
 #if defined(_WIN32) && !defined(__MINGW64__)
 #include <windows.h>
+#include <process.h>
+#include <sys/utime.h>
 #else
 #include <pthread.h>
+#include <unistd.h>
+#include <utime.h>
 #endif
 
 #if (defined(__cplusplus) && __cplusplus >= 201703L) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
 #include <filesystem>
 namespace fs = std::filesystem;
 #elif defined(_WIN32) && !defined(__MINGW64__)
+#include <sys/types.h>
+#include <sys/stat.h>
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -185,6 +192,73 @@ bool IsDirectory(const string& path)
 #endif
 }
 
+bool GetFileStatus(const string& path, uint64_t& fileSize, int64_t& modifyTime)
+{
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec)
+        return false;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec)
+        return false;
+    fileSize = (uint64_t)size;
+    modifyTime = (int64_t)mtime.time_since_epoch().count();
+    return true;
+#elif defined(_WIN32) && !defined(__MINGW64__)
+    struct _stat64 fileStat;
+    if (_stat64(path.c_str(), &fileStat) != 0)
+        return false;
+    fileSize = (uint64_t)fileStat.st_size;
+    modifyTime = (int64_t)fileStat.st_mtime;
+    return true;
+#else
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0)
+        return false;
+    fileSize = (uint64_t)fileStat.st_size;
+    modifyTime = (int64_t)fileStat.st_mtime;
+    return true;
+#endif
+}
+
+bool TouchFile(const string& path)
+{
+#if (defined(__cplusplus) && __cplusplus >= 201703L) || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return !ec;
+#elif defined(_WIN32) && !defined(__MINGW64__)
+    return _utime(path.c_str(), nullptr) == 0;
+#else
+    return utime(path.c_str(), nullptr) == 0;
+#endif
+}
+
+uint64_t Fnv1aHash(const string& str)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : str)
+    {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+string MakeUniqueTempPath(const string& path)
+{
+    static atomic<uint32_t> s_tmpFileCounter{0};
+#if defined(_WIN32) && !defined(__MINGW64__)
+    const int pid = _getpid();
+#else
+    const int pid = (int)getpid();
+#endif
+    ostringstream oss;
+    oss << path << "." << pid << "-" << s_tmpFileCounter.fetch_add(1) << ".tmp";
+    return oss.str();
+}
+
 class FileIterator_Impl : public FileIterator
 {
 public:
@@ -271,8 +345,7 @@ public:
         if (!m_isQuickSampleReady && !m_isParsed)
         {
             StartParseThread();
-            while (!m_isQuickSampleReady && !m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isQuickSampleReady || m_isParsed; });
         }
         return m_quickSample;
     }
@@ -287,8 +360,7 @@ public:
         if (!m_isParsed)
         {
             StartParseThread();
-            while (!m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isParsed; });
         }
         if (m_fileIndex >= m_paths.size())
         {
@@ -303,8 +375,7 @@ public:
         if (!m_isParsed)
         {
             StartParseThread();
-            while (!m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isParsed; });
         }
         if (m_fileIndex+1 >= m_paths.size())
         {
@@ -325,8 +396,7 @@ public:
         if (!m_isParsed)
         {
             StartParseThread();
-            while (!m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isParsed; });
         }
         return vector<string>(m_paths);
     }
@@ -336,8 +406,7 @@ public:
         if (!m_isParsed)
         {
             StartParseThread();
-            while (!m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isParsed; });
         }
         return m_paths.size();
     }
@@ -347,8 +416,7 @@ public:
         if (!m_isParsed)
         {
             StartParseThread();
-            while (!m_isParsed)
-                this_thread::sleep_for(chrono::milliseconds(5));
+            m_parseEvt.WaitUntil([this] { return m_isParsed; });
         }
         if (index >= m_paths.size())
         {
@@ -469,6 +537,7 @@ public:
         {
             m_isParsed = true;
             m_parseFailed = true;
+            m_parseEvt.Notify();
             return;
         }
         pathList.sort();
@@ -480,6 +549,7 @@ public:
             pathList.pop_front();
         }
         m_isParsed = true;
+        m_parseEvt.Notify();
     }
 
     bool ParseOneDir(const string& subDirPath, list<string>& pathList)
@@ -508,6 +578,7 @@ public:
                 {
                     m_quickSample = filePath.string();
                     m_isQuickSampleReady = true;
+                    m_parseEvt.Notify();
                 }
                 pathList.push_back(filePath.string());
             }
@@ -549,6 +620,7 @@ public:
                 {
                     m_quickSample = relativePath;
                     m_isQuickSampleReady = true;
+                    m_parseEvt.Notify();
                 }
                 pathList.push_back(relativePath);
             }
@@ -565,6 +637,7 @@ private:
     bool m_quitThread{false};
     atomic_bool m_parsingStarted{false};
     thread m_parseThread;
+    WaitableEvent m_parseEvt;
     vector<string> m_paths;
     string m_quickSample;
     bool m_isQuickSampleReady{false};
@@ -577,6 +650,53 @@ private:
     string m_errMsg;
 };
 
+void WaitableEvent::Notify()
+{
+    m_seq++;
+    if (m_waiterCnt.load() > 0)
+    {
+        lock_guard<mutex> lk(m_mtx);
+        m_cv.notify_all();
+    }
+    if (m_listenerCnt.load() > 0)
+    {
+        lock_guard<mutex> lk(m_listenerLock);
+        for (auto& listener : m_listeners)
+            listener.second();
+    }
+}
+
+bool WaitableEvent::Wait(uint64_t seq, uint32_t timeoutMillisec) const
+{
+    unique_lock<mutex> lk(m_mtx);
+    m_waiterCnt++;
+    const bool notified = m_cv.wait_for(lk, chrono::milliseconds(timeoutMillisec), [this, seq] { return m_seq.load() != seq; });
+    m_waiterCnt--;
+    return notified;
+}
+
+uint32_t WaitableEvent::AddListener(function<void()> listener)
+{
+    lock_guard<mutex> lk(m_listenerLock);
+    const auto listenerId = m_nextListenerId++;
+    m_listeners.push_back({listenerId, listener});
+    m_listenerCnt++;
+    return listenerId;
+}
+
+void WaitableEvent::RemoveListener(uint32_t listenerId)
+{
+    lock_guard<mutex> lk(m_listenerLock);
+    auto iter = find_if(m_listeners.begin(), m_listeners.end(), [listenerId] (const pair<uint32_t, function<void()>>& elem) {
+        return elem.first == listenerId;
+    });
+    if (iter != m_listeners.end())
+    {
+        m_listeners.erase(iter);
+        m_listenerCnt--;
+    }
+}
+
 static const auto FILE_ITERATOR_HOLDER_DELETER = [] (FileIterator* p) {
     FileIterator_Impl* ptr = dynamic_cast<FileIterator_Impl*>(p);
     delete ptr;
@@ -0,0 +1,446 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <vector>
+#include <list>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "ThreadPoolExecutor.h"
+
+using namespace std;
+using namespace Logger;
+
+namespace SysUtils
+{
+class ThreadPoolExecutor_Impl;
+static thread_local ThreadPoolExecutor_Impl* t_currExecutor = nullptr;
+static thread_local int t_currWorkerIdx = -1;
+
+class ThreadPoolExecutor_Impl : public ThreadPoolExecutor
+{
+public:
+    ThreadPoolExecutor_Impl(uint32_t threadCount, const string& name)
+        : m_name(name.empty() ? "TpExec" : name)
+    {
+        m_logger = GetLogger("TpExec");
+        if (threadCount == 0)
+            threadCount = thread::hardware_concurrency();
+        if (threadCount < 2)
+            threadCount = 2;
+        m_threadCount = threadCount;
+        for (uint32_t i = 0; i < m_threadCount; i++)
+            m_workers.push_back(unique_ptr<Worker>(new Worker()));
+        for (uint32_t i = 0; i < m_threadCount; i++)
+        {
+            m_workers[i]->th = thread(&ThreadPoolExecutor_Impl::WorkerProc, this, (int)i);
+            ostringstream thnOss; thnOss << m_name << "#" << i;
+            SetThreadName(m_workers[i]->th, thnOss.str());
+        }
+        m_logger->Log(DEBUG) << "Executor '" << m_name << "' is started with " << m_threadCount << " worker threads." << endl;
+    }
+
+    ~ThreadPoolExecutor_Impl()
+    {
+        m_quit = true;
+        {
+            lock_guard<mutex> lk(m_idleLock);
+            m_idleCv.notify_all();
+        }
+        for (auto& w : m_workers)
+        {
+            if (w->th.joinable())
+                w->th.join();
+        }
+        list<TaskImplHolder> remainTasks;
+        {
+            lock_guard<mutex> lk(m_tasksLock);
+            remainTasks.swap(m_tasks);
+        }
+        for (auto& task : remainTasks)
+        {
+            m_logger->Log(WARN) << "Task '" << task->m_name << "' is NOT finished when executor '" << m_name << "' is destroyed!" << endl;
+            task->Finish();
+        }
+    }
+
+    Task::Holder Submit(const string& name, StepFunction stepFunc, WaitableEvent* wakeupEvt, uint32_t idleWaitTimeout) override
+    {
+        if (!stepFunc)
+            return nullptr;
+        TaskImplHolder hTask(new Task_Impl(this, name, stepFunc, wakeupEvt, idleWaitTimeout));
+        if (wakeupEvt)
+        {
+            Task_Impl* pTask = hTask.get();
+            hTask->m_listenerId = wakeupEvt->AddListener([this, pTask] { ResumeTask(pTask); });
+        }
+        {
+            lock_guard<mutex> lk(m_tasksLock);
+            m_tasks.push_back(hTask);
+        }
+        Enqueue(hTask, false);
+        return hTask;
+    }
+
+    uint32_t GetThreadCount() const override
+    {
+        return m_threadCount;
+    }
+
+    uint32_t GetTaskCount() const override
+    {
+        lock_guard<mutex> lk(m_tasksLock);
+        return m_tasks.size();
+    }
+
+    bool IsWorkerThread() const override
+    {
+        return t_currExecutor == this;
+    }
+
+    void SetLogLevel(Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+private:
+    enum TaskState
+    {
+        TS_QUEUED = 0,
+        TS_RUNNING,
+        TS_PARKED,
+        TS_DONE,
+    };
+
+    struct Task_Impl : public Task, public enable_shared_from_this<Task_Impl>
+    {
+        Task_Impl(ThreadPoolExecutor_Impl* owner, const string& name, StepFunction stepFunc, WaitableEvent* wakeupEvt, uint32_t idleWaitTimeout)
+            : m_owner(owner), m_name(name), m_stepFunc(stepFunc), m_wakeupEvt(wakeupEvt), m_idleWaitTimeout(idleWaitTimeout)
+        {}
+
+        string GetName() const override { return m_name; }
+        bool IsDone() const override { return m_state.load() == TS_DONE; }
+
+        void Join() override
+        {
+            if (m_owner->IsWorkerThread())
+            {
+                // only the joined task is run here. Running any other task on this worker could nest the joins
+                // without bound, or block it in a task which waits for the one that is joining.
+                auto hSelf = shared_from_this();
+                while (!IsDone())
+                {
+                    const auto seq = m_doneEvt.Sequence();
+                    if (IsDone())
+                        break;
+                    if (m_owner->TakeQueuedTask(hSelf))
+                        m_owner->RunTask(hSelf);
+                    else
+                        m_doneEvt.Wait(seq, 1);
+                }
+            }
+            else
+            {
+                m_doneEvt.WaitUntil([this] { return IsDone(); });
+            }
+        }
+
+        void Finish()
+        {
+            if (m_wakeupEvt && m_listenerId > 0)
+            {
+                m_wakeupEvt->RemoveListener(m_listenerId);
+                m_listenerId = 0;
+            }
+            m_state = TS_DONE;
+            m_doneEvt.Notify();
+        }
+
+        ThreadPoolExecutor_Impl* m_owner;
+        string m_name;
+        StepFunction m_stepFunc;
+        WaitableEvent* m_wakeupEvt;
+        uint32_t m_idleWaitTimeout;
+        uint32_t m_listenerId{0};
+        atomic<int32_t> m_state{TS_QUEUED};
+        atomic<int64_t> m_parkDeadline{0};
+        WaitableEvent m_doneEvt;
+    };
+    using TaskImplHolder = shared_ptr<Task_Impl>;
+
+    struct Worker
+    {
+        thread th;
+        mutex queueLock;
+        deque<TaskImplHolder> queue;
+    };
+
+    static int64_t GetSteadyTimeMillisec()
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Enqueue(TaskImplHolder hTask, bool preferLocal)
+    {
+        if (preferLocal && t_currExecutor == this)
+        {
+            auto& w = m_workers[t_currWorkerIdx];
+            lock_guard<mutex> lk(w->queueLock);
+            w->queue.push_back(hTask);
+        }
+        else
+        {
+            lock_guard<mutex> lk(m_injectLock);
+            m_injectQ.push_back(hTask);
+        }
+        m_queuedCnt++;
+        if (m_idleWorkerCnt.load() > 0)
+        {
+            lock_guard<mutex> lk(m_idleLock);
+            if (m_signalCnt < m_idleWorkerCnt.load())
+                m_signalCnt++;
+            m_idleCv.notify_one();
+        }
+    }
+
+    void ResumeTask(Task_Impl* pTask)
+    {
+        int32_t state = TS_PARKED;
+        if (pTask->m_state.compare_exchange_strong(state, TS_QUEUED))
+            Enqueue(pTask->shared_from_this(), true);
+    }
+
+    TaskImplHolder FetchTask(int workerIdx)
+    {
+        TaskImplHolder hTask;
+        if (workerIdx >= 0)
+        {
+            auto& w = m_workers[workerIdx];
+            lock_guard<mutex> lk(w->queueLock);
+            if (!w->queue.empty())
+            {
+                hTask = w->queue.back();
+                w->queue.pop_back();
+            }
+        }
+        if (!hTask)
+        {
+            lock_guard<mutex> lk(m_injectLock);
+            if (!m_injectQ.empty())
+            {
+                hTask = m_injectQ.front();
+                m_injectQ.pop_front();
+            }
+        }
+        if (!hTask)
+        {
+            // steal from the other workers, from the opposite end of their queues
+            for (uint32_t i = 1; i < m_threadCount && !hTask; i++)
+            {
+                auto& w = m_workers[(workerIdx+i)%m_threadCount];
+                lock_guard<mutex> lk(w->queueLock);
+                if (!w->queue.empty())
+                {
+                    hTask = w->queue.front();
+                    w->queue.pop_front();
+                }
+            }
+        }
+        if (hTask)
+            m_queuedCnt--;
+        return hTask;
+    }
+
+    // take 'hTask' out of the queues, return false if it is not queued
+    bool TakeQueuedTask(const TaskImplHolder& hTask)
+    {
+        if (hTask->m_state.load() != TS_QUEUED)
+            return false;
+        {
+            lock_guard<mutex> lk(m_injectLock);
+            auto iter = find(m_injectQ.begin(), m_injectQ.end(), hTask);
+            if (iter != m_injectQ.end())
+            {
+                m_injectQ.erase(iter);
+                m_queuedCnt--;
+                return true;
+            }
+        }
+        for (auto& w : m_workers)
+        {
+            lock_guard<mutex> lk(w->queueLock);
+            auto iter = find(w->queue.begin(), w->queue.end(), hTask);
+            if (iter != w->queue.end())
+            {
+                w->queue.erase(iter);
+                m_queuedCnt--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RunOneTask(int workerIdx)
+    {
+        auto hTask = FetchTask(workerIdx);
+        if (!hTask)
+            return false;
+        RunTask(hTask);
+        return true;
+    }
+
+    // run the steps of a task which has been taken out of the queues, for one time slice at most
+    void RunTask(const TaskImplHolder& hTask)
+    {
+        hTask->m_state = TS_RUNNING;
+        const auto sliceEndTime = GetSteadyTimeMillisec()+m_timeSliceMillisec;
+        StepResult res;
+        uint64_t wakeupSeq;
+        while (true)
+        {
+            wakeupSeq = hTask->m_wakeupEvt ? hTask->m_wakeupEvt->Sequence() : 0;
+            res = hTask->m_stepFunc();
+            if (res != STEP_BUSY || m_quit || GetSteadyTimeMillisec() >= sliceEndTime)
+                break;
+        }
+
+        if (res == STEP_DONE)
+        {
+            hTask->Finish();
+            lock_guard<mutex> lk(m_tasksLock);
+            auto iter = find(m_tasks.begin(), m_tasks.end(), hTask);
+            if (iter != m_tasks.end())
+                m_tasks.erase(iter);
+        }
+        else if (res == STEP_BUSY)
+        {
+            // time slice is used up, let the other tasks run first
+            hTask->m_state = TS_QUEUED;
+            Enqueue(hTask, false);
+        }
+        else
+        {
+            hTask->m_parkDeadline = GetSteadyTimeMillisec()+hTask->m_idleWaitTimeout;
+            hTask->m_state = TS_PARKED;
+            // the notification may have been issued before the task is parked
+            const bool notified = hTask->m_wakeupEvt && hTask->m_wakeupEvt->Sequence() != wakeupSeq;
+            if (notified || hTask->m_idleWaitTimeout == 0)
+                ResumeTask(hTask.get());
+        }
+    }
+
+    // Resume the parked tasks whose idle timeout has expired, return the milliseconds until the next timeout
+    uint32_t ResumeExpiredTasks()
+    {
+        const auto currTime = GetSteadyTimeMillisec();
+        int64_t waitTime = m_maxIdleWaitMillisec;
+        list<Task_Impl*> expiredTasks;
+        {
+            lock_guard<mutex> lk(m_tasksLock);
+            for (auto& hTask : m_tasks)
+            {
+                if (hTask->m_state.load() != TS_PARKED)
+                    continue;
+                const auto deadline = hTask->m_parkDeadline.load();
+                if (deadline <= currTime)
+                    expiredTasks.push_back(hTask.get());
+                else if (deadline-currTime < waitTime)
+                    waitTime = deadline-currTime;
+            }
+            for (auto pTask : expiredTasks)
+                ResumeTask(pTask);
+        }
+        return (uint32_t)waitTime;
+    }
+
+    void WorkerProc(int workerIdx)
+    {
+        t_currExecutor = this;
+        t_currWorkerIdx = workerIdx;
+        while (!m_quit)
+        {
+            if (RunOneTask(workerIdx))
+                continue;
+
+            const auto waitTime = ResumeExpiredTasks();
+            unique_lock<mutex> lk(m_idleLock);
+            m_idleWorkerCnt++;
+            if (!m_quit && m_queuedCnt.load() <= 0)
+                m_idleCv.wait_for(lk, chrono::milliseconds(waitTime), [this] { return m_signalCnt > 0 || m_quit; });
+            if (m_signalCnt > 0)
+                m_signalCnt--;
+            m_idleWorkerCnt--;
+        }
+        t_currExecutor = nullptr;
+        t_currWorkerIdx = -1;
+    }
+
+private:
+    ALogger* m_logger;
+    string m_name;
+    uint32_t m_threadCount;
+    vector<unique_ptr<Worker>> m_workers;
+    mutex m_injectLock;
+    deque<TaskImplHolder> m_injectQ;
+    atomic<int32_t> m_queuedCnt{0};
+    mutex m_idleLock;
+    condition_variable m_idleCv;
+    atomic<int32_t> m_idleWorkerCnt{0};
+    int32_t m_signalCnt{0};
+    mutable mutex m_tasksLock;
+    list<TaskImplHolder> m_tasks;
+    atomic_bool m_quit{false};
+    int64_t m_timeSliceMillisec{4};
+    int64_t m_maxIdleWaitMillisec{100};
+};
+
+static const auto THREAD_POOL_EXECUTOR_HOLDER_DELETER = [] (ThreadPoolExecutor* p) {
+    ThreadPoolExecutor_Impl* ptr = dynamic_cast<ThreadPoolExecutor_Impl*>(p);
+    delete ptr;
+};
+
+ThreadPoolExecutor::Holder ThreadPoolExecutor::CreateInstance(uint32_t threadCount, const string& name)
+{
+    return ThreadPoolExecutor::Holder(new ThreadPoolExecutor_Impl(threadCount, name), THREAD_POOL_EXECUTOR_HOLDER_DELETER);
+}
+
+static ThreadPoolExecutor::Holder g_defaultExecutor;
+static mutex g_defaultExecutorLock;
+static uint32_t g_defaultExecutorThreadCount = 0;
+
+ThreadPoolExecutor::Holder ThreadPoolExecutor::GetDefaultInstance()
+{
+    lock_guard<mutex> lk(g_defaultExecutorLock);
+    if (!g_defaultExecutor)
+        g_defaultExecutor = CreateInstance(g_defaultExecutorThreadCount, "McExec");
+    return g_defaultExecutor;
+}
+
+bool ThreadPoolExecutor::SetDefaultThreadCount(uint32_t threadCount)
+{
+    lock_guard<mutex> lk(g_defaultExecutorLock);
+    if (g_defaultExecutor)
+        return false;
+    g_defaultExecutorThreadCount = threadCount;
+    return true;
+}
+}
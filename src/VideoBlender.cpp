@@ -22,6 +22,8 @@
 #include <AlphaBlending_vulkan.h>
 #endif
 #include "FFUtils.h"
+#include "MatUtils.h"
+#include "ImMatPool.h"
 #include "Logger.h"
 
 using namespace std;
@@ -74,7 +76,9 @@ public:
         }
         else
         {
-            res = m_ffBlender.Blend(baseImage, overlayImage, x, y, overlayImage.w, overlayImage.h);
+            res = BlendOnCpu(baseImage, overlayImage, x, y);
+            if (res.empty())
+                res = m_ffBlender.Blend(baseImage, overlayImage, x, y, overlayImage.w, overlayImage.h);
         }
         return res;
     }
@@ -114,7 +118,9 @@ public:
         }
         else
         {
-            res = m_ffBlender.Blend(baseImage, overlayImage);
+            res = BlendOnCpu(baseImage, overlayImage, m_ovlyX, m_ovlyY);
+            if (res.empty())
+                res = m_ffBlender.Blend(baseImage, overlayImage);
         }
         return res;
     }
@@ -139,6 +145,27 @@ public:
         return m_errMsg;
     }
 
+private:
+    // returns an empty ImMat if the images are not supported by the cpu blender
+    ImGui::ImMat BlendOnCpu(ImGui::ImMat& baseImage, ImGui::ImMat& overlayImage, int32_t x, int32_t y)
+    {
+        if (baseImage.empty() || overlayImage.empty())
+            return baseImage;
+        ImGui::ImMat res;
+        if (!m_hMatPool->Acquire(res, baseImage.w, baseImage.h, baseImage.c, baseImage.type))
+            return ImGui::ImMat();
+        if (!MatUtils::AlphaBlend(res, baseImage, overlayImage, x, y))
+            return ImGui::ImMat();
+        res.time_stamp = baseImage.time_stamp;
+        res.duration = baseImage.duration;
+        res.rate = baseImage.rate;
+        res.flags = baseImage.flags;
+        res.color_format = baseImage.color_format;
+        res.color_space = baseImage.color_space;
+        res.color_range = baseImage.color_range;
+        return res;
+    }
+
 private:
     bool m_useVulkan;
     int32_t m_ovlyX{0}, m_ovlyY{0};
@@ -146,6 +173,7 @@ private:
     ImGui::AlphaBlending_vulkan m_vulkanBlender;
 #endif
     FFOverlayBlender m_ffBlender;
+    ImMatPool::Holder m_hMatPool{ImMatPool::GetSharedInstance("Blend")};
     string m_errMsg;
 };
 
@@ -20,8 +20,12 @@
 #include <ColorConvert_vulkan.h>
 #include <AlphaBlending_vulkan.h>
 #endif
+#include <algorithm>
 #include "VideoClip.h"
 #include "VideoTransformFilter.h"
+#include "MediaReaderPool.h"
+#include "ProxyManager.h"
+#include "MemoryGovernor.h"
 #include "Logger.h"
 #include "DebugHelper.h"
 #include "SysUtils.h"
@@ -82,7 +86,7 @@ public:
     VideoClip_VideoImpl(
         int64_t id, MediaParser::Holder hParser, SharedSettings::Holder hSettings,
         int64_t start, int64_t end, int64_t startOffset, int64_t endOffset, int64_t readpos, bool forward)
-        : m_id(id), m_hSettings(hSettings), m_start(start)
+        : m_id(id), m_hSettings(hSettings), m_hParser(hParser), m_start(start)
     {
         string fileName = SysUtils::ExtractFileName(hParser->GetUrl());
         ostringstream loggerNameOss;
@@ -100,11 +104,6 @@ public:
         if (vidStm->isImage)
             throw invalid_argument("This video stream is an IMAGE, it should be instantiated with a 'VideoClip_ImageImpl' instance!");
         loggerNameOss.str(""); loggerNameOss << "VRdr-" << fileName.substr(0, 4) << "-" << idstr;
-        m_hReader = MediaReader::CreateVideoInstance(loggerNameOss.str());
-        // m_hReader->SetLogLevel(DEBUG);
-        m_hReader->EnableHwAccel(VideoClip::USE_HWACCEL);
-        if (!m_hReader->Open(hParser))
-            throw runtime_error(m_hReader->GetError());
         const auto outWidth = hSettings->VideoOutWidth();
         const auto outHeight = hSettings->VideoOutHeight();
         const auto frameRate = hSettings->VideoOutFrameRate();
@@ -121,15 +120,51 @@ public:
         }
         readerWidth += readerWidth&0x1;
         readerHeight += readerHeight&0x1;
+        m_srcWidth = readerWidth;
+        m_srcHeight = readerHeight;
+        // read the proxy instead of the source if it's ready, the transform filter maps the layout back to the source size
+        auto hReadParser = hParser;
+        uint32_t readWidth = vidStm->width, readHeight = vidStm->height;
+        if (hSettings->IsProxyMediaEnabled())
+        {
+            auto hProxyParser = ProxyManager::GetDefaultInstance()->GetProxyParser(hParser);
+            auto proxyStm = hProxyParser ? hProxyParser->GetBestVideoStream() : nullptr;
+            if (proxyStm && proxyStm->width > 0 && proxyStm->height > 0)
+            {
+                hReadParser = hProxyParser;
+                readWidth = proxyStm->width;
+                readHeight = proxyStm->height;
+                if (readWidth*readHeight < readerWidth*readerHeight)
+                {
+                    readerWidth = readWidth+(readWidth&0x1);
+                    readerHeight = readHeight+(readHeight&0x1);
+                }
+                m_useProxy = true;
+                m_logger->Log(DEBUG) << "Read proxy '" << hProxyParser->GetUrl() << "' (" << readWidth << "x" << readHeight << ") for '"
+                        << hParser->GetUrl() << "'." << endl;
+            }
+        }
+        // the reader feeds the key frames of the frame index to the demuxer once the index is built
+        const auto frmIdxCacheDir = hSettings->VideoFrameIndexCacheDirectory();
+        if (!frmIdxCacheDir.empty())
+        {
+            if (hReadParser->GetFrameIndexCacheDirectory().empty())
+                hReadParser->SetFrameIndexCacheDirectory(frmIdxCacheDir);
+            hReadParser->EnableParseInfo(MediaParser::VIDEO_FRAME_INDEX);
+        }
         ImInterpolateMode interpMode = IM_INTERPOLATE_BICUBIC;
-        if (readerWidth*readerHeight < vidStm->width*vidStm->height)
+        if (readerWidth*readerHeight < readWidth*readHeight)
             interpMode = IM_INTERPOLATE_AREA;
-        if (!m_hReader->ConfigVideoReader(readerWidth, readerHeight, m_outClrfmt, m_outDtype, interpMode))
-            throw runtime_error(m_hReader->GetError());
+        auto hReaderPool = MediaReaderPool::GetDefaultInstance();
+        m_hReader = hReaderPool->AcquireVideoReader(hReadParser, readerWidth, readerHeight, m_outClrfmt, m_outDtype, interpMode,
+                VideoClip::USE_HWACCEL, loggerNameOss.str());
+        if (!m_hReader)
+            throw runtime_error(hReaderPool->GetError());
+        // m_hReader->SetLogLevel(DEBUG);
         if (frameRate.num <= 0 || frameRate.den <= 0)
             throw invalid_argument("Invalid argument value for 'frameRate'!");
         m_frameRate = frameRate;
-        m_srcDuration = static_cast<int64_t>(m_hReader->GetVideoStream()->duration*1000);
+        m_srcDuration = static_cast<int64_t>(vidStm->duration*1000);
         if (startOffset < 0)
             throw invalid_argument("Argument 'startOffset' can NOT be NEGATIVE!");
         if (endOffset < 0)
@@ -147,9 +182,14 @@ public:
         bool suspend = readpos < -m_wakeupRange || readpos > Duration()+m_wakeupRange;
         if (!m_hReader->Start(suspend))
             throw runtime_error(m_hReader->GetError());
+        // a reader reused from the pool is started already, but suspended
+        if (!suspend && m_hReader->IsSuspended())
+            m_hReader->Wakeup();
         m_hWarpFilter = CreateVideoTransformFilter();
         if (!m_hWarpFilter->Initialize(outWidth, outHeight))
             throw runtime_error(m_hWarpFilter->GetError());
+        if (m_useProxy)
+            m_hWarpFilter->SetSourceSize(m_srcWidth, m_srcHeight);
     }
 
     ~VideoClip_VideoImpl()
@@ -160,7 +200,7 @@ public:
 
     MediaParser::Holder GetMediaParser() const override
     {
-        return m_hReader->GetMediaParser();
+        return m_hParser;
     }
 
     int64_t Id() const override
@@ -205,12 +245,12 @@ public:
 
     uint32_t SrcWidth() const override
     {
-        return m_hReader->GetVideoOutWidth();
+        return m_srcWidth;
     }
 
     uint32_t SrcHeight() const override
     {
-        return m_hReader->GetVideoOutHeight();
+        return m_srcHeight;
     }
 
     uint32_t OutWidth() const override
@@ -312,8 +352,11 @@ public:
             eof = true;
             return nullptr;
         }
-        if (m_hReader->IsSuspended())
-            m_hReader->Wakeup();
+        {
+            lock_guard<mutex> lk(m_readerStateLock);
+            if (m_hReader->IsSuspended())
+                m_hReader->Wakeup();
+        }
 
         const int64_t readPos = pos+m_startOffset;
         auto hVf = m_hReader->ReadVideoFrame(readPos, eof, wait);
@@ -358,6 +401,7 @@ public:
         else if (pos > Duration()) pos = Duration();
         auto seekPos = pos+m_startOffset;
         if (seekPos > m_srcDuration) seekPos = m_srcDuration;
+        lock_guard<mutex> lk(m_readerStateLock);
         if (seekPos != m_hReader->GetReadPos())
         {
             m_logger->Log(DEBUG) << "-> VidClip.SeekTo(" << seekPos << ")" << endl;
@@ -370,7 +414,22 @@ public:
     void NotifyReadPos(int64_t trackPos) override
     {
         auto clipPos = trackPos-m_start;
-        if (clipPos < -m_wakeupRange || clipPos > Duration()+m_wakeupRange)
+        // the cached frames of the clip under the play head are the last to be dropped under memory pressure
+        int32_t memPriority = MemoryGovernor::PRIORITY_LOW;
+        if (clipPos >= 0 && clipPos < Duration())
+            memPriority = MemoryGovernor::PRIORITY_HIGH;
+        else if (clipPos >= -m_wakeupRange && clipPos <= Duration()+m_wakeupRange)
+            memPriority = MemoryGovernor::PRIORITY_NORMAL;
+        m_hReader->SetMemoryPriority(memPriority);
+        // the range before the clip in the reading direction is kept awake for the prefetching
+        lock_guard<mutex> lk(m_readerStateLock);
+        // the reader is being woken up by the prefetching, its state is settled by the next notification
+        if (m_prefetching)
+            return;
+        const bool forward = m_hReader->IsDirectionForward();
+        const int64_t keepBefore = forward ? max(m_wakeupRange, m_prefetchWindow) : m_wakeupRange;
+        const int64_t keepAfter = forward ? m_wakeupRange : max(m_wakeupRange, m_prefetchWindow);
+        if (clipPos < -keepBefore || clipPos > Duration()+keepAfter)
         {
             if (!m_hReader->IsSuspended())
             {
@@ -378,7 +437,7 @@ public:
                 m_logger->Log(DEBUG) << ">>>> Clip#" << m_id <<" is SUSPENDED." << endl;
             }
         }
-        else if (m_hReader->IsSuspended())
+        else if (m_hReader->IsSuspended() && clipPos >= -m_wakeupRange && clipPos <= Duration()+m_wakeupRange)
         {
             const int64_t dur = Duration();
             int64_t seekPos = clipPos < 0 ? 0 : (clipPos > dur ? dur : clipPos);
@@ -391,6 +450,43 @@ public:
         }
     }
 
+    void Prefetch(int64_t pos) override
+    {
+        int64_t seekPos;
+        {
+            // the reader state must not be changed by the read thread between the check and the wakeup
+            lock_guard<mutex> lk(m_readerStateLock);
+            // an awake reader is already decoding, it must not be disturbed
+            if (!m_hReader->IsSuspended() || m_prefetching)
+                return;
+            const int64_t dur = Duration();
+            seekPos = pos < 0 ? 0 : (pos > dur ? dur : pos);
+            seekPos += m_startOffset;
+            if (seekPos > m_srcDuration) seekPos = m_srcDuration;
+            // the reader starts decoding from the seek position as soon as it's woken up
+            if (seekPos != m_hReader->GetReadPos())
+                m_hReader->SeekTo(seekPos);
+            m_prefetching = true;
+        }
+        // opening the media takes a while, the lock is not held meanwhile, so 'NotifyReadPos()' on the read thread is not blocked
+        m_hReader->Wakeup();
+        {
+            lock_guard<mutex> lk(m_readerStateLock);
+            m_prefetching = false;
+        }
+        m_logger->Log(DEBUG) << ">>>> Clip#" << m_id <<" is PREFETCHED at " << seekPos << "." << endl;
+    }
+
+    void SetPrefetchWindow(int64_t window) override
+    {
+        m_prefetchWindow = window;
+    }
+
+    void EnableScrubMode(bool enable) override
+    {
+        m_hReader->EnableScrubMode(enable);
+    }
+
     void SetDirection(bool forward) override
     {
         m_hReader->SetDirection(forward);
@@ -430,7 +526,10 @@ private:
     int64_t m_trackId{-1};
     SharedSettings::Holder m_hSettings;
     MediaInfo::Holder m_hInfo;
+    MediaParser::Holder m_hParser;
     MediaReader::Holder m_hReader;
+    bool m_useProxy{false};
+    uint32_t m_srcWidth{0}, m_srcHeight{0};
     int64_t m_srcDuration;
     int64_t m_start;
     int64_t m_startOffset;
@@ -442,6 +541,11 @@ private:
     VideoFilter::Holder m_hFilter;
     VideoTransformFilterHolder m_hWarpFilter;
     int64_t m_wakeupRange{1000};
+    int64_t m_prefetchWindow{0};
+    // guards the seek, suspend and wakeup of 'm_hReader' against the prefetching
+    mutex m_readerStateLock;
+    // set while the prefetching is waking up 'm_hReader' outside of 'm_readerStateLock'
+    bool m_prefetching{false};
     ImColorFormat m_outClrfmt{IM_CF_RGBA};
     ImDataType m_outDtype{IM_DT_FLOAT32};
     FailedRead m_failedRead;
@@ -463,9 +567,11 @@ VideoClip::Holder VideoClip::CreateVideoInstance(
 VideoClip::Holder VideoClip_VideoImpl::Clone(SharedSettings::Holder hSettings) const
 {
     VideoClip_VideoImpl* newInstance = new VideoClip_VideoImpl(
-        m_id, m_hReader->GetMediaParser(), hSettings, m_start, End(), m_startOffset, m_endOffset, 0, true);
+        m_id, m_hParser, hSettings, m_start, End(), m_startOffset, m_endOffset, 0, true);
     if (m_hFilter) newInstance->SetFilter(m_hFilter->Clone());
     newInstance->m_hWarpFilter = m_hWarpFilter->Clone(hSettings->VideoOutWidth(), hSettings->VideoOutHeight());
+    if (newInstance->m_useProxy)
+        newInstance->m_hWarpFilter->SetSourceSize(newInstance->m_srcWidth, newInstance->m_srcHeight);
     return VideoClip::Holder(newInstance, VIDEO_CLIP_HOLDER_VIDEOIMPL_DELETER);
 }
 
@@ -483,9 +589,6 @@ public:
         auto vidStm = hParser->GetBestVideoStream();
         if (!vidStm->isImage)
             throw invalid_argument("This video stream is NOT an IMAGE, it should be instantiated with a 'VideoClip_VideoImpl' instance!");
-        m_hReader = MediaReader::CreateInstance();
-        if (!m_hReader->Open(hParser))
-            throw runtime_error(m_hReader->GetError());
         const auto outWidth = hSettings->VideoOutWidth();
         const auto outHeight = hSettings->VideoOutHeight();
         uint32_t readerWidth, readerHeight;
@@ -504,14 +607,20 @@ public:
         ImInterpolateMode interpMode = IM_INTERPOLATE_BICUBIC;
         if (readerWidth*readerHeight < vidStm->width*vidStm->height)
             interpMode = IM_INTERPOLATE_AREA;
-        if (!m_hReader->ConfigVideoReader(readerWidth, readerHeight, m_outClrfmt, m_outDtype, interpMode))
-            throw runtime_error(m_hReader->GetError());
+        auto hReaderPool = MediaReaderPool::GetDefaultInstance();
+        m_hReader = hReaderPool->AcquireImageReader(hParser, readerWidth, readerHeight, m_outClrfmt, m_outDtype, interpMode);
+        if (!m_hReader)
+            throw runtime_error(hReaderPool->GetError());
+        // m_hReader->SetLogLevel(DEBUG);
         if (duration <= 0)
             throw invalid_argument("Argument 'duration' must be positive!");
         m_srcDuration = duration;
         m_start = start;
         if (!m_hReader->Start())
             throw runtime_error(m_hReader->GetError());
+        // a reader reused from the pool is started already, but suspended
+        if (m_hReader->IsSuspended())
+            m_hReader->Wakeup();
         m_hWarpFilter = CreateVideoTransformFilter();
         if (!m_hWarpFilter->Initialize(outWidth, outHeight))
             throw runtime_error(m_hWarpFilter->GetError());
@@ -672,6 +781,15 @@ public:
     void NotifyReadPos(int64_t pos) override
     {}
 
+    void Prefetch(int64_t pos) override
+    {}
+
+    void SetPrefetchWindow(int64_t window) override
+    {}
+
+    void EnableScrubMode(bool enable) override
+    {}
+
     void SetDirection(bool forward) override
     {}
 
@@ -0,0 +1,280 @@
+/*
+    Copyright (c) 2023 CodeWin
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "VideoFrameCache.h"
+#include "MemoryGovernor.h"
+
+using namespace std;
+using namespace Logger;
+
+namespace MediaCore
+{
+class VideoFrameCache_Impl : public VideoFrameCache, public MemoryGovernor::Consumer
+{
+public:
+    VideoFrameCache_Impl(uint64_t memoryBudget) : m_memoryBudget(memoryBudget)
+    {
+        m_logger = GetLogger("VfCache");
+        m_hMemGov = MemoryGovernor::GetDefaultInstance();
+        m_hMemGov->Register(this);
+    }
+
+    ~VideoFrameCache_Impl()
+    {
+        Clear();
+        m_hMemGov->Unregister(this);
+    }
+
+    bool Get(const Key& key, int64_t pts, ImGui::ImMat& m, int64_t ptsTolerance) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        auto srcIter = m_sources.find(key);
+        if (srcIter != m_sources.end())
+        {
+            auto& frames = srcIter->second;
+            auto frmIter = frames.upper_bound(pts);
+            if (frmIter != frames.begin())
+            {
+                frmIter--;
+                if (pts-frmIter->first <= ptsTolerance)
+                {
+                    auto lruIter = frmIter->second;
+                    m_lruList.splice(m_lruList.begin(), m_lruList, lruIter);
+                    m = lruIter->mat;
+                    m_hitCount++;
+                    return true;
+                }
+            }
+        }
+        m_missCount++;
+        return false;
+    }
+
+    void Put(const Key& key, int64_t pts, const ImGui::ImMat& m) override
+    {
+        if (m.empty())
+            return;
+        const uint64_t bytes = (uint64_t)m.total()*m.elemsize;
+        // over the global budget, the new frame can only take the place of the least recently used ones
+        const bool granted = m_hMemGov->RequestMemory(this, bytes);
+        lock_guard<mutex> lk(m_lock);
+        if (bytes > m_memoryBudget)
+            return;
+        if (!granted && EvictBytes(bytes) < bytes)
+        {
+            ReportMemoryUsage();
+            return;
+        }
+        auto srcIter = m_sources.find(key);
+        if (srcIter == m_sources.end())
+            srcIter = m_sources.insert({key, FrameTable()}).first;
+        auto& frames = srcIter->second;
+        auto frmIter = frames.find(pts);
+        if (frmIter != frames.end())
+        {
+            auto lruIter = frmIter->second;
+            m_memoryUsage -= lruIter->bytes;
+            lruIter->mat = m;
+            lruIter->bytes = bytes;
+            m_memoryUsage += bytes;
+            m_lruList.splice(m_lruList.begin(), m_lruList, lruIter);
+        }
+        else
+        {
+            m_lruList.push_front({srcIter, pts, m, bytes});
+            frames[pts] = m_lruList.begin();
+            m_memoryUsage += bytes;
+        }
+        EvictOverBudget();
+        ReportMemoryUsage();
+    }
+
+    void Remove(const string& url) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        auto srcIter = m_sources.begin();
+        while (srcIter != m_sources.end())
+        {
+            if (srcIter->first.url == url)
+            {
+                for (auto& elem : srcIter->second)
+                {
+                    m_memoryUsage -= elem.second->bytes;
+                    m_lruList.erase(elem.second);
+                }
+                srcIter = m_sources.erase(srcIter);
+            }
+            else
+                srcIter++;
+        }
+        ReportMemoryUsage();
+    }
+
+    void Clear() override
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_lruList.clear();
+        m_sources.clear();
+        m_memoryUsage = 0;
+        ReportMemoryUsage();
+    }
+
+    void SetMemoryBudget(uint64_t bytes) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        m_memoryBudget = bytes;
+        EvictOverBudget();
+        ReportMemoryUsage();
+        m_logger->Log(DEBUG) << "Memory budget is set to " << bytes << " bytes." << endl;
+    }
+
+    uint64_t GetMemoryBudget() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        return m_memoryBudget;
+    }
+
+    Stats GetStats() const override
+    {
+        lock_guard<mutex> lk(m_lock);
+        Stats stats;
+        stats.memoryBudget = m_memoryBudget;
+        stats.memoryUsage = m_memoryUsage;
+        stats.frameCount = (uint32_t)m_lruList.size();
+        stats.hitCount = m_hitCount;
+        stats.missCount = m_missCount;
+        stats.evictCount = m_evictCount;
+        return stats;
+    }
+
+    void SetLogLevel(Logger::Level l) override
+    {
+        m_logger->SetShowLevels(l);
+    }
+
+    string GetMemoryConsumerName() const override
+    {
+        return "VideoFrameCache";
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_reportedUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return MemoryGovernor::PRIORITY_LOW;
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        lock_guard<mutex> lk(m_lock);
+        const uint64_t evictedBytes = EvictBytes(bytes);
+        ReportMemoryUsage();
+        return evictedBytes;
+    }
+
+private:
+    struct CacheEntry;
+    using LruList = list<CacheEntry>;
+    using FrameTable = map<int64_t, LruList::iterator>;
+    using SourceTable = map<Key, FrameTable>;
+
+    struct CacheEntry
+    {
+        SourceTable::iterator srcIter;
+        int64_t pts;
+        ImGui::ImMat mat;
+        uint64_t bytes;
+    };
+
+    // 'm_lock' must be held when calling this method
+    void ReportMemoryUsage()
+    {
+        const uint64_t prevUsage = m_reportedUsage.exchange(m_memoryUsage);
+        if (m_memoryUsage != prevUsage)
+            m_hMemGov->ReportUsageChange((int64_t)m_memoryUsage-(int64_t)prevUsage);
+    }
+
+    void EvictOverBudget()
+    {
+        while (m_memoryUsage > m_memoryBudget && !m_lruList.empty())
+            EvictLru();
+    }
+
+    uint64_t EvictBytes(uint64_t bytes)
+    {
+        uint64_t evictedBytes = 0;
+        while (evictedBytes < bytes && !m_lruList.empty())
+            evictedBytes += EvictLru();
+        return evictedBytes;
+    }
+
+    uint64_t EvictLru()
+    {
+        auto& entry = m_lruList.back();
+        const uint64_t bytes = entry.bytes;
+        auto srcIter = entry.srcIter;
+        srcIter->second.erase(entry.pts);
+        if (srcIter->second.empty())
+            m_sources.erase(srcIter);
+        m_memoryUsage -= bytes;
+        m_lruList.pop_back();
+        m_evictCount++;
+        return bytes;
+    }
+
+private:
+    ALogger* m_logger;
+    MemoryGovernor::Holder m_hMemGov;
+    mutable mutex m_lock;
+    LruList m_lruList;
+    SourceTable m_sources;
+    uint64_t m_memoryBudget;
+    uint64_t m_memoryUsage{0};
+    atomic_uint64_t m_reportedUsage{0};
+    uint64_t m_hitCount{0};
+    uint64_t m_missCount{0};
+    uint64_t m_evictCount{0};
+};
+
+static const auto VIDEO_FRAME_CACHE_HOLDER_DELETER = [] (VideoFrameCache* p) {
+    VideoFrameCache_Impl* ptr = dynamic_cast<VideoFrameCache_Impl*>(p);
+    delete ptr;
+};
+
+VideoFrameCache::Holder VideoFrameCache::CreateInstance(uint64_t memoryBudget)
+{
+    return VideoFrameCache::Holder(new VideoFrameCache_Impl(memoryBudget), VIDEO_FRAME_CACHE_HOLDER_DELETER);
+}
+
+static VideoFrameCache::Holder g_defaultVideoFrameCache;
+static mutex g_defaultVideoFrameCacheLock;
+
+VideoFrameCache::Holder VideoFrameCache::GetDefaultInstance()
+{
+    lock_guard<mutex> lk(g_defaultVideoFrameCacheLock);
+    if (!g_defaultVideoFrameCache)
+        g_defaultVideoFrameCache = CreateInstance(512ULL*1024*1024);
+    return g_defaultVideoFrameCache;
+}
+}
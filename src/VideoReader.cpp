@@ -15,7 +15,6 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <thread>
 #include <mutex>
 #include <sstream>
 #include <atomic>
@@ -24,8 +23,11 @@
 #include <list>
 #include <functional>
 #include "MediaReader.h"
+#include "MemoryGovernor.h"
+#include "VideoFrameCache.h"
 #include "FFUtils.h"
 #include "SysUtils.h"
+#include "ThreadPoolExecutor.h"
 #include "DebugHelper.h"
 extern "C"
 {
@@ -44,7 +46,15 @@ using namespace Logger;
 
 namespace MediaCore
 {
-class VideoReader_Impl : public MediaReader
+using SysUtils::ThreadPoolExecutor;
+
+// with 'SetKeepHwFrames()', the hardware frames of the queue beyond this count are still downloaded, so the frames kept on
+// the device and the ones passed on to an encoder do not exhaust the surface pool of the decoder
+static const int32_t MAX_KEPT_HW_FRAMES = 4;
+// the frames within this count of frame intervals from a seek target are put into the shared frame cache
+static const int64_t FRAME_CACHE_TARGET_FRAMES = 2;
+
+class VideoReader_Impl : public MediaReader, public MemoryGovernor::Consumer
 {
 public:
     VideoReader_Impl(const string& loggerName = "")
@@ -58,9 +68,19 @@ public:
         m_logger->SetShowLevels(l, n);
 
         m_prevReadResult.first = 0.;
+        m_hMemGov = MemoryGovernor::GetDefaultInstance();
+        m_hMemGov->Register(this);
     }
 
-    virtual ~VideoReader_Impl() {}
+    virtual ~VideoReader_Impl()
+    {
+        {
+            lock_guard<mutex> _lk(m_vfrmQLock);
+            m_vfrmQ.clear();
+            UpdateMemoryUsage_l();
+        }
+        m_hMemGov->Unregister(this);
+    }
 
     bool Open(const string& url) override
     {
@@ -191,6 +211,7 @@ public:
 
     bool Start(bool suspend) override
     {
+        SysUtils::ScopedNotifier lockReleaseNotifier(m_wakeupEvt);
         lock_guard<recursive_mutex> lk(m_apiLock);
         if (!m_configured)
         {
@@ -233,6 +254,7 @@ public:
         m_readForward = true;
         m_seekPosUpdated = false;
         m_seekPos = 0;
+        m_frmCacheTargetPos = 0;
         m_vidDurMts = 0;
 
         m_prepared = false;
@@ -245,6 +267,7 @@ public:
     void Close() override
     {
         m_close = true;
+        m_wakeupEvt.Notify();
         lock_guard<recursive_mutex> lk(m_apiLock);
         WaitAllThreadsQuit();
         FlushAllQueues();
@@ -268,12 +291,14 @@ public:
         m_readForward = true;
         m_seekPosUpdated = false;
         m_seekPos = 0;
+        m_frmCacheTargetPos = 0;
         m_vidDurMts = 0;
         if (m_pFrmCvt)
         {
             delete m_pFrmCvt;
             m_pFrmCvt = nullptr;
         }
+        m_hFrameCache = nullptr;
 
         m_prepared = false;
         m_started = false;
@@ -296,6 +321,7 @@ public:
         }
 
         m_logger->Log(DEBUG) << "--> Seek[0]: Set seek pos " << pos << endl;
+        m_frmCacheTargetPos = pos;
         lock_guard<mutex> lk(m_seekPosLock);
         m_seekPos = pos;
         m_inSeeking = true;
@@ -305,6 +331,7 @@ public:
             int64_t seekPts = CvtMtsToPts(pos);
             UpdateReadPos(seekPts);
         }
+        m_wakeupEvt.Notify();
         return true;
     }
 
@@ -319,6 +346,7 @@ public:
             return;
         }
         m_readForward = forward;
+        m_wakeupEvt.Notify();
     }
 
     void Suspend() override
@@ -337,6 +365,7 @@ public:
 
     void Wakeup() override
     {
+        SysUtils::ScopedNotifier lockReleaseNotifier(m_wakeupEvt);
         lock_guard<recursive_mutex> lk(m_apiLock);
         if (!m_started)
         {
@@ -346,15 +375,19 @@ public:
         if (!m_quitThread || m_isImage)
             return;
 
-        int64_t readPos = m_seekPosUpdated ? m_seekPos : CvtPtsToMts(m_readPos);
         if (!OpenMedia(m_hParser))
         {
             m_logger->Log(Error) << "FAILED to re-open media when waking up this MediaReader!" << endl;
             return;
         }
-        m_seekPos = readPos;
-        m_seekPosUpdated = true;
-        m_inSeeking = true;
+        {
+            // 'SeekTo()' doesn't take the api lock, a seek made while the media is opened is kept
+            lock_guard<mutex> _lk(m_seekPosLock);
+            if (!m_seekPosUpdated)
+                m_seekPos = CvtPtsToMts(m_readPos);
+            m_seekPosUpdated = true;
+            m_inSeeking = true;
+        }
         StartAllThreads();
     }
 
@@ -396,8 +429,8 @@ public:
             eof = false;
             return nullptr;
         }
-        while (!m_quitThread && !m_prepared && wait)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        if (wait)
+            m_wakeupEvt.WaitUntil([this] { return m_prepared || m_quitThread; });
         if (m_close || !m_prepared)
         {
             m_errMsg = "This 'VideoReader' instance is NOT READY to read!";
@@ -426,8 +459,11 @@ public:
         auto wait0 = wait1;
         const int64_t hungupWarnInternal = 3000;
         VideoFrame::Holder hVfrm;
+        bool isScrubFrame = false;
+        bool frameCacheChecked = false;
         while (!m_quitThread)
         {
+            const uint64_t wakeupSeq = m_wakeupEvt.Sequence();
             // if (pts < m_cacheRange.first || pts > m_cacheRange.second)
             //     break;
             if (!m_inSeeking)
@@ -456,10 +492,32 @@ public:
                 }
                 if (hVfrm)
                     break;
+                // take the nearest decoded frame, it's not remembered as the read result since it's not the exact one
+                if (m_scrubMode && !m_vfrmQ.empty())
+                {
+                    hVfrm = iter == m_vfrmQ.begin() ? m_vfrmQ.front() : m_vfrmQ.back();
+                    isScrubFrame = true;
+                    break;
+                }
+            }
+            // another reader of the same source may have the frame converted already. The frames read with 'SetKeepHwFrames()'
+            // are taken as AVFrames, which the cache can not provide.
+            if (!frameCacheChecked && m_hFrameCache && !m_keepHwFrames)
+            {
+                frameCacheChecked = true;
+                ImGui::ImMat vmat;
+                if (m_hFrameCache->Get(m_frmCacheKey, pts, vmat, m_vidfrmIntvPts-1))
+                {
+                    vmat.time_stamp = (double)pos/1000;
+                    auto pVf = new VideoFrame_Impl(this, nullptr, pos, pts, m_vidfrmIntvPts, false);
+                    pVf->vmat = vmat;
+                    hVfrm = VideoFrame::Holder(pVf, VIDEO_READER_VIDEO_FRAME_HOLDER_DELETER);
+                    break;
+                }
             }
             if (!wait)
                 break;
-            this_thread::sleep_for(chrono::milliseconds(2));
+            m_wakeupEvt.Wait(wakeupSeq, m_idleWaitTimeout);
             auto wait2 = GetTimePoint();
             if (CountElapsedMillisec(wait1, wait2) > 3000)
             {
@@ -478,7 +536,8 @@ public:
             eof = true;
         }
 
-        m_prevReadResult = {pos, hVfrm};
+        if (!isScrubFrame)
+            m_prevReadResult = {pos, hVfrm};
         return hVfrm;
     }
 
@@ -537,6 +596,83 @@ public:
         throw runtime_error("VideoReader does NOT SUPPORT method GetCacheDuration()!");
     }
 
+    void SetReverseBufferFrames(uint32_t frames) override
+    {
+        m_reverseBufferFrames = frames;
+    }
+
+    void SetMemoryPriority(int32_t priority) override
+    {
+        m_memPriority = priority;
+    }
+
+    void EnableScrubMode(bool enable) override
+    {
+        if (m_scrubMode == enable)
+            return;
+        m_logger->Log(DEBUG) << (enable ? "Enter" : "Quit") << " scrub mode." << endl;
+        m_scrubMode = enable;
+        m_wakeupEvt.Notify();
+    }
+
+    bool IsScrubModeEnabled() const override
+    {
+        return m_scrubMode;
+    }
+
+    int32_t GetMemoryPrioritySetting() const override
+    {
+        return m_memPriority;
+    }
+
+    void ResetReadState() override
+    {
+        lock_guard<recursive_mutex> lk(m_apiLock);
+        if (m_opened)
+            SetDirection(true);
+        EnableScrubMode(false);
+        m_memPriority = MemoryGovernor::PRIORITY_NORMAL;
+        m_prevReadResult = {0, nullptr};
+    }
+
+    string GetMemoryConsumerName() const override
+    {
+        return m_logger->GetName();
+    }
+
+    uint64_t GetMemoryUsage() const override
+    {
+        return m_memUsage.load();
+    }
+
+    int32_t GetMemoryPriority() const override
+    {
+        return IsSuspended() ? (int32_t)MemoryGovernor::PRIORITY_IDLE : m_memPriority.load();
+    }
+
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        // only the frames behind the read position can be dropped, the ones ahead can not be decoded again without seeking
+        if (!m_readForward)
+            return 0;
+        uint32_t removeCnt = 0;
+        lock_guard<mutex> _lk(m_vfrmQLock);
+        const uint64_t frameBytes = EstimateFrameBytes();
+        auto iter = m_vfrmQ.begin();
+        while (iter != m_vfrmQ.end() && (uint64_t)removeCnt*frameBytes < bytes)
+        {
+            VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(iter->get());
+            if (pVf->pts+pVf->dur >= m_readPos || (pVf->isEofFrame && m_vfrmQ.size() == 1))
+                break;
+            iter = m_vfrmQ.erase(iter);
+            removeCnt++;
+        }
+        UpdateMemoryUsage_l();
+        if (removeCnt > 0)
+            m_logger->Log(DEBUG) << "Shrink: removed " << removeCnt << " cached frames behind the read position." << endl;
+        return (uint64_t)removeCnt*frameBytes;
+    }
+
     MediaInfo::Holder GetMediaInfo() const override
     {
         return m_hMediaInfo;
@@ -609,6 +745,16 @@ public:
         m_vidPreferUseHw = enable;
     }
 
+    void SetVideoConvertThreadCount(uint32_t count) override
+    {
+        m_cvtThreadCount = count;
+    }
+
+    void SetKeepHwFrames(bool keep) override
+    {
+        m_keepHwFrames = keep;
+    }
+
     void SetLogLevel(Logger::Level l) override
     {
         m_logger->SetShowLevels(l);
@@ -694,21 +840,9 @@ private:
         m_prepared = false;
     }
 
+    // called from the demuxing task with 'm_apiLock' held
     bool Prepare()
     {
-        bool locked = false;
-        do {
-            locked = m_apiLock.try_lock();
-            if (!locked)
-                this_thread::sleep_for(chrono::milliseconds(5));
-        } while (!locked && !m_quitThread);
-        if (m_quitThread)
-        {
-            m_logger->Log(WARN) << "Abort 'Prepare' procedure! 'm_quitThread' is set!" << endl;
-            return false;
-        }
-
-        lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
         int fferr;
         fferr = avformat_find_stream_info(m_avfmtCtx, nullptr);
         if (fferr < 0)
@@ -722,9 +856,14 @@ private:
         m_vidTimeBase = m_vidAvStm->time_base;
         m_vidDurationPts = m_vidAvStm->duration != AV_NOPTS_VALUE ? m_vidAvStm->duration : CvtMtsToPts(m_vidDurMts);
         m_vidfrmIntvPts = av_rescale_q(1, av_inv_q(m_vidAvStm->r_frame_rate), m_vidAvStm->time_base);
+        m_frmIdxEntriesAdded = false;
+        AddFrameIndexEntries();
 
         m_viddecOpenOpts.onlyUseSoftwareDecoder = !m_vidPreferUseHw;
         m_viddecOpenOpts.useHardwareType = m_vidUseHwType;
+        // let the decoder output reduced resolution pictures when the output images are small enough
+        m_viddecOpenOpts.minPictureWidth = m_useSizeFactor ? (uint32_t)ceil(m_vidAvStm->codecpar->width*m_ssWFactor) : m_outWidth;
+        m_viddecOpenOpts.minPictureHeight = m_useSizeFactor ? (uint32_t)ceil(m_vidAvStm->codecpar->height*m_ssHFactor) : m_outHeight;
         FFUtils::OpenVideoDecoderResult res;
         if (FFUtils::OpenVideoDecoder(m_avfmtCtx, -1, &m_viddecOpenOpts, &res))
         {
@@ -779,9 +918,27 @@ private:
                 m_errMsg = m_pFrmCvt->GetError();
                 return false;
             }
+            if (!m_pFrmCvt->SetThreadCount(m_cvtThreadCount))
+            {
+                m_errMsg = m_pFrmCvt->GetError();
+                return false;
+            }
+        }
+        if (!m_isImage)
+        {
+            m_hFrameCache = VideoFrameCache::GetDefaultInstance();
+            m_frmCacheKey.url = m_hParser->GetUrl();
+            m_frmCacheKey.streamIndex = m_vidStmIdx;
+            m_frmCacheKey.width = m_pFrmCvt->GetOutWidth();
+            m_frmCacheKey.height = m_pFrmCvt->GetOutHeight();
+            m_frmCacheKey.clrfmt = m_pFrmCvt->GetOutColorFormat();
+            m_frmCacheKey.dtype = m_pFrmCvt->GetOutDataType();
+            m_frmCacheKey.interp = m_pFrmCvt->GetResizeInterpolateMode();
+            m_frmCacheKey.useVulkan = m_pFrmCvt->IsUseVulkanConverter();
         }
 
         m_prepared = true;
+        m_wakeupEvt.Notify();
         {
             lock_guard<mutex> lk(m_seekPosLock);
             int64_t readPos = !m_seekPosUpdated ? m_vidStartTime : CvtMtsToPts(m_seekPos);
@@ -790,49 +947,82 @@ private:
         return true;
     }
 
+    // For the demuxers relying on the generic index, feeding the key frames of the frame index lets 'avformat_seek_file()'
+    // jump to the byte offset instead of searching by reading packets. The index is only there if it's enabled on the parser,
+    // which builds it in the background, so this is tried again before the seeks until the index is ready.
+    void AddFrameIndexEntries()
+    {
+        if (m_frmIdxEntriesAdded || m_isImage || !m_avfmtCtx || !m_vidAvStm)
+            return;
+        auto hFrmIdx = m_hParser->GetVideoFrameIndex(false);
+        if (!hFrmIdx)
+            return;
+        if ((m_avfmtCtx->iformat->flags&AVFMT_GENERIC_INDEX) != 0)
+        {
+            for (uint32_t frmIdx : hFrmIdx->keyFrames)
+            {
+                auto& frm = hFrmIdx->frames[frmIdx];
+                int64_t ts = frm.dts != AV_NOPTS_VALUE ? frm.dts : frm.pts;
+                if (frm.pos >= 0 && ts != AV_NOPTS_VALUE)
+                    av_add_index_entry(m_vidAvStm, frm.pos, ts, 0, 0, AVINDEX_KEYFRAME);
+            }
+            m_logger->Log(DEBUG) << "Added " << hFrmIdx->keyFrames.size() << " key frames of the frame index to the demuxer." << endl;
+        }
+        m_frmIdxEntriesAdded = true;
+    }
+
     void StartAllThreads()
     {
         string fileName = SysUtils::ExtractFileName(m_hParser->GetUrl());
         ostringstream thnOss;
         m_quitThread = false;
-        m_dmxThdRunning = true;
-        m_demuxThread = thread(&VideoReader_Impl::DemuxThreadProc, this);
+        m_demuxTaskCtx = DemuxTaskContext();
         thnOss << "VrdrDmx-" << fileName;
-        SysUtils::SetThreadName(m_demuxThread, thnOss.str());
-        m_decThdRunning = true;
-        m_decodeThread = thread(&VideoReader_Impl::DecodeThreadProc, this);
+        m_demuxTask = m_hExecutor->Submit(thnOss.str(), [this] { return DemuxThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+        m_decodeTaskCtx = DecodeTaskContext();
         thnOss.str(""); thnOss << "VrdrDec-" << fileName;
-        SysUtils::SetThreadName(m_decodeThread, thnOss.str());
-        m_cnvThdRunning = true;
-        m_cnvMatThread = thread(&VideoReader_Impl::ConvertMatThreadProc, this);
+        m_decodeTask = m_hExecutor->Submit(thnOss.str(), [this] { return DecodeThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
+        m_cnvMatTaskEntered = false;
         thnOss.str(""); thnOss << "VrdrCmt-" << fileName;
-        SysUtils::SetThreadName(m_cnvMatThread, thnOss.str());
+        m_cnvMatTask = m_hExecutor->Submit(thnOss.str(), [this] { return ConvertMatThreadProc(); }, &m_wakeupEvt, m_idleWaitTimeout);
     }
 
     void WaitAllThreadsQuit(bool callFromReleaseProc = false)
     {
         m_quitThread = true;
-        if (m_demuxThread.joinable())
+        m_wakeupEvt.Notify();
+        if (m_demuxTask)
         {
-            m_demuxThread.join();
-            m_demuxThread = thread();
+            m_demuxTask->Join();
+            m_demuxTask = nullptr;
         }
-        if (m_decodeThread.joinable())
+        if (m_decodeTask)
         {
-            m_decodeThread.join();
-            m_decodeThread = thread();
+            m_decodeTask->Join();
+            m_decodeTask = nullptr;
         }
-        if (m_cnvMatThread.joinable())
+        if (m_cnvMatTask)
         {
-            m_cnvMatThread.join();
-            m_cnvMatThread = thread();
+            m_cnvMatTask->Join();
+            m_cnvMatTask = nullptr;
         }
     }
 
     void FlushAllQueues()
     {
         m_vpktQ.clear();
+        lock_guard<mutex> _lk(m_vfrmQLock);
         m_vfrmQ.clear();
+        UpdateMemoryUsage_l();
+    }
+
+    // report the change of the memory taken by 'm_vfrmQ' to the governor, 'm_vfrmQLock' must be held when calling this method
+    void UpdateMemoryUsage_l()
+    {
+        const uint64_t usage = (uint64_t)m_vfrmQ.size()*EstimateFrameBytes();
+        const uint64_t prevUsage = m_memUsage.exchange(usage);
+        if (usage != prevUsage)
+            m_hMemGov->ReportUsageChange((int64_t)usage-(int64_t)prevUsage);
     }
 
     struct VideoPacket
@@ -842,6 +1032,8 @@ private:
         bool isAfterSeek{false};
         bool needFlushVfrmQ{false};
         bool isStartPacket{false};
+        // when reading backward, the frames decoded from this packet with pts less than this are beyond the reverse buffer
+        int64_t keepFromPts{INT64_MIN};
     };
 
     void UpdateReadPos(int64_t readPts)
@@ -858,6 +1050,7 @@ private:
             m_cacheRange.first--;
             m_cacheRange.second++;
         }
+        m_wakeupEvt.Notify();
     }
 
     struct VideoFrame_Impl : public VideoFrame
@@ -885,19 +1078,34 @@ private:
             // acquire the lock of 'frmPtr'
             while (!owner->m_quitThread)
             {
+                const uint64_t wakeupSeq = owner->m_wakeupEvt.Sequence();
                 bool testVal = false;
                 if (frmPtrInUse.compare_exchange_strong(testVal, true))
                     break;
-                this_thread::sleep_for(chrono::milliseconds(5));
+                owner->m_wakeupEvt.Wait(wakeupSeq, owner->m_idleWaitTimeout);
+            }
+            // the convert task may have taken the frame from the shared frame cache meanwhile
+            if (!vmat.empty())
+            {
+                frmPtrInUse = false;
+                owner->m_wakeupEvt.Notify();
+                m = vmat;
+                return true;
             }
 
-            // avframe -> ImMat
+            // avframe -> ImMat, unless another reader of the same source has converted this frame already
             double ts = (double)pos/1000;
-            if (!owner->m_pFrmCvt->ConvertImage(frmPtr.get(), vmat, ts))
+            auto& hFrameCache = owner->m_hFrameCache;
+            if (hFrameCache && hFrameCache->Get(owner->m_frmCacheKey, pts, vmat))
+                vmat.time_stamp = ts;
+            else if (!owner->m_pFrmCvt->ConvertImage(frmPtr.get(), vmat, ts))
                 owner->m_logger->Log(Error) << "AVFrameToImMatConverter::ConvertImage() FAILED at pos " << pos << "(" << pts << ")!" << endl;
+            else if (hFrameCache && owner->IsNearFrameCacheTarget(pts))
+                hFrameCache->Put(owner->m_frmCacheKey, pts, vmat);
             frmPtr = nullptr;
             isHwfrm = false;
             frmPtrInUse = false;
+            owner->m_wakeupEvt.Notify();
 
             if (vmat.empty())
                 return false;
@@ -905,6 +1113,25 @@ private:
             return true;
         }
 
+        shared_ptr<AVFrame> GetAVFrame() override
+        {
+            // acquire the lock of 'frmPtr'
+            while (!owner->m_quitThread)
+            {
+                const uint64_t wakeupSeq = owner->m_wakeupEvt.Sequence();
+                bool testVal = false;
+                if (frmPtrInUse.compare_exchange_strong(testVal, true))
+                    break;
+                owner->m_wakeupEvt.Wait(wakeupSeq, owner->m_idleWaitTimeout);
+            }
+            if (owner->m_quitThread)
+                return nullptr;
+            SelfFreeAVFramePtr avfrm = frmPtr;
+            frmPtrInUse = false;
+            owner->m_wakeupEvt.Notify();
+            return avfrm;
+        }
+
         int64_t Pos() const override { return pos; }
         int64_t Pts() const override { return pts; }
         int64_t Dur() const override { return dur; }
@@ -926,30 +1153,89 @@ private:
 
     static const function<void (VideoFrame*)> VIDEO_READER_VIDEO_FRAME_HOLDER_DELETER;
 
-    void DemuxThreadProc()
+    uint64_t EstimateFrameBytes() const
     {
-        m_logger->Log(DEBUG) << "Enter DemuxThreadProc()..." << endl;
+        uint32_t elemSize = 1;
+        if (m_outDtype == IM_DT_INT16 || m_outDtype == IM_DT_INT16_BE || m_outDtype == IM_DT_FLOAT16)
+            elemSize = 2;
+        else if (m_outDtype == IM_DT_INT32 || m_outDtype == IM_DT_FLOAT32)
+            elemSize = 4;
+        else if (m_outDtype == IM_DT_INT64 || m_outDtype == IM_DT_FLOAT64)
+            elemSize = 8;
+        return (uint64_t)GetVideoOutWidth()*GetVideoOutHeight()*4*elemSize;
+    }
+
+    // Only the frames around the latest seek target are put into the shared frame cache, same as the generic MediaReader.
+    bool IsNearFrameCacheTarget(int64_t pts)
+    {
+        const int64_t targetPts = CvtMtsToPts(m_frmCacheTargetPos);
+        return pts >= targetPts-m_vidfrmIntvPts*FRAME_CACHE_TARGET_FRAMES && pts <= targetPts+m_vidfrmIntvPts*FRAME_CACHE_TARGET_FRAMES;
+    }
 
-        if (!m_prepared && !Prepare())
+    // states of the demuxing task that are kept between the steps
+    struct DemuxTaskContext
+    {
+        bool entered{false};
+        bool demuxEof{false};
+        bool needSeek{false};
+        bool needFlushVfrmQ{false};
+        bool afterSeek{false};
+        bool readForward{true};
+        int64_t lastPktPts{INT64_MIN};
+        int64_t minPtsAfterSeek{INT64_MAX};
+        int64_t backwardReadLimitPts{INT64_MIN};
+        int64_t chunkKeepFromPts{INT64_MIN};
+        int64_t seekPts{INT64_MIN};
+        list<int64_t> ptsList;
+        bool needPtsSafeCheck{true};
+        bool nullPktSent{false};
+        bool isStartPacket{true};
+    };
+
+    ThreadPoolExecutor::StepResult DemuxThreadProc()
+    {
+        auto& ctx = m_demuxTaskCtx;
+        if (!ctx.entered)
         {
-            m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
-            return;
+            m_logger->Log(DEBUG) << "Enter DemuxThreadProc()..." << endl;
+            ctx.readForward = m_readForward;
+            ctx.entered = true;
+        }
+        if (!m_prepared)
+        {
+            if (m_quitThread)
+            {
+                m_logger->Log(WARN) << "Abort 'Prepare' procedure! 'm_quitThread' is set!" << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
+            // the api lock is usually held shortly by the api which starts this task, that api notifies
+            // 'm_wakeupEvt' after releasing the lock
+            if (!m_apiLock.try_lock())
+                return ThreadPoolExecutor::STEP_IDLE;
+            lock_guard<recursive_mutex> lk(m_apiLock, adopt_lock);
+            if (!Prepare())
+            {
+                m_logger->Log(Error) << "Prepare() FAILED! Error is '" << m_errMsg << "'." << endl;
+                return ThreadPoolExecutor::STEP_DONE;
+            }
         }
 
         int fferr;
-        bool demuxEof = false;
-        bool needSeek = false;
-        bool needFlushVfrmQ = false;
-        bool afterSeek = false;
-        bool readForward = m_readForward;
-        int64_t lastPktPts = INT64_MIN, minPtsAfterSeek = INT64_MAX;
-        int64_t backwardReadLimitPts;
-        int64_t seekPts = INT64_MIN;
-        list<int64_t> ptsList;
-        bool needPtsSafeCheck = true;
-        bool nullPktSent = false;
-        bool isStartPacket = true;
-        while (!m_quitThread)
+        bool& demuxEof = ctx.demuxEof;
+        bool& needSeek = ctx.needSeek;
+        bool& needFlushVfrmQ = ctx.needFlushVfrmQ;
+        bool& afterSeek = ctx.afterSeek;
+        bool& readForward = ctx.readForward;
+        int64_t& lastPktPts = ctx.lastPktPts;
+        int64_t& minPtsAfterSeek = ctx.minPtsAfterSeek;
+        int64_t& backwardReadLimitPts = ctx.backwardReadLimitPts;
+        int64_t& chunkKeepFromPts = ctx.chunkKeepFromPts;
+        int64_t& seekPts = ctx.seekPts;
+        list<int64_t>& ptsList = ctx.ptsList;
+        bool& needPtsSafeCheck = ctx.needPtsSafeCheck;
+        bool& nullPktSent = ctx.nullPktSent;
+        bool& isStartPacket = ctx.isStartPacket;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
 
@@ -988,6 +1274,7 @@ private:
                         else
                             iter++;
                     }
+                    UpdateMemoryUsage_l();
                     if (m_vfrmQ.empty())
                         backwardReadLimitPts = m_readPos;
                     else
@@ -1031,6 +1318,7 @@ private:
             if (needSeek)
             {
                 needSeek = false;
+                AddFrameIndexEntries();
                 // seek to the new position
                 m_logger->Log(VERBOSE) << "--> Seek[1]: Demux seek to " << (double)CvtPtsToMts(seekPts)/1000 << "(" << seekPts << ")." << endl;
                 fferr = avformat_seek_file(m_avfmtCtx, m_vidStmIdx, INT64_MIN, seekPts, seekPts, 0);
@@ -1044,6 +1332,13 @@ private:
                 demuxEof = false;
                 afterSeek = true;
                 isStartPacket = true;
+                // backward, the packets from the key frame up to 'backwardReadLimitPts' make a chunk, of which the decoder
+                // only keeps the top 'm_reverseBufferFrames' frames
+                const uint32_t reverseBufferFrames = m_reverseBufferFrames;
+                if (!m_readForward && reverseBufferFrames > 0)
+                    chunkKeepFromPts = backwardReadLimitPts-(int64_t)reverseBufferFrames*m_vidfrmIntvPts;
+                else
+                    chunkKeepFromPts = INT64_MIN;
             }
 
             // check read packet condition
@@ -1108,8 +1403,12 @@ private:
                 }
                 else if (!m_readForward)
                 {
-                    // under backward playback state, we need to pre-read and decode frames before the read-pos
-                    if (minPtsAfterSeek >= m_cacheRange.first && minPtsAfterSeek > m_vidStartTime)
+                    // under backward playback state, we need to pre-read and decode frames before the read-pos.
+                    // The next chunk ends right below the frames kept from this one, and it's requested half a reverse buffer
+                    // ahead, so it's decoded while the frames of this chunk are being read.
+                    const int64_t chunkBottomPts = max(minPtsAfterSeek, chunkKeepFromPts);
+                    const int64_t reverseLeadPts = m_readPos-(int64_t)(m_reverseBufferFrames/2)*m_vidfrmIntvPts;
+                    if ((chunkBottomPts >= m_cacheRange.first || chunkBottomPts >= reverseLeadPts) && chunkBottomPts > m_vidStartTime)
                     {
                         if (seekPts <= m_vidStartTime)
                         {
@@ -1117,7 +1416,7 @@ private:
                         }
                         else
                         {
-                            backwardReadLimitPts = minPtsAfterSeek-1;
+                            backwardReadLimitPts = chunkBottomPts-1;
                             if (backwardReadLimitPts > m_readPos)
                             {
                                 backwardReadLimitPts = m_readPos;
@@ -1158,6 +1457,7 @@ private:
                         nullPktSent = false;
                         VideoPacket::Holder hVpkt(new VideoPacket({pktPtr, afterSeek, needFlushVfrmQ}));
                         hVpkt->isStartPacket = isStartPacket; isStartPacket = false;
+                        hVpkt->keepFromPts = chunkKeepFromPts;
                         afterSeek = needFlushVfrmQ = false;
                         if (pktPtr->pts >= m_vidStartTime && pktPtr->pts <= m_vidDurationPts) lastPktPts = pktPtr->pts;
                         lock_guard<mutex> _lk(m_vpktQLock);
@@ -1185,24 +1485,44 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
-        m_dmxThdRunning = false;
+        ctx.ptsList.clear();
         m_logger->Log(DEBUG) << "Leave DemuxThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void DecodeThreadProc()
+    // states of the decoding task that are kept between the steps
+    struct DecodeTaskContext
     {
-        m_logger->Log(DEBUG) << "Enter DecodeThreadProc()..." << endl;
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        bool entered{false};
+        bool decoderEof{false};
+        bool nullPktSent{false};
+        bool isStartFrame{false};
+        int64_t keepFromPts{INT64_MIN};
+        VideoFrame::Holder hPrevFrm;
+    };
+
+    ThreadPoolExecutor::StepResult DecodeThreadProc()
+    {
+        auto& ctx = m_decodeTaskCtx;
+        if (!ctx.entered)
+        {
+            m_logger->Log(DEBUG) << "Enter DecodeThreadProc()..." << endl;
+            ctx.entered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
 
         int fferr;
-        bool decoderEof = false;
-        bool nullPktSent = false;
-        bool isStartFrame = false;
-        VideoFrame::Holder hPrevFrm;
-        while (!m_quitThread)
+        bool& decoderEof = ctx.decoderEof;
+        bool& nullPktSent = ctx.nullPktSent;
+        bool& isStartFrame = ctx.isStartFrame;
+        int64_t& keepFromPts = ctx.keepFromPts;
+        VideoFrame::Holder& hPrevFrm = ctx.hPrevFrm;
+        if (!m_quitThread)
         {
             bool idleLoop = true;
 
@@ -1237,6 +1557,7 @@ private:
                             isStartFrame = false;
                             lock_guard<mutex> _lk(m_vfrmQLock);
                             m_vfrmQ.clear();
+                            UpdateMemoryUsage_l();
                         }
                         m_inSeeking = false;
                     }
@@ -1257,17 +1578,25 @@ private:
             }
 
             // retrieve decoded frame
-            int64_t tailFramePts = INT64_MIN;
+            int64_t headFramePts = INT64_MAX, tailFramePts = INT64_MIN;
             {
                 lock_guard<mutex> _lk(m_vfrmQLock);
                 if (!m_vfrmQ.empty())
                 {
                     VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(m_vfrmQ.back().get());
                     tailFramePts = pVf->pts;
+                    headFramePts = m_vfrmQ.front()->Pts();
                 }
             }
-            bool doDecode = !decoderEof && m_pendingHwfrmCnt <= m_maxPendingHwfrmCnt
+            const int32_t maxPendingHwfrmCnt = m_keepHwFrames ? m_maxPendingHwfrmCnt+MAX_KEPT_HW_FRAMES : m_maxPendingHwfrmCnt;
+            bool doDecode = !decoderEof && m_pendingHwfrmCnt <= maxPendingHwfrmCnt
                     && (tailFramePts < m_cacheRange.second || !m_readForward);
+            // in scrub mode, a frame at or before the read position is good enough
+            if (doDecode && m_scrubMode && headFramePts <= m_readPos)
+                doDecode = false;
+            // once the frame at the read position is decoded, the forward cache only grows within the global memory budget
+            if (doDecode && m_readForward && tailFramePts >= m_readPos && !m_hMemGov->RequestMemory(this, EstimateFrameBytes()))
+                doDecode = false;
             if (doDecode)
             {
                 AVFrame* pAvfrm = av_frame_alloc();
@@ -1282,6 +1611,10 @@ private:
                         m_logger->Log(WARN) << "!! Got BAD video frame, pts=" << pAvfrm->pts << ", which is out of the video stream time range ["
                                 << m_vidStartTime << ", " << m_vidDurationPts << "]. DISCARD THIS FRAME." << endl;
                     }
+                    else if (!m_readForward && pAvfrm->pts < keepFromPts)
+                    {
+                        m_logger->Log(VERBOSE) << "Discard video frame: pts=" << pAvfrm->pts << ", which is beyond the reverse buffer." << endl;
+                    }
                     else
                     {
                         SelfFreeAVFramePtr frmPtr;
@@ -1291,6 +1624,7 @@ private:
                             frmPtr = SelfFreeAVFramePtr(pAvfrm, [this] (AVFrame* p) {
                                 av_frame_free(&p);
                                 m_pendingHwfrmCnt--;
+                                m_wakeupEvt.Notify();
                             });
                             m_pendingHwfrmCnt++;
                             isHwfrm = true;
@@ -1328,6 +1662,7 @@ private:
                             m_logger->Log(DEBUG) << "DISCARD duplicated VF@" << hVfrm->Pos() << "(" << hVfrm->Pts() << ")." << endl;
                         else
                             m_vfrmQ.insert(iter, hVfrm);
+                        UpdateMemoryUsage_l();
                     }
                     idleLoop = false;
                 }
@@ -1346,6 +1681,7 @@ private:
                         VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(hPrevFrm.get());
                         pVf->isEofFrame = true;
                         m_vfrmQ.push_back(hPrevFrm);
+                        UpdateMemoryUsage_l();
                     }
                 }
                 else if (fferr != AVERROR(EAGAIN))
@@ -1375,6 +1711,8 @@ private:
                 {
                     if (hVpkt->isStartPacket)
                         isStartFrame = true;
+                    if (pPkt)
+                        keepFromPts = hVpkt->keepFromPts;
                     popPkt = true;
                     idleLoop = false;
                 }
@@ -1393,19 +1731,26 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
-        m_decThdRunning = false;
+        ctx.hPrevFrm = nullptr;
         m_logger->Log(DEBUG) << "Leave DecodeThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
-    void ConvertMatThreadProc()
+    ThreadPoolExecutor::StepResult ConvertMatThreadProc()
     {
-        m_logger->Log(DEBUG) << "Enter ConvertMatThreadProc()..." << endl;
-        while (!m_prepared && !m_quitThread)
-            this_thread::sleep_for(chrono::milliseconds(5));
+        if (!m_cnvMatTaskEntered)
+        {
+            m_logger->Log(DEBUG) << "Enter ConvertMatThreadProc()..." << endl;
+            m_cnvMatTaskEntered = true;
+        }
+        if (!m_prepared && !m_quitThread)
+            return ThreadPoolExecutor::STEP_IDLE;
 
-        while (!m_quitThread)
+        if (!m_quitThread)
         {
             bool idleLoop = true;
 
@@ -1415,6 +1760,7 @@ private:
                 lock_guard<mutex> _lk(m_vfrmQLock);
                 auto iter = m_vfrmQ.begin();
                 bool firstGreaterPts = true;
+                int32_t keptHwfrmCnt = 0;
                 while (iter != m_vfrmQ.end())
                 {
                     VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(iter->get());
@@ -1444,26 +1790,28 @@ private:
                         iter = m_vfrmQ.erase(iter);
                         continue;
                     }
-                    if (!hVfrm && pVf->isHwfrm)
+                    if (!hVfrm && pVf->isHwfrm && (!m_keepHwFrames || ++keptHwfrmCnt > MAX_KEPT_HW_FRAMES))
                         hVfrm = *iter;
                     iter++;
                 }
+                UpdateMemoryUsage_l();
             }
 
-            // transfer hardware frame to software frame, to reduce the count of frames referenced from decoder
-            if (hVfrm)
+            // transfer hardware frame to software frame, to reduce the count of frames referenced from decoder.
+            // If the lock of 'frmPtr' is taken by the reader's user, it's retried after the user releases it and notifies 'm_wakeupEvt'.
+            bool testVal = false;
+            if (hVfrm && dynamic_cast<VideoFrame_Impl*>(hVfrm.get())->frmPtrInUse.compare_exchange_strong(testVal, true))
             {
                 VideoFrame_Impl* pVf = dynamic_cast<VideoFrame_Impl*>(hVfrm.get());
-                // acquire the lock of 'frmPtr'
-                while (!m_quitThread)
+                // the frame converted by another reader of the same source saves the download
+                ImGui::ImMat vmat;
+                if (!m_quitThread && pVf->frmPtr && m_hFrameCache && !m_keepHwFrames && m_hFrameCache->Get(m_frmCacheKey, pVf->pts, vmat))
                 {
-                    bool testVal = false;
-                    if (pVf->frmPtrInUse.compare_exchange_strong(testVal, true))
-                        break;
-                    this_thread::sleep_for(chrono::milliseconds(5));
+                    vmat.time_stamp = (double)pVf->pos/1000;
+                    pVf->vmat = vmat;
+                    pVf->frmPtr = nullptr;
                 }
-
-                if (!m_quitThread && pVf->frmPtr)
+                else if (!m_quitThread && pVf->frmPtr)
                 {
                     SelfFreeAVFramePtr swfrm = AllocSelfFreeAVFramePtr();
                     if (!TransferHwFrameToSwFrame(swfrm.get(), pVf->frmPtr.get()))
@@ -1473,6 +1821,7 @@ private:
                         lock_guard<mutex> _lk(m_vfrmQLock);
                         auto iter = find(m_vfrmQ.begin(), m_vfrmQ.end(), hVfrm);
                         if (iter != m_vfrmQ.end()) m_vfrmQ.erase(iter);
+                        UpdateMemoryUsage_l();
                     }
                     else
                     {
@@ -1485,10 +1834,12 @@ private:
             }
 
             if (idleLoop)
-                this_thread::sleep_for(chrono::milliseconds(5));
+                return ThreadPoolExecutor::STEP_IDLE;
+            m_wakeupEvt.Notify();
+            return ThreadPoolExecutor::STEP_BUSY;
         }
-        m_cnvThdRunning = false;
         m_logger->Log(DEBUG) << "Leave ConvertMatThreadProc()." << endl;
+        return ThreadPoolExecutor::STEP_DONE;
     }
 
 private:
@@ -1504,41 +1855,48 @@ private:
     bool m_prepared{false};
     bool m_close{false};
     bool m_quitThread{false};
+    SysUtils::WaitableEvent m_wakeupEvt;
+    uint32_t m_idleWaitTimeout{100};
     recursive_mutex m_apiLock;
 
     AVFormatContext* m_avfmtCtx{nullptr};
     int m_vidStmIdx{-1};
     AVStream* m_vidAvStm{nullptr};
+    bool m_frmIdxEntriesAdded{false};
     FFUtils::OpenVideoDecoderOptions m_viddecOpenOpts;
     AVCodecContext* m_viddecCtx{nullptr};
     bool m_vidPreferUseHw{true};
+    uint32_t m_cvtThreadCount{1};
+    bool m_keepHwFrames{false};
     AVHWDeviceType m_vidUseHwType{AV_HWDEVICE_TYPE_NONE};
     int64_t m_vidStartTime{0};
     int64_t m_vidDurationPts{0};
     AVRational m_vidTimeBase;
 
-    // demuxing thread
-    thread m_demuxThread;
-    bool m_dmxThdRunning{false};
+    ThreadPoolExecutor::Holder m_hExecutor{ThreadPoolExecutor::GetDefaultInstance()};
+    // demuxing task
+    ThreadPoolExecutor::Task::Holder m_demuxTask;
+    DemuxTaskContext m_demuxTaskCtx;
     list<VideoPacket::Holder> m_vpktQ;
     mutex m_vpktQLock;
     size_t m_vpktQMaxSize{8};
     int m_minGreaterPtsCountThanReadPos{2};
-    // video decoding thread
-    thread m_decodeThread;
-    bool m_decThdRunning{false};
+    // video decoding task
+    ThreadPoolExecutor::Task::Holder m_decodeTask;
+    DecodeTaskContext m_decodeTaskCtx;
     list<VideoFrame::Holder> m_vfrmQ;
-    mutex m_vfrmQLock;
+    mutable mutex m_vfrmQLock;
     atomic_int32_t m_pendingHwfrmCnt{0};
     int32_t m_maxPendingHwfrmCnt{2};
-    // convert hw frame to sw frame thread
-    thread m_cnvMatThread;
-    bool m_cnvThdRunning{false};
+    // convert hw frame to sw frame task
+    ThreadPoolExecutor::Task::Holder m_cnvMatTask;
+    bool m_cnvMatTaskEntered{false};
 
     int64_t m_readPos{0};
     pair<int64_t, int64_t> m_cacheRange;
     pair<int32_t, int32_t> m_forwardCacheFrameCount{1, 3};
     pair<int32_t, int32_t> m_backwardCacheFrameCount{8, 1};
+    atomic_uint32_t m_reverseBufferFrames{64};
     mutex m_cacheRangeLock;
     // pair<double, ImGui::ImMat> m_prevReadResult;
     pair<int64_t, VideoFrame::Holder> m_prevReadResult;
@@ -1557,6 +1915,15 @@ private:
     ImDataType m_outDtype;
     ImInterpolateMode m_interpMode;
     AVFrameToImMatConverter* m_pFrmCvt{nullptr};
+    VideoFrameCache::Holder m_hFrameCache;
+    VideoFrameCache::Key m_frmCacheKey;
+    // position of the latest seek in millisecond
+    atomic<int64_t> m_frmCacheTargetPos{0};
+    MemoryGovernor::Holder m_hMemGov;
+    atomic_int32_t m_memPriority{MemoryGovernor::PRIORITY_NORMAL};
+    // memory usage of 'm_vfrmQ' last reported to the governor
+    atomic_uint64_t m_memUsage{0};
+    atomic_bool m_scrubMode{false};
 };
 
 const function<void (MediaReader::VideoFrame*)> VideoReader_Impl::VIDEO_READER_VIDEO_FRAME_HOLDER_DELETER = [] (MediaReader::VideoFrame* p) {
@@ -283,6 +283,13 @@ public:
         m_quitThread = true;
         if (m_readThread.joinable())
             m_readThread.join();
+        thread prefetchThread;
+        {
+            lock_guard<mutex> lk(m_prefetchLock);
+            prefetchThread = move(m_prefetchThread);
+        }
+        if (prefetchThread.joinable())
+            prefetchThread.join();
         for (auto& rft : m_readFrameTasks)
             rft->SetDiscarded();
         m_readFrameTasks.clear();
@@ -319,6 +326,8 @@ public:
         // hClip->SetLogLevel(DEBUG);
         // add this clip into clip list 2
         hClip->SetDirection(m_readForward);
+        hClip->SetPrefetchWindow(m_prefetchWindow);
+        hClip->EnableScrubMode(m_scrubMode);
         hClip->SetTrackId(m_id);
         m_clips2.push_back(hClip);
         if (hClip->End() > m_duration2)
@@ -557,6 +566,26 @@ public:
         m_readForward = forward;
         for (auto& clip : m_clips)
             clip->SetDirection(forward);
+        m_prefetchClipId = -1;
+    }
+
+    void SetPrefetchWindow(int64_t window) override
+    {
+        if (window < 0) window = 0;
+        lock_guard<recursive_mutex> lk(m_clipChangeLock);
+        m_prefetchWindow = window;
+        for (auto& clip : m_clips2)
+            clip->SetPrefetchWindow(window);
+    }
+
+    void EnableScrubMode(bool enable) override
+    {
+        lock_guard<recursive_mutex> lk(m_clipChangeLock);
+        if (m_scrubMode == enable)
+            return;
+        m_scrubMode = enable;
+        for (auto& clip : m_clips2)
+            clip->EnableScrubMode(enable);
     }
 
     void SetVisible(bool visible) override
@@ -727,6 +756,7 @@ private:
                     }
                     for (auto& c : clips)
                         c->NotifyReadPos(readPos);
+                    RequestPrefetch(readPos, clips);
                 }
                 if (!pTask->IsSourceFrameReady())
                 {
@@ -763,6 +793,85 @@ private:
         m_logger->Log(DEBUG) << "----> SeekClipPos(" << readPos << ")" << endl;
         for (auto& c : m_clips)
             c->SeekTo(readPos-c->Start());
+        m_prefetchClipId = -1;
+        // the pending prefetch request was made for the old read position
+        m_seekGeneration++;
+    }
+
+    // find the next clip in the reading direction, and hand it to the prefetching thread if its boundary is within the window
+    void RequestPrefetch(int64_t readPos, const list<VideoClip::Holder>& clips)
+    {
+        if (m_prefetchWindow <= 0)
+            return;
+        VideoClip::Holder hNextClip;
+        if (m_readForward)
+        {
+            for (auto& c : clips)
+            {
+                if (c->Start() > readPos && (!hNextClip || c->Start() < hNextClip->Start()))
+                    hNextClip = c;
+            }
+            if (hNextClip && hNextClip->Start()-readPos > m_prefetchWindow)
+                hNextClip = nullptr;
+        }
+        else
+        {
+            for (auto& c : clips)
+            {
+                if (c->End() <= readPos && (!hNextClip || c->End() > hNextClip->End()))
+                    hNextClip = c;
+            }
+            if (hNextClip && readPos-hNextClip->End() > m_prefetchWindow)
+                hNextClip = nullptr;
+        }
+        if (!hNextClip || hNextClip->IsImage() || hNextClip->Id() == m_prefetchClipId)
+            return;
+
+        m_prefetchClipId = hNextClip->Id();
+        lock_guard<mutex> lk(m_prefetchLock);
+        m_prefetchClip = hNextClip;
+        m_prefetchPos = m_readForward ? 0 : hNextClip->Duration();
+        m_prefetchSeekGeneration = m_seekGeneration;
+        if (!m_prefetchScheduled)
+        {
+            m_prefetchScheduled = true;
+            // opening a cold reader blocks, so it runs on a thread of its own instead of the shared executor. The previous
+            // prefetching thread has already returned once 'm_prefetchScheduled' is cleared.
+            if (m_prefetchThread.joinable())
+                m_prefetchThread.join();
+            m_prefetchThread = thread(&VideoTrack_Impl::PrefetchProc, this);
+            SysUtils::SetThreadName(m_prefetchThread, m_logger->GetName()+"-pf");
+        }
+    }
+
+    // the prefetching thread runs while there are requests and quits when there is none
+    void PrefetchProc()
+    {
+        while (true)
+        {
+            VideoClip::Holder hClip;
+            int64_t clipPos;
+            {
+                lock_guard<mutex> lk(m_prefetchLock);
+                if (!m_prefetchClip || m_quitThread)
+                {
+                    m_prefetchClip = nullptr;
+                    m_prefetchScheduled = false;
+                    return;
+                }
+                hClip = m_prefetchClip;
+                clipPos = m_prefetchPos;
+                m_prefetchClip = nullptr;
+                // a seek after the request makes it stale
+                if (m_prefetchSeekGeneration != m_seekGeneration)
+                    hClip = nullptr;
+            }
+            if (hClip)
+            {
+                m_logger->Log(DEBUG) << "Prefetch clip#" << hClip->Id() << " at clip pos " << clipPos << "." << endl;
+                hClip->Prefetch(clipPos);
+            }
+        }
     }
 
     bool CheckClipRangeValid(int64_t clipId, int64_t start, int64_t end)
@@ -1021,6 +1130,16 @@ private:
     bool m_visible{true};
     thread m_readThread;
     bool m_quitThread{false};
+    int64_t m_prefetchWindow{2000};
+    bool m_scrubMode{false};
+    int64_t m_prefetchClipId{-1};
+    thread m_prefetchThread;
+    bool m_prefetchScheduled{false};
+    mutex m_prefetchLock;
+    VideoClip::Holder m_prefetchClip;
+    int64_t m_prefetchPos{0};
+    uint32_t m_prefetchSeekGeneration{0};
+    atomic<uint32_t> m_seekGeneration{0};
     list<ReadFrameTask::Holder> m_readFrameTasks;
     mutex m_readFrameTasksLock;
 };
@@ -1042,11 +1161,13 @@ VideoTrack::Holder VideoTrack_Impl::Clone(SharedSettings::Holder hSettings)
         UpdateClipState();
 
     VideoTrack_Impl* newInstance = new VideoTrack_Impl(m_id, hSettings);
+    newInstance->m_prefetchWindow = m_prefetchWindow;
     // duplicate the clips
     for (auto clip : m_clips)
     {
         auto newClip = clip->Clone(hSettings);
         newClip->SetTrackId(m_id);
+        newClip->SetPrefetchWindow(m_prefetchWindow);
         newInstance->m_clips2.push_back(newClip);
         newInstance->m_clipChanged = true;
         newInstance->UpdateClipState();
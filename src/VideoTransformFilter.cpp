@@ -156,6 +156,11 @@ namespace MediaCore
             return m_filter->SetKeyPoint(keypoint);
         }
 
+        bool SetSourceSize(uint32_t width, uint32_t height) override
+        {
+            return m_filter->SetSourceSize(width, height);
+        }
+
         uint32_t GetInWidth() const override
         {
             return m_filter->GetInWidth();
@@ -166,6 +171,16 @@ namespace MediaCore
             return m_filter->GetInHeight();
         }
 
+        uint32_t GetSourceWidth() const override
+        {
+            return m_filter->GetSourceWidth();
+        }
+
+        uint32_t GetSourceHeight() const override
+        {
+            return m_filter->GetSourceHeight();
+        }
+
         uint32_t GetOutWidth() const override
         {
             return m_filter->GetOutWidth();
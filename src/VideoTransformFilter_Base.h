@@ -32,6 +32,12 @@ namespace MediaCore
         uint32_t GetInHeight() const override
         { return m_inHeight; }
 
+        uint32_t GetSourceWidth() const override
+        { return m_srcWidth; }
+
+        uint32_t GetSourceHeight() const override
+        { return m_srcHeight; }
+
         uint32_t GetOutWidth() const override
         { return m_outWidth; }
 
@@ -212,6 +218,18 @@ namespace MediaCore
             return true;
         }
 
+        bool SetSourceSize(uint32_t width, uint32_t height) override
+        {
+            std::lock_guard<std::recursive_mutex> lk(m_processLock);
+            if (m_srcWidth == width && m_srcHeight == height)
+                return true;
+            m_srcWidth = width;
+            m_srcHeight = height;
+            m_needUpdateScaleParam = true;
+            m_needUpdateCropParam = true;
+            return true;
+        }
+
         // new API
         bool SetPositionOffset(float offsetH, float offsetV) override
         {
@@ -318,8 +336,16 @@ namespace MediaCore
         std::string GetError() const override
         { return m_errMsg; }
 
+    protected:
+        uint32_t RefWidth() const
+        { return m_srcWidth > 0 ? m_srcWidth : m_inWidth; }
+
+        uint32_t RefHeight() const
+        { return m_srcHeight > 0 ? m_srcHeight : m_inHeight; }
+
     protected:
         uint32_t m_inWidth{0}, m_inHeight{0};
+        uint32_t m_srcWidth{0}, m_srcHeight{0};
         uint32_t m_outWidth{0}, m_outHeight{0};
         std::string m_outputFormat;
         ScaleType m_scaleType{SCALE_TYPE__FIT};
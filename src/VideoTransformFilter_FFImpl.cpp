@@ -20,6 +20,7 @@
 #include <cmath>
 #include "VideoTransformFilter_FFImpl.h"
 #include "FFUtils.h"
+#include "MatUtils.h"
 #include "Logger.h"
 extern "C"
 {
@@ -327,22 +328,27 @@ namespace MediaCore
         return true;
     }
 
-    bool VideoTransformFilter_FFImpl::PerformCropStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    void VideoTransformFilter_FFImpl::UpdateCropParam()
     {
         if (m_needUpdateCropParamScale)
         {
-            m_cropL = m_inWidth * m_fcropL;
-            m_cropR = m_inWidth * m_fcropR;
-            m_cropT = m_inHeight * m_fcropT;
-            m_cropB = m_inHeight * m_fcropB;
+            m_cropL = RefWidth() * m_fcropL;
+            m_cropR = RefWidth() * m_fcropR;
+            m_cropT = RefHeight() * m_fcropT;
+            m_cropB = RefHeight() * m_fcropB;
             m_needUpdateCropParamScale = false;
             m_needUpdateCropParam = true;
         }
         
         if (m_needUpdateCropParam)
         {
-            uint32_t rectX = m_cropL<m_inWidth ? m_cropL : m_inWidth-1;
-            uint32_t rectX1 = m_cropR<m_inWidth ? m_inWidth-m_cropR : 0;
+            // the crop margins are in the pixels of the source, map them to the input image
+            const uint32_t cropL = (uint32_t)round((double)m_cropL*m_inWidth/RefWidth());
+            const uint32_t cropR = (uint32_t)round((double)m_cropR*m_inWidth/RefWidth());
+            const uint32_t cropT = (uint32_t)round((double)m_cropT*m_inHeight/RefHeight());
+            const uint32_t cropB = (uint32_t)round((double)m_cropB*m_inHeight/RefHeight());
+            uint32_t rectX = cropL<m_inWidth ? cropL : m_inWidth-1;
+            uint32_t rectX1 = cropR<m_inWidth ? m_inWidth-cropR : 0;
             uint32_t rectW;
             if (rectX < rectX1)
                 rectW = rectX1-rectX;
@@ -351,8 +357,8 @@ namespace MediaCore
                 rectW = rectX-rectX1;
                 rectX = rectX1;
             }
-            uint32_t rectY = m_cropT<m_inHeight ? m_cropT : m_inHeight-1;
-            uint32_t rectY1 = m_cropB<m_inHeight ? m_inHeight-m_cropB : 0;
+            uint32_t rectY = cropT<m_inHeight ? cropT : m_inHeight-1;
+            uint32_t rectY1 = cropB<m_inHeight ? m_inHeight-cropB : 0;
             uint32_t rectH;
             if (rectY < rectY1)
                 rectH = rectY1-rectY;
@@ -364,6 +370,11 @@ namespace MediaCore
             m_cropRectX = rectX; m_cropRectY = rectY;
             m_cropRectW = rectW; m_cropRectH = rectH;
         }
+    }
+
+    bool VideoTransformFilter_FFImpl::PerformCropStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    {
+        UpdateCropParam();
         if (m_cropL != 0 || m_cropR != 0 || m_cropT != 0 || m_cropB != 0)
         {
             if (!avfrmPtr->data[0])
@@ -412,46 +423,53 @@ namespace MediaCore
         return true;
     }
 
-    bool VideoTransformFilter_FFImpl::PerformScaleStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    void VideoTransformFilter_FFImpl::CalcFitScaleSize(uint32_t& fitScaleWidth, uint32_t& fitScaleHeight)
     {
-        if (m_needUpdateScaleParam)
+        fitScaleWidth = m_inWidth;
+        fitScaleHeight = m_inHeight;
+        switch (m_scaleType)
         {
-            uint32_t fitScaleWidth{m_inWidth}, fitScaleHeight{m_inHeight};
-            switch (m_scaleType)
+            case SCALE_TYPE__FIT:
+            if (m_inWidth*m_outHeight > m_inHeight*m_outWidth)
             {
-                case SCALE_TYPE__FIT:
-                if (m_inWidth*m_outHeight > m_inHeight*m_outWidth)
-                {
-                    fitScaleWidth = m_outWidth;
-                    fitScaleHeight = (uint32_t)round((double)m_inHeight*m_outWidth/m_inWidth);
-                }
-                else
-                {
-                    fitScaleHeight = m_outHeight;
-                    fitScaleWidth = (uint32_t)round((double)m_inWidth*m_outHeight/m_inHeight);
-                }
-                break;
-                case SCALE_TYPE__CROP:
-                fitScaleWidth = m_inWidth;
-                fitScaleHeight = m_inHeight;
-                break;
-                case SCALE_TYPE__FILL:
-                if (m_inWidth*m_outHeight > m_inHeight*m_outWidth)
-                {
-                    fitScaleHeight = m_outHeight;
-                    fitScaleWidth = (uint32_t)round((double)m_inWidth*m_outHeight/m_inHeight);
-                }
-                else
-                {
-                    fitScaleWidth = m_outWidth;
-                    fitScaleHeight = (uint32_t)round((double)m_inHeight*m_outWidth/m_inWidth);
-                }
-                break;
-                case SCALE_TYPE__STRETCH:
                 fitScaleWidth = m_outWidth;
+                fitScaleHeight = (uint32_t)round((double)m_inHeight*m_outWidth/m_inWidth);
+            }
+            else
+            {
+                fitScaleHeight = m_outHeight;
+                fitScaleWidth = (uint32_t)round((double)m_inWidth*m_outHeight/m_inHeight);
+            }
+            break;
+            case SCALE_TYPE__CROP:
+            fitScaleWidth = RefWidth();
+            fitScaleHeight = RefHeight();
+            break;
+            case SCALE_TYPE__FILL:
+            if (m_inWidth*m_outHeight > m_inHeight*m_outWidth)
+            {
                 fitScaleHeight = m_outHeight;
-                break;
+                fitScaleWidth = (uint32_t)round((double)m_inWidth*m_outHeight/m_inHeight);
+            }
+            else
+            {
+                fitScaleWidth = m_outWidth;
+                fitScaleHeight = (uint32_t)round((double)m_inHeight*m_outWidth/m_inWidth);
             }
+            break;
+            case SCALE_TYPE__STRETCH:
+            fitScaleWidth = m_outWidth;
+            fitScaleHeight = m_outHeight;
+            break;
+        }
+    }
+
+    bool VideoTransformFilter_FFImpl::PerformScaleStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    {
+        if (m_needUpdateScaleParam)
+        {
+            uint32_t fitScaleWidth, fitScaleHeight;
+            CalcFitScaleSize(fitScaleWidth, fitScaleHeight);
             m_realScaleRatioH = (double)fitScaleWidth/m_inWidth*m_scaleRatioH;
             m_realScaleRatioV = (double)fitScaleHeight/m_inHeight*m_scaleRatioV;
 
@@ -695,7 +713,7 @@ namespace MediaCore
         return true;
     }
 
-    bool VideoTransformFilter_FFImpl::PerformPositionStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    void VideoTransformFilter_FFImpl::UpdatePositionParam()
     {
         if (m_needUpdatePositionParamScale)
         {
@@ -703,6 +721,11 @@ namespace MediaCore
             m_posOffsetV = m_fposOffsetV * m_outHeight;
             m_needUpdatePositionParamScale = false;
         }
+    }
+
+    bool VideoTransformFilter_FFImpl::PerformPositionStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr)
+    {
+        UpdatePositionParam();
         const int32_t posOffH = m_posOffsetH+m_posOffCompH;
         const int32_t posOffV = m_posOffsetV+m_posOffCompV;
         if (!avfrmPtr->data[0] && (inMat.w != m_outWidth || inMat.h != m_outHeight || posOffH != 0 || posOffV != 0))
@@ -764,6 +787,73 @@ namespace MediaCore
         return true;
     }
 
+    bool VideoTransformFilter_FFImpl::CanPerformFusedTransform(const ImGui::ImMat& inMat) const
+    {
+        return inMat.device == IM_DD_CPU && inMat.c == 4 && inMat.color_format == IM_CF_RGBA &&
+            (inMat.type == IM_DT_INT8 || inMat.type == IM_DT_INT16 || inMat.type == IM_DT_FLOAT32) &&
+            m_unifiedOutputPixfmt == AV_PIX_FMT_RGBA;
+    }
+
+    bool VideoTransformFilter_FFImpl::PerformFusedTransform(const ImGui::ImMat& inMat, ImGui::ImMat& outMat)
+    {
+        UpdateCropParam();
+        UpdatePositionParam();
+        uint32_t fitScaleWidth, fitScaleHeight;
+        CalcFitScaleSize(fitScaleWidth, fitScaleHeight);
+        const double scaleH = (double)fitScaleWidth/m_inWidth*m_scaleRatioH;
+        const double scaleV = (double)fitScaleHeight/m_inHeight*m_scaleRatioV;
+        const bool hasCrop = m_cropL != 0 || m_cropR != 0 || m_cropT != 0 || m_cropB != 0;
+        if (!hasCrop && scaleH == 1 && scaleV == 1 && m_rotateAngle == 0 && m_posOffsetH == 0 && m_posOffsetV == 0 &&
+            inMat.w == m_outWidth && inMat.h == m_outHeight)
+        {
+            outMat = inMat;
+            return true;
+        }
+
+        if (!m_hMatPool->Acquire(outMat, m_outWidth, m_outHeight, 4, inMat.type))
+        {
+            m_errMsg = "FAILED to allocate the output image of the fused transform!";
+            return false;
+        }
+        if (scaleH <= 0 || scaleV <= 0)
+        {
+            memset(outMat.data, 0, outMat.total()*outMat.elemsize);
+        }
+        else
+        {
+            // map the output position back through position offset, rotation (clockwise), and scaling around the image centers
+            const double radians = m_rotateAngle*M_PI/180;
+            const double cosA = cos(radians), sinA = sin(radians);
+            const double cx = (double)m_outWidth/2+m_posOffsetH;
+            const double cy = (double)m_outHeight/2+m_posOffsetV;
+            const float matrix[6] = {
+                (float)(cosA/scaleH), (float)(sinA/scaleH), (float)(-(cx*cosA+cy*sinA)/scaleH+(double)inMat.w/2),
+                (float)(-sinA/scaleV), (float)(cosA/scaleV), (float)((cx*sinA-cy*cosA)/scaleV+(double)inMat.h/2) };
+            ImInterpolateMode interp = IM_INTERPOLATE_BICUBIC;
+            if (scaleH == 1 && scaleV == 1)
+                interp = m_rotateAngle == 0 ? IM_INTERPOLATE_NEAREST : IM_INTERPOLATE_BILINEAR;
+            int32_t clipX = 0, clipY = 0, clipW = inMat.w, clipH = inMat.h;
+            if (hasCrop)
+            {
+                clipX = m_cropRectX; clipY = m_cropRectY;
+                clipW = m_cropRectW; clipH = m_cropRectH;
+            }
+            if (!MatUtils::WarpAffine(outMat, inMat, matrix, clipX, clipY, clipW, clipH, interp))
+            {
+                m_errMsg = "FAILED to invoke 'MatUtils::WarpAffine()'!";
+                return false;
+            }
+        }
+        outMat.time_stamp = inMat.time_stamp;
+        outMat.duration = inMat.duration;
+        outMat.rate = inMat.rate;
+        outMat.flags = inMat.flags;
+        outMat.color_format = inMat.color_format;
+        outMat.color_space = inMat.color_space;
+        outMat.color_range = inMat.color_range;
+        return true;
+    }
+
     bool VideoTransformFilter_FFImpl::_filterImage(const ImGui::ImMat& inMat, ImGui::ImMat& outMat, int64_t pos)
     {
         lock_guard<recursive_mutex> lk(m_processLock);
@@ -802,6 +892,18 @@ namespace MediaCore
                 Log(WARN) << "UNKNOWN curve name '" << name << "', value=" << value << "." << endl;
         }
 
+        // crop, scale, rotation and position offset are folded into one affine mapping, the source is sampled once per output pixel.
+        // The parameters of the staged path below are left to be updated, in case the next input falls back to it.
+        if (m_useFusedTransform && CanPerformFusedTransform(inMat))
+        {
+            if (!PerformFusedTransform(inMat, outMat))
+                return false;
+            m_needUpdateCropParam = false;
+            m_needUpdateCropParamScale = false;
+            m_needUpdatePositionParamScale = false;
+            return true;
+        }
+
         // allocate intermediate AVFrame
         SelfFreeAVFramePtr avfrmPtr = AllocSelfFreeAVFramePtr();
         avfrmPtr->pts = (int64_t)(m_inputCount++)*AV_TIME_BASE*m_inputFrameRate.den/m_inputFrameRate.num;
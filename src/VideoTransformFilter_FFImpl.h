@@ -43,6 +43,11 @@ namespace MediaCore
     private:
         AVFilterGraph* CreateFilterGraph(const std::string& filterArgs, uint32_t w, uint32_t h, AVPixelFormat inputPixfmt, AVFilterContext** inputCtx, AVFilterContext** outputCtx);
         bool ConvertInMatToAVFrame(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr);
+        void UpdateCropParam();
+        void CalcFitScaleSize(uint32_t& fitScaleWidth, uint32_t& fitScaleHeight);
+        void UpdatePositionParam();
+        bool CanPerformFusedTransform(const ImGui::ImMat& inMat) const;
+        bool PerformFusedTransform(const ImGui::ImMat& inMat, ImGui::ImMat& outMat);
         bool PerformCropStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr);
         bool PerformScaleStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr);
         bool PerformRotateStage(const ImGui::ImMat& inMat, SelfFreeAVFramePtr& avfrmPtr);
@@ -73,5 +78,8 @@ namespace MediaCore
         AVFilterContext* m_rotateInputCtx{nullptr};
         AVFilterContext* m_rotateOutputCtx{nullptr};
         uint32_t m_rotInW{0}, m_rotInH{0};
+
+        bool m_useFusedTransform{true};
+        MediaCore::ImMatPool::Holder m_hMatPool{MediaCore::ImMatPool::GetSharedInstance("Transform")};
     };
 }
\ No newline at end of file
@@ -141,8 +141,8 @@ namespace MediaCore
                 }
                 break;
                 case SCALE_TYPE__CROP:
-                fitScaleWidth = m_inWidth;
-                fitScaleHeight = m_inHeight;
+                fitScaleWidth = RefWidth();
+                fitScaleHeight = RefHeight();
                 break;
                 case SCALE_TYPE__FILL:
                 if (m_inWidth*m_outHeight > m_inHeight*m_outWidth)
@@ -204,20 +204,21 @@ namespace MediaCore
 
         if (m_needUpdateCropParamScale)
         {
-            m_cropL = m_inWidth * m_fcropL;
-            m_cropR = m_inWidth * m_fcropR;
-            m_cropT = m_inHeight * m_fcropT;
-            m_cropB = m_inHeight * m_fcropB;
+            m_cropL = RefWidth() * m_fcropL;
+            m_cropR = RefWidth() * m_fcropR;
+            m_cropT = RefHeight() * m_fcropT;
+            m_cropB = RefHeight() * m_fcropB;
             m_needUpdateCropParamScale = false;
             m_needUpdateCropParam = true;
         }
 
         if (m_needUpdateCropParam)
         {
-            float _l = (float)m_cropL;
-            float _t = (float)m_cropT;
-            float _r = (float)m_cropR;
-            float _b = (float)m_cropB;
+            // the crop margins are in the pixels of the source, map them to the input image
+            float _l = (float)m_cropL*m_inWidth/RefWidth();
+            float _t = (float)m_cropT*m_inHeight/RefHeight();
+            float _r = (float)m_cropR*m_inWidth/RefWidth();
+            float _b = (float)m_cropB*m_inHeight/RefHeight();
             if (_l+_r > m_inWidth) { float tmp = _l; _l = m_inWidth-_r; _r = m_inWidth-tmp; }
             if (_t+_b > m_inHeight) { float tmp = _t; _t = m_inHeight-_b; _b = m_inHeight-tmp; }
             m_cropRect = {_l, _t, _r, _b};
@@ -15,13 +15,880 @@ static void Unit_CreateVideoReaderInstance()
     auto hVideoReader = MediaReader::CreateVideoInstance();
 }
 
+#include <cstdio>
+#include <cstring>
+#include "MediaEncoder.h"
+// Encode 'frameCount' frames of flat gray levels into an MJPEG video, for the tests that need a real media file.
+static bool MakeTestVideo(const string& url, uint32_t width, uint32_t height, int32_t frameCount, const Ratio& frameRate)
+{
+    auto hEncoder = MediaEncoder::CreateInstance();
+    string imageFormat;
+    if (!hEncoder->Open(url) || !hEncoder->ConfigureVideoStream("mjpeg", imageFormat, width, height, frameRate, (uint64_t)width*height*8) ||
+        !hEncoder->Start())
+    {
+        Log(Error) << "FAILED to setup the encoder of test video '" << url << "'! Error is '" << hEncoder->GetError() << "'." << endl;
+        return false;
+    }
+    for (int32_t i = 0; i < frameCount; i++)
+    {
+        ImGui::ImMat vmat;
+        vmat.create_type(width, height, 4, IM_DT_INT8);
+        memset(vmat.data, i*255/frameCount, vmat.total()*vmat.elemsize);
+        vmat.color_format = IM_CF_RGBA;
+        vmat.time_stamp = (double)i*frameRate.den/frameRate.num;
+        if (!hEncoder->EncodeVideoFrame(vmat))
+        {
+            Log(Error) << "FAILED to encode frame #" << i << " of test video '" << url << "'! Error is '" << hEncoder->GetError() << "'." << endl;
+            hEncoder->Close();
+            return false;
+        }
+    }
+    const bool success = hEncoder->FinishEncoding();
+    hEncoder->Close();
+    return success;
+}
+
+#include "MediaReaderPool.h"
+#include "MemoryGovernor.h"
+static void Unit_MediaReaderPool()
+{
+    AutoSection _as("MediaReaderPool");
+    const string url = "UnitTest_ReaderPool.mov";
+    if (!MakeTestVideo(url, 64, 64, 25, {25, 1}))
+        return;
+    auto hParser = MediaParser::CreateInstance();
+    if (!hParser->Open(url))
+    {
+        Log(Error) << "FAILED to open test video '" << url << "'! Error is '" << hParser->GetError() << "'." << endl;
+        remove(url.c_str());
+        return;
+    }
+    auto hPool = MediaReaderPool::CreateInstance(2);
+    auto hReader = hPool->AcquireVideoReader(hParser, 64, 64, IM_CF_RGBA, IM_DT_INT8, IM_INTERPOLATE_BICUBIC, false);
+    if (!hReader || !hReader->Start())
+    {
+        Log(Error) << "FAILED to acquire a video reader from the pool! Error is '" << hPool->GetError() << "'." << endl;
+        remove(url.c_str());
+        return;
+    }
+    bool eof;
+    if (!hReader->ReadVideoFrame(200, eof))
+        Log(Error) << "FAILED to read the frame at 200ms! Error is '" << hReader->GetError() << "'." << endl;
+    hReader->SetDirection(false);
+    hReader->EnableScrubMode(true);
+    hReader->SetMemoryPriority(MemoryGovernor::PRIORITY_HIGH);
+    const MediaReader* pReader = hReader.get();
+    hReader = nullptr;
+    if (hPool->GetStats().idleCount != 1)
+        Log(Error) << "MediaReaderPool does NOT keep the released reader!" << endl;
+    // the image readers are of another implementation, they are never mixed up with the video readers of the same output
+    auto hImgReader = hPool->AcquireImageReader(hParser, 64, 64, IM_CF_RGBA, IM_DT_INT8, IM_INTERPOLATE_BICUBIC);
+    if (hImgReader.get() == pReader)
+        Log(Error) << "MediaReaderPool hands out the released video reader as an image reader!" << endl;
+    hImgReader = nullptr;
+
+    hReader = hPool->AcquireVideoReader(hParser, 64, 64, IM_CF_RGBA, IM_DT_INT8, IM_INTERPOLATE_BICUBIC, false);
+    if (hReader.get() != pReader)
+        Log(Error) << "MediaReaderPool does NOT reuse the released reader!" << endl;
+    else if (!hReader->IsDirectionForward() || hReader->IsScrubModeEnabled() ||
+        hReader->GetMemoryPrioritySetting() != MemoryGovernor::PRIORITY_NORMAL)
+        Log(Error) << "MediaReaderPool hands out a reader with the state of its previous user!" << endl;
+    hReader = nullptr;
+    hPool->Trim();
+    hParser = nullptr;
+    remove(url.c_str());
+}
+
+#include <thread>
+#include <atomic>
+#include "SysUtils.h"
+static void Unit_WaitableEvent()
+{
+    AutoSection _as("WaitableEvent");
+    SysUtils::WaitableEvent evt;
+    auto seq = evt.Sequence();
+    evt.Notify();
+    if (!evt.Wait(seq, 1000))
+        Log(Error) << "WaitableEvent::Wait() does NOT return immediately after a notification!" << endl;
+    seq = evt.Sequence();
+    if (evt.Wait(seq, 10))
+        Log(Error) << "WaitableEvent::Wait() returns 'true' without any notification!" << endl;
+
+    atomic_bool ready{false};
+    thread producer([&evt, &ready] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        ready = true;
+        evt.Notify();
+    });
+    evt.WaitUntil([&ready] { return (bool)ready; }, 10000);
+    producer.join();
+}
+
+#include <vector>
+#include "ThreadPoolExecutor.h"
+static void Unit_ThreadPoolExecutor()
+{
+    AutoSection _as("ThreadPoolExecutor");
+    using SysUtils::ThreadPoolExecutor;
+    // more forking tasks than workers, each of them joins its own jobs from a worker thread
+    auto hExecutor = ThreadPoolExecutor::CreateInstance(2, "UtExec");
+    const int forkCount = 4, jobCount = 16;
+    atomic<int> jobsDone{0};
+    vector<ThreadPoolExecutor::Task::Holder> forkTasks;
+    for (int i = 0; i < forkCount; i++)
+    {
+        forkTasks.push_back(hExecutor->Submit("UtFork", [&hExecutor, &jobsDone] {
+            vector<ThreadPoolExecutor::Task::Holder> jobs;
+            for (int j = 0; j < jobCount; j++)
+                jobs.push_back(hExecutor->Submit("UtJob", [&jobsDone] { jobsDone++; return ThreadPoolExecutor::STEP_DONE; }));
+            for (auto& hJob : jobs)
+                hJob->Join();
+            return ThreadPoolExecutor::STEP_DONE;
+        }));
+    }
+    for (auto& hTask : forkTasks)
+        hTask->Join();
+    if (jobsDone != forkCount*jobCount)
+        Log(Error) << "ThreadPoolExecutor finishes " << jobsDone << " jobs, expected " << forkCount*jobCount << "!" << endl;
+    if (hExecutor->GetTaskCount() != 0)
+        Log(Error) << "ThreadPoolExecutor still has " << hExecutor->GetTaskCount() << " tasks after all of them are joined!" << endl;
+}
+
+#include "SpscRingBuffer.h"
+static void Unit_SpscRingBuffer()
+{
+    AutoSection _as("SpscRingBuffer");
+    SysUtils::WaitableEvent evt;
+    SysUtils::SpscRingBuffer<int> q(3, &evt);
+    if (q.Capacity() != 4)
+        Log(Error) << "SpscRingBuffer capacity is " << q.Capacity() << ", expected 4!" << endl;
+    for (int i = 0; i < 4; i++)
+        q.TryPush(i);
+    if (q.CanPush() || q.TryPush(4))
+        Log(Error) << "SpscRingBuffer accepts an element when it is full!" << endl;
+    int val;
+    if (!q.TryPop(val) || val != 0 || *q.Front() != 1)
+        Log(Error) << "SpscRingBuffer does NOT pop the elements in FIFO order!" << endl;
+    q.Clear();
+    // only the empty->non-empty push and the full->non-full pop notify
+    auto seq = evt.Sequence();
+    q.TryPush(0);
+    if (evt.Sequence() == seq)
+        Log(Error) << "SpscRingBuffer does NOT notify when pushing into an empty queue!" << endl;
+    seq = evt.Sequence();
+    q.TryPush(1);
+    q.TryPop(val);
+    if (evt.Sequence() != seq)
+        Log(Error) << "SpscRingBuffer notifies when the queue is neither empty nor full!" << endl;
+    q.SetHighWaterMark(1);
+    q.TryPop(val);
+    if (evt.Sequence() == seq)
+        Log(Error) << "SpscRingBuffer does NOT notify when popping from the high water mark!" << endl;
+    q.Reset(3);
+
+    const int total = 100000;
+    thread producer([&q, &evt] {
+        for (int i = 0; i < total; i++)
+        {
+            const auto seq = evt.Sequence();
+            if (!q.TryPush(i))
+            {
+                evt.Wait(seq, 10);
+                i--;
+            }
+        }
+    });
+    int expected = 0;
+    while (expected < total)
+    {
+        const auto seq = evt.Sequence();
+        if (!q.TryPop(val))
+        {
+            evt.Wait(seq, 10);
+            continue;
+        }
+        if (val != expected)
+        {
+            Log(Error) << "SpscRingBuffer pops " << val << ", expected " << expected << "!" << endl;
+            break;
+        }
+        expected++;
+    }
+    producer.join();
+    auto stats = q.GetStats();
+    Log(INFO) << "SpscRingBuffer stats: pushed=" << stats.pushCount << ", full=" << stats.fullCount
+            << ", producerStall=" << stats.producerStallUs << "us, consumerStall=" << stats.consumerStallUs << "us." << endl;
+}
+
+#include "VideoFrameCache.h"
+static void Unit_VideoFrameCache()
+{
+    AutoSection _as("VideoFrameCache");
+    auto hCache = VideoFrameCache::CreateInstance(128);
+    VideoFrameCache::Key key;
+    key.url = "test.mp4";
+    key.streamIndex = 0;
+    key.width = 4; key.height = 4;
+    for (int i = 0; i < 3; i++)
+    {
+        ImGui::ImMat m;
+        m.create_type(4, 4, 4, IM_DT_INT8);
+        hCache->Put(key, i*100, m);
+    }
+    ImGui::ImMat m;
+    if (hCache->Get(key, 0, m))
+        Log(Error) << "VideoFrameCache does NOT evict the least recently used frame!" << endl;
+    if (!hCache->Get(key, 150, m, 50) || hCache->Get(key, 150, m, 49))
+        Log(Error) << "VideoFrameCache does NOT respect the pts tolerance!" << endl;
+    key.width = 8;
+    if (hCache->Get(key, 100, m))
+        Log(Error) << "VideoFrameCache returns a frame of a different output size!" << endl;
+    auto stats = hCache->GetStats();
+    Log(INFO) << "VideoFrameCache stats: frames=" << stats.frameCount << ", usage=" << stats.memoryUsage << ", hit=" << stats.hitCount
+            << ", miss=" << stats.missCount << ", evict=" << stats.evictCount << "." << endl;
+}
+
+// Two video readers of the same source and output format, e.g. the two halves of a split clip. The frame converted by the
+// first one at the seek target is taken from the shared frame cache by the second one.
+static void Unit_VideoReaderFrameCache()
+{
+    AutoSection _as("VideoReaderFrameCache");
+    const string url = "UnitTest_ReaderFrameCache.mov";
+    if (!MakeTestVideo(url, 64, 64, 25, {25, 1}))
+        return;
+    auto hParser = MediaParser::CreateInstance();
+    if (!hParser->Open(url))
+    {
+        Log(Error) << "FAILED to open test video '" << url << "'! Error is '" << hParser->GetError() << "'." << endl;
+        remove(url.c_str());
+        return;
+    }
+    auto hCache = VideoFrameCache::GetDefaultInstance();
+    hCache->Remove(url);
+    uint64_t hitCount = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        auto hReader = MediaReader::CreateVideoInstance();
+        if (!hReader->Open(hParser) || !hReader->ConfigVideoReader(64u, 64u, IM_CF_RGBA, IM_DT_INT8, IM_INTERPOLATE_BICUBIC) || !hReader->Start())
+        {
+            Log(Error) << "FAILED to start video reader #" << i << "! Error is '" << hReader->GetError() << "'." << endl;
+            break;
+        }
+        hitCount = hCache->GetStats().hitCount;
+        hReader->SeekTo(200);
+        bool eof;
+        auto hVfrm = hReader->ReadVideoFrame(200, eof, true);
+        ImGui::ImMat m;
+        if (!hVfrm || !hVfrm->GetMat(m))
+            Log(Error) << "Video reader #" << i << " FAILED to read the frame at 200ms! Error is '" << hReader->GetError() << "'." << endl;
+        else if (i == 1 && hCache->GetStats().hitCount <= hitCount)
+            Log(Error) << "The second video reader of the same source does NOT take the frame from the shared frame cache!" << endl;
+    }
+    hCache->Remove(url);
+    hParser = nullptr;
+    remove(url.c_str());
+}
+
+#include "ImMatPool.h"
+static void Unit_ImMatPool()
+{
+    AutoSection _as("ImMatPool");
+    auto hPool = ImMatPool::CreateInstance("Test", 64*64*4*2);
+    ImGui::ImMat m1, m2, m3;
+    hPool->Acquire(m1, 64, 64, 4, IM_DT_INT8);
+    hPool->Acquire(m2, 64, 64, 4, IM_DT_INT8);
+    if (m1.data == m2.data)
+        Log(Error) << "ImMatPool hands out a buffer which is still in use!" << endl;
+    void* prevData = m1.data;
+    m1.release();
+    hPool->Acquire(m1, 64, 64, 4, IM_DT_INT8);
+    if (m1.data != prevData)
+        Log(Error) << "ImMatPool does NOT reuse the released buffer!" << endl;
+    hPool->Acquire(m3, 64, 64, 4, IM_DT_INT8);
+    auto stats = hPool->GetStats();
+    if (stats.overflowCount != 1 || stats.bufferCount != 2)
+        Log(Error) << "ImMatPool does NOT respect the high-water mark!" << endl;
+    Log(INFO) << "ImMatPool stats: buffers=" << stats.bufferCount << ", inUse=" << stats.inUseCount << ", acquire=" << stats.acquireCount
+            << ", reuse=" << stats.reuseCount << ", alloc=" << stats.allocCount << ", overflow=" << stats.overflowCount << "." << endl;
+
+    // the pooled bytes are reported to the default memory governor
+    auto GetGovernorUsage = [] (const string& name) {
+        for (auto& usage : MemoryGovernor::GetDefaultInstance()->GetUsage())
+            if (usage.name == name)
+                return (int64_t)usage.bytes;
+        return (int64_t)-1;
+    };
+    int64_t govUsage = GetGovernorUsage("ImMatPool-Test");
+    if (govUsage != (int64_t)stats.pooledBytes)
+        Log(Error) << "ImMatPool reports " << govUsage << " bytes to the memory governor, expected " << stats.pooledBytes << "!" << endl;
+    m1.release();
+    m2.release();
+    hPool->Trim();
+    govUsage = GetGovernorUsage("ImMatPool-Test");
+    if (govUsage != 0)
+        Log(Error) << "ImMatPool still reports " << govUsage << " bytes to the memory governor after Trim()!" << endl;
+    hPool = nullptr;
+    if (GetGovernorUsage("ImMatPool-Test") != -1)
+        Log(Error) << "The destroyed ImMatPool is still registered with the memory governor!" << endl;
+}
+
+#include "MemoryGovernor.h"
+struct TestMemoryConsumer : public MemoryGovernor::Consumer
+{
+    TestMemoryConsumer(const string& _name, int32_t _priority, uint64_t _usage) : name(_name), priority(_priority), usage(_usage) {}
+    string GetMemoryConsumerName() const override { return name; }
+    uint64_t GetMemoryUsage() const override { return usage; }
+    int32_t GetMemoryPriority() const override { return priority; }
+    uint64_t Shrink(uint64_t bytes) override
+    {
+        uint64_t released = bytes < usage ? bytes : usage;
+        usage -= released;
+        if (gov)
+            gov->ReportUsageChange(-(int64_t)released);
+        return released;
+    }
+
+    string name;
+    int32_t priority;
+    uint64_t usage;
+    MemoryGovernor* gov{nullptr};
+};
+
+static void Unit_MemoryGovernor()
+{
+    AutoSection _as("MemoryGovernor");
+    auto hGov = MemoryGovernor::CreateInstance(1000);
+    TestMemoryConsumer idle("Idle", MemoryGovernor::PRIORITY_IDLE, 300);
+    TestMemoryConsumer low("Low", MemoryGovernor::PRIORITY_LOW, 300);
+    TestMemoryConsumer high("High", MemoryGovernor::PRIORITY_HIGH, 300);
+    idle.gov = low.gov = high.gov = hGov.get();
+    hGov->Register(&idle);
+    hGov->Register(&low);
+    hGov->Register(&high);
+    if (hGov->GetTotalUsage() != 900)
+        Log(Error) << "MemoryGovernor does NOT count the usage of the registered consumers!" << endl;
+    if (!hGov->RequestMemory(&high, 100))
+        Log(Error) << "MemoryGovernor refuses a request within the budget!" << endl;
+    if (!hGov->RequestMemory(&high, 400) || idle.usage != 0 || low.usage != 300)
+        Log(Error) << "MemoryGovernor does NOT shrink the consumer of the lowest priority first!" << endl;
+    if (hGov->RequestMemory(&low, 500) || high.usage != 300)
+        Log(Error) << "MemoryGovernor shrinks a consumer of higher priority than the requester!" << endl;
+    high.usage += 50;
+    hGov->ReportUsageChange(50);
+    if (hGov->GetTotalUsage() != 650)
+        Log(Error) << "MemoryGovernor does NOT apply the reported usage change!" << endl;
+    high.usage -= 50;
+    hGov->ReportUsageChange(-50);
+    hGov->Unregister(&idle);
+    auto usages = hGov->GetUsage();
+    if (usages.size() != 2 || hGov->GetTotalUsage() != 600)
+        Log(Error) << "MemoryGovernor reports wrong usage after unregistering a consumer!" << endl;
+    hGov->Unregister(&low);
+    hGov->Unregister(&high);
+}
+
+#include "MediaEncoder.h"
+static void Unit_PlanVideoStreamCopy()
+{
+    AutoSection _as("PlanVideoStreamCopy");
+    // 3 closed GOPs of 10 frames, 40ms per frame, in millisecond time base
+    MediaParser::VideoFrameIndex frameIndex;
+    frameIndex.timeBase = { 1, 1000 };
+    for (int i = 0; i < 30; i++)
+    {
+        frameIndex.frames.push_back({ i*40, i*40, -1 });
+        if (i%10 == 0)
+        {
+            frameIndex.keyFrames.push_back(i);
+            frameIndex.gopSizes.push_back(10);
+        }
+    }
+    auto range = MediaEncoder::PlanVideoStreamCopy(frameIndex, 100, 1000);
+    if (range.startPos != 400 || range.endPos != 800)
+        Log(Error) << "PlanVideoStreamCopy() returns [" << range.startPos << ", " << range.endPos << "), expected [400, 800)!" << endl;
+    range = MediaEncoder::PlanVideoStreamCopy(frameIndex, 0, 2000);
+    if (range.startPos != 0 || range.endPos != 1161)
+        Log(Error) << "PlanVideoStreamCopy() returns [" << range.startPos << ", " << range.endPos << "), expected [0, 1161)!" << endl;
+    range = MediaEncoder::PlanVideoStreamCopy(frameIndex, 100, 700);
+    if (range.endPos > range.startPos)
+        Log(Error) << "PlanVideoStreamCopy() returns a copy range while no whole GOP is inside the source range!" << endl;
+    // positions are relative to the stream start time, not to the smallest pts in the index
+    frameIndex.startTime = -80;
+    range = MediaEncoder::PlanVideoStreamCopy(frameIndex, 100, 1000);
+    if (range.startPos != 480 || range.endPos != 880)
+        Log(Error) << "PlanVideoStreamCopy() with start time -80 returns [" << range.startPos << ", " << range.endPos << "), expected [480, 880)!" << endl;
+}
+
+static void Unit_VideoTimestampStitcher()
+{
+    AutoSection _as("VideoTimestampStitcher");
+    // each run has a reordering delay of 2 frames, the dts of a run starts before the last dts of the run before
+    struct Packet { int64_t pts, dts; };
+    const vector<vector<Packet>> runs = {
+        { {0, -2}, {3, -1}, {1, 0}, {2, 1}, {6, 2}, {4, 3}, {5, 4} },
+        { {7, 4}, {10, 5}, {8, 6}, {9, 7} },
+        { {11, 9}, {14, 10}, {12, 11}, {13, 12} },
+        { {15, INT64_MIN}, {16, INT64_MIN} },
+    };
+    const vector<int64_t> expectedOffsets = { 0, 1, 1, 1 };
+    MediaEncoder::VideoTimestampStitcher stitcher;
+    int64_t lastDts = INT64_MIN, maxPts = INT64_MIN;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        stitcher.StartRun();
+        const int64_t runMinPts = runs[i].front().pts;
+        for (auto pkt : runs[i])
+        {
+            const int64_t origPts = pkt.pts;
+            stitcher.Stitch(pkt.pts, pkt.dts);
+            if (pkt.pts-origPts != expectedOffsets[i])
+                Log(Error) << "Run #" << i << " is delayed by " << pkt.pts-origPts << ", expected " << expectedOffsets[i] << "!" << endl;
+            if (pkt.dts != INT64_MIN)
+            {
+                if (pkt.dts > pkt.pts)
+                    Log(Error) << "Run #" << i << " has dts " << pkt.dts << " > pts " << pkt.pts << "!" << endl;
+                if (lastDts != INT64_MIN && pkt.dts <= lastDts)
+                    Log(Error) << "Run #" << i << " has dts " << pkt.dts << " not after the last dts " << lastDts << "!" << endl;
+                lastDts = pkt.dts;
+            }
+        }
+        if (maxPts != INT64_MIN && runMinPts+expectedOffsets[i] <= maxPts)
+            Log(Error) << "Run #" << i << " overlaps the presentation of the run before!" << endl;
+        for (auto& pkt : runs[i])
+            maxPts = max(maxPts, pkt.pts+expectedOffsets[i]);
+    }
+}
+
+#include <sstream>
+#include <iomanip>
+#include "ProxyManager.h"
+static void Unit_ProxyManager()
+{
+    AutoSection _as("ProxyManager");
+    const string url = "UnitTest_Proxy.mov";
+    if (!MakeTestVideo(url, 128, 96, 50, {25, 1}))
+        return;
+    auto hParser = MediaParser::CreateInstance();
+    if (!hParser->Open(url))
+    {
+        Log(Error) << "FAILED to open test video '" << url << "'! Error is '" << hParser->GetError() << "'." << endl;
+        remove(url.c_str());
+        return;
+    }
+    // the proxy is named by the hash of the source path, size, modification time and the proxy height
+    auto MakeProxyPathPrefix = [&url] (uint32_t proxyHeight) {
+        uint64_t fileSize;
+        int64_t modifyTime;
+        SysUtils::GetFileStatus(url, fileSize, modifyTime);
+        ostringstream oss;
+        oss << url << "|" << fileSize << "|" << modifyTime << "|" << proxyHeight;
+        const string key = oss.str();
+        oss.str("");
+        oss << "./" << hex << setw(16) << setfill('0') << SysUtils::Fnv1aHash(key);
+        return oss.str();
+    };
+    auto FileExists = [] (const string& path) {
+        uint64_t fileSize;
+        int64_t modifyTime;
+        return SysUtils::GetFileStatus(path, fileSize, modifyTime);
+    };
+    auto WaitForState = [] (ProxyManager::Holder hMgr, MediaParser::Holder hParser) {
+        auto state = hMgr->GetProxyState(hParser);
+        for (int i = 0; i < 2000 && (state == ProxyManager::PROXY_QUEUED || state == ProxyManager::PROXY_GENERATING); i++)
+        {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            state = hMgr->GetProxyState(hParser);
+        }
+        return state;
+    };
+
+    auto hMgr = ProxyManager::CreateInstance(".");
+    hMgr->SetProxyHeight(48);
+    const string proxyPath = MakeProxyPathPrefix(48)+".mov";
+    const string tmpPath = MakeProxyPathPrefix(48)+".tmp.mov";
+    remove(proxyPath.c_str());
+    if (hMgr->GetProxyState(hParser) != ProxyManager::PROXY_NONE)
+        Log(Error) << "ProxyManager reports a proxy before it's requested!" << endl;
+    if (!hMgr->RequestProxy(hParser))
+        Log(Error) << "FAILED to request the proxy! Error is '" << hMgr->GetError() << "'." << endl;
+    auto state = hMgr->GetProxyState(hParser);
+    if (state != ProxyManager::PROXY_QUEUED && state != ProxyManager::PROXY_GENERATING && state != ProxyManager::PROXY_READY)
+        Log(Error) << "ProxyManager state is " << state << " after the proxy is requested!" << endl;
+    state = WaitForState(hMgr, hParser);
+    if (state != ProxyManager::PROXY_READY)
+    {
+        Log(Error) << "ProxyManager state is " << state << ", expected PROXY_READY!" << endl;
+    }
+    else
+    {
+        if (hMgr->GetProxyProgress(hParser) != 1.f)
+            Log(Error) << "The progress of the ready proxy is " << hMgr->GetProxyProgress(hParser) << ", expected 1!" << endl;
+        if (!FileExists(proxyPath) || FileExists(tmpPath))
+            Log(Error) << "The temporary proxy file is NOT renamed to '" << proxyPath << "'!" << endl;
+        auto hProxyParser = hMgr->GetProxyParser(hParser);
+        if (!hProxyParser || hProxyParser->GetUrl() != proxyPath)
+            Log(Error) << "The proxy parser is NOT opened on '" << proxyPath << "'!" << endl;
+        else if (!hProxyParser->GetBestVideoStream() || hProxyParser->GetBestVideoStream()->height != 48)
+            Log(Error) << "The proxy is NOT generated at the height of 48!" << endl;
+    }
+    // a ready proxy is found again by a new manager
+    auto hMgr2 = ProxyManager::CreateInstance(".");
+    hMgr2->SetProxyHeight(48);
+    if (hMgr2->GetProxyState(hParser) != ProxyManager::PROXY_READY)
+        Log(Error) << "A new ProxyManager does NOT find the ready proxy '" << proxyPath << "'!" << endl;
+    hMgr2 = nullptr;
+
+    // another proxy height is another proxy, cancel it right after it's requested
+    hMgr->SetProxyHeight(32);
+    const string cancelPath = MakeProxyPathPrefix(32)+".mov";
+    const string cancelTmpPath = MakeProxyPathPrefix(32)+".tmp.mov";
+    if (hMgr->GetProxyState(hParser) != ProxyManager::PROXY_NONE)
+        Log(Error) << "The proxy of another height is reported to exist!" << endl;
+    hMgr->RequestProxy(hParser);
+    hMgr->CancelProxy(hParser);
+    if (hMgr->GetProxyState(hParser) != ProxyManager::PROXY_NONE)
+        Log(Error) << "ProxyManager state is NOT PROXY_NONE after the proxy is cancelled!" << endl;
+    // the destruction joins the cancelled generation task
+    hMgr = nullptr;
+    if (FileExists(cancelPath) || FileExists(cancelTmpPath))
+        Log(Error) << "The cancelled proxy leaves its files!" << endl;
+
+    remove(proxyPath.c_str());
+    remove(cancelPath.c_str());
+    hParser = nullptr;
+    remove(url.c_str());
+}
+
+#include <random>
+#include "MatUtils.h"
+static void Unit_DownscalePlaneBox2x()
+{
+    AutoSection _as("DownscalePlaneBox2x");
+    mt19937 rng(24);
+    uniform_int_distribution<int> dist(0, 255);
+    const int32_t guardSize = 16;
+    // odd widths and the widths around the vector width exercise the scalar tail of the SIMD kernels
+    for (int32_t sampleSize : {1, 2})
+    {
+        for (int32_t dstWidth : {1, 7, 15, 16, 17, 31, 33, 63})
+        {
+            const int32_t dstHeight = 3;
+            const int32_t srcLineSize = 2*dstWidth*sampleSize+5;
+            const int32_t dstLineSize = dstWidth*sampleSize+guardSize;
+            vector<uint8_t> src(srcLineSize*dstHeight*2);
+            for (auto& v : src)
+                v = (uint8_t)dist(rng);
+            vector<uint8_t> dst(dstLineSize*dstHeight, 0xA5);
+            MatUtils::DownscalePlaneBox2x(dst.data(), dstLineSize, src.data(), srcLineSize, dstWidth, dstHeight, sampleSize);
+            int32_t mismatchCount = 0;
+            for (int32_t y = 0; y < dstHeight; y++)
+            {
+                const uint8_t* src0 = src.data()+2*y*srcLineSize;
+                const uint8_t* src1 = src0+srcLineSize;
+                const uint8_t* dstRow = dst.data()+y*dstLineSize;
+                for (int32_t i = 0; i < dstWidth*sampleSize; i++)
+                {
+                    const int32_t x = i/sampleSize, c = i%sampleSize;
+                    const int32_t j = 2*x*sampleSize+c;
+                    const uint8_t expected = (uint8_t)((src0[j]+src0[j+sampleSize]+src1[j]+src1[j+sampleSize]+2)>>2);
+                    if (dstRow[i] != expected)
+                        mismatchCount++;
+                }
+                for (int32_t i = dstWidth*sampleSize; i < dstLineSize; i++)
+                {
+                    if (dstRow[i] != 0xA5)
+                        mismatchCount++;
+                }
+            }
+            if (mismatchCount > 0)
+                Log(Error) << "DownscalePlaneBox2x(dstWidth=" << dstWidth << ", sampleSize=" << sampleSize << ") has " << mismatchCount
+                        << " bytes differing from the scalar reference!" << endl;
+        }
+    }
+}
+
+#include <cmath>
+#include <algorithm>
+static void Unit_MatUtilsSimd()
+{
+    AutoSection _as("MatUtilsSimd");
+    mt19937 rng(7);
+    auto RandomFloat = [&rng] (float lo, float hi) {
+        return uniform_real_distribution<float>(lo, hi)(rng);
+    };
+    auto FillRandom = [&rng] (ImGui::ImMat& mat, bool opaqueAlpha) {
+        const size_t valueCount = (size_t)mat.w*mat.h*mat.c;
+        for (size_t i = 0; i < valueCount; i++)
+        {
+            const bool isAlpha = mat.c == 4 && i%4 == 3;
+            if (mat.type == IM_DT_INT8)
+                ((uint8_t*)mat.data)[i] = isAlpha && opaqueAlpha ? 255 : (uint8_t)(rng()&0xFF);
+            else if (mat.type == IM_DT_INT16)
+                ((uint16_t*)mat.data)[i] = isAlpha && opaqueAlpha ? 65535 : (uint16_t)(rng()&0xFFFF);
+            else
+                ((float*)mat.data)[i] = isAlpha && opaqueAlpha ? 1.f : (float)(rng()&0xFFFF)/65535.f;
+        }
+    };
+    // the largest difference of two images in units of the data type's maximum value
+    auto MaxDifference = [] (const ImGui::ImMat& a, const ImGui::ImMat& b) {
+        const size_t valueCount = (size_t)a.w*a.h*a.c;
+        float maxDiff = 0.f;
+        for (size_t i = 0; i < valueCount; i++)
+        {
+            float diff;
+            if (a.type == IM_DT_INT8)
+                diff = fabsf((float)((uint8_t*)a.data)[i]-(float)((uint8_t*)b.data)[i])/255.f;
+            else if (a.type == IM_DT_INT16)
+                diff = fabsf((float)((uint16_t*)a.data)[i]-(float)((uint16_t*)b.data)[i])/65535.f;
+            else
+                diff = fabsf(((float*)a.data)[i]-((float*)b.data)[i]);
+            maxDiff = max(maxDiff, diff);
+        }
+        return maxDiff;
+    };
+    // run 'proc' with the scalar code into 'scalarMat' and with the SIMD kernels into 'simdMat', both created like 'shapeMat'
+    auto RunScalarAndSimd = [] (const ImGui::ImMat& shapeMat, ImGui::ImMat& scalarMat, ImGui::ImMat& simdMat, function<bool (ImGui::ImMat&)> proc) {
+        scalarMat.create_type(shapeMat.w, shapeMat.h, shapeMat.c, shapeMat.type);
+        simdMat.create_type(shapeMat.w, shapeMat.h, shapeMat.c, shapeMat.type);
+        memset(scalarMat.data, 0, scalarMat.total()*scalarMat.elemsize);
+        memset(simdMat.data, 0, simdMat.total()*simdMat.elemsize);
+        MatUtils::SetSimdEnabled(false);
+        bool success = proc(scalarMat);
+        MatUtils::SetSimdEnabled(true);
+        success &= proc(simdMat);
+        return success;
+    };
+    // one step of the 8-bit type, the kernels differ in the rounding and in the reciprocal approximation at most
+    const float tolerance = 1.f/255.f+1e-5f;
+    // the widths are chosen not to be multiples of the vector widths, so the scalar tails are run too
+    const int32_t widths[] = {1, 3, 7, 9, 17, 37};
+    const ImDataType dtypes[] = {IM_DT_INT8, IM_DT_INT16, IM_DT_FLOAT32};
+
+    for (auto dtype : dtypes)
+    {
+        for (int32_t width : widths)
+        {
+            ImGui::ImMat baseMat, ovlyMat, scalarMat, simdMat;
+            baseMat.create_type(width, 5, 4, dtype);
+            ovlyMat.create_type(width+2, 3, 4, dtype);
+            FillRandom(baseMat, false);
+            FillRandom(ovlyMat, false);
+            if (!RunScalarAndSimd(baseMat, scalarMat, simdMat, [&] (ImGui::ImMat& dstMat) { return MatUtils::AlphaBlend(dstMat, baseMat, ovlyMat, -1, 1); }))
+                Log(Error) << "AlphaBlend(type=" << dtype << ", width=" << width << ") FAILED!" << endl;
+            else if (MaxDifference(scalarMat, simdMat) > tolerance)
+                Log(Error) << "AlphaBlend(type=" << dtype << ", width=" << width << ") differs by " << MaxDifference(scalarMat, simdMat)
+                        << " between the scalar and the SIMD code!" << endl;
+
+            // an opaque middle layer makes the tiles it covers skip the bottom layer
+            vector<MatUtils::BlendLayer> layers(3);
+            layers[0].mat.create_type(width, 9, 4, dtype);
+            layers[1].mat.create_type(width, 4, 4, dtype);
+            layers[1].y = 2;
+            layers[2].mat.create_type(max(width-2, 1), 7, 4, dtype);
+            layers[2].x = 1; layers[2].y = 1; layers[2].opacity = 0.6f;
+            FillRandom(layers[0].mat, false);
+            FillRandom(layers[1].mat, true);
+            FillRandom(layers[2].mat, false);
+            if (!RunScalarAndSimd(layers[0].mat, scalarMat, simdMat, [&] (ImGui::ImMat& dstMat) { return MatUtils::CompositeLayers(dstMat, layers, 4); }))
+                Log(Error) << "CompositeLayers(type=" << dtype << ", width=" << width << ") FAILED!" << endl;
+            else if (MaxDifference(scalarMat, simdMat) > tolerance)
+                Log(Error) << "CompositeLayers(type=" << dtype << ", width=" << width << ") differs by " << MaxDifference(scalarMat, simdMat)
+                        << " between the scalar and the SIMD code!" << endl;
+
+            // rotate by 30 degrees and scale by 0.8 around the image center
+            const ImInterpolateMode interps[] = {IM_INTERPOLATE_NEAREST, IM_INTERPOLATE_BILINEAR, IM_INTERPOLATE_BICUBIC};
+            ImGui::ImMat srcMat, shapeMat;
+            srcMat.create_type(width+4, 12, 4, dtype);
+            FillRandom(srcMat, false);
+            shapeMat.create_type(width, 10, 4, dtype);
+            const float cs = cosf(0.5236f)/0.8f, sn = sinf(0.5236f)/0.8f;
+            const float matrix[6] = {cs, -sn, srcMat.w*0.5f-cs*width*0.5f+sn*5.f, sn, cs, srcMat.h*0.5f-sn*width*0.5f-cs*5.f};
+            for (auto interp : interps)
+            {
+                if (!RunScalarAndSimd(shapeMat, scalarMat, simdMat, [&] (ImGui::ImMat& dstMat) {
+                        return MatUtils::WarpAffine(dstMat, srcMat, matrix, 1, 0, srcMat.w-2, srcMat.h, interp); }))
+                    Log(Error) << "WarpAffine(type=" << dtype << ", width=" << width << ", interp=" << interp << ") FAILED!" << endl;
+                else if (MaxDifference(scalarMat, simdMat) > tolerance)
+                    Log(Error) << "WarpAffine(type=" << dtype << ", width=" << width << ", interp=" << interp << ") differs by "
+                            << MaxDifference(scalarMat, simdMat) << " between the scalar and the SIMD code!" << endl;
+            }
+        }
+    }
+
+    // YUV420P and NV12 of 8 bits, P010 of 10 bits in the high bits of 16-bit words
+    for (int32_t width : widths)
+    {
+        const int32_t height = 6;
+        const int32_t chromaWidth = (width+1)/2, chromaHeight = height/2;
+        for (int32_t format = 0; format < 3; format++)
+        {
+            const int32_t bytesPerSample = format == 2 ? 2 : 1;
+            const bool interleaved = format != 0;
+            vector<uint8_t> planes[3];
+            MatUtils::YuvImage yuvImg;
+            yuvImg.width = width; yuvImg.height = height;
+            yuvImg.bitDepth = format == 2 ? 10 : 8;
+            yuvImg.sampleShift = format == 2 ? 6 : 0;
+            yuvImg.interleavedChroma = interleaved;
+            yuvImg.colorRange = format == 1 ? IM_CR_FULL_RANGE : IM_CR_NARROW_RANGE;
+            yuvImg.lineSize[0] = width*bytesPerSample+3;
+            yuvImg.lineSize[1] = yuvImg.lineSize[2] = chromaWidth*bytesPerSample*(interleaved ? 2 : 1)+3;
+            for (int32_t i = 0; i < (interleaved ? 2 : 3); i++)
+            {
+                planes[i].resize(yuvImg.lineSize[i]*(i == 0 ? height : chromaHeight));
+                for (auto& v : planes[i])
+                    v = (uint8_t)(rng()&0xFF);
+                if (format == 2)
+                {
+                    for (size_t j = 0; j < planes[i].size(); j += 2)
+                        planes[i][j] &= 0xC0;
+                }
+                yuvImg.data[i] = planes[i].data();
+            }
+            ImGui::ImMat shapeMat, scalarMat, simdMat;
+            shapeMat.create_type(width, height, 4, IM_DT_FLOAT32);
+            if (!RunScalarAndSimd(shapeMat, scalarMat, simdMat, [&] (ImGui::ImMat& dstMat) { return MatUtils::ConvertYuv420ToRgbaFloat(dstMat, yuvImg); }))
+                Log(Error) << "ConvertYuv420ToRgbaFloat(format=" << format << ", width=" << width << ") FAILED!" << endl;
+            else if (MaxDifference(scalarMat, simdMat) > 1e-5f)
+                Log(Error) << "ConvertYuv420ToRgbaFloat(format=" << format << ", width=" << width << ") differs by "
+                        << MaxDifference(scalarMat, simdMat) << " between the scalar and the SIMD code!" << endl;
+        }
+    }
+
+    // 5 and 6 sources do not fill whole groups of the mixing kernels
+    for (uint32_t sampleCount : {1u, 3u, 7u, 13u, 37u})
+    {
+        for (uint32_t srcCount = 1; srcCount <= 6; srcCount++)
+        {
+            vector<vector<float>> srcBufs(srcCount, vector<float>(sampleCount));
+            vector<const float*> srcs(srcCount);
+            vector<float> gains(srcCount);
+            for (uint32_t i = 0; i < srcCount; i++)
+            {
+                for (auto& v : srcBufs[i])
+                    v = RandomFloat(-1.f, 1.f);
+                srcs[i] = srcBufs[i].data();
+                gains[i] = RandomFloat(0.f, 1.f);
+            }
+            vector<float> scalarDst(sampleCount), simdDst(sampleCount);
+            MatUtils::SetSimdEnabled(false);
+            MatUtils::MixAudioSamples(scalarDst.data(), srcs.data(), gains.data(), srcCount, sampleCount);
+            MatUtils::SetSimdEnabled(true);
+            MatUtils::MixAudioSamples(simdDst.data(), srcs.data(), gains.data(), srcCount, sampleCount);
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                if (fabsf(scalarDst[i]-simdDst[i]) > 1e-5f)
+                {
+                    Log(Error) << "MixAudioSamples(srcCount=" << srcCount << ", sampleCount=" << sampleCount << ") differs at sample #" << i
+                            << ", scalar=" << scalarDst[i] << ", simd=" << simdDst[i] << "!" << endl;
+                    break;
+                }
+            }
+        }
+
+        vector<float> samples(sampleCount);
+        for (auto& v : samples)
+            v = RandomFloat(-1.f, 1.f);
+        float scalarMin = 1.f, scalarMax = -1.f, scalarSumSq = 0.f;
+        float simdMin = 1.f, simdMax = -1.f, simdSumSq = 0.f;
+        MatUtils::SetSimdEnabled(false);
+        MatUtils::AccumulateAudioStats(samples.data(), sampleCount, scalarMin, scalarMax, scalarSumSq);
+        MatUtils::SetSimdEnabled(true);
+        MatUtils::AccumulateAudioStats(samples.data(), sampleCount, simdMin, simdMax, simdSumSq);
+        if (scalarMin != simdMin || scalarMax != simdMax || fabsf(scalarSumSq-simdSumSq) > 1e-5f*max(scalarSumSq, 1.f))
+            Log(Error) << "AccumulateAudioStats(sampleCount=" << sampleCount << ") differs, scalar=(" << scalarMin << ", " << scalarMax << ", "
+                    << scalarSumSq << "), simd=(" << simdMin << ", " << simdMax << ", " << simdSumSq << ")!" << endl;
+    }
+
+    for (int32_t sampleSize : {1, 2})
+    {
+        for (int32_t dstWidth : {1, 15, 17, 33})
+        {
+            const int32_t srcLineSize = 2*dstWidth*sampleSize+1;
+            vector<uint8_t> src(srcLineSize*4);
+            for (auto& v : src)
+                v = (uint8_t)(rng()&0xFF);
+            vector<uint8_t> scalarDst(dstWidth*sampleSize*2), simdDst(dstWidth*sampleSize*2);
+            MatUtils::SetSimdEnabled(false);
+            MatUtils::DownscalePlaneBox2x(scalarDst.data(), dstWidth*sampleSize, src.data(), srcLineSize, dstWidth, 2, sampleSize);
+            MatUtils::SetSimdEnabled(true);
+            MatUtils::DownscalePlaneBox2x(simdDst.data(), dstWidth*sampleSize, src.data(), srcLineSize, dstWidth, 2, sampleSize);
+            if (scalarDst != simdDst)
+                Log(Error) << "DownscalePlaneBox2x(dstWidth=" << dstWidth << ", sampleSize=" << sampleSize << ") differs between the scalar and the SIMD code!" << endl;
+        }
+    }
+}
+
+static void Unit_WarpAffineDownscale()
+{
+    AutoSection _as("WarpAffineDownscale");
+    // a checkerboard of single pixels shrunk to about 1/4 must average to gray, the taps of bicubic alone would pick a few of them.
+    // the larger source is shrunk to about 1/34, beyond the tap grid of the area sampling, and has to be halved beforehand
+    for (int32_t srcSize : {64, 512})
+    {
+        ImGui::ImMat srcMat, dstMat;
+        srcMat.create_type(srcSize, srcSize, 4, IM_DT_INT8);
+        uint8_t* srcData = (uint8_t*)srcMat.data;
+        for (int32_t y = 0; y < srcMat.h; y++)
+        {
+            for (int32_t x = 0; x < srcMat.w; x++)
+            {
+                uint8_t* p = srcData+(y*srcMat.w+x)*4;
+                p[0] = p[1] = p[2] = (x+y)%2 == 0 ? 255 : 0;
+                p[3] = 255;
+            }
+        }
+        // a scale which is not the inverse of an integer, so the taps do not land on the same phase of the pattern
+        dstMat.create_type(15, 15, 4, IM_DT_INT8);
+        const float scale = (float)srcMat.w/dstMat.w;
+        const float matrix[6] = {scale, 0.f, 0.f, 0.f, scale, 0.f};
+        for (auto interp : {IM_INTERPOLATE_BILINEAR, IM_INTERPOLATE_BICUBIC})
+        {
+            if (!MatUtils::WarpAffine(dstMat, srcMat, matrix, 0, 0, srcMat.w, srcMat.h, interp))
+            {
+                Log(Error) << "WarpAffine(srcSize=" << srcSize << ", interp=" << interp << ") FAILED!" << endl;
+                continue;
+            }
+            int32_t aliasedCount = 0;
+            const uint8_t* dstData = (const uint8_t*)dstMat.data;
+            // the border pixels are blended with the transparent area out of the source
+            for (int32_t y = 1; y < dstMat.h-1; y++)
+            {
+                for (int32_t x = 1; x < dstMat.w-1; x++)
+                {
+                    const uint8_t* p = dstData+(y*dstMat.w+x)*4;
+                    if (abs((int)p[0]-128) > 16 || p[1] != p[0] || p[2] != p[0] || p[3] != 255)
+                        aliasedCount++;
+                }
+            }
+            if (aliasedCount > 0)
+                Log(Error) << "WarpAffine(srcSize=" << srcSize << ", interp=" << interp << ") shrinking a checkerboard has "
+                        << aliasedCount << " pixels NOT averaged to gray!" << endl;
+        }
+    }
+}
+
 struct TestCase
 {
     function<void (void)> testProc;
 };
 
 static unordered_map<string, TestCase> g_TestUnits = {
-    {"CreateVideoReaderInstance", {Unit_CreateVideoReaderInstance}}
+    {"CreateVideoReaderInstance", {Unit_CreateVideoReaderInstance}},
+    {"MediaReaderPool", {Unit_MediaReaderPool}},
+    {"WaitableEvent", {Unit_WaitableEvent}},
+    {"ThreadPoolExecutor", {Unit_ThreadPoolExecutor}},
+    {"SpscRingBuffer", {Unit_SpscRingBuffer}},
+    {"VideoFrameCache", {Unit_VideoFrameCache}},
+    {"VideoReaderFrameCache", {Unit_VideoReaderFrameCache}},
+    {"ImMatPool", {Unit_ImMatPool}},
+    {"MemoryGovernor", {Unit_MemoryGovernor}},
+    {"PlanVideoStreamCopy", {Unit_PlanVideoStreamCopy}},
+    {"VideoTimestampStitcher", {Unit_VideoTimestampStitcher}},
+    {"ProxyManager", {Unit_ProxyManager}},
+    {"DownscalePlaneBox2x", {Unit_DownscalePlaneBox2x}},
+    {"MatUtilsSimd", {Unit_MatUtilsSimd}},
+    {"WarpAffineDownscale", {Unit_WarpAffineDownscale}},
 };
 
 int main(int argc, char* argv[])